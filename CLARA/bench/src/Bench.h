@@ -0,0 +1,97 @@
+#pragma once
+#include <CLARA/Common.h>
+#include <chrono>
+
+namespace CLARA::Bench {
+
+using BenchmarkFunc = void(*)();
+
+struct Benchmark {
+	string_view name;
+	BenchmarkFunc func;
+};
+
+inline auto getBenchmarks()->vector<Benchmark>&
+{
+	static auto benchmarks = vector<Benchmark>{};
+	return benchmarks;
+}
+
+inline auto registerBenchmark(string_view name, BenchmarkFunc func)
+{
+	getBenchmarks().push_back(Benchmark{name, func});
+	return true;
+}
+
+/**
+ * Time a function and print its throughput.
+ *
+ * The function is run repeatedly until at least `minDuration` has elapsed and the best run is reported.
+ *
+ * @param  name  Name of the measurement.
+ * @param  bytes Number of bytes processed by each run of the function.
+ * @param  func  The function to time.
+ * @return The best throughput in MB/s.
+ */
+template<typename TFunc>
+auto measureThroughput(string_view name, size_t bytes, TFunc&& func, chrono::milliseconds minDuration = 500ms)->double
+{
+	using clock = chrono::steady_clock;
+	auto best = clock::duration::max();
+	auto total = clock::duration::zero();
+	auto runs = 0;
+
+	while (total < minDuration || runs < 3) {
+		auto start = clock::now();
+		func();
+		auto elapsed = clock::now() - start;
+		best = std::min(best, elapsed);
+		total += elapsed;
+		++runs;
+	}
+
+	auto seconds = chrono::duration<double>(best).count();
+	auto mbps = static_cast<double>(bytes) / (1024.0 * 1024.0) / seconds;
+	fmt::print("  {:<32} {:>10.2f} MB/s  ({} bytes, best of {} runs: {:.3f} ms)\n", name, mbps, bytes, runs, seconds * 1000.0);
+	return mbps;
+}
+
+/**
+ * Generate a synthetic CLASM source resembling generated compiler output.
+ *
+ * @param  size The approximate size of the source in bytes.
+ * @return The source code.
+ */
+inline auto generateSource(size_t size)->string
+{
+	auto code = string{};
+	code.reserve(size + 256);
+	code += ".data\n";
+
+	for (auto i = 0; code.size() < size / 4; ++i) {
+		code += fmt::format("STR_{}: DS \"generated string {} with \\\"escapes\\\" and \\x41\\x42\"\n", i, i);
+	}
+
+	code += ".code\n";
+
+	for (auto i = 0; code.size() < size; ++i) {
+		code += fmt::format("func_{}:\n", i);
+		code += "\tpush 0\n";
+		code += fmt::format("\tpush {}\n", i % 100);
+		code += fmt::format("\tpushd 0x{:08X} ; load constant\n", i * 2654435761u);
+		code += "\tpush -12, add\n";
+		code += "\tdup, pop 1\n";
+		code += fmt::format("\tjmpd func_{}\n", i);
+	}
+	return code;
+}
+
+}
+
+#define CLARA_BENCHMARK_CONCAT_(a, b) a##b
+#define CLARA_BENCHMARK_CONCAT(a, b) CLARA_BENCHMARK_CONCAT_(a, b)
+#define CLARA_BENCHMARK(name) \
+	static auto CLARA_BENCHMARK_CONCAT(benchmarkFunc, __LINE__)()->void; \
+	static const auto CLARA_BENCHMARK_CONCAT(benchmarkReg, __LINE__) = \
+		::CLARA::Bench::registerBenchmark(name, &CLARA_BENCHMARK_CONCAT(benchmarkFunc, __LINE__)); \
+	static auto CLARA_BENCHMARK_CONCAT(benchmarkFunc, __LINE__)()->void
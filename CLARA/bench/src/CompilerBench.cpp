@@ -0,0 +1,86 @@
+#include "Bench.h"
+#include <CLARA/Compiler.h>
+#include <CLARA/ModuleBuilder.h>
+#include <CLARA/Parser.h>
+
+using namespace CLARA;
+using namespace CLARA::CLASM;
+
+namespace {
+
+// takes the compiled bytes without keeping them, so only emission is measured
+struct NullOutput : IBinaryOutput {
+	size_t size = 0;
+	size_t calls = 0;
+
+	auto write(const uint8_t* begin, const uint8_t* end)->void override
+	{
+		size += static_cast<size_t>(end - begin);
+		++calls;
+	}
+};
+
+}
+
+CLARA_BENCHMARK("compiler throughput")
+{
+	auto parseOptions = Parser::Options{};
+	parseOptions.errorReporting = false;
+	const auto source = make_shared<Source>("bench", Bench::generateSource(8 * 1024 * 1024));
+	const auto result = Parser::tokenize(parseOptions, source);
+	if (!result.ok()) fmt::print("  unexpected parse errors\n");
+
+	auto options = Compiler::Options{};
+	auto output = NullOutput{};
+	Compiler::compile(options, result.info, output);
+	const auto size = output.size;
+	const auto calls = output.calls;
+
+	Bench::measureThroughput("Compiler::compile (8 MB source)", size, [&] {
+		Compiler::compile(options, result.info, output);
+	});
+	fmt::print("  {:<32} {:>10} bytes emitted in {} output calls\n", "", size, calls);
+
+	for (auto threads : {2_uz, 4_uz, 8_uz}) {
+		options.threads = threads;
+
+		Bench::measureThroughput(fmt::format("Compiler::compile ({} threads)", threads), size, [&] {
+			Compiler::compile(options, result.info, output);
+		});
+	}
+}
+
+CLARA_BENCHMARK("module builder")
+{
+	constexpr auto functions = 200000;
+
+	// the same module printed as assembly and lexed back, and built in code
+	auto code = ".code\n"s;
+	for (auto i = 0; i < functions; ++i)
+		code += fmt::format("func_{}:\npushd {}\npushw {}\nadd\njmpd func_{}\n", i, i * 7919, i % 1000, (i + 1) % functions);
+
+	auto options = Parser::Options{};
+	options.errorReporting = false;
+	const auto source = make_shared<Source>("bench", code);
+
+	Bench::measureThroughput("Parser::tokenize", code.size(), [&] {
+		auto result = Parser::tokenize(options, source);
+		if (!result.ok()) fmt::print("  unexpected parse errors\n");
+	});
+
+	Bench::measureThroughput("ModuleBuilder", code.size(), [&] {
+		auto builder = ModuleBuilder{};
+		auto labels = vector<const Label*>(functions);
+		for (auto i = 0; i < functions; ++i)
+			labels[i] = builder.makeLabel(fmt::format("func_{}", i));
+
+		for (auto i = 0; i < functions; ++i) {
+			builder.label(labels[i]);
+			builder.emit<Instruction::PUSHD>(static_cast<uint32>(i * 7919))
+				.emit<Instruction::PUSHW>(i % 1000)
+				.emit<Instruction::ADD>()
+				.emit<Instruction::JMPD>(builder.ref(labels[(i + 1) % functions]));
+		}
+		builder.finish();
+	});
+}
@@ -0,0 +1,59 @@
+#include "Bench.h"
+#include <CLARA/Compiler.h>
+#include <CLARA/Decoder.h>
+#include <CLARA/Parser.h>
+
+using namespace CLARA;
+using namespace CLARA::CLASM;
+
+namespace {
+
+// keeps only the code segment, which is all the decoder is given
+struct CodeOutput : IBinaryOutput {
+	vector<uint8_t> code;
+
+	auto write([[maybe_unused]] const uint8_t* begin, [[maybe_unused]] const uint8_t* end)->void override
+	{ }
+
+	auto writeSegment(Segment::Type segment, const uint8_t* begin, const uint8_t* end)->void override
+	{
+		if (segment == Segment::Code)
+			code.assign(begin, end);
+	}
+};
+
+}
+
+CLARA_BENCHMARK("decoder throughput")
+{
+	auto options = Parser::Options{};
+	options.errorReporting = false;
+	const auto result = Parser::tokenize(options, make_shared<Source>("bench", Bench::generateSource(16 * 1024 * 1024)));
+	if (!result.ok()) fmt::print("  unexpected parse errors\n");
+
+	auto output = CodeOutput{};
+	Compiler::compile(Compiler::Options{}, result.info, output);
+	const auto& code = output.code;
+
+	auto count = 0_uz;
+	Bench::measureThroughput("Decoder::decode", code.size(), [&] {
+		count = Decoder::decode(code.data(), code.size()).size();
+	});
+	fmt::print("  {:<32} {:>10} instructions\n", "", count);
+
+	auto reused = vector<Decoder::DecodedInstruction>{};
+	Bench::measureThroughput("Decoder::decode (reused array)", code.size(), [&] {
+		Decoder::decode(code.data(), code.size(), reused);
+	});
+
+	const auto instructions = Decoder::decode(code.data(), code.size());
+	auto sum = uint64{};
+	Bench::measureThroughput("Decoder::readOperand", code.size(), [&] {
+		for (auto& instruction : instructions) {
+			auto& info = Decoder::getOpcodeInfo(instruction.instruction);
+			for (auto i = 0_uz; i < info.numOperands; ++i)
+				sum += Decoder::readOperand(code.data(), instruction, i);
+		}
+	});
+	if (!sum) fmt::print("  no operands read\n");
+}
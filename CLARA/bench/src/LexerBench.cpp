@@ -0,0 +1,343 @@
+#include "Bench.h"
+#include <CLARA/Common/Scan.h>
+#include <CLARA/Lexer.h>
+#include <CLARA/Parser.h>
+#include <regex>
+
+using namespace CLARA;
+using namespace CLARA::CLASM;
+
+namespace {
+
+// The regex/rule-list lexer which Lexer::scan replaced, kept as the benchmark baseline.
+namespace Legacy {
+
+struct LexRule {
+	TokenType type;
+	size_t(*func)(string_view);
+};
+
+auto lexComment(string_view sv)->size_t
+{
+	if (sv[0] == ';') {
+		auto pos = sv.find('\n', 1);
+		if (pos != sv.npos) return pos;
+	}
+	return 0_uz;
+}
+
+auto lexWhitespaceNoNewlines(string_view sv)->size_t
+{
+	auto it = std::find_if_not(sv.cbegin(), sv.cend(), [](auto c) {
+		return c != '\n' && std::isspace(static_cast<unsigned char>(c));
+	});
+	return static_cast<size_t>(std::distance(sv.cbegin(), it));
+}
+
+auto lexNewline(string_view sv)->size_t
+{
+	auto it = std::find_if_not(sv.cbegin(), sv.cend(), [](auto c) {
+		return c == '\n';
+	});
+	return static_cast<size_t>(std::distance(sv.cbegin(), it));
+}
+
+auto lexIdentifier(string_view sv)->size_t
+{
+	if ((std::isalpha(sv[0]) || sv[0] == '_') && sv.size() > 1) {
+		auto it = std::find_if_not(sv.cbegin() + 1, sv.cend(), [](auto c) {
+			return c == '_' || std::isalnum(c);
+		});
+		if (it == sv.cend())
+			return sv.size();
+		return static_cast<size_t>(std::distance(sv.cbegin(), it));
+	}
+	return 0_uz;
+}
+
+auto lexSegment(string_view sv)->size_t
+{
+	if (sv[0] == '.') {
+		if (auto res = lexIdentifier(sv.substr(1))) {
+			return static_cast<size_t>(res) + 1;
+		}
+	}
+	return 0_uz;
+}
+
+auto lexLabel(string_view sv)->size_t
+{
+	if (auto res = lexIdentifier(sv)) {
+		if (res < sv.size() && sv[res] == ':') {
+			++res;
+			if (res == sv.size() || std::isspace(sv[res]))
+				return res;
+		}
+	}
+	return 0_uz;
+}
+
+auto lexHexLiteral(string_view sv)->size_t
+{
+	static std::regex hexRegex("^([+\\-]?0x[\\dA-Fa-f]+)\\b");
+	auto s = string(sv);
+	std::smatch sm;
+
+	if (std::regex_search(s, sm, hexRegex)) {
+		return static_cast<size_t>(sm[0].length());
+	}
+	return 0_uz;
+}
+
+auto lexIntegerLiteral(string_view sv)->size_t
+{
+	static std::regex integerRegex{"^([+\\-]?(?:0|[1-9]\\d*))(?:\\b[^\\.]|$)"};
+	auto s = string(sv);
+	std::smatch sm;
+
+	if (std::regex_search(s, sm, integerRegex)) {
+		return static_cast<size_t>(sm[1].length());
+	}
+	return 0_uz;
+}
+
+auto lexFloatLiteral(string_view sv)->size_t
+{
+	static std::regex floatRegex{"^[+\\-]?(?:0|[1-9]\\d*)(?:\\.\\d*)(?:[eE][+\\-]?\\d+)?\\b"};
+	auto s = string(sv);
+	std::smatch sm;
+
+	if (std::regex_search(s, sm, floatRegex)) {
+		return static_cast<size_t>(sm[0].length());
+	}
+	return 0_uz;
+}
+
+auto lexString(string_view sv)->size_t
+{
+	if (sv[0] == '"') {
+		size_t end = 0;
+
+		for (auto pos = sv.find('"', 1); pos != sv.npos; pos = sv.find('"', pos + 1)) {
+			auto rpos = pos - 1;
+
+			if (rpos != 1) {
+				while (sv[rpos] == '\\') {
+					--rpos;
+				}
+
+				if (((pos - rpos - 1) % 2) != 0)
+					continue;
+			}
+
+			end = pos + 1;
+			break;
+		}
+
+		if (end)
+			return end;
+	}
+	return 0_uz;
+}
+
+auto lexSeparator(string_view sv)->size_t
+{
+	switch (sv[0]) {
+	case '=':
+	case ':':
+	case ',':
+		return 1_uz;
+	}
+	return 0_uz;
+}
+
+const auto lexRules = initializer_list<LexRule>{
+	{TokenType::EndOfLine, lexNewline},
+	{TokenType::WhiteSpace, lexComment},
+	{TokenType::WhiteSpace, lexWhitespaceNoNewlines},
+	{TokenType::Separator, lexSeparator},
+	{TokenType::Segment, lexSegment},
+	{TokenType::String, lexString},
+	{TokenType::HexLiteral, lexHexLiteral},
+	{TokenType::IntegerLiteral, lexIntegerLiteral},
+	{TokenType::FloatLiteral, lexFloatLiteral},
+	{TokenType::Label, lexLabel},
+	{TokenType::Identifier, lexIdentifier},
+};
+
+auto lexOneOf(string_view sv)->pair<TokenType, size_t>
+{
+	for (auto& rule : lexRules) {
+		if (auto len = rule.func(sv))
+			return {rule.type, len};
+	}
+	return {TokenType::None, 0};
+}
+
+}
+
+template<typename TFunc>
+auto countTokens(string_view code, TFunc&& lex)
+{
+	auto count = 0_uz;
+	for (auto offset = 0_uz; offset < code.size(); ++count) {
+		auto length = lex(code, offset);
+		if (!length) break;
+		offset += length;
+	}
+	return count;
+}
+
+auto legacyLex(string_view code, size_t offset)
+{
+	return Legacy::lexOneOf(code.substr(offset)).second;
+}
+
+auto scanLex(string_view code, size_t offset)
+{
+	return Lexer::scan(code, offset).length;
+}
+
+}
+
+CLARA_BENCHMARK("lexer throughput")
+{
+	// the legacy lexer copies the remaining source for every numeric literal, so it is quadratic and
+	// only measured on a small input
+	const auto small = Bench::generateSource(16 * 1024);
+	const auto large = Bench::generateSource(8 * 1024 * 1024);
+
+	if (countTokens(small, legacyLex) != countTokens(small, scanLex)) {
+		fmt::print("  token count mismatch between legacy lexer and scanner\n");
+	}
+
+	auto sink = 0_uz;
+	auto legacy = Bench::measureThroughput("legacy lexOneOf (16 KB)", small.size(), [&] {
+		sink += countTokens(small, legacyLex);
+	}, 0ms);
+	auto scanSmall = Bench::measureThroughput("Lexer::scan (16 KB)", small.size(), [&] {
+		sink += countTokens(small, scanLex);
+	});
+	Bench::measureThroughput("Lexer::scan (8 MB)", large.size(), [&] {
+		sink += countTokens(large, scanLex);
+	});
+	fmt::print("  speedup on 16 KB: {:.1f}x ({} tokens lexed in total)\n", scanSmall / legacy, sink);
+}
+
+CLARA_BENCHMARK("tokenize throughput")
+{
+	auto options = Parser::Options{};
+	options.errorReporting = false;
+	const auto source = make_shared<Source>("bench", Bench::generateSource(8 * 1024 * 1024));
+
+	Bench::measureThroughput("Parser::tokenize (8 MB)", source->getCode().size(), [&] {
+		auto result = Parser::tokenize(options, source);
+		if (!result.ok()) fmt::print("  unexpected parse errors\n");
+	});
+
+	auto reused = Parser::Result{};
+	Bench::measureThroughput("Parser::tokenize reused (8 MB)", source->getCode().size(), [&] {
+		Parser::tokenize(options, source, reused);
+		if (!reused.ok()) fmt::print("  unexpected parse errors\n");
+	});
+}
+
+CLARA_BENCHMARK("token storage")
+{
+	const auto source = make_shared<Source>("bench", Bench::generateSource(8 * 1024 * 1024));
+	auto sink = 0_uz;
+
+	for (auto storage : {TokenStorage::Tokens, TokenStorage::Compact}) {
+		auto options = Parser::Options{};
+		options.errorReporting = false;
+		options.tokenStorage = storage;
+
+		const auto name = storage == TokenStorage::Compact ? "compact"sv : "tokens"sv;
+		const auto result = Parser::tokenize(options, source);
+		auto memory = 0_uz;
+		auto count = 0_uz;
+
+		for (auto& segment : result.info.segments) {
+			memory += segment.tokens->getMemoryUsage();
+			count += segment.tokens->size();
+		}
+
+		fmt::print("  {:<32} {:>10.2f} MB   ({} tokens, {:.1f} bytes per token)\n", fmt::format("{} memory", name),
+			static_cast<double>(memory) / (1024.0 * 1024.0), count, static_cast<double>(memory) / static_cast<double>(count));
+
+		Bench::measureThroughput(fmt::format("Parser::tokenize {} (8 MB)", name), source->getCode().size(), [&] {
+			sink += Parser::tokenize(options, source).info.segments[Segment::Code].tokens->size();
+		});
+		Bench::measureThroughput(fmt::format("iterate {} (8 MB)", name), source->getCode().size(), [&] {
+			for (auto& segment : result.info.segments) {
+				for (auto& token : *segment.tokens)
+					sink += token.annotation.index();
+			}
+		});
+	}
+
+	fmt::print("  ({} in total)\n", sink);
+}
+
+CLARA_BENCHMARK("scan kernels")
+{
+	const auto source = Bench::generateSource(8 * 1024 * 1024);
+	// a long literal made of escapes, which used to be quadratic in the string lexer
+	const auto escapes = "\"" + string(4 * 1024 * 1024, '\\') + "\"";
+	const auto plain = "\"" + string(4 * 1024 * 1024, 'a') + "\"";
+	const auto comment = "; " + string(4 * 1024 * 1024, '-') + "\n";
+	const auto isaNames = array<string_view, 3>{"scalar", "SSE2", "AVX2"};
+	const auto previous = Scan::getIsa();
+	auto sink = 0_uz;
+
+	for (auto isa : {Scan::Isa::Scalar, Scan::Isa::SSE2, Scan::Isa::AVX2}) {
+		if (Scan::setIsa(isa) != isa) continue;
+
+		auto name = isaNames[static_cast<size_t>(isa)];
+		Bench::measureThroughput(fmt::format("Lexer::scan {} (8 MB)", name), source.size(), [&] {
+			sink += countTokens(source, scanLex);
+		});
+		Bench::measureThroughput(fmt::format("escaped string {} (4 MB)", name), escapes.size(), [&] {
+			sink += Lexer::scan(escapes, 0).length;
+		});
+		Bench::measureThroughput(fmt::format("plain string {} (4 MB)", name), plain.size(), [&] {
+			sink += Lexer::scan(plain, 0).length;
+		});
+		Bench::measureThroughput(fmt::format("comment {} (4 MB)", name), comment.size(), [&] {
+			sink += Lexer::scan(comment, 0).length;
+		});
+	}
+
+	Scan::setIsa(previous);
+	fmt::print("  ({} bytes scanned in total)\n", sink);
+}
+
+CLARA_BENCHMARK("source index")
+{
+	const auto code = Bench::generateSource(8 * 1024 * 1024);
+	const auto isaNames = array<string_view, 3>{"scalar", "SSE2", "AVX2"};
+	const auto previous = Scan::getIsa();
+	auto sink = 0_uz;
+
+	for (auto isa : {Scan::Isa::Scalar, Scan::Isa::SSE2, Scan::Isa::AVX2}) {
+		if (Scan::setIsa(isa) != isa) continue;
+
+		Bench::measureThroughput(fmt::format("Source {} (8 MB)", isaNames[static_cast<size_t>(isa)]), code.size(), [&] {
+			sink += Source{"bench", code}.getNumLines();
+		});
+	}
+
+	Scan::setIsa(previous);
+
+	const auto source = Source{"bench", code};
+	Bench::measureThroughput("getLineIndexByOffset (8 MB)", code.size(), [&] {
+		for (auto offset = 0u; offset < code.size(); offset += 7)
+			sink += source.getLineIndexByOffset(offset);
+	});
+	Bench::measureThroughput("getColumnByOffset (8 MB)", code.size(), [&] {
+		for (auto offset = 0u; offset < code.size(); offset += 7)
+			sink += source.getColumnByOffset(offset);
+	});
+
+	fmt::print("  ({} in total)\n", sink);
+}
@@ -0,0 +1,57 @@
+#include "Bench.h"
+#include <CLARA/Compiler.h>
+#include <CLARA/Label.h>
+#include <CLARA/Optimizer.h>
+#include <CLARA/Parser.h>
+
+using namespace CLARA;
+using namespace CLARA::CLASM;
+
+namespace {
+
+struct SizeOutput : IBinaryOutput {
+	size_t size = 0;
+
+	auto write(const uint8_t* begin, const uint8_t* end)->void override
+	{
+		size += static_cast<size_t>(end - begin);
+	}
+};
+
+auto getCompiledSize(const Parser::ParseInfo& info)
+{
+	auto output = SizeOutput{};
+	Compiler::compile(Compiler::Options{}, info, output);
+	return output.size;
+}
+
+}
+
+CLARA_BENCHMARK("optimizer")
+{
+	auto parseOptions = Parser::Options{};
+	parseOptions.errorReporting = false;
+	const auto source = make_shared<Source>("bench", Bench::generateSource(8 * 1024 * 1024));
+	auto result = Parser::tokenize(parseOptions, source);
+	if (!result.ok()) fmt::print("  unexpected parse errors\n");
+
+	// every run optimizes the parse as it was, the code segment's stream is only replaced
+	auto& segment = result.info.segments[Segment::Code];
+	const auto tokens = segment.tokens;
+	auto definitions = vector<uint32>{};
+	for (auto label : result.info.labels)
+		definitions.push_back(label->definition.index);
+
+	const auto size = getCompiledSize(result.info);
+	auto optimized = Optimizer::Result{};
+
+	Bench::measureThroughput("Optimizer::optimize (8 MB source)", source->getCode().size(), [&] {
+		segment.tokens = tokens;
+		for (auto i = 0_uz; i < definitions.size(); ++i)
+			result.info.labels[i]->definition.index = definitions[i];
+		optimized = Optimizer::optimize(Optimizer::Options{}, result.info);
+	});
+
+	fmt::print("  {:<32} {:>10} rewrites, {} of {} tokens removed\n", "", optimized.rewrites, optimized.removedTokens, tokens->size());
+	fmt::print("  {:<32} {:>10} bytes compiled, {} before\n", "", getCompiledSize(result.info), size);
+}
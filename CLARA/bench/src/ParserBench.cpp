@@ -0,0 +1,190 @@
+#include "Bench.h"
+#include <CLARA/ParseCache.h>
+#include <CLARA/Parser.h>
+#include <cstdlib>
+#include <new>
+
+using namespace CLARA;
+using namespace CLARA::CLASM;
+
+namespace {
+
+// counts every heap allocation made by the benchmark executable
+auto allocationCount = size_t{0};
+
+auto countLines(string_view code)
+{
+	return static_cast<size_t>(std::count(code.begin(), code.end(), '\n'));
+}
+
+}
+
+auto operator new(size_t size)->void*
+{
+	++allocationCount;
+
+	if (auto ptr = std::malloc(size ? size : 1))
+		return ptr;
+	throw std::bad_alloc{};
+}
+
+auto operator new[](size_t size)->void*
+{
+	return operator new(size);
+}
+
+auto operator delete(void* ptr) noexcept->void
+{
+	std::free(ptr);
+}
+
+auto operator delete[](void* ptr) noexcept->void
+{
+	std::free(ptr);
+}
+
+auto operator delete(void* ptr, size_t) noexcept->void
+{
+	std::free(ptr);
+}
+
+auto operator delete[](void* ptr, size_t) noexcept->void
+{
+	std::free(ptr);
+}
+
+CLARA_BENCHMARK("parser allocations")
+{
+	auto options = Parser::Options{};
+	options.errorReporting = false;
+
+	for (auto size : {1_uz * 1024 * 1024, 8_uz * 1024 * 1024}) {
+		const auto source = make_shared<Source>("bench", Bench::generateSource(size));
+		const auto lines = countLines(source->getCode());
+		auto result = Parser::Result{};
+
+		auto before = allocationCount;
+		Parser::tokenize(options, source, result);
+		const auto cold = allocationCount - before;
+
+		// once the result has grown to fit the source, parsing it again should not touch the heap
+		before = allocationCount;
+		Parser::tokenize(options, source, result);
+		const auto warm = allocationCount - before;
+
+		if (!result.ok()) fmt::print("  unexpected parse errors\n");
+
+		fmt::print("  {:<32} {:>10} lines, {} allocations cold ({:.4f} per line), {} warm ({:.4f} per line)\n",
+			fmt::format("Parser::tokenize ({} MB)", size / (1024 * 1024)), lines,
+			cold, static_cast<double>(cold) / static_cast<double>(lines),
+			warm, static_cast<double>(warm) / static_cast<double>(lines));
+	}
+}
+
+CLARA_BENCHMARK("parser diagnostics")
+{
+	auto options = Parser::Options{};
+	options.errorReporting = false;
+
+	// the same instructions, with and without a misplaced separator on every line
+	constexpr auto lines = 100000;
+	auto clean = string{".code\n"};
+	auto faulty = string{".code\n"};
+
+	for (auto i = 0; i < lines; ++i) {
+		clean += "nop  \n";
+		faulty += "nop :\n";
+	}
+
+	for (auto& [name, code] : {pair{"no diagnostics"sv, &clean}, pair{"100k diagnostics"sv, &faulty}}) {
+		const auto source = make_shared<Source>("bench", *code);
+		auto result = Parser::Result{};
+		Parser::tokenize(options, source, result);
+
+		const auto before = allocationCount;
+		Parser::tokenize(options, source, result);
+		const auto warm = allocationCount - before;
+
+		Bench::measureThroughput(fmt::format("Parser::tokenize ({})", name), code->size(), [&] {
+			Parser::tokenize(options, source, result);
+		});
+		fmt::print("  {:<32} {:>10} reports, {} allocations warm\n", "", result.reports.size(), warm);
+	}
+}
+
+CLARA_BENCHMARK("parser threads")
+{
+	auto options = Parser::Options{};
+	options.errorReporting = false;
+
+	const auto source = make_shared<Source>("bench", Bench::generateSource(8 * 1024 * 1024));
+	auto result = Parser::Result{};
+
+	for (auto threads : {1_uz, 2_uz, 4_uz, 8_uz}) {
+		options.threads = threads;
+		Parser::tokenize(options, source, result);
+
+		Bench::measureThroughput(fmt::format("Parser::tokenize ({} threads)", threads), source->getCode().size(), [&] {
+			Parser::tokenize(options, source, result);
+		});
+	}
+}
+
+CLARA_BENCHMARK("parser edits")
+{
+	auto options = Parser::Options{};
+	options.errorReporting = false;
+
+	for (auto storage : {TokenStorage::Tokens, TokenStorage::Compact}) {
+		options.tokenStorage = storage;
+
+		for (auto size : {1_uz * 1024 * 1024, 8_uz * 1024 * 1024}) {
+			// one operand in the middle of the source is edited back and forth
+			const auto code = Bench::generateSource(size);
+			const auto offset = code.find("\tpush 0\n", code.size() / 2) + 6;
+			auto edited = code;
+			edited[offset] = '1';
+
+			const auto sources = array<shared_ptr<const Source>, 2>{make_shared<Source>("bench", code), make_shared<Source>("bench", edited)};
+			const auto edit = Parser::Edit{offset, 1, 1};
+			const auto storageName = storage == TokenStorage::Tokens ? "tokens"sv : "compact"sv;
+			auto result = Parser::tokenize(options, sources[0]);
+			auto current = 0_uz;
+
+			Bench::measureThroughput(fmt::format("Parser::retokenize ({} MB, {})", size / (1024 * 1024), storageName), code.size(), [&] {
+				current ^= 1;
+				Parser::retokenize(options, sources[current], edit, result);
+			});
+			Bench::measureThroughput(fmt::format("Parser::tokenize ({} MB, {})", size / (1024 * 1024), storageName), code.size(), [&] {
+				Parser::tokenize(options, sources[current], result);
+			});
+		}
+	}
+}
+
+CLARA_BENCHMARK("parse cache")
+{
+	auto options = Parser::Options{};
+	options.errorReporting = false;
+
+	for (auto storage : {TokenStorage::Tokens, TokenStorage::Compact}) {
+		options.tokenStorage = storage;
+
+		const auto source = make_shared<Source>("bench", Bench::generateSource(8 * 1024 * 1024));
+		const auto storageName = storage == TokenStorage::Tokens ? "tokens"sv : "compact"sv;
+		auto result = Parser::tokenize(options, source);
+		auto blob = ParseCache::save(options, *source, result);
+
+		fmt::print("  blob of {} bytes for {} bytes of code\n", blob.size(), source->getCode().size());
+
+		Bench::measureThroughput(fmt::format("ParseCache::save ({})", storageName), source->getCode().size(), [&] {
+			blob = ParseCache::save(options, *source, result);
+		});
+		Bench::measureThroughput(fmt::format("ParseCache::load ({})", storageName), source->getCode().size(), [&] {
+			ParseCache::load(options, source, blob, result);
+		});
+		Bench::measureThroughput(fmt::format("Parser::tokenize ({})", storageName), source->getCode().size(), [&] {
+			Parser::tokenize(options, source, result);
+		});
+	}
+}
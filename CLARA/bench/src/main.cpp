@@ -0,0 +1,17 @@
+#include "Bench.h"
+
+using namespace CLARA;
+
+int main(int argc, char* argv[])
+{
+	auto filter = argc > 1 ? string_view{argv[1]} : string_view{};
+
+	for (auto& benchmark : Bench::getBenchmarks()) {
+		if (!filter.empty() && benchmark.name.find(filter) == string_view::npos)
+			continue;
+
+		fmt::print("{}\n", benchmark.name);
+		benchmark.func();
+	}
+	return 0;
+}
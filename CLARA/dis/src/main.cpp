@@ -0,0 +1,218 @@
+#include <CLARA/pch.h>
+#include <CLARA/Common/File.h>
+#include <CLARA/Compiler.h>
+#include <CLARA/Decoder.h>
+#include <CLARA/Parser.h>
+#include <CLARA/Source.h>
+#include <cstdio>
+
+using namespace CLARA;
+using namespace CLARA::CLASM;
+
+namespace {
+
+constexpr auto usage = "usage: clara-dis [--source <file>] [--no-offsets] <image>\n"
+	"\n"
+	"  --source <file>  assembly the image was compiled from, naming the labels and locating the code segment\n"
+	"  --no-offsets     leave the offsets out of the listing, so listings of different builds diff cleanly\n";
+
+// the listing is written out whenever this much of it is formatted
+constexpr auto flushSize = 1_uz << 20;
+
+struct Options {
+	string image;
+	string source;
+	bool offsets = true;
+};
+
+/// Names of the labels of the code segment, by offset.
+class LabelIndex {
+public:
+	auto add(uint64 offset, string_view name)
+	{
+		m_labels.emplace_back(offset, name);
+	}
+
+	auto sort()
+	{
+		std::stable_sort(m_labels.begin(), m_labels.end(), [](auto& a, auto& b) { return a.first < b.first; });
+	}
+
+	/// Get the index of the first label at or after an offset.
+	auto lowerBound(uint64 offset) const
+	{
+		auto it = std::lower_bound(m_labels.begin(), m_labels.end(), offset, [](auto& label, uint64 value) { return label.first < value; });
+		return static_cast<size_t>(it - m_labels.begin());
+	}
+
+	/// Find the name of a label at an offset, the first one defined if there are several.
+	auto find(uint64 offset) const->optional<string_view>
+	{
+		auto index = lowerBound(offset);
+		if (index < m_labels.size() && m_labels[index].first == offset)
+			return m_labels[index].second;
+		return nullopt;
+	}
+
+	auto size() const { return m_labels.size(); }
+	auto& operator[](size_t index) const { return m_labels[index]; }
+
+private:
+	vector<pair<uint64, string_view>> m_labels;
+};
+
+auto parseArgs(int argc, char** argv)->optional<Options>
+{
+	auto options = Options{};
+
+	for (auto i = 1; i < argc; ++i) {
+		auto arg = string_view{argv[i]};
+
+		if (arg == "--source" && i + 1 < argc)
+			options.source = argv[++i];
+		else if (arg == "--no-offsets")
+			options.offsets = false;
+		else if (!arg.empty() && arg[0] != '-' && options.image.empty())
+			options.image = string{arg};
+		else
+			return nullopt;
+	}
+
+	if (options.image.empty()) return nullopt;
+	return options;
+}
+
+auto flush(fmt::memory_buffer& out)
+{
+	std::fwrite(out.data(), 1, out.size(), stdout);
+	out.clear();
+}
+
+auto writeOperand(fmt::memory_buffer& out, const LabelIndex& labels, const Decoder::OpcodeInfo& info, size_t index, uint64 bits)
+{
+	auto inserter = std::back_inserter(out);
+
+	if (info.operands[index] == OperandType::REL32) {
+		if (auto name = labels.find(bits))
+			fmt::format_to(inserter, " {}", *name);
+		else
+			fmt::format_to(inserter, " 0x{:X}", bits);
+	}
+	else if (info.real[index] && getOperandSize(info.operands[index]) == sizeof(float)) {
+		auto value = float{};
+		auto word = static_cast<uint32>(bits);
+		std::memcpy(&value, &word, sizeof(value));
+		fmt::format_to(inserter, " {}", value);
+	}
+	else if (info.real[index]) {
+		auto value = double{};
+		std::memcpy(&value, &bits, sizeof(value));
+		fmt::format_to(inserter, " {}", value);
+	}
+	else {
+		fmt::format_to(inserter, " {}", bits);
+	}
+}
+
+/**
+ * Write the listing of a code segment to stdout.
+ *
+ * @param  options Options of the listing.
+ * @param  code    The bytes of the segment.
+ * @param  size    The number of bytes.
+ * @param  labels  Names of the segment's labels.
+ * @throws Decoder::DecodeException if the segment can't be decoded.
+ */
+auto writeListing(const Options& options, const uint8* code, size_t size, const LabelIndex& labels)
+{
+	const auto instructions = Decoder::decode(code, size);
+
+	auto out = fmt::memory_buffer{};
+	auto inserter = std::back_inserter(out);
+	auto nextLabel = 0_uz;
+
+	auto writeLabels = [&](uint64 offset) {
+		for (; nextLabel < labels.size() && labels[nextLabel].first <= offset; ++nextLabel)
+			fmt::format_to(inserter, "{}:\n", labels[nextLabel].second);
+	};
+
+	for (auto& instruction : instructions) {
+		writeLabels(instruction.offset);
+
+		auto& info = Decoder::getOpcodeInfo(instruction.instruction);
+		if (options.offsets)
+			fmt::format_to(inserter, "{:08X}\t{}", instruction.offset, Instruction::getName(instruction.instruction));
+		else
+			fmt::format_to(inserter, "\t{}", Instruction::getName(instruction.instruction));
+
+		for (auto i = 0_uz; i < info.numOperands; ++i)
+			writeOperand(out, labels, info, i, Decoder::readOperand(code, instruction, i));
+		out.push_back('\n');
+
+		if (out.size() >= flushSize)
+			flush(out);
+	}
+
+	// labels at the end of the segment
+	writeLabels(size);
+	flush(out);
+}
+
+auto run(const Options& options)->int
+{
+	auto image = MappedFile{options.image};
+	auto data = image.getData();
+	auto begin = reinterpret_cast<const uint8*>(data.data());
+	auto size = data.size();
+	auto labels = LabelIndex{};
+
+	// the parse gives where the code segment is in the image and the offsets of its labels
+	auto parseOptions = Parser::Options{};
+	auto result = Parser::Result{};
+
+	if (!options.source.empty()) {
+		result = Parser::tokenize(parseOptions, Source::fromFile(options.source));
+		if (!result.ok()) return 1;
+
+		Compiler::layout(result.info);
+		auto& segments = result.info.segments;
+		auto codeOffset = segments[Segment::Header].size + segments[Segment::Data].size;
+
+		if (codeOffset + segments[Segment::Code].size != size) {
+			fmt::print(stderr, "{} is {} bytes, but {} assembles to {}\n", options.image, size, options.source, codeOffset + segments[Segment::Code].size);
+			return 1;
+		}
+
+		for (auto label : result.info.labels) {
+			if (label->segment == Segment::Code)
+				labels.add(label->offset, label->name);
+		}
+		labels.sort();
+
+		begin += codeOffset;
+		size = segments[Segment::Code].size;
+	}
+
+	writeListing(options, begin, size, labels);
+	return 0;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+	auto options = parseArgs(argc, argv);
+	if (!options) {
+		fmt::print(stderr, "{}", usage);
+		return 2;
+	}
+
+	try {
+		return run(*options);
+	}
+	catch (const std::exception& ex) {
+		std::fflush(stdout);
+		fmt::print(stderr, "clara-dis: {}\n", ex.what());
+		return 1;
+	}
+}
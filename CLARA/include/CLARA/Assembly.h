@@ -11,17 +11,45 @@ enum class OperandType {
 	REL32,						//< relative script offset
 };
 
-struct InstructionOverload;
+/// Size of an operand type in encoded form.
+constexpr auto getOperandSize(OperandType type)->size_t
+{
+	switch (type) {
+	case OperandType::IMM8:
+	case OperandType::LV8: return 1;
+	case OperandType::IMM16:
+	case OperandType::LV16:
+	case OperandType::V16: return 2;
+	case OperandType::IMM32:
+	case OperandType::LV32:
+	case OperandType::V32:
+	case OperandType::S32:
+	case OperandType::REL32: return 4;
+	case OperandType::IMM64: return 8;
+	}
+	return 0;
+}
 
 struct InstructionOperand {
-	vector<OperandType> types;
+	ArrayView<OperandType> types;
 	bool variadic = false;
+	bool real = false;							//< an immediate holding a floating-point value
+};
 
-	InstructionOperand(vector<OperandType> types, bool variadic = false) :
-		types(types), variadic(variadic)
-	{ }
+/// What the operand of a mnemonic looks like, classified once per line to pick its instruction.
+enum class OperandShape : uint8_t {
+	None,										//< no operand
+	Int8, Int16, Int32, Int64,					//< integer literal, by the narrowest type holding it
+	Real32, Real64,								//< floating-point literal
+	Label,										//< label reference
+	String,										//< string literal
+	Other,										//< anything else, or more than one operand
+	MAX
 };
 
+struct InstructionInfo;
+struct InstructionOverload;
+
 class Segment {
 public:
 	enum Type {
@@ -39,7 +67,7 @@ public:
 	};
 
 public:
-	static auto fromName(const string&)->Type;
+	static auto fromName(string_view)->Type;
 };
 
 class Keyword {
@@ -50,7 +78,7 @@ public:
 	};
 
 public:
-	static auto fromName(const string&)->Type;
+	static auto fromName(string_view)->Type;
 };
 
 class Mnemonic {
@@ -61,56 +89,371 @@ public:
 	};
 
 public:
-	static auto fromName(const string&)->Type;
-	static auto getOverloads(Type type)->const vector<InstructionOverload>&;
+	static auto fromName(string_view)->Type;
+	static constexpr auto getOverloads(Type type)->const ArrayView<InstructionOverload>&;
 };
 
+/**
+ * The instruction set, one row per instruction in opcode order: X(type, name, mnemonic, operands)
+ *
+ * `mnemonic` is the mnemonic which resolves to the instruction (MAX if none), the overload with the smallest
+ * encoding which fits the operand is picked. `operands` names one of the layouts in CLASM::Operands. The
+ * Instruction::Type enum and every instruction table (names, operands, encoded sizes, mnemonic resolution) are
+ * generated from this.
+ */
+#define CLASM_INSTRUCTION_SET(X) \
+	/* Misc */ \
+	X(NOP,     "nop",     MAX,   None)  \
+	X(BREAK,   "break",   MAX,   None)  \
+	X(THROW,   "throw",   MAX,   IMM8)  \
+	/* Stack Manipulation */ \
+	X(PUSHN,   "pushn",   PUSH,  None)  \
+	X(PUSHB,   "pushb",   PUSH,  IMM8)  \
+	X(PUSHW,   "pushw",   PUSH,  IMM16) \
+	X(PUSHD,   "pushd",   PUSH,  IMM32) \
+	X(PUSHQ,   "pushq",   PUSH,  IMM64) \
+	X(PUSHF,   "pushf",   PUSH,  F32)   \
+	X(PUSHQF,  "pushqf",  PUSH,  F64)   \
+	X(PUSHAB,  "pushab",  PUSHA, None)  \
+	X(PUSHAW,  "pushaw",  PUSHA, None)  \
+	X(PUSHAD,  "pushad",  PUSHA, None)  \
+	X(PUSHAQ,  "pushaq",  PUSHA, None)  \
+	X(PUSHAF,  "pushaf",  PUSHA, None)  \
+	X(PUSHAQF, "pushaqf", PUSHA, None)  \
+	X(PUSHS,   "pushs",   MAX,   S32)   \
+	X(POP,     "pop",     POP,   IMM8)  \
+	X(POPLN,   "popln",   POP,   LV8)   \
+	X(POPL,    "popl",    POP,   LV16)  \
+	X(POPLE,   "pople",   POP,   LV32)  \
+	X(POPV,    "popv",    POP,   V16)   \
+	X(POPVE,   "popve",   POP,   V32)   \
+	X(SWAP,    "swap",    MAX,   None)  \
+	X(DUP,     "dup",     DUP,   None)  \
+	X(DUPE,    "dupe",    DUP,   IMM8)  \
+	/* Variable Access */ \
+	X(LOCAL,   "local",   MAX,   None)  \
+	X(GLOBAL,  "global",  MAX,   None)  \
+	X(ARRAY,   "array",   MAX,   IMM8)  \
+	/* Arithimetic/Bitwise/Conversion Operations */ \
+	X(EXF,     "exf",     MAX,   None)  \
+	X(INC,     "inc",     MAX,   None)  \
+	X(DEC,     "dec",     MAX,   None)  \
+	X(ADD,     "add",     MAX,   None)  \
+	X(SUB,     "sub",     MAX,   None)  \
+	X(MUL,     "mul",     MAX,   None)  \
+	X(DIV,     "div",     MAX,   None)  \
+	X(MOD,     "mod",     MAX,   None)  \
+	X(NOT,     "not",     MAX,   None)  \
+	X(AND,     "and",     MAX,   None)  \
+	X(OR,      "or",      MAX,   None)  \
+	X(XOR,     "xor",     MAX,   None)  \
+	X(SHL,     "shl",     MAX,   None)  \
+	X(SHR,     "shr",     MAX,   None)  \
+	X(NEG,     "neg",     MAX,   None)  \
+	X(TOI,     "toi",     MAX,   None)  \
+	X(TOF,     "tof",     MAX,   None)  \
+	/* Comparison */ \
+	X(CMPNN,   "cmpnn",   MAX,   None)  \
+	X(CMPE,    "cmpe",    MAX,   None)  \
+	X(CMPNE,   "cmpne",   MAX,   None)  \
+	X(CMPGE,   "cmpge",   MAX,   None)  \
+	X(CMPLE,   "cmple",   MAX,   None)  \
+	X(CMPG,    "cmpg",    MAX,   None)  \
+	X(CMPL,    "cmpl",    MAX,   None)  \
+	X(IF,      "if",      MAX,   None)  \
+	X(EVAL,    "eval",    MAX,   IMM8)  \
+	/* Branching */ \
+	X(JT,      "jt",      MAX,   REL32) \
+	X(JNT,     "jnt",     MAX,   REL32) \
+	X(JMP,     "jmp",     JMP,   None)  \
+	X(JMPD,    "jmpd",    JMP,   REL32) \
+	X(SWITCH,  "switch",  MAX,   None)  \
+	X(RSWITCH, "rswitch", MAX,   None)  \
+	/* Functions */ \
+	X(CALL,    "call",    CALL,  None)  \
+	X(CALLD,   "calld",   CALL,  REL32) \
+	X(ENTER,   "enter",   MAX,   IMM8)  \
+	X(RET,     "ret",     MAX,   None)  \
+	/* External Read / Write */ \
+	X(READ,    "read",    MAX,   IMM8)  \
+	X(WRITE,   "write",   MAX,   IMM8)  \
+	X(COPY,    "copy",    MAX,   None)  \
+	X(FILL,    "fill",    MAX,   None)  \
+	X(COMP,    "comp",    MAX,   None)  \
+	/* External Calling */ \
+	X(NATIVE,  "native",  MAX,   IMM32) \
+	X(CMD,     "cmd",     MAX,   IMM32) \
+	X(CDECL,   "cdecl",   MAX,   IMM8)  \
+	X(STDC,    "stdc",    MAX,   IMM8)  \
+	X(THISC,   "thisc",   MAX,   IMM8)  \
+	X(FASTC,   "fastc",   MAX,   IMM8)
+
 class Instruction {
 public:
+#define CLASM_INSTRUCTION_TYPE(type, name, mnemonic, operands) type,
 	enum Type : uint8_t {
-		// Misc
-		NOP, BREAK, THROW,
-		// Stack Manipulation
-		PUSHN, PUSHB, PUSHW, PUSHD, PUSHQ, PUSHF, PUSHQF,
-		PUSHAB, PUSHAW, PUSHAD, PUSHAQ, PUSHAF, PUSHAQF, PUSHS,
-		POP, POPLN, POPL, POPLE, POPV, POPVE,
-		SWAP,
-		DUP, DUPE,
-		// Variable Access
-		LOCAL, GLOBAL, ARRAY,
-		// Arithimetic/Bitwise/Conversion Operations
-		EXF,
-		INC, DEC,
-		ADD, SUB, MUL, DIV, MOD,
-		NOT, AND, OR, XOR,
-		SHL, SHR,
-		NEG,
-		TOI, TOF,
-		// Comparison
-		CMPNN, CMPE, CMPNE, CMPGE, CMPLE, CMPG, CMPL,
-		IF, EVAL,
-		// Branching
-		JT, JNT, JMP, JMPD,
-		SWITCH, RSWITCH,
-		// Functions
-		CALL, CALLD,
-		ENTER, RET,
-		// External Read / Write
-		READ, WRITE, COPY, FILL, COMP,
-		// External Calling
-		NATIVE, CMD, CDECL, STDC, THISC, FASTC,
-		//
+		CLASM_INSTRUCTION_SET(CLASM_INSTRUCTION_TYPE)
 		MAX
 	};
+#undef CLASM_INSTRUCTION_TYPE
 
 public:
-	static auto fromName(const string& sv)->Type;
-	static auto getOperands(Type type)->const vector<InstructionOperand>&;
+	static auto fromName(string_view)->Type;
+	static constexpr auto getInfo(Type type)->const InstructionInfo&;
+	static constexpr auto getName(Type type)->string_view;
+	static constexpr auto getOperands(Type type)->const ArrayView<InstructionOperand>&;
+	static constexpr auto getSize(Type type)->size_t;
+
+	/**
+	 * Resolve a mnemonic to the instruction with the smallest encoding taking an operand of a shape.
+	 *
+	 * @param  mnemonic The mnemonic.
+	 * @param  shape    The shape of the operand given to it.
+	 * @return The instruction, or MAX if none of the overloads fits.
+	 */
+	static constexpr auto fromMnemonic(Mnemonic::Type mnemonic, OperandShape shape)->Type;
+};
+
+struct InstructionInfo {
+	Instruction::Type type;
+	string_view name;
+	Mnemonic::Type mnemonic;					//< mnemonic which resolves to this instruction, or MAX
+	ArrayView<InstructionOperand> operands;
+	size_t size;								//< encoded size in bytes, minimum size if an operand is variadic
 };
 
 struct InstructionOverload {
 	Instruction::Type insn;
-	vector<OperandType> params;
+	ArrayView<OperandType> params;
+};
+
+/// Operand layouts referenced by CLASM_INSTRUCTION_SET.
+namespace Operands {
+	namespace Detail {
+		inline constexpr auto types = array<OperandType, 11>{
+			OperandType::IMM8, OperandType::IMM16, OperandType::IMM32, OperandType::IMM64,
+			OperandType::LV8, OperandType::LV16, OperandType::LV32,
+			OperandType::V16, OperandType::V32,
+			OperandType::S32,
+			OperandType::REL32,
+		};
+
+		constexpr auto makeSingleOperands()
+		{
+			auto operands = array<InstructionOperand, types.size()>{};
+			for (auto i = 0_uz; i < types.size(); ++i)
+				operands[i].types = ArrayView<OperandType>{&types[i], 1};
+			return operands;
+		}
+
+		inline constexpr auto single = makeSingleOperands();
+
+		inline constexpr auto real = array<InstructionOperand, 2>{
+			InstructionOperand{ArrayView<OperandType>{&types[2], 1}, false, true},
+			InstructionOperand{ArrayView<OperandType>{&types[3], 1}, false, true},
+		};
+
+		constexpr auto getSingle(OperandType type)
+		{
+			return ArrayView<InstructionOperand>{&single[static_cast<size_t>(type)], 1};
+		}
+	}
+
+	inline constexpr auto None = ArrayView<InstructionOperand>{};
+	inline constexpr auto IMM8 = Detail::getSingle(OperandType::IMM8);
+	inline constexpr auto IMM16 = Detail::getSingle(OperandType::IMM16);
+	inline constexpr auto IMM32 = Detail::getSingle(OperandType::IMM32);
+	inline constexpr auto IMM64 = Detail::getSingle(OperandType::IMM64);
+	inline constexpr auto LV8 = Detail::getSingle(OperandType::LV8);
+	inline constexpr auto LV16 = Detail::getSingle(OperandType::LV16);
+	inline constexpr auto LV32 = Detail::getSingle(OperandType::LV32);
+	inline constexpr auto V16 = Detail::getSingle(OperandType::V16);
+	inline constexpr auto V32 = Detail::getSingle(OperandType::V32);
+	inline constexpr auto S32 = Detail::getSingle(OperandType::S32);
+	inline constexpr auto REL32 = Detail::getSingle(OperandType::REL32);
+	inline constexpr auto F32 = ArrayView<InstructionOperand>{&Detail::real[0], 1};
+	inline constexpr auto F64 = ArrayView<InstructionOperand>{&Detail::real[1], 1};
+}
+
+/// Tables generated from CLASM_INSTRUCTION_SET.
+namespace InstructionSet {
+	constexpr auto getEncodedSize(ArrayView<InstructionOperand> operands)
+	{
+		auto size = 1_uz;
+		for (auto& operand : operands) {
+			if (operand.variadic) continue;
+			for (auto type : operand.types)
+				size += getOperandSize(type);
+		}
+		return size;
+	}
+
+#define CLASM_INSTRUCTION_INFO(type, name, mnemonic, operands) \
+	InstructionInfo{Instruction::type, name, Mnemonic::mnemonic, Operands::operands, getEncodedSize(Operands::operands)},
+	inline constexpr auto instructions = array<InstructionInfo, Instruction::MAX>{
+		CLASM_INSTRUCTION_SET(CLASM_INSTRUCTION_INFO)
+	};
+#undef CLASM_INSTRUCTION_INFO
+
+	constexpr auto countOverloads()
+	{
+		auto count = 0_uz;
+		for (auto& info : instructions) {
+			if (info.mnemonic != Mnemonic::MAX) ++count;
+		}
+		return count;
+	}
+
+	// overloads of each mnemonic are contiguous and in opcode order
+	constexpr auto makeOverloads()
+	{
+		auto overloads = array<InstructionOverload, countOverloads()>{};
+		auto count = 0_uz;
+		for (auto mnemonic = 0u; mnemonic < Mnemonic::MAX; ++mnemonic) {
+			for (auto& info : instructions) {
+				if (info.mnemonic != mnemonic) continue;
+				// an overload is matched by the types of its single operand
+				if (info.operands.size() > 1 || (!info.operands.empty() && info.operands[0].variadic))
+					throw std::logic_error("mnemonic overloads may take at most one operand");
+				overloads[count].insn = info.type;
+				if (!info.operands.empty())
+					overloads[count].params = info.operands[0].types;
+				++count;
+			}
+		}
+		return overloads;
+	}
+
+	inline constexpr auto overloads = makeOverloads();
+
+	constexpr auto makeOverloadSets()
+	{
+		auto sets = array<ArrayView<InstructionOverload>, Mnemonic::MAX>{};
+		auto begin = 0_uz;
+		for (auto mnemonic = 0u; mnemonic < Mnemonic::MAX; ++mnemonic) {
+			auto end = begin;
+			while (end < overloads.size() && instructions[overloads[end].insn].mnemonic == mnemonic)
+				++end;
+			sets[mnemonic] = ArrayView<InstructionOverload>{overloads.data() + begin, end - begin};
+			begin = end;
+		}
+		return sets;
+	}
+
+	inline constexpr auto overloadSets = makeOverloadSets();
+
+	/// Check whether the operands of an overload fit an operand shape.
+	constexpr auto fitsShape(ArrayView<InstructionOperand> operands, OperandShape shape)
+	{
+		if (operands.empty())
+			return shape == OperandShape::None;
+
+		auto& operand = operands[0];
+
+		switch (shape) {
+		case OperandShape::Int8:
+		case OperandShape::Int16:
+		case OperandShape::Int32:
+		case OperandShape::Int64:
+			if (operand.real)
+				return false;
+
+			switch (operand.types[0]) {
+			default: return false;
+			case OperandType::IMM8: return shape == OperandShape::Int8;
+			case OperandType::IMM16: return shape <= OperandShape::Int16;
+			case OperandType::IMM32: return shape <= OperandShape::Int32;
+			case OperandType::IMM64: return true;
+			}
+
+		case OperandShape::Real32:
+			return operand.real;
+		case OperandShape::Real64:
+			return operand.real && operand.types[0] == OperandType::IMM64;
+		case OperandShape::Label:
+			return operand.types[0] == OperandType::REL32;
+		case OperandShape::String:
+			return operand.types[0] == OperandType::S32;
+		case OperandShape::None:
+		case OperandShape::Other:
+		case OperandShape::MAX:
+			break;
+		}
+		return false;
+	}
+
+	using MnemonicResolution = array<Instruction::Type, static_cast<size_t>(OperandShape::MAX)>;
+
+	// the instruction each mnemonic resolves to for each operand shape, the smallest encoding winning over opcode order
+	constexpr auto makeMnemonicResolutions()
+	{
+		auto table = array<MnemonicResolution, Mnemonic::MAX>{};
+
+		for (auto mnemonic = 0u; mnemonic < Mnemonic::MAX; ++mnemonic) {
+			for (auto shape = 0_uz; shape < table[mnemonic].size(); ++shape) {
+				auto best = Instruction::MAX;
+
+				for (auto& info : instructions) {
+					if (info.mnemonic != mnemonic || !fitsShape(info.operands, static_cast<OperandShape>(shape)))
+						continue;
+					if (best == Instruction::MAX || info.size < instructions[best].size)
+						best = info.type;
+				}
+				table[mnemonic][shape] = best;
+			}
+		}
+		return table;
+	}
+
+	inline constexpr auto mnemonicResolutions = makeMnemonicResolutions();
+}
+
+constexpr auto Instruction::getInfo(Type type)->const InstructionInfo&
+{
+	return InstructionSet::instructions[type];
+}
+
+constexpr auto Instruction::getName(Type type)->string_view
+{
+	return getInfo(type).name;
+}
+
+constexpr auto Instruction::getOperands(Type type)->const ArrayView<InstructionOperand>&
+{
+	return getInfo(type).operands;
+}
+
+constexpr auto Instruction::getSize(Type type)->size_t
+{
+	return getInfo(type).size;
+}
+
+constexpr auto Instruction::fromMnemonic(Mnemonic::Type mnemonic, OperandShape shape)->Type
+{
+	return InstructionSet::mnemonicResolutions[mnemonic][static_cast<size_t>(shape)];
+}
+
+constexpr auto Mnemonic::getOverloads(Type type)->const ArrayView<InstructionOverload>&
+{
+	return InstructionSet::overloadSets[type];
+}
+
+/// Every meaning a reserved word has, categories the word does not belong to are MAX.
+struct ReservedWord {
+	string_view name;
+	Keyword::Type keyword = Keyword::MAX;
+	Mnemonic::Type mnemonic = Mnemonic::MAX;
+	Instruction::Type instruction = Instruction::MAX;
+	DataType::Type dataType = DataType::MAX;
+	Segment::Type segment = Segment::MAX;
+
+	/**
+	 * Look up a reserved word with a single probe of a perfect hash table built at compile time.
+	 *
+	 * @param  name The identifier, or segment name without the leading '.'.
+	 * @return The reserved word, or nullptr if `name` is not reserved.
+	 */
+	static auto fromName(string_view name)->const ReservedWord*;
 };
 
 }
@@ -2,14 +2,23 @@
 #include <CLARA/Common/Macros.h>
 #include <CLARA/Common/Imports.h>
 #include <CLARA/Common/Algorithm.h>
+#include <CLARA/Common/Arena.h>
+#include <CLARA/Common/ArrayView.h>
 #include <CLARA/Common/String.h>
 #include <CLARA/Common/Literals.h>
 
+// the version of the CMake project, defined by the build
+#ifndef CLARA_VERSION_MAJOR
+#define CLARA_VERSION_MAJOR 0
+#define CLARA_VERSION_MINOR 0
+#define CLARA_VERSION_PATCH 0
+#endif
+
 namespace CLARA {
 	namespace CLASM {
-		constexpr auto VERSION_MAJOR = 0;
-		constexpr auto VERSION_MINOR = 0;
-		constexpr auto VERSION_PATCH = 0;
+		constexpr auto VERSION_MAJOR = CLARA_VERSION_MAJOR;
+		constexpr auto VERSION_MINOR = CLARA_VERSION_MINOR;
+		constexpr auto VERSION_PATCH = CLARA_VERSION_PATCH;
 		constexpr auto VERSION_BUILD = 0;
 		constexpr auto IS_DEV = true;
 	}
@@ -0,0 +1,147 @@
+#pragma once
+#include <CLARA/Common/Imports.h>
+#include <CLARA/Common/Literals.h>
+
+namespace CLARA {
+
+/**
+ * Bump allocator handing out memory from a few large blocks.
+ *
+ * Nothing is freed individually: reset() runs the destructors of objects made with create() and rewinds to the first
+ * block, keeping every block for reuse, so a host can reuse one arena for any number of jobs without touching the heap
+ * once it is warm. Blocks are never moved, so pointers stay valid when the arena itself is moved.
+ */
+class Arena {
+public:
+	static constexpr auto defaultBlockSize = 64_uz * 1024;
+
+	explicit Arena(size_t blockSize = defaultBlockSize) : blockSize(blockSize)
+	{ }
+
+	Arena(Arena&& other) noexcept;
+	Arena(const Arena&) = delete;
+	~Arena();
+
+	auto operator=(Arena&& other) noexcept->Arena&;
+	auto operator=(const Arena&)->Arena& = delete;
+
+	/**
+	 * Allocate uninitialized memory.
+	 *
+	 * @param  size  The number of bytes.
+	 * @param  align The alignment, a power of two.
+	 * @return The memory, valid until the next reset.
+	 */
+	[[nodiscard]] auto allocate(size_t size, size_t align = alignof(std::max_align_t))->void*;
+
+	/**
+	 * Construct an object in the arena, its destructor is run by reset() or the arena destructor.
+	 *
+	 * @param  args Arguments for the constructor.
+	 * @return The object.
+	 */
+	template<typename T, typename... TArgs>
+	auto create(TArgs&&... args)->T*
+	{
+		auto object = new(allocate(sizeof(T), alignof(T))) T{forward<TArgs>(args)...};
+
+		if constexpr (!std::is_trivially_destructible_v<T>) {
+			auto finalizer = static_cast<Finalizer*>(allocate(sizeof(Finalizer), alignof(Finalizer)));
+			finalizer->destroy = [](void* ptr) { static_cast<T*>(ptr)->~T(); };
+			finalizer->object = object;
+			finalizer->next = finalizers;
+			finalizers = finalizer;
+		}
+		return object;
+	}
+
+	/// Destroy every object made with create() and make all memory available again, keeping the blocks.
+	auto reset()->void;
+
+	/// Get the number of bytes handed out since the last reset.
+	[[nodiscard]] auto getUsed() const noexcept->size_t
+	{
+		return used;
+	}
+
+	/// Get the number of bytes held in blocks.
+	[[nodiscard]] auto getCapacity() const noexcept->size_t
+	{
+		return capacity;
+	}
+
+	/// Get the number of blocks.
+	[[nodiscard]] auto getBlockCount() const noexcept->size_t
+	{
+		return blocks.size();
+	}
+
+private:
+	struct Block {
+		unique_ptr<std::byte[]> data;
+		size_t size;
+	};
+
+	struct Finalizer {
+		void(*destroy)(void*);
+		void* object;
+		Finalizer* next;
+	};
+
+	auto nextBlock(size_t minSize)->void;
+	auto runFinalizers() noexcept->void;
+
+private:
+	size_t blockSize;
+	vector<Block> blocks;
+	size_t nextIndex = 0;						//< the block to move to when the current one is exhausted
+	std::byte* ptr = nullptr;
+	std::byte* end = nullptr;
+	size_t used = 0;
+	size_t capacity = 0;
+	Finalizer* finalizers = nullptr;
+};
+
+/**
+ * Standard allocator over an Arena, for containers owned by the same object as the arena.
+ *
+ * Deallocation is a no-op, so containers which outlive a reset of their arena must be reassigned first.
+ */
+template<typename T>
+struct ArenaAllocator {
+	using value_type = T;
+	using propagate_on_container_copy_assignment = std::true_type;
+	using propagate_on_container_move_assignment = std::true_type;
+	using propagate_on_container_swap = std::true_type;
+
+	Arena* arena;
+
+	ArenaAllocator(Arena& arena) noexcept : arena(&arena)
+	{ }
+
+	template<typename U>
+	ArenaAllocator(const ArenaAllocator<U>& other) noexcept : arena(other.arena)
+	{ }
+
+	[[nodiscard]] auto allocate(size_t count)->T*
+	{
+		return static_cast<T*>(arena->allocate(count * sizeof(T), alignof(T)));
+	}
+
+	auto deallocate(T*, size_t) noexcept->void
+	{ }
+
+	template<typename U>
+	auto operator==(const ArenaAllocator<U>& other) const noexcept
+	{
+		return arena == other.arena;
+	}
+
+	template<typename U>
+	auto operator!=(const ArenaAllocator<U>& other) const noexcept
+	{
+		return arena != other.arena;
+	}
+};
+
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include <CLARA/Common/Imports.h>
+
+namespace CLARA {
+
+/// Non-owning, constexpr view over a contiguous array, used for tables built at compile time.
+template<typename T>
+class ArrayView {
+public:
+	using value_type = T;
+	using const_iterator = const T*;
+
+	constexpr ArrayView() = default;
+
+	constexpr ArrayView(const T* data, size_t size) : ptr(data), count(size)
+	{ }
+
+	template<size_t N>
+	constexpr ArrayView(const array<T, N>& arr) : ptr(arr.data()), count(N)
+	{ }
+
+	constexpr auto begin() const->const T* { return ptr; }
+	constexpr auto end() const->const T* { return ptr + count; }
+	constexpr auto data() const->const T* { return ptr; }
+	constexpr auto size() const->size_t { return count; }
+	constexpr auto empty() const->bool { return count == 0; }
+	constexpr auto front() const->const T& { return ptr[0]; }
+	constexpr auto back() const->const T& { return ptr[count - 1]; }
+	constexpr auto operator[](size_t idx) const->const T& { return ptr[idx]; }
+
+private:
+	const T* ptr = nullptr;
+	size_t count = 0;
+};
+
+}
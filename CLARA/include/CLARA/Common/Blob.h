@@ -0,0 +1,120 @@
+#pragma once
+#include <CLARA/Common/Imports.h>
+#include <cstring>
+
+namespace CLARA {
+
+/// Appends plain values and arrays of them to a binary blob, each aligned to its size from the start of the blob.
+class BlobWriter {
+public:
+	template<typename T>
+	auto write(const T& value)->void
+	{
+		writeArray(&value, 1);
+	}
+
+	template<typename T>
+	auto writeArray(const T* values, size_t count)->void
+	{
+		static_assert(std::is_trivially_copyable_v<T>, "only plain values can be written");
+
+		// padding keeps arrays aligned in blobs mapped straight from a file
+		m_data.resize((m_data.size() + alignof(T) - 1) & ~(alignof(T) - 1));
+
+		const auto offset = m_data.size();
+		m_data.resize(offset + sizeof(T) * count);
+		if (count) std::memcpy(&m_data[offset], values, sizeof(T) * count);
+	}
+
+	template<typename T>
+	auto writeArray(const vector<T>& values)->void
+	{
+		writeArray(values.data(), values.size());
+	}
+
+	/// Get the blob written so far.
+	auto getData() const->string_view
+	{
+		return m_data;
+	}
+
+	/// Take the blob, leaving the writer empty.
+	auto release()->string
+	{
+		return move(m_data);
+	}
+
+private:
+	string m_data;
+};
+
+/// Reads the values a BlobWriter wrote back in the same order, copying them out so the blob needn't be aligned.
+class BlobReader {
+public:
+	explicit BlobReader(string_view data) : m_data(data)
+	{ }
+
+	/**
+	 * Read a value.
+	 *
+	 * @return The value.
+	 * @throws std::out_of_range if the blob ends before it.
+	 */
+	template<typename T>
+	auto read()->T
+	{
+		auto value = T{};
+		readArray(&value, 1);
+		return value;
+	}
+
+	/**
+	 * Read an array of values.
+	 *
+	 * @param  values Receives the values.
+	 * @param  count  The number of values.
+	 * @throws std::out_of_range if the blob ends before the last of them.
+	 */
+	template<typename T>
+	auto readArray(T* values, size_t count)->void
+	{
+		static_assert(std::is_trivially_copyable_v<T>, "only plain values can be read");
+
+		const auto offset = (m_offset + alignof(T) - 1) & ~(alignof(T) - 1);
+		if (offset > m_data.size() || count > (m_data.size() - offset) / sizeof(T))
+			throw std::out_of_range("blob ends early");
+
+		if (count) std::memcpy(values, m_data.data() + offset, sizeof(T) * count);
+		m_offset = offset + sizeof(T) * count;
+	}
+
+	/// Read an array of values, replacing the contents of a vector.
+	template<typename T>
+	auto readArray(vector<T>& values, size_t count)->void
+	{
+		// a count which can't fit is caught before it's allocated for
+		if (count > m_data.size() / sizeof(T))
+			throw std::out_of_range("blob ends early");
+
+		values.resize(count);
+		readArray(values.data(), count);
+	}
+
+	/// Get the part of the blob which hasn't been read.
+	auto getRemaining() const->string_view
+	{
+		return m_data.substr(std::min(m_offset, m_data.size()));
+	}
+
+	/// Check whether the whole blob was read.
+	auto atEnd() const->bool
+	{
+		return m_offset >= m_data.size();
+	}
+
+private:
+	string_view m_data;
+	size_t m_offset = 0;
+};
+
+}
@@ -5,6 +5,8 @@ namespace CLARA::CLASM {
 
 namespace fs {
 
+using namespace std::filesystem;
+
 // convenience function for non-throwing fs::exists
 inline auto fexists(const fs::path& path) noexcept->bool
 {
@@ -28,4 +30,39 @@ inline auto readBinaryFile(const fs::path& path)->optional<vector<uint8>>
 	return nullopt;
 }
 
+/**
+ * Check whether a stream writes to a terminal, rather than a pipe or a file.
+ *
+ * @param  stream The stream.
+ * @return Whether it's a terminal.
+ */
+auto isTerminal(std::FILE* stream)->bool;
+
+/// A read-only view of a whole file, mapped into memory.
+class MappedFile {
+public:
+	/**
+	 * Map a file into memory.
+	 *
+	 * @param  path Path of the file to map.
+	 * @throws std::system_error if the file can't be opened or mapped.
+	 */
+	explicit MappedFile(const fs::path& path);
+	MappedFile(const MappedFile&) = delete;
+	~MappedFile();
+
+	auto operator=(const MappedFile&)->MappedFile& = delete;
+
+	/**
+	 * Get the contents of the file.
+	 *
+	 * @return The mapped bytes, valid for the lifetime of the object.
+	 */
+	auto getData() const->string_view;
+
+private:
+	const char* m_data = nullptr;
+	size_t m_size = 0;
+};
+
 }
\ No newline at end of file
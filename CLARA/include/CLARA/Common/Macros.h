@@ -24,3 +24,23 @@
 #if defined(_DEBUG)
 #define CLASM_DEBUG
 #endif
+
+#if defined(_M_X64) || defined(_M_AMD64) || defined(__x86_64__)
+	#define CLASM_ARCH_X64
+	#define CLASM_SIMD_SSE2
+#elif defined(_M_IX86) || defined(__i386__)
+	#define CLASM_ARCH_X86
+	#if (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+		#define CLASM_SIMD_SSE2
+	#endif
+#endif
+
+#if defined(_WIN32) || (defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+	#define CLASM_LITTLE_ENDIAN
+#elif defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	#define CLASM_BIG_ENDIAN
+#endif
+
+#if defined(CLASM_SIMD_SSE2) && (defined(_MSC_VER) || defined(__GNUC__) || defined(__clang__))
+	#define CLASM_SIMD_AVX2
+#endif
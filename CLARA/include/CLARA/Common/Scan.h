@@ -0,0 +1,78 @@
+#pragma once
+#include <CLARA/Common/Imports.h>
+#include <CLARA/Common/Macros.h>
+
+namespace CLARA::Scan {
+
+/// Instruction sets the scanning kernels can be dispatched to.
+enum class Isa {
+	Scalar, SSE2, AVX2
+};
+
+/**
+ * Get the best instruction set supported by the running CPU.
+ *
+ * @return The instruction set the kernels dispatch to by default.
+ */
+auto getSupportedIsa()->Isa;
+
+/**
+ * Get the instruction set the kernels currently dispatch to.
+ *
+ * @return The active instruction set.
+ */
+auto getIsa()->Isa;
+
+/**
+ * Force the kernels to dispatch to an instruction set, for testing and benchmarking.
+ *
+ * @param  isa The instruction set, which is clamped to the one supported by the running CPU.
+ * @return The instruction set now in use.
+ */
+auto setIsa(Isa isa)->Isa;
+
+/**
+ * Skip horizontal whitespace (space, \t, \r, \v and \f).
+ *
+ * @return Pointer to the first character which is not horizontal whitespace, or `end`.
+ */
+auto skipSpaces(const char* begin, const char* end)->const char*;
+
+/**
+ * Skip newline characters.
+ *
+ * @return Pointer to the first character which is not '\n', or `end`.
+ */
+auto skipNewlines(const char* begin, const char* end)->const char*;
+
+/**
+ * Find the next newline character.
+ *
+ * @return Pointer to the first '\n', or `end`.
+ */
+auto findNewline(const char* begin, const char* end)->const char*;
+
+/**
+ * Find the next character which may end or escape a string literal body.
+ *
+ * @return Pointer to the first '"' or '\\', or `end`.
+ */
+auto findQuoteOrBackslash(const char* begin, const char* end)->const char*;
+
+/**
+ * Find the next character which may begin a string literal or a comment.
+ *
+ * @return Pointer to the first '"' or ';', or `end`.
+ */
+auto findQuoteOrSemicolon(const char* begin, const char* end)->const char*;
+
+/**
+ * Validate UTF-8 text and find where its lines start, in one pass.
+ *
+ * The offset following each '\n', relative to `begin`, is appended to `lineStarts`.
+ *
+ * @return Pointer to the first byte of an invalid UTF-8 sequence, or `end` if the text is valid.
+ */
+auto indexLines(const char* begin, const char* end, vector<uint32>& lineStarts)->const char*;
+
+}
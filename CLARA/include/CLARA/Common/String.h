@@ -1,5 +1,7 @@
 #pragma once
+#include <CLARA/Common/Macros.h>
 #include <CLARA/Common/Imports.h>
+#include <cstring>
 
 namespace CLARA {
 
@@ -148,4 +150,49 @@ constexpr auto encodeBytes(TInt value)->std::enable_if_t<std::is_arithmetic_v<TI
 		: encodeBytesBE<TInt, TSize>(value);
 }
 
+/**
+ * Store a value as little-endian bytes, with the byte order of the system worked out at compile time where possible.
+ *
+ * @param  dest  Where to store the value, with room for sizeof(TInt) bytes.
+ * @param  value The value.
+ * @return The address just past the stored bytes.
+ */
+template<typename TInt>
+inline auto storeBytesLE(uint8* dest, TInt value)->std::enable_if_t<std::is_arithmetic_v<TInt>, uint8*>
+{
+#if defined(CLASM_LITTLE_ENDIAN)
+	std::memcpy(dest, &value, sizeof(TInt));
+#elif defined(CLASM_BIG_ENDIAN)
+	auto bytes = std::array<uint8, sizeof(TInt)>{};
+	std::memcpy(bytes.data(), &value, sizeof(TInt));
+	std::reverse_copy(bytes.begin(), bytes.end(), dest);
+#else
+	auto bytes = encodeBytesLE(value);
+	std::memcpy(dest, bytes.data(), sizeof(TInt));
+#endif
+	return dest + sizeof(TInt);
+}
+
+/**
+ * Load a value from little-endian bytes, the counterpart of storeBytesLE.
+ *
+ * @param  src Where the value is stored, sizeof(TInt) bytes which needn't be aligned.
+ * @return The value.
+ */
+template<typename TInt>
+inline auto loadBytesLE(const uint8* src)->std::enable_if_t<std::is_arithmetic_v<TInt>, TInt>
+{
+	auto value = TInt{};
+#if defined(CLASM_LITTLE_ENDIAN)
+	std::memcpy(&value, src, sizeof(TInt));
+#else
+	auto bytes = std::array<uint8, sizeof(TInt)>{};
+	std::reverse_copy(src, src + sizeof(TInt), bytes.begin());
+	if (getSystemEndianness() == Endian::Little)
+		std::reverse(bytes.begin(), bytes.end());
+	std::memcpy(&value, bytes.data(), sizeof(TInt));
+#endif
+	return value;
+}
+
 }
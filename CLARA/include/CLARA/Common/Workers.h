@@ -0,0 +1,74 @@
+#pragma once
+#include <CLARA/Common/Imports.h>
+#include <CLARA/Common/Literals.h>
+
+namespace CLARA {
+
+/**
+ * Get the number of threads to run a job on.
+ *
+ * @param  requested The number of threads asked for, 0 for one per core.
+ * @return The number of threads, including the calling thread.
+ */
+auto getThreadCount(size_t requested)->size_t;
+
+/**
+ * Threads helping the calling thread through the items of a job, each taking the first item nobody has taken until
+ * none are left.
+ *
+ * Fewer threads are started than asked for if the system can't start more, so the calling thread takes items too
+ * rather than only wait. The threads are stopped from taking more items and joined when the workers go out of scope,
+ * so a job the calling thread leaves with an exception doesn't leave them running.
+ */
+class Workers {
+public:
+	/**
+	 * Start threads taking items of a job.
+	 *
+	 * @param  threads The number of threads to run the job on, including the calling thread.
+	 * @param  items   The number of items in the job.
+	 * @param  func    Function called with the index of each item a thread takes, which mustn't throw.
+	 */
+	template<typename TFunc>
+	Workers(size_t threads, size_t items, TFunc func) : m_items(items)
+	{
+		auto count = std::min(threads, items);
+		if (count <= 1) return;
+
+		m_threads.reserve(count - 1);
+
+		for (auto i = 1_uz; i < count; ++i) {
+			try {
+				m_threads.emplace_back([this, func] {
+					while (auto index = take())
+						func(*index);
+				});
+			}
+			catch (const std::system_error&) {
+				break;
+			}
+		}
+	}
+
+	Workers(const Workers&) = delete;
+	~Workers();
+
+	auto operator=(const Workers&)->Workers& = delete;
+
+	/**
+	 * Take the first item nobody has taken.
+	 *
+	 * @return Its index, or nullopt if none are left.
+	 */
+	auto take()->optional<size_t>;
+
+	/// Stop handing out items and wait for the threads to finish the ones they took.
+	auto join()->void;
+
+private:
+	std::atomic<size_t> m_next{0};
+	size_t m_items;
+	vector<std::thread> m_threads;
+};
+
+}
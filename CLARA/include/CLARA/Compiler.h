@@ -12,12 +12,39 @@ struct Options {
 	Reporter reporter;
 	bool errorReporting = true;
 	bool testForceCompilation = false;
+	size_t threads = 1;                                  // Threads to emit chunks of the segments on, 0 for one per core
+	size_t chunkSize = 64 * 1024;                        // Fewest tokens of a segment worth giving a thread
 };
 
 struct Result {
 	
 };
 
+/**
+ * Work out where everything of a parse goes before it's emitted.
+ *
+ * Sets the size of every segment and the offset of every label in its segment, so references can be emitted before
+ * the labels they refer to.
+ *
+ * @param  tokens The parse to lay out.
+ */
+auto layout(const CLARA::CLASM::Parser::ParseInfo& tokens)->void;
+
+/**
+ * Compile a parse, segment by segment.
+ *
+ * The segments are laid out and emitted into one buffer of their exact size with values stored little-endian. REL32
+ * sites are patched with the segment-relative offsets of their labels, then each segment is handed to the output in
+ * one IBinaryOutput::writeSegment call.
+ *
+ * With more than one thread, segments are split into chunks of tokens which are sized and emitted at the same time
+ * into their slices of the buffer. The output is the same as compiling on one thread.
+ *
+ * @param  options The options.
+ * @param  tokens  The parse to compile.
+ * @param  out     The output the segments are written to, in segment order.
+ * @return The result.
+ */
 auto compile(const Options& options, const CLARA::CLASM::Parser::ParseInfo& tokens, IBinaryOutput& out)->Result;
 
 }
\ No newline at end of file
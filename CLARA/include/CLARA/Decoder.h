@@ -0,0 +1,130 @@
+#pragma once
+#include <CLARA/Assembly.h>
+#include <CLARA/Common.h>
+
+/**
+ * Decoding of compiled code back into instructions.
+ *
+ * Every opcode's length and operand layout is looked up in a table generated from CLASM_INSTRUCTION_SET at compile
+ * time, so decoding an instruction is one lookup and a bounds check. A whole code segment is decoded in one pass into
+ * an array of fixed-size records pointing back into the bytes, operand values are only read when they're asked for.
+ */
+namespace CLARA::CLASM::Decoder {
+
+namespace Detail {
+	constexpr auto countMaxOperands()
+	{
+		auto count = 0_uz;
+		for (auto& info : InstructionSet::instructions) {
+			auto operands = 0_uz;
+			for (auto& operand : info.operands)
+				operands += operand.types.size();
+			count = std::max(count, operands);
+		}
+		return count;
+	}
+}
+
+/// Most operands any instruction is encoded with.
+inline constexpr auto maxOperands = Detail::countMaxOperands();
+
+/// How an opcode is encoded.
+struct OpcodeInfo {
+	Instruction::Type instruction = Instruction::MAX;   //< the instruction, MAX for bytes which aren't an opcode
+	uint8 size = 0;                                     //< encoded size in bytes, the opcode included
+	uint8 numOperands = 0;
+	array<OperandType, maxOperands> operands{};
+	array<uint8, maxOperands> offsets{};                //< offset of each operand from the opcode
+	array<bool, maxOperands> real{};                    //< whether each operand holds a floating-point value
+};
+
+namespace Detail {
+	constexpr auto makeOpcodes()
+	{
+		auto opcodes = array<OpcodeInfo, 256>{};
+		for (auto& info : InstructionSet::instructions) {
+			auto& opcode = opcodes[info.type];
+			opcode.instruction = info.type;
+			opcode.size = static_cast<uint8>(info.size);
+
+			auto offset = 1_uz;
+			for (auto& operand : info.operands) {
+				// the length of an instruction has to follow from its opcode alone
+				if (operand.variadic)
+					throw std::logic_error("decoded instructions may not take variadic operands");
+
+				for (auto type : operand.types) {
+					opcode.operands[opcode.numOperands] = type;
+					opcode.offsets[opcode.numOperands] = static_cast<uint8>(offset);
+					opcode.real[opcode.numOperands] = operand.real;
+					++opcode.numOperands;
+					offset += getOperandSize(type);
+				}
+			}
+		}
+		return opcodes;
+	}
+}
+
+/// Encoding of every opcode, indexed by the opcode byte.
+inline constexpr auto opcodes = Detail::makeOpcodes();
+
+/// An instruction decoded from a code segment.
+struct DecodedInstruction {
+	uint32 offset;                                      //< offset of the opcode in the segment
+	Instruction::Type instruction;
+	uint8 size;                                         //< encoded size in bytes, the opcode included
+};
+
+struct DecodeException : std::runtime_error {
+	DecodeException(const string& msg, size_t offset) : std::runtime_error(msg), offset(offset)
+	{ }
+
+	size_t offset;                                      //< offset of the instruction which couldn't be decoded
+};
+
+/**
+ * Get how an opcode is encoded.
+ *
+ * @param  opcode The opcode byte.
+ * @return The encoding, which has an instruction of MAX if the byte isn't an opcode.
+ */
+constexpr auto getOpcodeInfo(uint8 opcode)->const OpcodeInfo&
+{
+	return opcodes[opcode];
+}
+
+/**
+ * Decode every instruction of a code segment.
+ *
+ * @param  code The bytes of the segment.
+ * @param  size The number of bytes.
+ * @return The instructions, in the order they're in the segment.
+ * @throws DecodeException if a byte where an instruction starts isn't an opcode, or the last instruction is cut short.
+ * @throws std::length_error if the segment is too big for the offsets of its instructions.
+ */
+auto decode(const uint8* code, size_t size)->vector<DecodedInstruction>;
+
+/**
+ * Decode every instruction of a code segment into an array, reusing its memory.
+ *
+ * @param  code         The bytes of the segment.
+ * @param  size         The number of bytes.
+ * @param  instructions The array, which is cleared and filled with the instructions in the order they're in.
+ * @throws DecodeException if a byte where an instruction starts isn't an opcode, or the last instruction is cut short.
+ * @throws std::length_error if the segment is too big for the offsets of its instructions.
+ */
+auto decode(const uint8* code, size_t size, vector<DecodedInstruction>& instructions)->void;
+
+/**
+ * Read an operand of a decoded instruction.
+ *
+ * @param  code        The bytes of the segment the instruction was decoded from.
+ * @param  instruction The instruction.
+ * @param  index       The index of the operand.
+ * @return The bits of the operand, zero-extended. Floating-point operands are the bits of a float or a double by
+ *         the size of the operand.
+ */
+auto readOperand(const uint8* code, const DecodedInstruction& instruction, size_t index)->uint64;
+
+}
@@ -10,6 +10,99 @@ namespace CLARA::CLASM {
 	using AnyOf = vector<AnyOfExpect>;
 	using Expected = variant<TokenType, TokenAndString, AnyOf>;
 
+	/// Separator characters an expectation can name on their own.
+	enum class Punctuator : uint8 {
+		Comma, Colon, Equals, MAX
+	};
+
+	constexpr auto punctuatorText = array<string_view, static_cast<size_t>(Punctuator::MAX)>{",", ":", "="};
+
+	// the order expected token types are listed in diagnostics
+	constexpr auto expectationOrder = array{
+		TokenType::EndOfFile, TokenType::EndOfLine, TokenType::None, TokenType::WhiteSpace, TokenType::Separator,
+		TokenType::Directive, TokenType::String, TokenType::Identifier, TokenType::Keyword, TokenType::Label,
+		TokenType::LabelRef, TokenType::Mnemonic, TokenType::Instruction, TokenType::DataType, TokenType::Numeric,
+		TokenType::HexLiteral, TokenType::IntegerLiteral, TokenType::FloatLiteral, TokenType::Segment,
+	};
+
+	/**
+	 * A set of expected tokens: any of some token types, or a separator with particular text.
+	 *
+	 * Checking a token is a mask test, the Expected listing the tokens is only made for a diagnostic.
+	 */
+	class TokenExpectation {
+	public:
+		constexpr TokenExpectation() = default;
+
+		constexpr TokenExpectation(std::initializer_list<TokenType> types, std::initializer_list<Punctuator> punctuators = {})
+		{
+			for (auto type : types)
+				this->types |= getBit(type);
+			for (auto punctuator : punctuators)
+				this->punctuators |= static_cast<uint8>(1u << static_cast<uint>(punctuator));
+		}
+
+		/**
+		 * Check whether a token is expected.
+		 *
+		 * @param  type The token type.
+		 * @param  text The token text, only looked at for separators.
+		 * @return True if the token is expected.
+		 */
+		constexpr auto matches(TokenType type, string_view text) const->bool
+		{
+			if (types & getBit(type))
+				return true;
+			if (type != TokenType::Separator || !punctuators)
+				return false;
+
+			for (auto i = 0_uz; i < punctuatorText.size(); ++i) {
+				if ((punctuators & (1u << i)) && punctuatorText[i] == text)
+					return true;
+			}
+			return false;
+		}
+
+		constexpr auto empty() const->bool
+		{
+			return !types && !punctuators;
+		}
+
+		/// Get the expected tokens in the form diagnostics list them.
+		auto toExpected() const->Expected
+		{
+			auto anyOf = AnyOf{};
+
+			for (auto type : expectationOrder) {
+				if (types & getBit(type))
+					anyOf.emplace_back(type);
+			}
+			for (auto i = 0_uz; i < punctuatorText.size(); ++i) {
+				if (punctuators & (1u << i))
+					anyOf.emplace_back(make_pair(TokenType::Separator, string{punctuatorText[i]}));
+			}
+
+			if (anyOf.size() == 1) {
+				if (auto type = get_if<TokenType>(&anyOf[0]))
+					return *type;
+				return get<TokenAndString>(move(anyOf[0]));
+			}
+			return anyOf;
+		}
+
+	private:
+		static constexpr auto getBit(TokenType type)->uint32
+		{
+			return 1u << static_cast<uint>(type);
+		}
+
+	private:
+		uint32 types = 0;
+		uint8 punctuators = 0;
+	};
+
+	static_assert(expectationOrder.size() == static_cast<size_t>(TokenType::FloatLiteral) + 1);
+
 	enum class DiagCode : uint32_t {
 		Unknown = 0,
 		// Internal errors
@@ -37,7 +130,9 @@ namespace CLARA::CLASM {
 	};
 
 	template<DiagCode TCode>
-	struct DiagCodeTag {};
+	struct DiagCodeTag {
+		static constexpr auto code = TCode;
+	};
 
 	class Diagnosis;
 
@@ -48,48 +143,45 @@ namespace CLARA::CLASM {
 		constexpr static auto name = "(internal error) unknown error"sv;
 	};
 
+	/**
+	 * A diagnostic record: the code and its arguments, kept inline as plain data.
+	 *
+	 * Nothing is allocated when a diagnosis is made, the name and message are only looked up and formatted
+	 * when something asks for them.
+	 */
 	class Diagnosis {
-		template <typename T, typename = void>
-		struct has_format : std::false_type {};
-		template <typename T>
-		struct has_format<T, std::void_t<decltype(std::declval<T>().formatMessage())>> : std::true_type {};
-
 	public:
-		Diagnosis() : m_name(Diagnostic<DiagCode::Unknown>::name)
-		{}
+		static constexpr auto payloadSize = 32_uz;
+		static constexpr auto payloadAlign = alignof(size_t);
 
-		template<DiagCode Code, typename... TArgs, std::enable_if_t<!has_format<Diagnostic<Code>>::value, int> = 0>
+		Diagnosis() = default;
+
+		template<DiagCode Code, typename... TArgs>
 		Diagnosis(DiagCodeTag<Code>, TArgs&& ... args) noexcept :
-			m_code(Code),
-			m_name(Diagnostic<Code>::name),
-			m_data(Diagnostic<Code>{forward<TArgs>(args)...})
-		{}
-
-		template<DiagCode Code, typename... TArgs, std::enable_if_t<has_format<Diagnostic<Code>>::value, int> = 0>
-		Diagnosis(DiagCodeTag<Code>, TArgs&&... args) noexcept :
-			m_code(Code),
-			m_name(Diagnostic<Code>::name),
-			m_data(Diagnostic<Code>{forward<TArgs>(args)...})
+			m_code(Code)
 		{
-			m_message = std::any_cast<Diagnostic<Code>&>(m_data).formatMessage();
+			using T = Diagnostic<Code>;
+			static_assert(std::is_trivially_copyable_v<T> && std::is_trivially_destructible_v<T>, "diagnostic arguments must be plain data");
+			static_assert(sizeof(T) <= payloadSize && alignof(T) <= payloadAlign, "diagnostic arguments must fit the inline payload");
+			new (m_data) T{forward<TArgs>(args)...};
 		}
 
 		template<DiagCode Code>
 		auto& get()
 		{
-			return std::any_cast<Diagnostic<Code>&>(m_data);
+			assert(m_code == Code);
+			return *std::launder(reinterpret_cast<Diagnostic<Code>*>(m_data));
 		}
 
 		template<DiagCode Code>
 		auto& get() const
 		{
-			return std::any_cast<const Diagnostic<Code>&>(m_data);
+			assert(m_code == Code);
+			return *std::launder(reinterpret_cast<const Diagnostic<Code>*>(m_data));
 		}
 
-		constexpr auto getName() const noexcept
-		{
-			return m_name;
-		}
+		/// Get the short name of the diagnostic.
+		auto getName() const noexcept->string_view;
 
 		constexpr auto getCode() const noexcept
 		{
@@ -101,10 +193,8 @@ namespace CLARA::CLASM {
 			return static_cast<std::underlying_type_t<DiagCode>>(m_code);
 		}
 
-		constexpr auto& getMessage() const noexcept
-		{
-			return m_message;
-		}
+		/// Format the message describing the diagnostic, empty if it has none.
+		auto getMessage() const->string;
 
 		constexpr auto is(DiagCode code) const noexcept
 		{
@@ -113,9 +203,7 @@ namespace CLARA::CLASM {
 
 	private:
 		DiagCode m_code = DiagCode::Unknown;
-		string_view m_name;
-		any m_data;
-		string m_message;
+		alignas(payloadAlign) std::byte m_data[payloadSize] = {};
 	};
 
 	template<DiagCode Code, typename... TArgs>
@@ -140,7 +228,7 @@ namespace CLARA::CLASM {
 
 		auto formatMessage() const
 		{
-			return "invalid sequence of characters";
+			return "invalid sequence of characters"s;
 		}
 	};
 	
@@ -148,7 +236,13 @@ namespace CLARA::CLASM {
 		constexpr static auto name = "unexpected token"sv;
 
 		TokenType given;                                   // the type of token that was given
-		Expected expected;                                 // the type of token expected
+		TokenExpectation expected;                         // the tokens expected
+
+		/// Get the expected tokens as a listing.
+		auto getExpected() const->Expected
+		{
+			return expected.toExpected();
+		}
 
 		auto formatMessage() const
 		{
@@ -180,7 +274,7 @@ namespace CLARA::CLASM {
 						return str + ", "s + expectToStr(val);
 					});
 				},
-			}, expected);
+			}, getExpected());
 		}
 	};
 
@@ -218,7 +312,7 @@ namespace CLARA::CLASM {
 	};
 
 	template<> struct Diagnostic<DiagCode::InvalidIdentifier> {
-		constexpr static auto name = "invalid identifier";
+		constexpr static auto name = "invalid identifier"sv;
 
 		auto formatMessage() const
 		{
@@ -227,7 +321,7 @@ namespace CLARA::CLASM {
 	};
 
 	template<> struct Diagnostic<DiagCode::InvalidSegment> {
-		constexpr static auto name = "invalid segment";
+		constexpr static auto name = "invalid segment"sv;
 
 		auto formatMessage() const
 		{
@@ -275,6 +369,10 @@ namespace CLARA::CLASM {
 		}
 	};
 
+	template<> struct Diagnostic<DiagCode::InvalidEscapeSequence> {
+		constexpr static auto name = "invalid escape sequence"sv;
+	};
+
 	template<> struct Diagnostic<DiagCode::InvalidHexEscapeSequence> {
 		constexpr static auto name = "invalid hex escape sequence"sv;
 		
@@ -332,11 +430,12 @@ namespace CLARA::CLASM {
 	template<> struct Diagnostic<DiagCode::LabelRedefinition> {
 		constexpr static auto name = "label redefinition"sv;
 
-		const Label& original;
+		Source::Token original;				//< the definition of the label
 
 		auto formatMessage() const
 		{
-			return "label already defined on line "s + to_string(original.definition.getLineNumber());
+			auto line = original.source ? original.source->getLineIndexByOffset(static_cast<uint>(original.offset)) + 1 : 0;
+			return "label already defined on line "s + to_string(line);
 		}
 	};
 
@@ -371,4 +470,65 @@ namespace CLARA::CLASM {
 	template<> struct Diagnostic<DiagCode::InvalidNumericLiteral> {
 		constexpr static auto name = "invalid numeric literal"sv;
 	};
-}
\ No newline at end of file
+
+	/**
+	 * Call a function with the tag of a diagnostic code.
+	 *
+	 * @param  code The diagnostic code.
+	 * @param  func Function taking a DiagCodeTag.
+	 * @return The result of the function.
+	 */
+	template<typename TFunc>
+	auto visitDiagCode(DiagCode code, TFunc&& func)
+	{
+#define CLARA_DIAG_CASE(code) case DiagCode::code: return func(DiagCodeTag<DiagCode::code>{})
+		switch (code) {
+		CLARA_DIAG_CASE(UnexpectedTokenBeganLine);
+		CLARA_DIAG_CASE(UnexpectedLexeme);
+		CLARA_DIAG_CASE(ExpectedToken);
+		CLARA_DIAG_CASE(UnexpectedToken);
+		CLARA_DIAG_CASE(UnexpectedSeparator);
+		CLARA_DIAG_CASE(UnexpectedSegmentAfterTokens);
+		CLARA_DIAG_CASE(UnexpectedLabelAfterTokens);
+		CLARA_DIAG_CASE(UnexpectedOperand);
+		CLARA_DIAG_CASE(InvalidIdentifier);
+		CLARA_DIAG_CASE(InvalidSegment);
+		CLARA_DIAG_CASE(InvalidOperandType);
+		CLARA_DIAG_CASE(InvalidMnemonicOperands);
+		CLARA_DIAG_CASE(MissingOperand);
+		CLARA_DIAG_CASE(LiteralValueSizeOverflow);
+		CLARA_DIAG_CASE(InvalidEscapeSequence);
+		CLARA_DIAG_CASE(InvalidHexEscapeSequence);
+		CLARA_DIAG_CASE(LabelRedefinition);
+		CLARA_DIAG_CASE(UnresolvedLabelReference);
+		CLARA_DIAG_CASE(InvalidKeywordArgCount);
+		CLARA_DIAG_CASE(InvalidNumericLiteral);
+		case DiagCode::Unknown: break;
+		}
+#undef CLARA_DIAG_CASE
+		return func(DiagCodeTag<DiagCode::Unknown>{});
+	}
+
+	template<typename T, typename = void>
+	struct HasFormatMessage : std::false_type {};
+	template<typename T>
+	struct HasFormatMessage<T, std::void_t<decltype(std::declval<T>().formatMessage())>> : std::true_type {};
+
+	inline auto Diagnosis::getName() const noexcept->string_view
+	{
+		return visitDiagCode(m_code, [](auto tag)->string_view {
+			return Diagnostic<decltype(tag)::code>::name;
+		});
+	}
+
+	inline auto Diagnosis::getMessage() const->string
+	{
+		return visitDiagCode(m_code, [this](auto tag)->string {
+			constexpr auto code = decltype(tag)::code;
+			if constexpr (HasFormatMessage<Diagnostic<code>>::value)
+				return get<code>().formatMessage();
+			else
+				return {};
+		});
+	}
+}
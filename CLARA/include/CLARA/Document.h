@@ -0,0 +1,152 @@
+#pragma once
+#include <CLARA/Common.h>
+#include <CLARA/Parser.h>
+#include <CLARA/Source.h>
+#include <CLARA/Token.h>
+
+namespace CLARA::CLASM {
+
+/**
+ * A source being edited, kept parsed so questions about it are answered from the parse.
+ *
+ * Edits are applied to the text as they come and parsed in one go by update(), which only parses the lines around
+ * them again where it can. Labels and the tokens referring to them are looked up in the parse result, the first
+ * lookup of references after an update indexes every label token of the parse once.
+ *
+ * A document isn't safe to use from more than one thread at a time, even through const members.
+ */
+class Document {
+public:
+	/// A place in the text as editors count it.
+	struct Position {
+		uint line = 0;                                      //< 0-based line index
+		uint character = 0;                                 //< 0-based column in UTF-16 code units
+	};
+
+	struct Range {
+		Position start;
+		Position end;
+	};
+
+public:
+	/**
+	 * Parse a document.
+	 *
+	 * @param  name    The logical name of the source.
+	 * @param  text    The text of the document.
+	 * @param  options Options for parsing it, now and on every update.
+	 * @throws std::runtime_error if the text isn't valid UTF-8.
+	 */
+	Document(string name, string text, Parser::Options options);
+
+	/// Get the source of the last parse.
+	auto getSource() const->const shared_ptr<const Source>&;
+
+	/// Get the result of the last parse.
+	auto getResult() const->const Parser::Result&;
+
+	/// Get the text with every edit made to it, parsed or not.
+	auto getText() const->string_view;
+
+	/// Check whether the document was edited since it was last parsed.
+	auto isEdited() const->bool;
+
+	/**
+	 * Replace a range of the text, leaving it to be parsed by the next update.
+	 *
+	 * @param  range The range replaced, in the text with every edit before this one.
+	 * @param  text  The text to replace it with.
+	 */
+	auto edit(const Range& range, string_view text)->void;
+
+	/**
+	 * Replace the whole text, leaving it to be parsed by the next update.
+	 *
+	 * @param  text The new text.
+	 */
+	auto setText(string text)->void;
+
+	/**
+	 * Parse the text as it is after the edits made since the last parse.
+	 *
+	 * The edits are parsed as a single one spanning the bytes they changed.
+	 *
+	 * @return Whether only the lines around the edits were parsed, rather than the whole text.
+	 * @throws std::runtime_error if the edited text isn't valid UTF-8, which keeps the edits and the last parse.
+	 */
+	auto update()->bool;
+
+	/**
+	 * Get the offset of a position in the parsed source, clamped to the end of its line.
+	 *
+	 * @param  position The position.
+	 * @return The offset in bytes.
+	 */
+	auto getOffset(const Position& position) const->size_t;
+
+	/**
+	 * Get the position of an offset in the parsed source.
+	 *
+	 * @param  offset The offset in bytes.
+	 * @return The position.
+	 */
+	auto getPosition(size_t offset) const->Position;
+
+	/**
+	 * Get the range of a token of the parsed source.
+	 *
+	 * @param  token The token.
+	 * @return The range it spans.
+	 */
+	auto getRange(const Source::Token& token) const->Range;
+
+	/**
+	 * Find the label defined or referred to by the label token at an offset, or just before it.
+	 *
+	 * @param  offset The offset in the parsed source.
+	 * @return The label, or nullptr if there's no label token there or it refers to an undefined label.
+	 */
+	auto findLabel(size_t offset) const->const Label*;
+
+	/**
+	 * Get the token defining a label.
+	 *
+	 * @param  label A label of the parse.
+	 * @return The token.
+	 */
+	auto getDefinition(const Label& label) const->Token;
+
+	/**
+	 * Find the tokens referring to a label, in source order.
+	 *
+	 * @param  label             A label of the parse.
+	 * @param  includeDefinition Whether to include the tokens defining it, redefinitions included.
+	 * @return The tokens.
+	 */
+	auto findReferences(const Label& label, bool includeDefinition) const->vector<Token>;
+
+private:
+	/// A label token of the parse.
+	struct Reference {
+		size_t offset = 0;
+		TokenHandle handle;
+		bool definition = false;                        //< whether the token defines the label
+	};
+
+	/// Every label token of the parse, by label and in source order.
+	using ReferenceIndex = std::unordered_map<const Label*, vector<Reference>>;
+
+	auto getReferenceIndex() const->const ReferenceIndex&;
+
+private:
+	string m_name;
+	Parser::Options m_options;
+	shared_ptr<const Source> m_source;
+	Parser::Result m_result;
+	string m_text;                                      //< the edited text, while there are edits to parse
+	bool m_edited = false;
+	mutable ReferenceIndex m_references;
+	mutable bool m_indexed = false;
+};
+
+}
@@ -1,5 +1,6 @@
 #pragma once
 #include <CLARA/Common/Imports.h>
+#include <CLARA/Assembly.h>
 
 namespace CLARA::CLASM {
 
@@ -9,6 +10,20 @@ public:
 	virtual ~IBinaryOutput() = default;
 
 	virtual auto write(const uint8_t*, const uint8_t*)->void = 0;
+
+	/**
+	 * Write a whole compiled segment, which the compiler hands over in one call per segment.
+	 *
+	 * Written like any other bytes unless overridden, e.g. to place segments separately.
+	 *
+	 * @param  segment The segment.
+	 * @param  begin   The start of the segment's bytes.
+	 * @param  end     The end of the segment's bytes.
+	 */
+	virtual auto writeSegment([[maybe_unused]] Segment::Type segment, const uint8_t* begin, const uint8_t* end)->void
+	{
+		write(begin, end);
+	}
 	
 	auto write8(uint8_t val)->void
 	{
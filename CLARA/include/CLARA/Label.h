@@ -4,8 +4,9 @@
 namespace CLARA::CLASM {
 
 struct Label {
-	string name;
-	const Token& definition;
+	Symbol symbol;
+	string_view name;				//< interned in Parser::ParseInfo::symbols
+	TokenHandle definition;			//< resolve with Parser::ParseInfo::getToken
 	Segment::Type segment;
 	mutable uint64_t offset = 0;
 };
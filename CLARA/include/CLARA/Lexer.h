@@ -0,0 +1,34 @@
+#pragma once
+#include <CLARA/Common.h>
+#include <CLARA/Token.h>
+
+namespace CLARA::CLASM::Lexer {
+
+/// A single lexeme recognised by the scanner.
+struct Lexeme {
+	TokenType type = TokenType::None;	//< None if no lexeme could be recognised
+	size_t length = 0;					//< length of the lexeme in bytes
+	uint64 integer = 0;					//< magnitude of a hex or integer literal
+	float real = 0;						//< value of a floating-point literal
+	bool negative = false;				//< numeric literal was prefixed with '-'
+	bool valid = true;					//< false if a numeric literal is unrepresentable
+
+	Lexeme() = default;
+
+	constexpr Lexeme(TokenType type, size_t length) : type(type), length(length)
+	{ }
+};
+
+/**
+ * Scan a single lexeme.
+ *
+ * Dispatches on the first byte at `offset` and recognises the lexeme in one forward pass without
+ * allocating. Numeric literals have their value computed during the same scan.
+ *
+ * @param  code   The code to scan.
+ * @param  offset The offset in `code` to scan from.
+ * @return The lexeme, with type `TokenType::None` if no lexeme could be recognised.
+ */
+auto scan(string_view code, size_t offset)->Lexeme;
+
+}
@@ -0,0 +1,242 @@
+#pragma once
+#include <CLARA/Assembly.h>
+#include <CLARA/Common.h>
+#include <CLARA/Compiler.h>
+#include <CLARA/IBinaryOutput.h>
+#include <CLARA/Label.h>
+#include <CLARA/Parser.h>
+#include <CLARA/Token.h>
+#include <CLARA/TokenStream.h>
+
+namespace CLARA::CLASM {
+
+/**
+ * Builds a module in code, giving the parse of it without any source text to lex.
+ *
+ * Statements go into the active segment as they would after a segment directive: instructions anywhere but the data
+ * segment, data declarations only there. Labels may be referred to before they're defined, every label has to be
+ * defined by the time the module is finished or compiled.
+ *
+ * Operands are stored at the width of their operand type, so the compiled bytes are the encoding of each
+ * instruction whichever C++ type the values were given as. Instructions named by a template argument have the number
+ * and kind of their operands checked at compile time, values are range checked when they're emitted either way.
+ *
+ * The parse has no source, so its tokens have no text and it has no segment switches.
+ */
+class ModuleBuilder {
+public:
+	/**
+	 * Start an empty module with the code segment active.
+	 *
+	 * @param  storage How to store the tokens of the segments.
+	 */
+	explicit ModuleBuilder(TokenStorage storage = TokenStorage::Tokens);
+
+	/// Make a segment the active one.
+	auto setSegment(Segment::Type segment)->ModuleBuilder&;
+
+	/// Get the active segment.
+	auto getSegment() const->Segment::Type;
+
+	/**
+	 * Make a label to define later, so it can be referred to before it's defined.
+	 *
+	 * @param  name The name of the label.
+	 * @return The label.
+	 * @throws std::invalid_argument if the module already has a label with the name.
+	 */
+	auto makeLabel(string_view name)->const Label*;
+
+	/**
+	 * Define a label at the end of the active segment.
+	 *
+	 * @param  label A label made by this builder.
+	 * @return The builder.
+	 * @throws std::invalid_argument if the label isn't one of this builder's.
+	 * @throws std::logic_error if the label is already defined.
+	 */
+	auto label(const Label* label)->ModuleBuilder&;
+
+	/**
+	 * Make a label and define it at the end of the active segment.
+	 *
+	 * @param  name The name of the label.
+	 * @return The label.
+	 * @throws std::invalid_argument if the module already has a label with the name.
+	 */
+	auto label(string_view name)->const Label*;
+
+	/// Refer to a label in a REL32 operand.
+	static auto ref(const Label* label)->LabelRef;
+
+	/**
+	 * Emit an instruction into the active segment.
+	 *
+	 * @param  instruction The instruction.
+	 * @param  operands    Its operands: integers or floating-point values for immediates and variable indices, label
+	 *                     references for REL32 and strings for S32.
+	 * @return The builder.
+	 * @throws std::invalid_argument if there are too few or too many operands, or one is of the wrong kind.
+	 * @throws std::out_of_range if a value doesn't fit its operand.
+	 * @throws std::logic_error if the active segment is the data segment.
+	 */
+	template<typename... TArgs>
+	auto emit(Instruction::Type instruction, const TArgs&... operands)->ModuleBuilder&
+	{
+		if (countOperands(instruction) != sizeof...(TArgs)) {
+			throw std::invalid_argument(fmt::format("{} takes {} operands, not {}",
+				Instruction::getName(instruction), countOperands(instruction), sizeof...(TArgs)));
+		}
+
+		auto values = makeOperands(instruction, std::index_sequence_for<TArgs...>{}, operands...);
+		pushInstruction(instruction, values.data(), values.size());
+		return *this;
+	}
+
+	/**
+	 * Emit an instruction into the active segment, with the number and kinds of its operands checked at compile time.
+	 *
+	 * @param  operands Its operands, as for emit(Instruction::Type, const TArgs&...).
+	 * @return The builder.
+	 * @throws std::out_of_range if a value doesn't fit its operand.
+	 * @throws std::logic_error if the active segment is the data segment.
+	 */
+	template<Instruction::Type TInstruction, typename... TArgs>
+	auto emit(const TArgs&... operands)->ModuleBuilder&
+	{
+		static_assert(countOperands(TInstruction) == sizeof...(TArgs), "wrong number of operands for the instruction");
+		static_assert(fitsOperands<TArgs...>(TInstruction, std::index_sequence_for<TArgs...>{}), "operand of the wrong kind for the instruction");
+		return emit(TInstruction, operands...);
+	}
+
+	/// Declare a byte in the data segment.
+	auto db(uint8 value)->ModuleBuilder&;
+
+	/// Declare a 16-bit word in the data segment.
+	auto dw(uint16 value)->ModuleBuilder&;
+
+	/// Declare a 32-bit word in the data segment.
+	auto dd(uint32 value)->ModuleBuilder&;
+
+	/// Declare a 64-bit word in the data segment.
+	auto dq(uint64 value)->ModuleBuilder&;
+
+	/// Declare a string in the data segment.
+	auto ds(string_view value)->ModuleBuilder&;
+
+	/// Get the parse of the module as built so far.
+	auto getInfo() const->const Parser::ParseInfo&;
+
+	/**
+	 * Finish the module, leaving the builder empty.
+	 *
+	 * @return The parse of the module.
+	 * @throws std::logic_error if a label wasn't defined.
+	 */
+	auto finish()->Parser::ParseInfo;
+
+	/**
+	 * Compile the module as built so far.
+	 *
+	 * @param  options Compiler options.
+	 * @param  out     The output the segments are written to.
+	 * @return The result.
+	 * @throws std::logic_error if a label wasn't defined.
+	 */
+	auto compile(const Compiler::Options& options, IBinaryOutput& out) const->Compiler::Result;
+
+private:
+	/// One operand of an instruction, flattened from its operand layout.
+	struct OperandSlot {
+		OperandType type = OperandType::IMM8;
+		bool real = false;
+	};
+
+	struct Operand {
+		TokenType type;
+		TokenAnnotation annotation;
+	};
+
+	static constexpr auto countOperands(Instruction::Type instruction)
+	{
+		auto count = 0_uz;
+		for (auto& operand : Instruction::getOperands(instruction))
+			count += operand.types.size();
+		return count;
+	}
+
+	static constexpr auto getOperandSlot(Instruction::Type instruction, size_t index)
+	{
+		for (auto& operand : Instruction::getOperands(instruction)) {
+			if (index < operand.types.size())
+				return OperandSlot{operand.types[index], operand.real};
+			index -= operand.types.size();
+		}
+		return OperandSlot{};
+	}
+
+	template<typename T>
+	static constexpr auto fitsOperand(OperandSlot slot)
+	{
+		switch (slot.type) {
+		case OperandType::REL32:
+			return std::is_same_v<T, LabelRef>;
+		case OperandType::S32:
+			return std::is_convertible_v<const T&, string_view>;
+		default:
+			return slot.real ? std::is_arithmetic_v<T> : std::is_integral_v<T>;
+		}
+	}
+
+	template<typename... TArgs, size_t... Indices>
+	static constexpr auto fitsOperands([[maybe_unused]] Instruction::Type instruction, std::index_sequence<Indices...>)
+	{
+		return (fitsOperand<TArgs>(getOperandSlot(instruction, Indices)) && ...);
+	}
+
+	template<typename... TArgs, size_t... Indices>
+	auto makeOperands([[maybe_unused]] Instruction::Type instruction, std::index_sequence<Indices...>, const TArgs&... operands)
+	{
+		return array<Operand, sizeof...(TArgs)>{makeOperand(instruction, Indices, operands)...};
+	}
+
+	template<typename T>
+	auto makeOperand(Instruction::Type instruction, size_t index, const T& value)->Operand
+	{
+		auto slot = getOperandSlot(instruction, index);
+
+		if (!fitsOperand<T>(slot)) {
+			throw std::invalid_argument(fmt::format("expected {} for operand {} of {}",
+				to_string(slot.type), index + 1, Instruction::getName(instruction)));
+		}
+
+		if constexpr (std::is_same_v<T, LabelRef>)
+			return Operand{TokenType::LabelRef, value};
+		else if constexpr (std::is_convertible_v<const T&, string_view>)
+			return Operand{TokenType::String, m_info.symbols.intern(string_view{value})};
+		else if constexpr (std::is_floating_point_v<T>)
+			return makeRealOperand(slot, static_cast<double>(value));
+		else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>)
+			return slot.real ? makeRealOperand(slot, static_cast<double>(value)) : makeIntegerOperand(slot, static_cast<int64>(value));
+		else if constexpr (std::is_integral_v<T>)
+			return slot.real ? makeRealOperand(slot, static_cast<double>(value)) : makeIntegerOperand(slot, static_cast<uint64>(value));
+		else
+			static_assert(always_false<T>::value, "operands are numbers, label references or strings");
+	}
+
+	static auto makeIntegerOperand(OperandSlot slot, int64 value)->Operand;
+	static auto makeIntegerOperand(OperandSlot slot, uint64 value)->Operand;
+	static auto makeRealOperand(OperandSlot slot, double value)->Operand;
+
+	auto pushInstruction(Instruction::Type instruction, const Operand* operands, size_t count)->void;
+	auto pushData(DataType::Type type, Operand&& value)->ModuleBuilder&;
+	auto makeHandle() const->TokenHandle;
+	auto checkLabels() const->void;
+
+private:
+	Parser::ParseInfo m_info;
+	Segment::Type m_segment = Segment::Code;
+	TokenStorage m_storage;
+};
+
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <CLARA/Common.h>
+#include <CLARA/Parser.h>
+
+/**
+ * A peephole optimizer for parsed code, run between Parser::tokenize and Compiler::compile.
+ *
+ * Rewrites are declared in a table of rules, each a pattern of statements and a function giving what they're replaced
+ * with. The patterns are compiled into one matching automaton, so the code segment is optimized in a single pass:
+ * statements are fed through the automaton as they're output, and a rule which matches at the end of the output
+ * replaces the statements it matched with statements which are fed through in turn, so rewrites which make others
+ * possible are all applied. A label definition ends every pattern but the one removing jumps to it, so nothing is
+ * rewritten across a jump target, and no rewrite touches statements an `exf` flags.
+ */
+namespace CLARA::CLASM::Optimizer {
+
+struct Options {
+	bool foldConstants = true;                           // Fold adding and multiplying two pushed integers into one push
+	bool reduceStrength = true;                          // Multiply by a pushed power of two with a shift
+};
+
+struct Result {
+	size_t rewrites = 0;                                 // Number of times a rule was applied
+	size_t removedTokens = 0;                            // Number of tokens the code segment is shorter by
+};
+
+/**
+ * Optimize the code segment of a parse.
+ *
+ * The segment is given a new token stream unless nothing was rewritten, and labels defined in it are moved to the
+ * indices of their definitions in it. New statements take the source position of the first statement they replace.
+ *
+ * @param  options Optimizer options.
+ * @param  parse   A parse without errors.
+ * @return The result.
+ */
+auto optimize(const Options& options, Parser::ParseInfo& parse)->Result;
+
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include <CLARA/Common.h>
+#include <CLARA/Common/File.h>
+#include <CLARA/Parser.h>
+#include <CLARA/Source.h>
+
+/**
+ * A persistent cache of parse results.
+ *
+ * A result is written to a compact binary blob holding its symbols, labels, segment switches and the parallel arrays
+ * of each segment's tokens in compact form, keyed by a hash of the source code and the options which change what
+ * parsing gives. Loading one copies the arrays straight into the token streams, so the source is neither lexed nor
+ * parsed again. Blobs are only valid for the build that wrote them: the format version, byte order and a checksum
+ * of the whole blob are checked, and any blob which doesn't match is treated as missing.
+ */
+namespace CLARA::CLASM::ParseCache {
+
+/// Version of the blob format, blobs of any other version are ignored.
+constexpr auto VERSION = uint32{2};
+
+/**
+ * Get the key a parse of a source is cached by.
+ *
+ * @param  options Parsing options, of which only those changing the result are part of the key.
+ * @param  source  The source.
+ * @return A hash of the code and options.
+ */
+auto getKey(const Parser::Options& options, const Source& source)->uint64;
+
+/**
+ * Write a parse result to a blob.
+ *
+ * Only results without reports can be cached, as loading one passes nothing to the reporter.
+ *
+ * @param  options Options the source was parsed with.
+ * @param  source  The source the result was parsed from.
+ * @param  result  The result.
+ * @return The blob.
+ * @throws std::invalid_argument if the result has reports.
+ */
+auto save(const Parser::Options& options, const Source& source, const Parser::Result& result)->string;
+
+/**
+ * Load a parse result from a blob, rebuilding its token streams without lexing the source.
+ *
+ * The token streams are stored as the options say, whichever way they were stored when the blob was written.
+ *
+ * @param  options Parsing options.
+ * @param  source  The source the result is for.
+ * @param  blob    The blob, which isn't referred to by the result once it's loaded.
+ * @param  result  The result to reset and load into.
+ * @return Whether the blob held a parse of the source with the options, otherwise the result is left reset.
+ */
+auto load(const Parser::Options& options, shared_ptr<const Source> source, string_view blob, Parser::Result& result)->bool;
+
+/**
+ * Parse a source, using a cache of results in a directory.
+ *
+ * A cached result is mapped from its file and loaded if there is one. Otherwise the source is parsed, and the result
+ * is written to the cache if it has no reports. Failing to read or write the cache only makes it a miss.
+ *
+ * @param  options   Parsing options.
+ * @param  source    The source to parse.
+ * @param  directory The directory of the cache, which is made if it doesn't exist.
+ * @param  result    The result to reset and parse or load into.
+ * @return Whether the result was loaded from the cache.
+ */
+auto tokenize(const Parser::Options& options, shared_ptr<const Source> source, const fs::path& directory, Parser::Result& result)->bool;
+
+}
@@ -31,20 +31,46 @@ struct Report {
 struct SegmentInfo {
 	Segment::Type type;
 	shared_ptr<TokenStream> tokens;
-	size_t size = 0;
+	mutable size_t size = 0;                             // size of the assembly, set by Compiler::layout
 };
 
+/// Where a segment directive made its segment the active one.
+struct SegmentSwitch {
+	size_t offset = 0;                                   // offset of the directive in the source
+	Segment::Type segment = Segment::Header;
+};
+
+using LabelMap = std::unordered_map<Symbol, size_t, std::hash<Symbol>, std::equal_to<Symbol>, ArenaAllocator<pair<const Symbol, size_t>>>;
+
 struct ParseInfo {
-	vector<unique_ptr<Label>> labels;
-	unordered_map<string, size_t> labelMap;
+	unique_ptr<Arena> arena;                             // owns the labels and label map nodes
+	SymbolTable symbols;
+	vector<Label*> labels;
+	LabelMap labelMap;
 	array<SegmentInfo, Segment::MAX> segments;
+	vector<SegmentSwitch> segmentSwitches;               // every segment directive, in source order
 
-	ParseInfo()
-	{
-		for (auto i = 0; i < Segment::MAX; ++i) {
-			segments[i].type = static_cast<Segment::Type>(i);
-		}
-	}
+	ParseInfo();
+
+	/// Move a parse, leaving the other with an arena of its own so it can be parsed into again.
+	ParseInfo(ParseInfo&& other);
+
+	auto operator=(ParseInfo&& other)->ParseInfo&;
+
+	/**
+	 * Get a copy of a token by its handle.
+	 *
+	 * @param  handle The handle of a token in one of the segments.
+	 * @return The token.
+	 */
+	auto getToken(const TokenHandle& handle) const->Token;
+
+	/**
+	 * Free everything owned by the parse in one go, keeping the memory for the next parse.
+	 *
+	 * Segment token streams which aren't shared elsewhere are cleared and reused by the next parse.
+	 */
+	auto reset()->void;
 };
 
 struct Result {
@@ -63,14 +89,68 @@ struct Result {
 	{
 		return !numErrors;
 	}
+
+	/// Clear the result so it can be parsed into again without reallocating.
+	auto reset()->void;
 };
 
 struct Options {
 	Reporter reporter;
-	bool errorReporting = true;
+	bool errorReporting = true;                          // Write reports to stderr when there's no reporter
+	ReportFormat reportFormat = ReportFormat::Text;      // Format reports are written in without a reporter
 	bool testForceTokenization = false;                  // Disables errors that may prevent tokenization
+	TokenStorage tokenStorage = TokenStorage::Tokens;    // How segment token streams store their tokens
+	size_t threads = 1;                                  // Threads to parse shards of the source on, 0 for one per core
+	size_t shardSize = 256 * 1024;                       // Smallest shard of the source worth giving a thread
 };
 
+/// A change to the code of a source, replacing a run of bytes with others.
+struct Edit {
+	size_t offset = 0;                                   // Offset of the replaced bytes in the code before the edit
+	size_t removed = 0;                                  // Number of bytes replaced
+	size_t inserted = 0;                                 // Number of bytes they were replaced with
+};
+
+/**
+ * Parse a source into segment token streams.
+ *
+ * With more than one thread the source is split into shards at line boundaries, which are parsed at the same time
+ * and merged in order. The result and the reports, including the order they're passed to the reporter in, are the
+ * same as parsing it on one thread.
+ *
+ * @param  options Parsing options.
+ * @param  source  The source to parse.
+ * @return The result.
+ */
 auto tokenize(const Options& options, shared_ptr<const Source> source)->Result;
 
+/**
+ * Parse into an existing result, reusing the memory it holds from previous parses.
+ *
+ * Everything the result held before is reset, so labels and tokens from a previous parse must no longer be in use.
+ *
+ * @param  options Parsing options.
+ * @param  source  The source to parse.
+ * @param  result  The result to reset and parse into.
+ */
+auto tokenize(const Options& options, shared_ptr<const Source> source, Result& result)->void;
+
+/**
+ * Update a result for an edit of the source it was parsed from, parsing only the lines around the edit again.
+ *
+ * The tokens of those lines are spliced into the segment token streams, and only the labels they define and the
+ * references they make are updated. The whole source is parsed again instead if the edit changes which labels are
+ * defined or the segment of the lines after it, or the result ended with a fatal report. Either way the result holds
+ * the tokens, labels and reports parsing the edited source would, but only reports of the lines parsed again are
+ * passed to the reporter.
+ *
+ * @param  options Parsing options.
+ * @param  source  The edited source.
+ * @param  edit    The edit made to the source the result was parsed from.
+ * @param  result  The result of parsing the source before the edit, which is updated.
+ * @return Whether only the lines around the edit were parsed, rather than the whole source.
+ * @throws std::out_of_range if the edit doesn't fit the sources.
+ */
+auto retokenize(const Options& options, shared_ptr<const Source> source, const Edit& edit, Result& result)->bool;
+
 }
\ No newline at end of file
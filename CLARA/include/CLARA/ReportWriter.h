@@ -0,0 +1,68 @@
+#pragma once
+#include <CLARA/Common.h>
+#include <CLARA/Common/File.h>
+#include <CLARA/Parser.h>
+#include <CLARA/Reporter.h>
+
+namespace CLARA::CLASM {
+
+/**
+ * Collects parser reports and renders them all at once.
+ *
+ * Reports are held until the writer is flushed, then they're sorted by position, duplicates are dropped and the
+ * whole lot is rendered into one buffer, which is written out with a single call.
+ */
+class ReportWriter {
+public:
+	struct Options {
+		ReportFormat format = ReportFormat::Text;
+		bool colour = isTerminal(stderr);                   //< colour text output with terminal escapes, by default if stderr is a terminal
+	};
+
+public:
+	ReportWriter() = default;
+	ReportWriter(Options options);
+
+	/**
+	 * Get a reporter which adds the reports it's given to this writer.
+	 *
+	 * The writer must outlive the reporter.
+	 *
+	 * @return The reporter.
+	 */
+	auto getReporter()->Reporter;
+
+	/**
+	 * Add a report to be written by the next flush.
+	 *
+	 * @param  report The report.
+	 */
+	auto add(const Parser::Report& report)->void;
+
+	/// Get the number of reports waiting to be written.
+	auto size() const->size_t;
+
+	/**
+	 * Sort, deduplicate and render the reports waiting to be written, then forget them.
+	 *
+	 * @return The rendered reports.
+	 */
+	auto render()->string;
+
+	/**
+	 * Render the reports waiting to be written and write them to a stream.
+	 *
+	 * @param  stream The stream to write to.
+	 */
+	auto flush(std::FILE* stream)->void;
+
+private:
+	auto renderBuffer()->void;
+
+private:
+	Options m_options;
+	vector<Parser::Report> m_reports;
+	fmt::memory_buffer m_buffer;
+};
+
+}
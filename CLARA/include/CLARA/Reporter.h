@@ -7,6 +7,13 @@ enum class ReportType {
 	Info, Warning, Error, Fatal
 };
 
+/// How reports are rendered when they're written out.
+enum class ReportFormat {
+	Text,                                               // for people, with the offending line of source
+	JsonLines,                                          // a JSON object per report, one per line
+	Sarif,                                              // a SARIF 2.1.0 log
+};
+
 struct ReportData {
 	ReportType type;
 	const any& data;
@@ -37,9 +37,32 @@ public:
 	 *
 	 * @param  name The logical name of the source code.
 	 * @param  code The source code string.
+	 * @throws std::runtime_error if the code isn't valid UTF-8.
 	 */
 	Source(string name, string code);
 
+	/**
+	 * Make a source from a file, mapping it into memory instead of reading it.
+	 *
+	 * @param  path The path of the file, which is also the logical name of the source.
+	 * @return The source, which keeps the mapping for as long as it lives.
+	 * @throws std::system_error if the file can't be mapped.
+	 * @throws std::runtime_error if the file isn't valid UTF-8.
+	 */
+	static auto fromFile(const fs::path& path)->shared_ptr<Source>;
+
+	/**
+	 * Make a source viewing code owned by the caller, without copying it.
+	 *
+	 * The code must outlive the source and any tokens made from it.
+	 *
+	 * @param  name The logical name of the source code.
+	 * @param  code The source code.
+	 * @return The source.
+	 * @throws std::runtime_error if the code isn't valid UTF-8.
+	 */
+	static auto fromBuffer(string name, string_view code)->shared_ptr<Source>;
+
 	/**
 	 * Get the logical source name.
 	 *
@@ -52,7 +75,7 @@ public:
 	 *
 	 * @return The code string.
 	 */
-	auto getCode() const->const string&;
+	auto getCode() const->string_view;
 
 	/**
 	 * Get number of code lines.
@@ -64,6 +87,8 @@ public:
 	/**
 	 * Get line informations.
 	 *
+	 * The line informations are worked out the first time they're needed.
+	 *
 	 * @return The vector of line informations.
 	 */
 	auto getLineInfos() const->const vector<LineInfo>&;
@@ -76,6 +101,14 @@ public:
 	 */
 	auto getLineInfo(uint index) const->const LineInfo&;
 
+	/**
+	 * Get the offset of a line without working out the rest of the line information.
+	 *
+	 * @param  index The 0-based index of the line.
+	 * @return The offset of the line in bytes.
+	 */
+	auto getLineOffset(uint index) const->uint;
+
 	/**
 	 * Get the line index at an offset.
 	 *
@@ -87,6 +120,8 @@ public:
 	/**
 	 * Get the line column number of a code offset.
 	 *
+	 * Constant time for lines of single byte characters, otherwise the characters before the offset are counted.
+	 *
 	 * @param  offset The offset to get the column number of.
 	 * @return The line column number.
 	 */
@@ -124,11 +159,19 @@ public:
 	 */
 	auto getToken(size_t from, size_t size) const->Token;
 
+private:
+	Source(string name, string_view code, shared_ptr<const void> owner);
+
+	auto indexLines()->void;
+
 private:
 	const string m_name;
-	const string m_code;
-	vector<LineInfo> m_lineInfos;
-	map<uint, uint> m_offsetLines;
+	const string m_storage;                             //< the code, if the source owns a copy of it
+	const shared_ptr<const void> m_owner;               //< keeps code the source doesn't own alive
+	const string_view m_code;
+	vector<uint32> m_lineStarts;                        //< offset of each line, ascending
+	mutable std::once_flag m_lineInfosBuilt;
+	mutable vector<LineInfo> m_lineInfos;
 };
 
 }
\ No newline at end of file
@@ -0,0 +1,94 @@
+#pragma once
+#include <CLARA/Common.h>
+#include <CLARA/Common/Arena.h>
+
+namespace CLARA::CLASM {
+
+/// Dense ID of a string interned in a SymbolTable, numbered from 0 in order of interning.
+enum class Symbol : uint32 {};
+
+/**
+ * Interning pool for identifiers, label names and string literals.
+ *
+ * Each distinct string is stored once, in arena blocks which are never reallocated, so views returned by get() stay
+ * valid until the table is cleared or destroyed, including after it is moved.
+ */
+class SymbolTable {
+public:
+	SymbolTable() = default;
+	SymbolTable(SymbolTable&&) = default;
+	SymbolTable(const SymbolTable&) = delete;
+
+	auto operator=(SymbolTable&&)->SymbolTable& = default;
+	auto operator=(const SymbolTable&)->SymbolTable& = delete;
+
+	/**
+	 * Get the symbol of a string, adding it to the table if it is new.
+	 *
+	 * @param  str The string.
+	 * @return The symbol.
+	 */
+	auto intern(string_view str)->Symbol;
+
+	/**
+	 * Find the symbol of a string without adding it.
+	 *
+	 * @param  str The string.
+	 * @return The symbol, or nullopt if the string was never interned.
+	 */
+	[[nodiscard]] auto find(string_view str) const->optional<Symbol>;
+
+	/**
+	 * Intern every string of another table, in the order they were interned there.
+	 *
+	 * @param  other   The table.
+	 * @param  symbols Receives the symbol in this table of each symbol of the other.
+	 */
+	auto merge(const SymbolTable& other, vector<Symbol>& symbols)->void;
+
+	/// Remove every symbol, keeping the allocated memory for reuse.
+	auto clear()->void;
+
+	/**
+	 * Get the string of a symbol.
+	 *
+	 * @param  symbol A symbol returned by this table.
+	 * @return The interned string.
+	 */
+	[[nodiscard]] auto get(Symbol symbol) const->string_view
+	{
+		assert(static_cast<size_t>(symbol) < strings.size());
+		return strings[static_cast<size_t>(symbol)];
+	}
+
+	/**
+	 * Get the number of distinct strings.
+	 *
+	 * @return The number of symbols.
+	 */
+	[[nodiscard]] auto size() const noexcept->size_t
+	{
+		return strings.size();
+	}
+
+	/**
+	 * Estimate the heap memory held by the table.
+	 *
+	 * @return The number of bytes allocated for strings and the hash index.
+	 */
+	[[nodiscard]] auto getMemoryUsage() const->size_t;
+
+private:
+	auto probe(string_view str, uint32 hash) const->size_t;
+	auto insert(string_view str, uint32 hash)->Symbol;
+	auto store(string_view str)->string_view;
+	auto rehash(size_t capacity)->void;
+
+private:
+	Arena storage;
+	vector<string_view> strings;			//< indexed by symbol
+	vector<uint32> hashes;					//< indexed by symbol, kept so growing the index doesn't rehash strings
+	vector<uint32> slots;					//< open addressing index of symbol + 1, 0 marks an empty slot
+};
+
+}
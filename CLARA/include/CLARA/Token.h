@@ -2,6 +2,7 @@
 #include <CLARA/Assembly.h>
 #include <CLARA/Common.h>
 #include <CLARA/Source.h>
+#include <CLARA/SymbolTable.h>
 
 namespace CLARA::CLASM {
 
@@ -40,7 +41,7 @@ using TokenAnnotation = variant<
 	monostate,
 	uint8, int8, uint16, int16, uint32, int32, uint64, int64,
 	float, double,
-	string,
+	Symbol,			// identifiers and string literals, interned in Parser::ParseInfo::symbols
 	const Label*,
 	LabelRef,
 	Keyword::Type,
@@ -69,7 +70,14 @@ struct Token : public Source::Token {
 	auto getAssemblySize() const->size_t;
 };
 
+/// Position of a token in the stream of its segment, which stays valid however the stream grows or stores tokens.
+struct TokenHandle {
+	Segment::Type segment = Segment::Header;
+	uint32 index = 0;
+};
+
 auto getAnnotationTokenType(const TokenAnnotation&)->TokenType;
+auto getAnnotationSize(const TokenAnnotation&)->size_t;
 
 }
 
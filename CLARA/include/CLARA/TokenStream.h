@@ -1,5 +1,6 @@
 #pragma once
 #include <CLARA/Common.h>
+#include <CLARA/Common/Blob.h>
 #include <CLARA/Source.h>
 #include <CLARA/Token.h>
 
@@ -7,16 +8,23 @@ namespace CLARA::CLASM {
 
 using TokenVec = vector<Token>;
 
+/// How a TokenStream stores its tokens.
+enum class TokenStorage {
+	Tokens,		//< a vector of Token objects, elements can be referenced and modified in place
+	Compact,	//< parallel arrays of type, offset, length and annotation index, tokens are materialized on access
+};
+
 class TokenStream {
 public:
+	/// Iterates tokens read-only in either storage mode, tokens are modified with operator[] or setAnnotation.
 	template<typename T>
 	struct iter : public std::random_access_iterator_tag {
 		using iterator_category = std::random_access_iterator_tag;
 		using value_type        = Token;
 		using difference_type   = size_t;
 		using size_type         = size_t;
-		using pointer           = value_type*;
-		using reference         = value_type&;
+		using pointer           = const value_type*;
+		using reference         = const value_type&;
 
 		T* stream = nullptr;
 		ptrdiff_t index = -1;
@@ -49,6 +57,7 @@ public:
 		{
 			stream = other.stream;
 			index = other.index;
+			stashIndex = -1;
 			return *this;
 		}
 
@@ -115,22 +124,39 @@ public:
 
 		[[nodiscard]] constexpr auto& operator*() noexcept
 		{
-			return (*stream)[index];
+			return deref();
 		}
 
 		[[nodiscard]] constexpr auto& operator*() const noexcept
 		{
-			return (*stream)[index];
+			return deref();
 		}
 
 		[[nodiscard]] constexpr auto* operator->() noexcept
 		{
-			return &(*stream)[index];
+			return &deref();
 		}
 
 		[[nodiscard]] constexpr auto* operator->() const noexcept
 		{
-			return &(*stream)[index];
+			return &deref();
+		}
+
+	private:
+		// compact streams have no Token objects to point to, so the iterator holds a materialized copy,
+		// which is why no iterator gives out a token that can be written to
+		mutable Token stash;
+		mutable ptrdiff_t stashIndex = -1;
+
+		auto deref() const->const Token&
+		{
+			if (!stream->isCompact())
+				return (*stream)[index];
+			if (stashIndex != index) {
+				stash = stream->get(static_cast<size_t>(index));
+				stashIndex = index;
+			}
+			return stash;
 		}
 	};
 
@@ -138,32 +164,38 @@ public:
 	using const_iterator = iter<const TokenStream>;
 
 public:
-	TokenStream(size_t reserve = 4096)
+	TokenStream(size_t reserve = 0)
 	{
 		tokens.reserve(reserve);
 	}
 
-	TokenStream(shared_ptr<const Source> source, size_t reserve = 4096) : source(source)
+	TokenStream(shared_ptr<const Source> source, size_t reserve = 0) : source(source)
 	{
 		tokens.reserve(reserve);
 	}
 
+	TokenStream(shared_ptr<const Source> source, TokenStorage storage, size_t reserve = 0);
+
 	template<typename T, typename = std::enable_if_t<!std::is_integral_v<T>>>
 	TokenStream(const T& tokenInits)
 	{
 		initFrom(tokenInits);
 	}
 
+	/// Access a token in place, only for TokenStorage::Tokens.
 	[[nodiscard]] auto operator[](size_t index) noexcept->Token&
 	{
+		assert(!isCompact());
 		return tokens[index];
 	}
 
+	/// Access a token in place, only for TokenStorage::Tokens.
 	[[nodiscard]] auto operator[](size_t index) const noexcept->const Token&
 	{
+		assert(!isCompact());
 		return tokens[index];
 	}
-	
+
 	[[nodiscard]] constexpr auto all() const noexcept->const TokenVec&
 	{
 		return tokens;
@@ -178,46 +210,180 @@ public:
 	{
 		return tokens.back();
 	}
-	
+
 	[[nodiscard]] auto& back() const noexcept
 	{
 		return tokens.back();
 	}
 
-	[[nodiscard]] constexpr auto begin() noexcept
+	[[nodiscard]] auto begin() noexcept
 	{
 		return iterator{*this, 0};
 	}
 
-	[[nodiscard]] constexpr auto begin() const noexcept
+	[[nodiscard]] auto begin() const noexcept
 	{
 		return const_iterator{*this, 0};
 	}
 
-	[[nodiscard]] constexpr auto end() noexcept
+	[[nodiscard]] auto end() noexcept
 	{
 		return iterator{*this};
 	}
 
-	[[nodiscard]] constexpr auto end() const noexcept
+	[[nodiscard]] auto end() const noexcept
 	{
 		return const_iterator{*this};
 	}
 
 	[[nodiscard]] auto empty() const noexcept
 	{
-		return tokens.empty();
+		return size() == 0;
 	}
 
 	[[nodiscard]] auto size() const noexcept->size_t
 	{
-		return tokens.size();
+		return isCompact() ? compact.types.size() : tokens.size();
+	}
+
+	[[nodiscard]] auto getStorage() const noexcept->TokenStorage
+	{
+		return storage;
+	}
+
+	[[nodiscard]] auto isCompact() const noexcept->bool
+	{
+		return storage == TokenStorage::Compact;
 	}
 
+	[[nodiscard]] auto getSource() const noexcept->const shared_ptr<const Source>&
+	{
+		return source;
+	}
+
+	/**
+	 * Get a copy of a token, in either storage mode.
+	 *
+	 * @param  index The index of the token.
+	 * @return The token.
+	 */
+	[[nodiscard]] auto get(size_t index) const->Token;
+
+	/**
+	 * Get the type of a token without materializing it.
+	 *
+	 * @param  index The index of the token.
+	 * @return The token type.
+	 */
+	[[nodiscard]] auto getType(size_t index) const->TokenType;
+
+	/**
+	 * Get the annotation of a token without materializing it.
+	 *
+	 * @param  index The index of the token.
+	 * @return The annotation.
+	 */
+	[[nodiscard]] auto getAnnotation(size_t index) const->TokenAnnotation;
+
+	/**
+	 * Get the source offset of a token without materializing it.
+	 *
+	 * @param  index The index of the token.
+	 * @return The offset of the token in the source.
+	 */
+	[[nodiscard]] auto getOffset(size_t index) const->size_t;
+
+	/**
+	 * Find the first token at or after a source offset, the tokens being in source order.
+	 *
+	 * @param  offset The offset in the source.
+	 * @return The index of the token, or the size of the stream if there's none.
+	 */
+	[[nodiscard]] auto findOffset(size_t offset) const->size_t;
+
+	/**
+	 * Replace the annotation of a token, in either storage mode.
+	 *
+	 * @param  index      The index of the token.
+	 * @param  annotation The new annotation.
+	 */
+	auto setAnnotation(size_t index, TokenAnnotation annotation)->void;
+
+	/**
+	 * Make room for tokens, so pushing up to that many doesn't reallocate.
+	 *
+	 * @param  count The number of tokens.
+	 */
+	auto reserve(size_t count)->void;
+
+	/**
+	 * Append every token of a stream from another parse of the same source, translating its symbols and labels.
+	 *
+	 * @param  other   The stream to append.
+	 * @param  symbols The symbol in this parse of each symbol of the other.
+	 * @param  labels  The label in this parse of each label of the other, indexed by the symbol of its name.
+	 */
+	auto append(const TokenStream& other, const vector<Symbol>& symbols, const vector<const Label*>& labels)->void;
+
+	/**
+	 * Replace a run of tokens with every token of a stream from a parse of part of an edited source.
+	 *
+	 * The stream is rebound to the edited source of the other stream, and the tokens after the run are moved by how
+	 * far the edit moved the code after it, so the work is proportional to the run and the tokens after it. Tokens
+	 * stored in place before the run keep viewing the code they were parsed from, which the stream keeps alive until
+	 * enough sources are held that they're all pointed at the edited code. A compact stream drops the side table
+	 * entries of replaced tokens once enough of the entries are dead.
+	 *
+	 * @param  begin   The index of the first token replaced.
+	 * @param  end     The index past the last token replaced.
+	 * @param  other   The stream to put in their place.
+	 * @param  symbols The symbol in this parse of each symbol of the other.
+	 * @param  labels  The label in this parse of each label of the other, indexed by the symbol of its name.
+	 * @param  shift   How far the edit moved the code after the run.
+	 */
+	auto splice(size_t begin, size_t end, const TokenStream& other, const vector<Symbol>& symbols, const vector<const Label*>& labels, ptrdiff_t shift)->void;
+
+	/**
+	 * Write the tokens to a blob, in the compact form whichever way they're stored.
+	 *
+	 * @param  writer        The writer of the blob.
+	 * @param  getLabelIndex Get the index in the parse of a label, which label annotations are written as.
+	 */
+	auto save(BlobWriter& writer, const function<uint32(const Label*)>& getLabelIndex) const->void;
+
+	/**
+	 * Replace the tokens with those a stream wrote to a blob, without lexing the source again.
+	 *
+	 * The tokens are stored however the stream stores them, and refer to the source it was last reset with.
+	 *
+	 * @param  reader The reader of the blob.
+	 * @param  labels The labels of the parse, by the index they were written as.
+	 * @throws std::out_of_range if the blob ends early or refers to a label which isn't there.
+	 */
+	auto load(BlobReader& reader, const vector<Label*>& labels)->void;
+
+	/**
+	 * Remove every token and rebind the stream to a source, keeping the allocated memory for reuse.
+	 *
+	 * @param  source  The source the tokens will refer to.
+	 * @param  storage How to store the tokens.
+	 */
+	auto reset(shared_ptr<const Source> source, TokenStorage storage)->void;
+
+	/**
+	 * Estimate the heap memory held by the stream.
+	 *
+	 * @return The number of bytes allocated for tokens, annotations and side tables.
+	 */
+	[[nodiscard]] auto getMemoryUsage() const->size_t;
+
 	template<typename... TArgs>
 	auto push(TArgs&&... args)->iterator
 	{
-		tokens.emplace_back(forward<TArgs>(args)...);
+		if (isCompact())
+			pushCompact(Token(forward<TArgs>(args)...));
+		else
+			tokens.emplace_back(forward<TArgs>(args)...);
 		return iterator(*this, size() - 1);
 	}
 
@@ -235,9 +401,41 @@ private:
 		}
 	}
 
+	auto pushCompact(Token&& token)->void;
+	auto encodeAnnotation(const TokenAnnotation& annotation)->uint32;
+	auto decodeAnnotation(uint32 annotation) const->TokenAnnotation;
+
 private:
+	struct Compact;
+	using Decoder = TokenAnnotation(*)(const Compact&, uint32);
+
+	template<size_t Kind>
+	static auto decodeAs(const Compact& compact, uint32 payload)->TokenAnnotation;
+
+	template<size_t... Kinds>
+	static constexpr auto makeDecoders(std::index_sequence<Kinds...>)->array<Decoder, sizeof...(Kinds)>;
+
+private:
+	/// Parallel arrays of TokenStorage::Compact, the annotation holds the variant index in its top bits
+	/// and either the value itself or an index into one of the side tables.
+	struct Compact {
+		vector<uint8> types;
+		vector<uint32> offsets;
+		vector<uint32> lengths;
+		vector<uint32> annotations;
+		vector<uint64> numbers;				//< 32 and 64-bit literals
+		vector<const Label*> labels;		//< label definitions and references
+		size_t deadEntries = 0;				//< side table entries no annotation refers to any more
+	};
+
+	auto releaseAnnotation(uint32 annotation)->void;
+	auto compactSideTables()->void;
+
 	shared_ptr<const Source> source;
+	vector<shared_ptr<const Source>> retired;	//< sources spliced over which tokens stored in place still view
+	TokenStorage storage = TokenStorage::Tokens;
 	TokenVec tokens;
+	Compact compact;
 };
 
-}
\ No newline at end of file
+}
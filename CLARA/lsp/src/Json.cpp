@@ -0,0 +1,391 @@
+#include <CLARA/pch.h>
+#include "Json.h"
+
+using namespace CLARA;
+using namespace CLARA::LSP;
+
+namespace {
+
+const auto nullJson = Json{};
+const auto emptyString = string{};
+const auto emptyArray = Json::Array{};
+
+// arrays and objects are read recursively, so nesting is limited to keep the stack from overflowing
+constexpr auto maxDepth = 256_uz;
+
+/// Reads a JSON value from text, one character at a time.
+struct Reader {
+	string_view text;
+	size_t offset = 0;
+
+	auto skipWhiteSpace()
+	{
+		while (offset < text.size() && (text[offset] == ' ' || text[offset] == '\t' || text[offset] == '\n' || text[offset] == '\r'))
+			++offset;
+	}
+
+	auto peek()
+	{
+		skipWhiteSpace();
+		if (offset >= text.size())
+			throw JsonException("unexpected end of JSON");
+		return text[offset];
+	}
+
+	auto expect(char c)
+	{
+		if (peek() != c)
+			throw JsonException("unexpected character in JSON");
+		++offset;
+	}
+
+	auto consume(string_view word)
+	{
+		if (text.substr(offset, word.size()) != word)
+			throw JsonException("invalid JSON literal");
+		offset += word.size();
+	}
+
+	auto readHex()
+	{
+		if (offset + 4 > text.size())
+			throw JsonException("invalid JSON escape");
+
+		auto value = 0u;
+
+		for (auto i = 0; i < 4; ++i) {
+			auto c = text[offset++];
+			auto digit = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+			if (digit < 0)
+				throw JsonException("invalid JSON escape");
+			value = value * 16 + static_cast<uint>(digit);
+		}
+		return value;
+	}
+
+	auto appendUtf8(string& out, uint c)
+	{
+		if (c < 0x80) {
+			out += static_cast<char>(c);
+		}
+		else if (c < 0x800) {
+			out += static_cast<char>(0xC0 | (c >> 6));
+			out += static_cast<char>(0x80 | (c & 0x3F));
+		}
+		else if (c < 0x10000) {
+			out += static_cast<char>(0xE0 | (c >> 12));
+			out += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+			out += static_cast<char>(0x80 | (c & 0x3F));
+		}
+		else {
+			out += static_cast<char>(0xF0 | (c >> 18));
+			out += static_cast<char>(0x80 | ((c >> 12) & 0x3F));
+			out += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+			out += static_cast<char>(0x80 | (c & 0x3F));
+		}
+	}
+
+	auto readString()
+	{
+		expect('"');
+		auto out = string{};
+
+		while (true) {
+			// copy the run of plain characters in one go, most strings have no escapes at all
+			auto end = text.find_first_of("\"\\", offset);
+			if (end == string_view::npos)
+				throw JsonException("unterminated JSON string");
+
+			out.append(text.data() + offset, end - offset);
+			offset = end + 1;
+			if (text[end] == '"') break;
+			if (offset >= text.size())
+				throw JsonException("unterminated JSON string");
+
+			switch (auto c = text[offset++]) {
+			case '"': case '\\': case '/': out += c; break;
+			case 'b': out += '\b'; break;
+			case 'f': out += '\f'; break;
+			case 'n': out += '\n'; break;
+			case 'r': out += '\r'; break;
+			case 't': out += '\t'; break;
+			case 'u': {
+				auto code = readHex();
+
+				// a surrogate pair escapes a character outside the basic plane as two
+				if (code >= 0xD800 && code < 0xDC00 && text.substr(offset, 2) == "\\u") {
+					offset += 2;
+					auto low = readHex();
+					if (low < 0xDC00 || low >= 0xE000)
+						throw JsonException("invalid JSON surrogate pair");
+					code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+				}
+				else if (code >= 0xD800 && code < 0xE000) {
+					throw JsonException("invalid JSON surrogate pair");
+				}
+
+				appendUtf8(out, code);
+				break;
+			}
+			default:
+				throw JsonException("invalid JSON escape");
+			}
+		}
+		return out;
+	}
+
+	auto isDigit()
+	{
+		return offset < text.size() && text[offset] >= '0' && text[offset] <= '9';
+	}
+
+	auto readDigits()
+	{
+		if (!isDigit())
+			throw JsonException("invalid JSON number");
+		while (isDigit()) ++offset;
+	}
+
+	auto readNumber()->Json
+	{
+		auto start = offset;
+		auto integral = true;
+
+		// -?(0|[1-9][0-9]*)(.[0-9]+)?([eE][+-]?[0-9]+)?
+		if (offset < text.size() && text[offset] == '-') ++offset;
+
+		if (offset < text.size() && text[offset] == '0')
+			++offset;
+		else
+			readDigits();
+
+		if (offset < text.size() && text[offset] == '.') {
+			++offset;
+			readDigits();
+			integral = false;
+		}
+
+		if (offset < text.size() && (text[offset] == 'e' || text[offset] == 'E')) {
+			++offset;
+			if (offset < text.size() && (text[offset] == '+' || text[offset] == '-')) ++offset;
+			readDigits();
+			integral = false;
+		}
+
+		auto number = string{text.substr(start, offset - start)};
+
+		// integers too big for 64 bits are read as doubles, like other JSON readers do
+		if (integral) {
+			auto value = int64{};
+			auto result = std::from_chars(number.data(), number.data() + number.size(), value);
+			if (result.ec == std::errc{}) return Json{value};
+		}
+
+		try {
+			return Json{std::stod(number)};
+		}
+		catch (const std::out_of_range&) {
+			throw JsonException("JSON number out of range");
+		}
+	}
+
+	auto read(size_t depth = 0)->Json
+	{
+		if (depth > maxDepth)
+			throw JsonException("JSON nested too deeply");
+
+		switch (peek()) {
+		case 'n': consume("null"); return Json{};
+		case 't': consume("true"); return Json{true};
+		case 'f': consume("false"); return Json{false};
+		case '"': return Json{readString()};
+
+		case '[': {
+			++offset;
+			auto array = Json::Array{};
+			if (peek() == ']') {
+				++offset;
+				return Json{move(array)};
+			}
+
+			while (true) {
+				array.push_back(read(depth + 1));
+				if (peek() == ']') break;
+				expect(',');
+			}
+			++offset;
+			return Json{move(array)};
+		}
+
+		case '{': {
+			++offset;
+			auto object = Json::Object{};
+			if (peek() == '}') {
+				++offset;
+				return Json{move(object)};
+			}
+
+			while (true) {
+				auto key = readString();
+				expect(':');
+				object.emplace_back(move(key), read(depth + 1));
+				if (peek() == '}') break;
+				expect(',');
+			}
+			++offset;
+			return Json{move(object)};
+		}
+
+		default:
+			return readNumber();
+		}
+	}
+};
+
+auto appendString(fmt::memory_buffer& buffer, string_view text)
+{
+	buffer.push_back('"');
+
+	for (auto c : text) {
+		switch (c) {
+		case '"': buffer.append(string_view{"\\\""}); break;
+		case '\\': buffer.append(string_view{"\\\\"}); break;
+		case '\n': buffer.append(string_view{"\\n"}); break;
+		case '\r': buffer.append(string_view{"\\r"}); break;
+		case '\t': buffer.append(string_view{"\\t"}); break;
+		default:
+			if (static_cast<unsigned char>(c) < 0x20)
+				fmt::format_to(std::back_inserter(buffer), "\\u{:04x}", static_cast<uint>(c));
+			else
+				buffer.push_back(c);
+		}
+	}
+
+	buffer.push_back('"');
+}
+
+}
+
+auto Json::parse(string_view text)->Json
+{
+	auto reader = Reader{text};
+	auto value = reader.read();
+	reader.skipWhiteSpace();
+
+	if (reader.offset != text.size())
+		throw JsonException("unexpected text after JSON value");
+	return value;
+}
+
+auto Json::dump() const->string
+{
+	auto buffer = fmt::memory_buffer{};
+	dump(buffer);
+	return fmt::to_string(buffer);
+}
+
+auto Json::dump(fmt::memory_buffer& buffer) const->void
+{
+	std::visit(visitor{
+		[&](monostate) { buffer.append(string_view{"null"}); },
+		[&](bool value) { buffer.append(value ? string_view{"true"} : string_view{"false"}); },
+		[&](int64 value) { fmt::format_to(std::back_inserter(buffer), "{}", value); },
+		[&](double value) { fmt::format_to(std::back_inserter(buffer), "{}", value); },
+		[&](const string& value) { appendString(buffer, value); },
+		[&](const Array& array) {
+			buffer.push_back('[');
+			for (auto& element : array) {
+				if (&element != array.data()) buffer.push_back(',');
+				element.dump(buffer);
+			}
+			buffer.push_back(']');
+		},
+		[&](const Object& object) {
+			buffer.push_back('{');
+			for (auto& [key, value] : object) {
+				if (&key != &object.front().first) buffer.push_back(',');
+				appendString(buffer, key);
+				buffer.push_back(':');
+				value.dump(buffer);
+			}
+			buffer.push_back('}');
+		},
+	}, m_value);
+}
+
+auto Json::isNull() const->bool
+{
+	return std::holds_alternative<monostate>(m_value);
+}
+
+auto Json::isBool() const->bool
+{
+	return std::holds_alternative<bool>(m_value);
+}
+
+auto Json::isNumber() const->bool
+{
+	return std::holds_alternative<int64>(m_value) || std::holds_alternative<double>(m_value);
+}
+
+auto Json::isString() const->bool
+{
+	return std::holds_alternative<string>(m_value);
+}
+
+auto Json::isArray() const->bool
+{
+	return std::holds_alternative<Array>(m_value);
+}
+
+auto Json::isObject() const->bool
+{
+	return std::holds_alternative<Object>(m_value);
+}
+
+auto Json::getBool() const->bool
+{
+	auto value = std::get_if<bool>(&m_value);
+	return value && *value;
+}
+
+auto Json::getInt() const->int64
+{
+	if (auto value = std::get_if<int64>(&m_value))
+		return *value;
+	if (auto value = std::get_if<double>(&m_value))
+		return static_cast<int64>(*value);
+	return 0;
+}
+
+auto Json::getString() const->const string&
+{
+	auto value = std::get_if<string>(&m_value);
+	return value ? *value : emptyString;
+}
+
+auto Json::getArray() const->const Array&
+{
+	auto value = std::get_if<Array>(&m_value);
+	return value ? *value : emptyArray;
+}
+
+auto Json::operator[](string_view key) const->const Json&
+{
+	if (auto object = std::get_if<Object>(&m_value)) {
+		for (auto& [name, value] : *object) {
+			if (name == key) return value;
+		}
+	}
+	return nullJson;
+}
+
+auto Json::set(string key, Json value)->Json&
+{
+	if (isNull())
+		m_value = Object{};
+
+	auto& object = get<Object>(m_value);
+	object.emplace_back(move(key), move(value));
+	return *this;
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include <CLARA/Common.h>
+
+namespace CLARA::LSP {
+
+struct JsonException : std::runtime_error {
+	JsonException(const char* msg) : std::runtime_error(msg)
+	{ }
+};
+
+/// A JSON value, just enough of one for the messages of the language server protocol.
+class Json {
+public:
+	using Array = vector<Json>;
+	using Object = vector<pair<string, Json>>;          // members in the order they were added
+
+public:
+	Json() = default;
+	Json(std::nullptr_t) { }
+	Json(bool value) : m_value(value) { }
+	Json(int value) : m_value(static_cast<int64>(value)) { }
+	Json(uint value) : m_value(static_cast<int64>(value)) { }
+	Json(int64 value) : m_value(value) { }
+	Json(size_t value) : m_value(static_cast<int64>(value)) { }
+	Json(double value) : m_value(value) { }
+	Json(const char* value) : m_value(string{value}) { }
+	Json(string_view value) : m_value(string{value}) { }
+	Json(string value) : m_value(move(value)) { }
+	Json(Array value) : m_value(move(value)) { }
+	Json(Object value) : m_value(move(value)) { }
+
+	/**
+	 * Parse JSON text.
+	 *
+	 * @param  text The text.
+	 * @return The value.
+	 * @throws JsonException if the text isn't a single valid JSON value, or nests arrays and objects too deeply.
+	 */
+	static auto parse(string_view text)->Json;
+
+	/// Write the value as JSON text without white space.
+	auto dump() const->string;
+
+	auto isNull() const->bool;
+	auto isBool() const->bool;
+	auto isNumber() const->bool;
+	auto isString() const->bool;
+	auto isArray() const->bool;
+	auto isObject() const->bool;
+
+	/// Get a boolean, or false if the value isn't one.
+	auto getBool() const->bool;
+
+	/// Get a number as an integer, or 0 if the value isn't a number.
+	auto getInt() const->int64;
+
+	/// Get a string, or an empty one if the value isn't a string.
+	auto getString() const->const string&;
+
+	/// Get the elements of an array, or none if the value isn't an array.
+	auto getArray() const->const Array&;
+
+	/// Get a member of an object, or null if the value isn't an object or has no such member.
+	auto operator[](string_view key) const->const Json&;
+
+	/// Add a member to an object, turning a null value into an empty object first.
+	auto set(string key, Json value)->Json&;
+
+private:
+	auto dump(fmt::memory_buffer& buffer) const->void;
+
+private:
+	variant<monostate, bool, int64, double, string, Array, Object> m_value;
+};
+
+}
@@ -0,0 +1,417 @@
+#include <CLARA/pch.h>
+#include "Server.h"
+
+using namespace CLARA;
+using namespace CLARA::CLASM;
+using namespace CLARA::LSP;
+
+namespace {
+
+auto makePosition(const Document::Position& position)
+{
+	return Json{}.set("line", position.line).set("character", position.character);
+}
+
+auto makeRange(const Document::Range& range)
+{
+	return Json{}.set("start", makePosition(range.start)).set("end", makePosition(range.end));
+}
+
+auto getPosition(const Json& position)
+{
+	// negative numbers wrap around to huge ones, which are clamped to the end of the line or text
+	return Document::Position{static_cast<uint>(position["line"].getInt()), static_cast<uint>(position["character"].getInt())};
+}
+
+auto getRange(const Json& range)
+{
+	return Document::Range{getPosition(range["start"]), getPosition(range["end"])};
+}
+
+auto getSeverity(ReportType type)
+{
+	switch (type) {
+	case ReportType::Fatal:
+	case ReportType::Error:
+		return 1;
+	case ReportType::Warning:
+		return 2;
+	case ReportType::Info:
+		break;
+	}
+	return 3;
+}
+
+auto getMessage(const Diagnosis& diagnosis)
+{
+	auto message = diagnosis.getMessage();
+	return message.empty() ? string{diagnosis.getName()} : message;
+}
+
+}
+
+Server::Server(std::FILE* input, std::FILE* output) :
+	m_input(input), m_output(output)
+{
+	// edits are spliced into compact streams in a fraction of the time, and opening a big file may use every core
+	m_options.errorReporting = false;
+	m_options.tokenStorage = TokenStorage::Compact;
+	m_options.threads = 0;
+}
+
+auto Server::run()->int
+{
+	auto reader = std::thread{[this] { read(); }};
+	auto message = Message{};
+	auto exitCode = 1;
+
+	while (pop(message)) {
+		if (message.method == "exit") {
+			exitCode = m_shutdown ? 0 : 1;
+			break;
+		}
+
+		handle(message);
+	}
+
+	reader.join();
+	return exitCode;
+}
+
+auto Server::read()->void
+{
+	auto body = string{};
+
+	while (readBody(body)) {
+		auto message = Message{};
+
+		try {
+			message.json = Json::parse(body);
+		}
+		catch (const JsonException& e) {
+			respondError(Json{}, ErrorCode::ParseError, e.what());
+			continue;
+		}
+
+		message.method = message.json["method"].getString();
+		message.uri = message.json["params"]["textDocument"]["uri"].getString();
+
+		// cancelling has to overtake the queue to be of any use, so it's done here rather than by the handler
+		if (message.method == "$/cancelRequest") {
+			cancel(message.json["params"]["id"]);
+			continue;
+		}
+
+		auto exit = message.method == "exit";
+		push(move(message));
+		if (exit) break;
+	}
+
+	auto lock = std::lock_guard{m_mutex};
+	m_closed = true;
+	m_received.notify_one();
+}
+
+auto Server::cancel(const Json& id)->void
+{
+	auto key = id.dump();
+	auto lock = std::lock_guard{m_mutex};
+
+	for (auto& message : m_queue) {
+		if (message.json["id"].dump() == key)
+			message.cancelled = true;
+	}
+}
+
+auto Server::readBody(string& body)->bool
+{
+	constexpr auto contentLength = "Content-Length:"sv;
+	auto length = optional<size_t>{};
+	char line[1024];
+
+	// headers end at an empty line, and only the length of the content is of any interest
+	while (std::fgets(line, sizeof(line), m_input)) {
+		auto header = string_view{line};
+
+		if (header == "\r\n" || header == "\n") {
+			if (length) break;
+			continue;
+		}
+
+		if (header.substr(0, contentLength.size()) == contentLength) {
+			auto value = header.substr(contentLength.size());
+			auto start = value.find_first_not_of(' ');
+			auto size = 0_uz;
+			if (start == string_view::npos) continue;
+
+			auto result = std::from_chars(value.data() + start, value.data() + value.size(), size);
+			if (result.ec == std::errc{}) length = size;
+		}
+	}
+
+	if (!length) return false;
+
+	body.resize(*length);
+	return std::fread(body.data(), 1, body.size(), m_input) == body.size();
+}
+
+auto Server::write(const Json& message)->void
+{
+	auto body = message.dump();
+	auto lock = std::lock_guard{m_writeMutex};
+	fmt::print(m_output, "Content-Length: {}\r\n\r\n{}", body.size(), body);
+	std::fflush(m_output);
+}
+
+auto Server::respond(const Json& id, Json result)->void
+{
+	write(Json{}.set("jsonrpc", "2.0").set("id", id).set("result", move(result)));
+}
+
+auto Server::respondError(const Json& id, ErrorCode code, string_view message)->void
+{
+	auto error = Json{}.set("code", static_cast<int>(code)).set("message", message);
+	write(Json{}.set("jsonrpc", "2.0").set("id", id).set("error", move(error)));
+}
+
+auto Server::push(Message&& message)->void
+{
+	auto lock = std::lock_guard{m_mutex};
+	if (message.method == "textDocument/didChange")
+		++m_queuedChanges[message.uri];
+
+	m_queue.push_back(move(message));
+	m_received.notify_one();
+}
+
+auto Server::pop(Message& message)->bool
+{
+	auto lock = std::unique_lock{m_mutex};
+	m_received.wait(lock, [this] { return !m_queue.empty() || m_closed; });
+	if (m_queue.empty()) return false;
+
+	message = move(m_queue.front());
+	m_queue.pop_front();
+
+	if (message.method == "textDocument/didChange") {
+		auto it = m_queuedChanges.find(message.uri);
+		if (!--it->second) m_queuedChanges.erase(it);
+	}
+	return true;
+}
+
+auto Server::isStale(const string& uri)->bool
+{
+	auto lock = std::lock_guard{m_mutex};
+	return m_queuedChanges.count(uri) != 0;
+}
+
+auto Server::handle(const Message& message)->void
+{
+	auto& id = message.json["id"];
+	auto& params = message.json["params"];
+
+	if (id.isNull()) {
+		try {
+			handleNotification(message.method, params);
+		}
+		catch (const std::exception& e) {
+			fmt::print(stderr, "clara-lsp: {}: {}\n", message.method, e.what());
+		}
+		return;
+	}
+
+	if (message.cancelled)
+		return respondError(id, ErrorCode::RequestCancelled, "request cancelled");
+	if (!message.uri.empty() && isStale(message.uri))
+		return respondError(id, ErrorCode::ContentModified, "document changed");
+
+	try {
+		respond(id, handleRequest(message.method, params));
+	}
+	catch (const ResponseError& e) {
+		respondError(id, e.code, e.what());
+	}
+	catch (const std::exception& e) {
+		respondError(id, ErrorCode::InternalError, e.what());
+	}
+}
+
+auto Server::handleNotification(const string& method, const Json& params)->void
+{
+	if (!m_initialized || m_shutdown) return;
+
+	if (method == "textDocument/didOpen")
+		didOpen(params);
+	else if (method == "textDocument/didChange")
+		didChange(params);
+	else if (method == "textDocument/didClose")
+		didClose(params);
+}
+
+auto Server::handleRequest(const string& method, const Json& params)->Json
+{
+	if (method == "initialize")
+		return initialize(params);
+	if (!m_initialized)
+		throw ResponseError(ErrorCode::ServerNotInitialized, "server not initialized");
+	if (m_shutdown)
+		throw ResponseError(ErrorCode::InvalidRequest, "server is shutting down");
+
+	if (method == "shutdown") {
+		m_shutdown = true;
+		m_documents.clear();
+		return Json{};
+	}
+	if (method == "textDocument/definition")
+		return definition(params);
+	if (method == "textDocument/references")
+		return references(params);
+
+	throw ResponseError(ErrorCode::MethodNotFound, "method not found");
+}
+
+auto Server::initialize(const Json&)->Json
+{
+	if (m_initialized)
+		throw ResponseError(ErrorCode::InvalidRequest, "server already initialized");
+
+	m_initialized = true;
+
+	auto sync = Json{}.set("openClose", true).set("change", 2);
+	auto capabilities = Json{}
+		.set("positionEncoding", "utf-16")
+		.set("textDocumentSync", move(sync))
+		.set("definitionProvider", true)
+		.set("referencesProvider", true);
+	auto version = fmt::format("{}.{}.{}", VERSION_MAJOR, VERSION_MINOR, VERSION_PATCH);
+	return Json{}
+		.set("capabilities", move(capabilities))
+		.set("serverInfo", Json{}.set("name", "clara-lsp").set("version", version));
+}
+
+auto Server::didOpen(const Json& params)->void
+{
+	auto& item = params["textDocument"];
+	auto& uri = item["uri"].getString();
+	auto document = OpenDocument{Document{uri, item["text"].getString(), m_options}, item["version"].getInt()};
+	auto it = m_documents.insert_or_assign(uri, move(document)).first;
+	publishDiagnostics(uri, it->second);
+}
+
+auto Server::didChange(const Json& params)->void
+{
+	auto& uri = params["textDocument"]["uri"].getString();
+	auto& document = getDocument(params);
+	document.version = params["textDocument"]["version"].getInt();
+
+	for (auto& change : params["contentChanges"].getArray()) {
+		if (change["range"].isNull())
+			document.document.setText(change["text"].getString());
+		else
+			document.document.edit(getRange(change["range"]), change["text"].getString());
+	}
+
+	// a run of changes waiting in the queue is parsed once, by the last of them
+	if (!isStale(uri))
+		update(uri, document);
+}
+
+auto Server::didClose(const Json& params)->void
+{
+	auto& uri = params["textDocument"]["uri"].getString();
+	m_documents.erase(uri);
+
+	writeDiagnostics(uri, Json{}, Json::Array{});
+}
+
+auto Server::definition(const Json& params)->Json
+{
+	auto& uri = params["textDocument"]["uri"].getString();
+	auto& document = getDocument(params);
+	if (document.document.isEdited())
+		update(uri, document);
+
+	auto offset = document.document.getOffset(getPosition(params["position"]));
+	auto label = document.document.findLabel(offset);
+	if (!label) return Json{};
+
+	return makeLocation(uri, document, document.document.getDefinition(*label));
+}
+
+auto Server::references(const Json& params)->Json
+{
+	auto& uri = params["textDocument"]["uri"].getString();
+	auto& document = getDocument(params);
+	if (document.document.isEdited())
+		update(uri, document);
+
+	auto locations = Json::Array{};
+	auto offset = document.document.getOffset(getPosition(params["position"]));
+	auto label = document.document.findLabel(offset);
+	if (!label) return locations;
+
+	for (auto& token : document.document.findReferences(*label, params["context"]["includeDeclaration"].getBool()))
+		locations.push_back(makeLocation(uri, document, token));
+	return locations;
+}
+
+auto Server::getDocument(const Json& params)->OpenDocument&
+{
+	auto it = m_documents.find(params["textDocument"]["uri"].getString());
+	if (it == m_documents.end())
+		throw ResponseError(ErrorCode::InvalidParams, "document isn't open");
+	return it->second;
+}
+
+auto Server::update(const string& uri, OpenDocument& document)->void
+{
+	try {
+		document.document.update();
+	}
+	catch (const std::runtime_error& e) {
+		// the edits are kept, so the text stays the client's, and requests are answered from the last parse until
+		// an update succeeds
+		auto diagnostic = Json{}
+			.set("range", makeRange(Document::Range{}))
+			.set("severity", getSeverity(ReportType::Error))
+			.set("source", "clara")
+			.set("message", e.what());
+		writeDiagnostics(uri, Json{document.version}, Json::Array{move(diagnostic)});
+		return;
+	}
+
+	publishDiagnostics(uri, document);
+}
+
+auto Server::publishDiagnostics(const string& uri, const OpenDocument& document)->void
+{
+	auto diagnostics = Json::Array{};
+	auto& result = document.document.getResult();
+	diagnostics.reserve(result.reports.size());
+
+	for (auto& report : result.reports) {
+		diagnostics.push_back(Json{}
+			.set("range", makeRange(document.document.getRange(report.token)))
+			.set("severity", getSeverity(report.type))
+			.set("code", fmt::format("E{:04}", report.diagnosis.getCodeInt()))
+			.set("source", "clara")
+			.set("message", getMessage(report.diagnosis)));
+	}
+
+	writeDiagnostics(uri, Json{document.version}, move(diagnostics));
+}
+
+auto Server::writeDiagnostics(const string& uri, Json version, Json::Array diagnostics)->void
+{
+	auto notification = Json{}.set("uri", uri);
+	if (!version.isNull())
+		notification.set("version", move(version));
+	notification.set("diagnostics", move(diagnostics));
+	write(Json{}.set("jsonrpc", "2.0").set("method", "textDocument/publishDiagnostics").set("params", move(notification)));
+}
+
+auto Server::makeLocation(const string& uri, const OpenDocument& document, const Source::Token& token) const->Json
+{
+	return Json{}.set("uri", uri).set("range", makeRange(document.document.getRange(token)));
+}
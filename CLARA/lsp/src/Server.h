@@ -0,0 +1,113 @@
+#pragma once
+#include <CLARA/Common.h>
+#include <CLARA/Document.h>
+#include <CLARA/Parser.h>
+#include <deque>
+#include "Json.h"
+
+namespace CLARA::LSP {
+
+/// Error codes of responses, from JSON-RPC and the language server protocol.
+enum class ErrorCode {
+	ParseError = -32700,
+	InvalidRequest = -32600,
+	MethodNotFound = -32601,
+	InvalidParams = -32602,
+	InternalError = -32603,
+	ServerNotInitialized = -32002,
+	RequestCancelled = -32800,
+	ContentModified = -32801,
+};
+
+/// Thrown by a request handler to respond with an error.
+struct ResponseError : std::runtime_error {
+	ErrorCode code;
+
+	ResponseError(ErrorCode code, const char* msg) : std::runtime_error(msg), code(code)
+	{ }
+};
+
+/**
+ * A language server for CLASM sources, talking JSON-RPC over a pair of streams.
+ *
+ * Every open document stays parsed, and requests about it are answered from the parse. Messages are read on a thread
+ * of their own while the last ones are handled, so the server can tell when work has gone stale: a change is only
+ * parsed if no later change to the same document is waiting, and a request about a document with a later change
+ * waiting is answered with ContentModified instead of from a version the client has moved on from. Requests the
+ * client cancels before they're handled are answered with RequestCancelled.
+ */
+class Server {
+public:
+	/**
+	 * Make a server talking over a pair of streams.
+	 *
+	 * @param  input  The stream messages are read from.
+	 * @param  output The stream messages are written to.
+	 */
+	Server(std::FILE* input, std::FILE* output);
+
+	/**
+	 * Handle messages until the client says to exit or closes the input.
+	 *
+	 * @return The exit code of the server, which is 0 only if the client shut it down before it exited.
+	 */
+	auto run()->int;
+
+private:
+	struct Message {
+		Json json;
+		string method;
+		string uri;                                     //< the document the message is about, if any
+		bool cancelled = false;
+	};
+
+	struct OpenDocument {
+		CLASM::Document document;
+		int64 version = 0;
+	};
+
+	auto read()->void;
+	auto cancel(const Json& id)->void;
+	auto readBody(string& body)->bool;
+	auto write(const Json& message)->void;
+	auto respond(const Json& id, Json result)->void;
+	auto respondError(const Json& id, ErrorCode code, string_view message)->void;
+
+	auto push(Message&& message)->void;
+	auto pop(Message& message)->bool;
+	auto isStale(const string& uri)->bool;
+
+	auto handle(const Message& message)->void;
+	auto handleNotification(const string& method, const Json& params)->void;
+	auto handleRequest(const string& method, const Json& params)->Json;
+
+	auto initialize(const Json& params)->Json;
+	auto didOpen(const Json& params)->void;
+	auto didChange(const Json& params)->void;
+	auto didClose(const Json& params)->void;
+	auto definition(const Json& params)->Json;
+	auto references(const Json& params)->Json;
+
+	auto getDocument(const Json& params)->OpenDocument&;
+	auto update(const string& uri, OpenDocument& document)->void;
+	auto publishDiagnostics(const string& uri, const OpenDocument& document)->void;
+	auto writeDiagnostics(const string& uri, Json version, Json::Array diagnostics)->void;
+	auto makeLocation(const string& uri, const OpenDocument& document, const CLASM::Source::Token& token) const->Json;
+
+private:
+	std::FILE* m_input;
+	std::FILE* m_output;
+	CLASM::Parser::Options m_options;
+	std::unordered_map<string, OpenDocument> m_documents;
+	bool m_initialized = false;
+	bool m_shutdown = false;
+
+	std::mutex m_writeMutex;                            //< keeps messages written from both threads whole
+	std::mutex m_mutex;                                 //< guards everything below, shared with the reading thread
+	std::condition_variable m_received;
+	std::deque<Message> m_queue;
+	std::unordered_map<string, size_t> m_queuedChanges; //< number of changes waiting in the queue, by document
+	bool m_closed = false;                              //< whether the reading thread is done
+};
+
+}
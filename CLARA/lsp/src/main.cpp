@@ -0,0 +1,21 @@
+#include <CLARA/pch.h>
+#include "Server.h"
+
+#if defined(CLASM_SYSTEM_WINDOWS)
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+using namespace CLARA;
+
+int main()
+{
+#if defined(CLASM_SYSTEM_WINDOWS)
+	// message lengths are counted in bytes, which line ending translation would throw off
+	_setmode(_fileno(stdin), _O_BINARY);
+	_setmode(_fileno(stdout), _O_BINARY);
+#endif
+
+	auto server = LSP::Server{stdin, stdout};
+	return server.run();
+}
@@ -4,13 +4,15 @@
 using namespace CLARA;
 using namespace CLARA::CLASM;
 
-const auto keywords = array<string, Keyword::MAX>{
+namespace {
+
+constexpr auto keywordNames = array<string_view, Keyword::MAX>{
 	/* Global  */ "global",
 	/* Extern  */ "extern",
 	/* Import  */ "import",
 	/* Include */ "include",
 };
-const auto mnemonics = array<string, Mnemonic::MAX>{
+constexpr auto mnemonicNames = array<string_view, Mnemonic::MAX>{
 	/* PUSH  */ "push",
 	/* PUSHA */ "pusha",
 	/* POP   */ "pop",
@@ -18,212 +20,148 @@ const auto mnemonics = array<string, Mnemonic::MAX>{
 	/* JMP   */ "jmp",
 	/* CALL  */ "call",
 };
-const auto mnemonicTable = array<vector<InstructionOverload>, static_cast<size_t>(Mnemonic::MAX)>{{
-	/* PUSH */ {
-		{Instruction::PUSHN,  {}},
-		{Instruction::PUSHB,  {OperandType::IMM8}},
-		{Instruction::PUSHW,  {OperandType::IMM16}},
-		{Instruction::PUSHD,  {OperandType::IMM32}},
-		{Instruction::PUSHQ,  {OperandType::IMM64}},
-		{Instruction::PUSHF,  {OperandType::IMM32}},
-		{Instruction::PUSHQF, {OperandType::IMM64}},
-	},
-	/* PUSHA */ {
-		{Instruction::PUSHAB, {OperandType::IMM8}},
-		{Instruction::PUSHAW, {OperandType::IMM16}},
-		{Instruction::PUSHAD, {OperandType::IMM32}},
-		{Instruction::PUSHAQ, {OperandType::IMM32}},
-		{Instruction::PUSHAF, {OperandType::IMM32}},
-	},
-	/* POP */ {
-		{Instruction::POP,    {OperandType::IMM8}},
-		{Instruction::POPLN,  {OperandType::LV8}},
-		{Instruction::POPL,   {OperandType::LV16}},
-		{Instruction::POPLE,  {OperandType::LV32}},
-		{Instruction::POPV,   {OperandType::LV16}},
-		{Instruction::POPVE,  {OperandType::LV32}},
-	},
-	/* DUP */ {
-		{Instruction::DUP,    {}},
-		{Instruction::DUPE,   {OperandType::IMM8}},
-	},
-	/* JMP */ {
-		{Instruction::JMP,    {}},
-		{Instruction::JMPD,   {OperandType::REL32}},
-	},
-	/* CALL */ {
-		{Instruction::CALL,   {}},
-		{Instruction::CALLD,  {OperandType::REL32}},
-	},
-}};
-const auto instructionMap = unordered_map<string, Instruction::Type>{
-	{"nop",     Instruction::NOP},
-	{"break",   Instruction::BREAK},
-	{"throw",   Instruction::THROW},
-	{"pushn",   Instruction::PUSHN},
-	{"pushb",   Instruction::PUSHB},
-	{"pushw",   Instruction::PUSHW},
-	{"pushd",   Instruction::PUSHD},
-	{"pushf",   Instruction::PUSHF},
-	{"pushab",  Instruction::PUSHAB},
-	{"pushaw",  Instruction::PUSHAW},
-	{"pushaf",  Instruction::PUSHAF},
-	{"pushs",   Instruction::PUSHS},
-	{"pop",     Instruction::POP},
-	{"popln",   Instruction::POPLN},
-	{"popl",    Instruction::POPL},
-	{"pople",   Instruction::POPLE},
-	{"popv",    Instruction::POPV},
-	{"popve",   Instruction::POPVE},
-	{"swap",    Instruction::SWAP},
-	{"dup",     Instruction::DUP},
-	{"dupe",    Instruction::DUPE},
-	{"local",   Instruction::LOCAL},
-	{"global",  Instruction::GLOBAL},
-	{"array",   Instruction::ARRAY},
-	{"exf",     Instruction::EXF},
-	{"inc",     Instruction::INC},
-	{"dec",     Instruction::DEC},
-	{"add",     Instruction::ADD},
-	{"sub",     Instruction::SUB},
-	{"mul",     Instruction::MUL},
-	{"div",     Instruction::DIV},
-	{"mod",     Instruction::MOD},
-	{"not",     Instruction::NOT},
-	{"and",     Instruction::AND},
-	{"or",      Instruction::OR},
-	{"xor",     Instruction::XOR},
-	{"shl",     Instruction::SHL},
-	{"shr",     Instruction::SHR},
-	{"neg",     Instruction::NEG},
-	{"toi",     Instruction::TOI},
-	{"tof",     Instruction::TOF},
-	{"cmpnn",   Instruction::CMPNN},
-	{"cmpe",    Instruction::CMPE},
-	{"cmpne",   Instruction::CMPNE},
-	{"cmpge",   Instruction::CMPGE},
-	{"cmple",   Instruction::CMPLE},
-	{"cmpg",    Instruction::CMPG},
-	{"cmpl",    Instruction::CMPL},
-	{"if",      Instruction::IF},
-	{"eval",    Instruction::EVAL},
-	{"jt",      Instruction::JT},
-	{"jnt",     Instruction::JNT},
-	{"jmp",     Instruction::JMP},
-	{"jmpd",    Instruction::JMPD},
-	{"switch",  Instruction::SWITCH},
-	{"rswitch", Instruction::RSWITCH},
-	{"call",    Instruction::CALL},
-	{"calld",   Instruction::CALLD},
-	{"enter",   Instruction::ENTER},
-	{"ret",     Instruction::RET},
-	{"read",    Instruction::READ},
-	{"write",   Instruction::WRITE},
-	{"copy",    Instruction::COPY},
-	{"fill",    Instruction::FILL},
-	{"comp",    Instruction::COMP},
-	{"native",  Instruction::NATIVE},
-	{"cmd",     Instruction::CMD},
-	{"cdecl",   Instruction::CDECL},
-	{"stdc",    Instruction::STDC},
-	{"thisc",   Instruction::THISC},
-	{"fastc",   Instruction::FASTC},
+constexpr auto dataTypeNames = array<string_view, DataType::MAX>{
+	/* DB */ "DB",
+	/* DW */ "DW",
+	/* DD */ "DD",
+	/* DQ */ "DQ",
+	/* DS */ "DS",
+};
+constexpr auto segmentNames = array<string_view, Segment::MAX>{
+	/* Header */ "",
+	/* Data   */ "data",
+	/* Code   */ "code",
+};
+
+constexpr auto maxReservedWords = size_t{Keyword::MAX + Mnemonic::MAX + Instruction::MAX + DataType::MAX + Segment::MAX};
+
+struct ReservedWordList {
+	array<ReservedWord, maxReservedWords> words{};
+	size_t size = 0;
+	size_t maxLength = 0;
+
+	constexpr auto add(string_view name)->ReservedWord&
+	{
+		for (auto i = 0_uz; i < size; ++i) {
+			if (words[i].name == name)
+				return words[i];
+		}
+
+		maxLength = std::max(maxLength, name.size());
+		words[size].name = name;
+		return words[size++];
+	}
 };
 
-auto DataType::fromName(const string& name)->DataType::Type
+// merges every category into one entry per name, e.g. "pop" is both a mnemonic and an instruction
+constexpr auto makeReservedWords()
 {
-	if (name.size() == 2 && name[0] == 'D') {
-		switch (name[1]) {
-		case 'B': return DataType::DB;
-		case 'W': return DataType::DW;
-		case 'D': return DataType::DD;
-		case 'Q': return DataType::DQ;
-		case 'S': return DataType::DS;
+	auto list = ReservedWordList{};
+	for (auto i = 0_uz; i < keywordNames.size(); ++i)
+		list.add(keywordNames[i]).keyword = static_cast<Keyword::Type>(i);
+	for (auto i = 0_uz; i < mnemonicNames.size(); ++i)
+		list.add(mnemonicNames[i]).mnemonic = static_cast<Mnemonic::Type>(i);
+	for (auto& info : InstructionSet::instructions)
+		list.add(info.name).instruction = info.type;
+	for (auto i = 0_uz; i < dataTypeNames.size(); ++i)
+		list.add(dataTypeNames[i]).dataType = static_cast<DataType::Type>(i);
+	for (auto i = 0_uz; i < segmentNames.size(); ++i) {
+		if (!segmentNames[i].empty())
+			list.add(segmentNames[i]).segment = static_cast<Segment::Type>(i);
+	}
+	return list;
+}
+
+constexpr auto reservedWords = makeReservedWords();
+
+// FNV-1a, seeded so that a collision-free seed can be searched for
+constexpr auto hashName(string_view name, uint32 seed)
+{
+	auto hash = 2166136261u ^ seed;
+	for (auto c : name) {
+		hash ^= static_cast<uint8>(c);
+		hash *= 16777619u;
+	}
+	return hash ^ (hash >> 16);
+}
+
+struct PerfectHash {
+	static constexpr auto size = 1024_uz;
+	static constexpr auto empty = uint8{0xFF};
+
+	uint32 seed = 0;
+	array<uint8, size> slots{};
+
+	constexpr auto getSlot(string_view name) const
+	{
+		return slots[hashName(name, seed) & (size - 1)];
+	}
+};
+
+static_assert(reservedWords.size < PerfectHash::empty, "too many reserved words for 8-bit slots");
+
+constexpr auto makePerfectHash()
+{
+	for (auto seed = 0u; seed < 10000u; ++seed) {
+		auto hash = PerfectHash{};
+		hash.seed = seed;
+		for (auto& slot : hash.slots) slot = PerfectHash::empty;
+
+		auto i = 0_uz;
+		for (; i < reservedWords.size; ++i) {
+			auto& slot = hash.slots[hashName(reservedWords.words[i].name, seed) & (PerfectHash::size - 1)];
+			if (slot != PerfectHash::empty) break;
+			slot = static_cast<uint8>(i);
 		}
+		if (i == reservedWords.size)
+			return hash;
 	}
-	return DataType::MAX;
+	throw std::logic_error("no perfect hash seed found for the reserved words");
 }
 
-auto Keyword::fromName(const string& name)->Keyword::Type
+constexpr auto reservedWordHash = makePerfectHash();
+
+}
+
+auto ReservedWord::fromName(string_view name)->const ReservedWord*
 {
-	static_assert(keywords.size() == Keyword::MAX);
-	auto idx = findIndexIf(keywords.begin(), keywords.end(), [&](const auto& val) {
-		return val == name;
-	});
-	return static_cast<Keyword::Type>(idx);
+	if (name.size() > reservedWords.maxLength)
+		return nullptr;
+
+	auto slot = reservedWordHash.getSlot(name);
+	if (slot == PerfectHash::empty)
+		return nullptr;
+
+	auto& word = reservedWords.words[slot];
+	return word.name == name ? &word : nullptr;
 }
 
-auto Instruction::fromName(const string& name)->Instruction::Type
+auto DataType::fromName(string_view name)->DataType::Type
 {
-	auto it = instructionMap.find(name);
-	return it != instructionMap.end() ? it->second : Instruction::MAX;
+	auto word = ReservedWord::fromName(name);
+	return word ? word->dataType : DataType::MAX;
 }
 
-auto Mnemonic::fromName(const string& name)->Mnemonic::Type
+auto Keyword::fromName(string_view name)->Keyword::Type
 {
-	static_assert(mnemonics.size() == Mnemonic::MAX);
-	auto idx = findIndexIf(mnemonics.begin(), mnemonics.end(), [&](const auto& val) {
-		return val == name;
-	});
-	return static_cast<Mnemonic::Type>(idx);
+	auto word = ReservedWord::fromName(name);
+	return word ? word->keyword : Keyword::MAX;
 }
 
-auto Segment::fromName(string_view name)->Segment::Type
+auto Instruction::fromName(string_view name)->Instruction::Type
 {
-	if (name == "code") return Segment::Code;
-	if (name == "data") return Segment::Data;
-	return Segment::MAX;
+	auto word = ReservedWord::fromName(name);
+	return word ? word->instruction : Instruction::MAX;
 }
 
-const auto noOperands = vector<InstructionOperand>{};
-const auto operandsImm8 = vector<InstructionOperand>{{{OperandType::IMM8}}};
-const auto operandsImm16 = vector<InstructionOperand>{{{OperandType::IMM16}}};
-const auto operandsImm32 = vector<InstructionOperand>{{{OperandType::IMM32}}};
-const auto operandsImm64 = vector<InstructionOperand>{{{OperandType::IMM64}}};
-const auto operandsS32 = vector<InstructionOperand>{{{OperandType::S32}}};
-const auto operandsLv8 = vector<InstructionOperand>{{{OperandType::LV8}}};
-const auto operandsLv16 = vector<InstructionOperand>{{{OperandType::LV16}}};
-const auto operandsLv32 = vector<InstructionOperand>{{{OperandType::LV32}}};
-const auto operandsV16 = vector<InstructionOperand>{{{OperandType::V16}}};
-const auto operandsV32 = vector<InstructionOperand>{{{OperandType::V32}}};
-const auto operandsRel32 = vector<InstructionOperand>{{{OperandType::REL32}}};
-const auto switchOperands = vector<InstructionOperand>{{{OperandType::IMM16}}, {{OperandType::IMM32}}};
-
-auto Instruction::getOperands(Type type)->const vector<InstructionOperand>&
+auto Mnemonic::fromName(string_view name)->Mnemonic::Type
 {
-	switch (type) {
-	case THROW:
-	case PUSHB:
-	case POP:
-	case DUPE:
-	case ARRAY:
-	case EVAL:
-	case ENTER:
-	case READ:
-	case WRITE: return operandsImm8;
-	case PUSHW: return operandsImm16;
-	case PUSHD:
-	case NATIVE:
-	case CMD: return operandsImm32;
-	case PUSHQ:
-	case PUSHQF: return operandsImm64;
-	case PUSHS: return operandsS32;
-	case POPLN: return operandsLv8;
-	case POPL: return operandsLv16;
-	case POPLE: return operandsLv32;
-	case POPV: return operandsV16;
-	case POPVE: return operandsV32;
-	case JT:
-	case JNT:
-	case JMPD:
-	case CALLD: return operandsRel32;
-	case SWITCH: break;
-	default: break;
-	}
-	return noOperands;
+	auto word = ReservedWord::fromName(name);
+	return word ? word->mnemonic : Mnemonic::MAX;
 }
 
-auto Mnemonic::getOverloads(Mnemonic::Type type)->const vector<InstructionOverload>&
+auto Segment::fromName(string_view name)->Segment::Type
 {
-	return mnemonicTable[static_cast<std::underlying_type_t<Mnemonic::Type>>(type)];
+	auto word = ReservedWord::fromName(name);
+	return word ? word->segment : Segment::MAX;
 }
\ No newline at end of file
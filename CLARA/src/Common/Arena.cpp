@@ -0,0 +1,100 @@
+#include <CLARA/pch.h>
+#include <CLARA/Common/Arena.h>
+#include <utility>
+
+namespace CLARA {
+
+Arena::Arena(Arena&& other) noexcept :
+	blockSize(other.blockSize),
+	blocks(move(other.blocks)),
+	nextIndex(std::exchange(other.nextIndex, 0)),
+	ptr(std::exchange(other.ptr, nullptr)),
+	end(std::exchange(other.end, nullptr)),
+	used(std::exchange(other.used, 0)),
+	capacity(std::exchange(other.capacity, 0)),
+	finalizers(std::exchange(other.finalizers, nullptr))
+{
+	other.blocks.clear();
+}
+
+Arena::~Arena()
+{
+	runFinalizers();
+}
+
+auto Arena::operator=(Arena&& other) noexcept->Arena&
+{
+	if (this != &other) {
+		runFinalizers();
+		blockSize = other.blockSize;
+		blocks = move(other.blocks);
+		other.blocks.clear();
+		nextIndex = std::exchange(other.nextIndex, 0);
+		ptr = std::exchange(other.ptr, nullptr);
+		end = std::exchange(other.end, nullptr);
+		used = std::exchange(other.used, 0);
+		capacity = std::exchange(other.capacity, 0);
+		finalizers = std::exchange(other.finalizers, nullptr);
+	}
+	return *this;
+}
+
+auto Arena::allocate(size_t size, size_t align)->void*
+{
+	assert(align && (align & (align - 1)) == 0);
+
+	for (;;) {
+		auto address = reinterpret_cast<uintptr_t>(ptr);
+		auto padding = (align - (address & (align - 1))) & (align - 1);
+
+		if (ptr && static_cast<size_t>(end - ptr) >= size + padding) {
+			auto result = ptr + padding;
+			ptr = result + size;
+			used += size + padding;
+			return result;
+		}
+
+		nextBlock(size + align);
+	}
+}
+
+auto Arena::reset()->void
+{
+	runFinalizers();
+	nextIndex = 0;
+	ptr = end = nullptr;
+	used = 0;
+}
+
+auto Arena::nextBlock(size_t minSize)->void
+{
+	// blocks kept from before a reset are reused in order, any too small for this request are skipped until the next one
+	for (; nextIndex < blocks.size(); ++nextIndex) {
+		auto& block = blocks[nextIndex];
+
+		if (block.size >= minSize) {
+			ptr = block.data.get();
+			end = ptr + block.size;
+			++nextIndex;
+			return;
+		}
+	}
+
+	auto size = std::max(blockSize, minSize);
+	auto& block = blocks.emplace_back(Block{unique_ptr<std::byte[]>(new std::byte[size]), size});
+	capacity += size;
+	nextIndex = blocks.size();
+	ptr = block.data.get();
+	end = ptr + size;
+}
+
+auto Arena::runFinalizers() noexcept->void
+{
+	// most recently created objects first, as they may refer to earlier ones
+	for (auto finalizer = finalizers; finalizer; finalizer = finalizer->next) {
+		finalizer->destroy(finalizer->object);
+	}
+	finalizers = nullptr;
+}
+
+}
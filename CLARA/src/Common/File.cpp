@@ -0,0 +1,119 @@
+#include <CLARA/pch.h>
+#include <CLARA/Common/File.h>
+
+#if defined(CLASM_SYSTEM_WINDOWS)
+#include <io.h>
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace CLARA;
+using namespace CLARA::CLASM;
+
+namespace {
+
+[[noreturn]] auto throwMapError(int error, const std::filesystem::path& path, const char* what)
+{
+	throw std::system_error{error, std::system_category(), fmt::format("{} '{}'", what, path.string())};
+}
+
+}
+
+namespace CLARA::CLASM {
+
+auto isTerminal(std::FILE* stream)->bool
+{
+#if defined(CLASM_SYSTEM_WINDOWS)
+	return _isatty(_fileno(stream)) != 0;
+#else
+	return ::isatty(::fileno(stream)) != 0;
+#endif
+}
+
+}
+
+#if defined(CLASM_SYSTEM_WINDOWS)
+MappedFile::MappedFile(const fs::path& path)
+{
+	auto file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		throwMapError(static_cast<int>(GetLastError()), path, "failed to open");
+
+	auto size = LARGE_INTEGER{};
+	if (!GetFileSizeEx(file, &size)) {
+		auto error = GetLastError();
+		CloseHandle(file);
+		throwMapError(static_cast<int>(error), path, "failed to get the size of");
+	}
+
+	m_size = static_cast<size_t>(size.QuadPart);
+
+	// empty files can't be mapped, and there's nothing to map anyway
+	if (m_size) {
+		auto mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		auto error = GetLastError();
+		CloseHandle(file);
+		if (!mapping)
+			throwMapError(static_cast<int>(error), path, "failed to map");
+
+		m_data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+		error = GetLastError();
+		CloseHandle(mapping);
+		if (!m_data)
+			throwMapError(static_cast<int>(error), path, "failed to map");
+	}
+	else {
+		CloseHandle(file);
+	}
+}
+
+MappedFile::~MappedFile()
+{
+	if (m_data) UnmapViewOfFile(m_data);
+}
+#else
+MappedFile::MappedFile(const fs::path& path)
+{
+	auto file = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (file < 0)
+		throwMapError(errno, path, "failed to open");
+
+	struct stat info;
+	if (::fstat(file, &info) != 0) {
+		auto error = errno;
+		::close(file);
+		throwMapError(error, path, "failed to get the size of");
+	}
+
+	m_size = static_cast<size_t>(info.st_size);
+
+	// empty files can't be mapped, and there's nothing to map anyway
+	if (m_size) {
+		auto data = ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, file, 0);
+		auto error = errno;
+		::close(file);
+		if (data == MAP_FAILED)
+			throwMapError(error, path, "failed to map");
+
+		::posix_madvise(data, m_size, POSIX_MADV_SEQUENTIAL);
+		m_data = static_cast<const char*>(data);
+	}
+	else {
+		::close(file);
+	}
+}
+
+MappedFile::~MappedFile()
+{
+	if (m_data) ::munmap(const_cast<char*>(m_data), m_size);
+}
+#endif
+
+auto MappedFile::getData() const->string_view
+{
+	return string_view{m_data, m_size};
+}
@@ -0,0 +1,452 @@
+#include <CLARA/pch.h>
+#include <CLARA/Common/Scan.h>
+
+#if defined(CLASM_SIMD_SSE2)
+#include <emmintrin.h>
+#endif
+#if defined(CLASM_SIMD_AVX2)
+#include <immintrin.h>
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define CLASM_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define CLASM_TARGET_AVX2
+#endif
+
+namespace CLARA::Scan {
+
+namespace {
+
+using Kernel = const char*(*)(const char*, const char*);
+using LineKernel = const char*(*)(const char*, const char*, vector<uint32>&);
+
+struct Kernels {
+	Isa isa;
+	Kernel skipSpaces;
+	Kernel skipNewlines;
+	Kernel findNewline;
+	Kernel findQuoteOrBackslash;
+	Kernel findQuoteOrSemicolon;
+	LineKernel indexLines;
+};
+
+inline auto countTrailingZeros(uint32 mask)->uint32
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return static_cast<uint32>(index);
+#else
+	return static_cast<uint32>(__builtin_ctz(mask));
+#endif
+}
+
+// Each matcher classifies bytes, `invert` makes the scan stop on the first byte which does *not* match.
+
+struct Spaces {
+	static constexpr bool invert = true;
+
+	static auto scalar(char c)
+	{
+		return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+	}
+
+#if defined(CLASM_SIMD_SSE2)
+	static auto sse2(__m128i v)
+	{
+		auto a = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\t')));
+		auto b = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\r')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\v')));
+		return _mm_or_si128(_mm_or_si128(a, b), _mm_cmpeq_epi8(v, _mm_set1_epi8('\f')));
+	}
+#endif
+#if defined(CLASM_SIMD_AVX2)
+	CLASM_TARGET_AVX2 static auto avx2(__m256i v)
+	{
+		auto a = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t')));
+		auto b = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\v')));
+		return _mm256_or_si256(_mm256_or_si256(a, b), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\f')));
+	}
+#endif
+};
+
+template<char Char, bool Invert>
+struct Equals {
+	static constexpr bool invert = Invert;
+
+	static auto scalar(char c)
+	{
+		return c == Char;
+	}
+
+#if defined(CLASM_SIMD_SSE2)
+	static auto sse2(__m128i v)
+	{
+		return _mm_cmpeq_epi8(v, _mm_set1_epi8(Char));
+	}
+#endif
+#if defined(CLASM_SIMD_AVX2)
+	CLASM_TARGET_AVX2 static auto avx2(__m256i v)
+	{
+		return _mm256_cmpeq_epi8(v, _mm256_set1_epi8(Char));
+	}
+#endif
+};
+
+using Newlines = Equals<'\n', true>;
+using Newline = Equals<'\n', false>;
+
+struct QuoteOrBackslash {
+	static constexpr bool invert = false;
+
+	static auto scalar(char c)
+	{
+		return c == '"' || c == '\\';
+	}
+
+#if defined(CLASM_SIMD_SSE2)
+	static auto sse2(__m128i v)
+	{
+		return _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('"')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\\')));
+	}
+#endif
+#if defined(CLASM_SIMD_AVX2)
+	CLASM_TARGET_AVX2 static auto avx2(__m256i v)
+	{
+		return _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('"')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\')));
+	}
+#endif
+};
+
+struct QuoteOrSemicolon {
+	static constexpr bool invert = false;
+
+	static auto scalar(char c)
+	{
+		return c == '"' || c == ';';
+	}
+
+#if defined(CLASM_SIMD_SSE2)
+	static auto sse2(__m128i v)
+	{
+		return _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('"')), _mm_cmpeq_epi8(v, _mm_set1_epi8(';')));
+	}
+#endif
+#if defined(CLASM_SIMD_AVX2)
+	CLASM_TARGET_AVX2 static auto avx2(__m256i v)
+	{
+		return _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('"')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8(';')));
+	}
+#endif
+};
+
+template<typename TMatch>
+auto scanScalar(const char* p, const char* end)->const char*
+{
+	for (; p != end; ++p) {
+		if (TMatch::scalar(*p) != TMatch::invert)
+			return p;
+	}
+	return end;
+}
+
+/**
+ * Get the length of the UTF-8 sequence at `p`.
+ *
+ * @return The number of bytes in the sequence, or 0 if it's invalid, overlong, a surrogate or out of range.
+ */
+auto getSequenceLength(const unsigned char* p, const unsigned char* end)->ptrdiff_t
+{
+	auto lead = p[0];
+	auto length = ptrdiff_t{0};
+	auto codepoint = uint32{0};
+	auto minimum = uint32{0};
+
+	if (lead < 0x80) return 1;
+	if ((lead & 0xE0) == 0xC0) length = 2, codepoint = lead & 0x1Fu, minimum = 0x80;
+	else if ((lead & 0xF0) == 0xE0) length = 3, codepoint = lead & 0x0Fu, minimum = 0x800;
+	else if ((lead & 0xF8) == 0xF0) length = 4, codepoint = lead & 0x07u, minimum = 0x10000;
+	else return 0;
+
+	if (end - p < length) return 0;
+
+	for (auto i = 1; i < length; ++i) {
+		if ((p[i] & 0xC0) != 0x80) return 0;
+		codepoint = (codepoint << 6) | (p[i] & 0x3Fu);
+	}
+
+	if (codepoint < minimum || codepoint > 0x10FFFF || (codepoint >= 0xD800 && codepoint <= 0xDFFF)) return 0;
+	return length;
+}
+
+/**
+ * Validate and index lines from `p` until at least `stop`, a sequence beginning before `stop` may end past it.
+ *
+ * @return Where indexing stopped, which is before `stop` only if the sequence there is invalid.
+ */
+auto indexLinesFrom(const char* begin, const char* p, const char* stop, const char* end, vector<uint32>& lineStarts)->const char*
+{
+	while (p < stop) {
+		if (*p == '\n') {
+			lineStarts.push_back(static_cast<uint32>(p - begin + 1));
+			++p;
+			continue;
+		}
+
+		auto length = getSequenceLength(reinterpret_cast<const unsigned char*>(p), reinterpret_cast<const unsigned char*>(end));
+		if (!length) return p;
+		p += length;
+	}
+	return p;
+}
+
+auto indexLinesScalar(const char* begin, const char* end, vector<uint32>& lineStarts)->const char*
+{
+	auto p = indexLinesFrom(begin, begin, end, end, lineStarts);
+	return p < end ? p : end;
+}
+
+inline auto pushLineStarts(const char* begin, const char* p, uint32 newlines, vector<uint32>& lineStarts)
+{
+	for (; newlines; newlines &= newlines - 1)
+		lineStarts.push_back(static_cast<uint32>(p - begin) + countTrailingZeros(newlines) + 1);
+}
+
+#if defined(CLASM_SIMD_SSE2)
+// Most runs in assembly source are only a few bytes long, so check a short prefix before loading vectors.
+constexpr auto scalarPrefix = ptrdiff_t{8};
+
+template<typename TMatch>
+auto scanPrefix(const char*& p, const char* end)
+{
+	for (auto last = p + std::min(end - p, scalarPrefix); p != last; ++p) {
+		if (TMatch::scalar(*p) != TMatch::invert)
+			return true;
+	}
+	return p == end;
+}
+
+template<typename TMatch>
+auto scanSse2(const char* p, const char* end)->const char*
+{
+	if (scanPrefix<TMatch>(p, end)) return p;
+
+	for (; end - p >= 16; p += 16) {
+		auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+		auto mask = static_cast<uint32>(_mm_movemask_epi8(TMatch::sse2(v)));
+		if constexpr (TMatch::invert) mask ^= 0xFFFFu;
+		if (mask) return p + countTrailingZeros(mask);
+	}
+	return scanScalar<TMatch>(p, end);
+}
+
+// Blocks of ASCII only need their newlines recording, anything else is checked a sequence at a time.
+auto indexLinesSse2(const char* begin, const char* end, vector<uint32>& lineStarts)->const char*
+{
+	auto p = begin;
+
+	while (end - p >= 16) {
+		auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+
+		if (!_mm_movemask_epi8(v)) {
+			pushLineStarts(begin, p, static_cast<uint32>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')))), lineStarts);
+			p += 16;
+			continue;
+		}
+
+		auto stop = p + 16;
+		p = indexLinesFrom(begin, p, stop, end, lineStarts);
+		if (p < stop) return p;
+	}
+
+	p = indexLinesFrom(begin, p, end, end, lineStarts);
+	return p < end ? p : end;
+}
+#endif
+
+#if defined(CLASM_SIMD_AVX2)
+template<typename TMatch>
+CLASM_TARGET_AVX2 auto scanAvx2(const char* p, const char* end)->const char*
+{
+	if (scanPrefix<TMatch>(p, end)) return p;
+
+	for (; end - p >= 32; p += 32) {
+		auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+		auto mask = static_cast<uint32>(_mm256_movemask_epi8(TMatch::avx2(v)));
+		if constexpr (TMatch::invert) mask ^= 0xFFFFFFFFu;
+		if (mask) return p + countTrailingZeros(mask);
+	}
+	return scanSse2<TMatch>(p, end);
+}
+
+CLASM_TARGET_AVX2 auto indexLinesAvx2(const char* begin, const char* end, vector<uint32>& lineStarts)->const char*
+{
+	auto p = begin;
+
+	while (end - p >= 32) {
+		auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+
+		if (!_mm256_movemask_epi8(v)) {
+			pushLineStarts(begin, p, static_cast<uint32>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')))), lineStarts);
+			p += 32;
+			continue;
+		}
+
+		auto stop = p + 32;
+		p = indexLinesFrom(begin, p, stop, end, lineStarts);
+		if (p < stop) return p;
+	}
+
+	p = indexLinesFrom(begin, p, end, end, lineStarts);
+	return p < end ? p : end;
+}
+#endif
+
+constexpr auto scalarKernels = Kernels{
+	Isa::Scalar,
+	&scanScalar<Spaces>,
+	&scanScalar<Newlines>,
+	&scanScalar<Newline>,
+	&scanScalar<QuoteOrBackslash>,
+	&scanScalar<QuoteOrSemicolon>,
+	&indexLinesScalar,
+};
+
+#if defined(CLASM_SIMD_SSE2)
+constexpr auto sse2Kernels = Kernels{
+	Isa::SSE2,
+	&scanSse2<Spaces>,
+	&scanSse2<Newlines>,
+	&scanSse2<Newline>,
+	&scanSse2<QuoteOrBackslash>,
+	&scanSse2<QuoteOrSemicolon>,
+	&indexLinesSse2,
+};
+#endif
+
+#if defined(CLASM_SIMD_AVX2)
+constexpr auto avx2Kernels = Kernels{
+	Isa::AVX2,
+	&scanAvx2<Spaces>,
+	&scanAvx2<Newlines>,
+	&scanAvx2<Newline>,
+	&scanAvx2<QuoteOrBackslash>,
+	&scanAvx2<QuoteOrSemicolon>,
+	&indexLinesAvx2,
+};
+#endif
+
+auto detectIsa()->Isa
+{
+#if defined(CLASM_SIMD_AVX2)
+#if defined(_MSC_VER) && !defined(__clang__)
+	int info[4];
+	__cpuid(info, 0);
+
+	if (info[0] >= 7) {
+		__cpuid(info, 1);
+		auto osxsave = (info[2] & (1 << 27)) != 0;
+		auto avx = (info[2] & (1 << 28)) != 0;
+		__cpuidex(info, 7, 0);
+		auto avx2 = (info[1] & (1 << 5)) != 0;
+
+		// the OS must also save the upper halves of the ymm registers
+		if (osxsave && avx && avx2 && (_xgetbv(0) & 0x6) == 0x6)
+			return Isa::AVX2;
+	}
+#else
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		return Isa::AVX2;
+#endif
+#endif
+#if defined(CLASM_SIMD_SSE2)
+	return Isa::SSE2;
+#else
+	return Isa::Scalar;
+#endif
+}
+
+auto getKernels(Isa isa)->const Kernels*
+{
+	switch (isa) {
+#if defined(CLASM_SIMD_AVX2)
+	case Isa::AVX2: return &avx2Kernels;
+#endif
+#if defined(CLASM_SIMD_SSE2)
+	case Isa::SSE2: return &sse2Kernels;
+#endif
+	default: break;
+	}
+	return &scalarKernels;
+}
+
+std::atomic<const Kernels*> activeKernels{nullptr};
+
+auto kernels()->const Kernels&
+{
+	auto active = activeKernels.load(std::memory_order_relaxed);
+	if (!active) {
+		active = getKernels(getSupportedIsa());
+		activeKernels.store(active, std::memory_order_relaxed);
+	}
+	return *active;
+}
+
+}
+
+auto getSupportedIsa()->Isa
+{
+	static const auto isa = detectIsa();
+	return isa;
+}
+
+auto getIsa()->Isa
+{
+	return kernels().isa;
+}
+
+auto setIsa(Isa isa)->Isa
+{
+	if (static_cast<int>(isa) > static_cast<int>(getSupportedIsa()))
+		isa = getSupportedIsa();
+
+	auto active = getKernels(isa);
+	activeKernels.store(active, std::memory_order_relaxed);
+	return active->isa;
+}
+
+auto skipSpaces(const char* begin, const char* end)->const char*
+{
+	return kernels().skipSpaces(begin, end);
+}
+
+auto skipNewlines(const char* begin, const char* end)->const char*
+{
+	return kernels().skipNewlines(begin, end);
+}
+
+auto findNewline(const char* begin, const char* end)->const char*
+{
+	return kernels().findNewline(begin, end);
+}
+
+auto findQuoteOrBackslash(const char* begin, const char* end)->const char*
+{
+	return kernels().findQuoteOrBackslash(begin, end);
+}
+
+auto findQuoteOrSemicolon(const char* begin, const char* end)->const char*
+{
+	return kernels().findQuoteOrSemicolon(begin, end);
+}
+
+auto indexLines(const char* begin, const char* end, vector<uint32>& lineStarts)->const char*
+{
+	return kernels().indexLines(begin, end, lineStarts);
+}
+
+}
@@ -0,0 +1,32 @@
+#include <CLARA/pch.h>
+#include <CLARA/Common/Workers.h>
+
+namespace CLARA {
+
+auto getThreadCount(size_t requested)->size_t
+{
+	auto threads = requested ? requested : static_cast<size_t>(std::thread::hardware_concurrency());
+	return std::max(threads, 1_uz);
+}
+
+Workers::~Workers()
+{
+	join();
+}
+
+auto Workers::take()->optional<size_t>
+{
+	auto index = m_next.fetch_add(1);
+	return index < m_items ? make_optional(index) : nullopt;
+}
+
+auto Workers::join()->void
+{
+	m_next = m_items;
+
+	for (auto& thread : m_threads)
+		thread.join();
+	m_threads.clear();
+}
+
+}
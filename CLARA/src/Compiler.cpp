@@ -1,5 +1,6 @@
 #include <CLARA/pch.h>
 #include <CLARA/Assembly.h>
+#include <CLARA/Common/Workers.h>
 #include <CLARA/Compiler.h>
 
 using namespace CLARA;
@@ -9,51 +10,191 @@ namespace CLARA::CLASM::Compiler {
 
 using TokenIterator = vector<Token>::const_iterator;
 
+/// A REL32 site written before the offset it refers to is patched in.
+struct Fixup {
+	size_t offset;                                      //< offset of the site in its segment
+	const Label* label;                                 //< label whose offset goes in the site
+};
+
+auto getAssemblySize(const Parser::ParseInfo& parse, const TokenAnnotation& annotation)->size_t
+{
+	// strings are sized by their symbol, which the token can't see
+	if (auto symbol = std::get_if<Symbol>(&annotation))
+		return parse.symbols.get(*symbol).size();
+	return getAnnotationSize(annotation);
+}
+
+auto isDefinition(const Label* label, const Parser::SegmentInfo& segment, size_t index)
+{
+	return label->definition.segment == segment.type && label->definition.index == index;
+}
+
+/**
+ * Get the number of bytes a run of tokens of a segment is assembled to.
+ *
+ * @param  parsed       The parse.
+ * @param  segment      The segment.
+ * @param  begin        Index of the first token.
+ * @param  end          Index past the last token.
+ * @param  defineLabels Whether to set the offsets of the labels the run defines, which are from the start of the run.
+ * @return The number of bytes.
+ */
+auto getRunSize(const Parser::ParseInfo& parsed, const Parser::SegmentInfo& segment, size_t begin, size_t end, bool defineLabels = false)
+{
+	auto size = 0_uz;
+
+	for (auto index = begin; index < end; ++index) {
+		const auto annotation = segment.tokens->getAnnotation(index);
+
+		if (defineLabels) {
+			if (auto label = std::get_if<const Label*>(&annotation)) {
+				if (*label && isDefinition(*label, segment, index))
+					(*label)->offset = size;
+			}
+		}
+
+		size += getAssemblySize(parsed, annotation);
+	}
+	return size;
+}
+
+/// A run of tokens of a segment, emitted by one thread into its slice of the output buffer.
+struct Chunk {
+	const Parser::SegmentInfo* segment = nullptr;
+	size_t begin = 0;                                   //< index of the first token
+	size_t end = 0;                                     //< index past the last token
+	size_t offset = 0;                                  //< offset of its bytes in the segment
+	size_t size = 0;                                    //< number of bytes it's assembled to
+	vector<Fixup> fixups;                               //< its REL32 sites, by offset in the segment
+};
+
+// chunks per thread, enough to even out chunks which are quicker to emit than others
+constexpr auto chunksPerThread = 4_uz;
+
+/**
+ * Split the segments of a parse into chunks, in segment order.
+ *
+ * @param  options Compiler options.
+ * @param  threads The number of threads to emit on.
+ * @param  parsed  The parse.
+ * @return The chunks, just one for each segment with tokens when there's one thread.
+ */
+auto makeChunks(const Options& options, size_t threads, const Parser::ParseInfo& parsed)
+{
+	auto chunks = vector<Chunk>{};
+
+	for (auto& segment : parsed.segments) {
+		auto size = segment.tokens ? segment.tokens->size() : 0;
+		if (!size) continue;
+
+		auto count = threads == 1 ? 1_uz : std::clamp(size / std::max(options.chunkSize, 1_uz), 1_uz, threads * chunksPerThread);
+
+		for (auto i = 0_uz; i < count; ++i) {
+			auto& chunk = chunks.emplace_back();
+			chunk.segment = &segment;
+			chunk.begin = size * i / count;
+			chunk.end = size * (i + 1) / count;
+		}
+	}
+	return chunks;
+}
+
+/**
+ * Run a function on every chunk, on worker threads as well as the calling thread.
+ *
+ * @param  threads The number of threads to run on, including the calling thread.
+ * @param  chunks  The chunks.
+ * @param  func    The function, which mustn't touch anything of other chunks.
+ * @throws Whatever the function threw for the first chunk it threw for, once every chunk is done.
+ */
+template<typename TFunc>
+auto forEachChunk(size_t threads, vector<Chunk>& chunks, TFunc&& func)
+{
+	if (threads == 1 || chunks.size() <= 1) {
+		for (auto& chunk : chunks)
+			func(chunk);
+		return;
+	}
+
+	auto errors = vector<std::exception_ptr>(chunks.size());
+
+	auto run = [&](size_t index) {
+		try {
+			func(chunks[index]);
+		}
+		catch (...) {
+			errors[index] = std::current_exception();
+		}
+	};
+
+	// chunks without a worker to run them are run by the calling thread
+	auto workers = Workers{threads, chunks.size(), run};
+	while (auto index = workers.take())
+		run(*index);
+	workers.join();
+
+	for (auto& error : errors) {
+		if (error) std::rethrow_exception(error);
+	}
+}
+
+/// Emits a chunk of a segment into its slice of the output buffer.
 struct CompilerContext {
 	const Options& options;
 	const Reporter& report;
-	IBinaryOutput& output;
 	const Parser::ParseInfo& parse;
-	size_t offset = 0;
+	uint8_t* segmentBegin = nullptr;                    //< where the segment's bytes begin in the output buffer
+	uint8_t* cursor = nullptr;                          //< where the next bytes of the chunk go
+	uint8_t* chunkEnd = nullptr;                        //< where the chunk's bytes end
+	vector<Fixup>& fixups;
 
-	CompilerContext(const Options& opts, IBinaryOutput& out, const Parser::ParseInfo& parse) :
-		options(opts), report(opts.reporter), output(out), parse(parse)
+	CompilerContext(const Options& opts, const Parser::ParseInfo& parse, uint8_t* segmentBegin, Chunk& chunk) :
+		options(opts), report(opts.reporter), parse(parse),
+		segmentBegin(segmentBegin), cursor(segmentBegin + chunk.offset), chunkEnd(cursor + chunk.size), fixups(chunk.fixups)
 	{
 	}
 
+	auto getOffset() const
+	{
+		return static_cast<size_t>(cursor - segmentBegin);
+	}
+
 	auto write(const uint8_t* begin, const uint8_t* end)
 	{
-		output.write(begin, end);
+		assert(end - begin <= chunkEnd - cursor);
+		cursor = std::copy(begin, end, cursor);
+	}
+
+	template<typename T>
+	auto writeValue(T val)
+	{
+		assert(static_cast<ptrdiff_t>(sizeof(T)) <= chunkEnd - cursor);
+		cursor = storeBytesLE(cursor, val);
 	}
 
 	auto write8(uint8 val)
 	{
-		output.write8(val);
-		offset += 1;
+		writeValue(val);
 	}
 
 	auto write16(uint16 val)
 	{
-		output.write16(val);
-		offset += 2;
+		writeValue(val);
 	}
 
 	auto write32(uint32 val)
 	{
-		output.write32(val);
-		offset += 4;
+		writeValue(val);
 	}
 
 	auto write64(uint64 val)
 	{
-		output.write64(val);
-		offset += 8;
+		writeValue(val);
 	}
 
 	auto writeString(string_view sv)
 	{
-		output.write(sv);
-		offset += sv.size();
+		write(reinterpret_cast<const uint8_t*>(sv.data()), reinterpret_cast<const uint8_t*>(sv.data() + sv.size()));
 	}
 
 	auto writeInstruction(const Token& token)
@@ -61,28 +202,35 @@ struct CompilerContext {
 		write8(static_cast<uint8>(get<Instruction::Type>(token.annotation)));
 	}
 
-	auto compileSegment(const Parser::SegmentInfo& segment)
+	auto writeFixup(const Label* label)
+	{
+		fixups.push_back(Fixup{getOffset(), label});
+		write32(0);
+	}
+
+	auto compileChunk(const Parser::SegmentInfo& segment, size_t begin, size_t end)
 	{
-		if (!segment.tokens) return;
-		for (auto it = segment.tokens->begin(); it != segment.tokens->end(); ++it) {
+		// annotations are all that's emitted, so tokens aren't materialized
+		for (auto index = begin; index < end; ++index) {
 			std::visit([&](auto&& arg) {
 				using T = std::decay_t<decltype(arg)>;
 
 				if constexpr (std::is_arithmetic_v<T>) {
-					auto arr = encodeBytes(arg);
-					write(reinterpret_cast<uint8_t*>(&arr[0]), reinterpret_cast<uint8_t*>(&arr[0] + arr.size()));
+					writeValue(arg);
 				}
-				else if constexpr (std::is_same_v<T, std::string>) {
-					write(reinterpret_cast<const uint8_t*>(&arg[0]), reinterpret_cast<const uint8_t*>(&arg[0] + arg.size()));
+				else if constexpr (std::is_same_v<T, Symbol>) {
+					writeString(parse.symbols.get(arg));
 				}
 				else if constexpr (std::is_same_v<T, Instruction::Type>) {
 					write8(static_cast<uint8>(arg));
 				}
 				else if constexpr (std::is_same_v<T, const Label*>) {
-					arg->offset = offset;
+					// each label is defined by one token, so only the thread emitting it sets its offset
+					if (arg && isDefinition(arg, segment, index))
+						arg->offset = getOffset();
 				}
 				else if constexpr (std::is_same_v<T, LabelRef>) {
-					write32(arg.label->offset);
+					writeFixup(arg.label);
 				}
 				else if constexpr (
 					!std::is_same_v<T, monostate> &&
@@ -93,16 +241,65 @@ struct CompilerContext {
 				) {
 					static_assert(always_false<T>::value, "non-exhaustive visitor!");
 				}
-			}, it->annotation);
+			}, segment.tokens->getAnnotation(index));
 		}
+
+		assert(cursor == chunkEnd);
 	}
 };
 
+auto layout(const Parser::ParseInfo& parsed)->void
+{
+	for (auto& segment : parsed.segments)
+		segment.size = segment.tokens ? getRunSize(parsed, segment, 0, segment.tokens->size(), true) : 0;
+}
+
 auto compile(const Options& opts, const Parser::ParseInfo& parsed, IBinaryOutput& out)->Result
 {
-	CompilerContext ctx{opts, out, parsed};
+	const auto threads = getThreadCount(opts.threads);
+	auto chunks = makeChunks(opts, threads, parsed);
+
+	// size every chunk, then place the chunks in their segments and the segments in the buffer
+	forEachChunk(threads, chunks, [&](Chunk& chunk) {
+		chunk.size = getRunSize(parsed, *chunk.segment, chunk.begin, chunk.end);
+	});
+
+	auto segmentOffsets = array<size_t, Segment::MAX>{};
+	auto size = 0_uz;
+
+	for (auto& segment : parsed.segments)
+		segment.size = 0;
+
+	for (auto& chunk : chunks) {
+		chunk.offset = chunk.segment->size;
+		chunk.segment->size += chunk.size;
+	}
+
+	for (auto& segment : parsed.segments) {
+		segmentOffsets[segment.type] = size;
+		size += segment.size;
+	}
+
+	// chunks set the offsets of the labels they define as they're emitted, so sites are patched once all are
+	auto buffer = vector<uint8_t>(size);
+
+	forEachChunk(threads, chunks, [&](Chunk& chunk) {
+		CompilerContext ctx{opts, parsed, buffer.data() + segmentOffsets[chunk.segment->type], chunk};
+		ctx.compileChunk(*chunk.segment, chunk.begin, chunk.end);
+	});
+
+	for (auto& chunk : chunks) {
+		auto segmentBegin = buffer.data() + segmentOffsets[chunk.segment->type];
+
+		for (auto& fixup : chunk.fixups)
+			storeBytesLE(segmentBegin + fixup.offset, static_cast<uint32>(fixup.label->offset));
+	}
+
 	for (auto& segment : parsed.segments) {
-		ctx.compileSegment(segment);
+		auto segmentBegin = buffer.data() + segmentOffsets[segment.type];
+
+		if (segment.size)
+			out.writeSegment(segment.type, segmentBegin, segmentBegin + segment.size);
 	}
 	return Result{};
 }
@@ -0,0 +1,62 @@
+#include <CLARA/pch.h>
+#include <CLARA/Decoder.h>
+
+using namespace CLARA;
+using namespace CLARA::CLASM;
+
+namespace CLARA::CLASM::Decoder {
+
+// instructions are rarely longer than this on average, so most segments are decoded without the array growing
+constexpr auto averageSize = 2_uz;
+
+[[noreturn]] auto throwDecodeError(const uint8* code, size_t offset)->void
+{
+	auto& info = opcodes[code[offset]];
+	if (info.instruction == Instruction::MAX)
+		throw DecodeException(fmt::format("invalid opcode 0x{:02X} at offset 0x{:X}", code[offset], offset), offset);
+	throw DecodeException(fmt::format("{} at offset 0x{:X} is cut short", Instruction::getName(info.instruction), offset), offset);
+}
+
+auto decode(const uint8* code, size_t size, vector<DecodedInstruction>& instructions)->void
+{
+	if (size > std::numeric_limits<uint32>::max())
+		throw std::length_error("code segment too big to decode");
+
+	instructions.clear();
+	instructions.reserve(size / averageSize + 1);
+
+	for (auto offset = 0_uz; offset < size;) {
+		auto& info = opcodes[code[offset]];
+
+		// bytes which aren't an opcode have a size of 0, which wraps around, so one check rejects both
+		if (static_cast<size_t>(info.size - 1) >= size - offset)
+			throwDecodeError(code, offset);
+
+		instructions.push_back(DecodedInstruction{static_cast<uint32>(offset), info.instruction, info.size});
+		offset += info.size;
+	}
+}
+
+auto decode(const uint8* code, size_t size)->vector<DecodedInstruction>
+{
+	auto instructions = vector<DecodedInstruction>{};
+	decode(code, size, instructions);
+	return instructions;
+}
+
+auto readOperand(const uint8* code, const DecodedInstruction& instruction, size_t index)->uint64
+{
+	auto& info = opcodes[instruction.instruction];
+	assert(index < info.numOperands);
+
+	auto operand = code + instruction.offset + info.offsets[index];
+
+	switch (getOperandSize(info.operands[index])) {
+	case 1: return loadBytesLE<uint8>(operand);
+	case 2: return loadBytesLE<uint16>(operand);
+	case 4: return loadBytesLE<uint32>(operand);
+	}
+	return loadBytesLE<uint64>(operand);
+}
+
+}
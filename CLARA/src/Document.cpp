@@ -0,0 +1,233 @@
+#include <CLARA/pch.h>
+#include <CLARA/Document.h>
+
+using namespace CLARA;
+using namespace CLARA::CLASM;
+
+namespace {
+
+/// Get the label a token defines or refers to, or nullptr if it isn't a label token of a defined label.
+auto getLabel(const TokenAnnotation& annotation)->const Label*
+{
+	if (auto label = std::get_if<const Label*>(&annotation))
+		return *label;
+	if (auto reference = std::get_if<LabelRef>(&annotation))
+		return reference->label;
+	return nullptr;
+}
+
+/// Count the UTF-16 code units of UTF-8 text, characters of four bytes taking two.
+auto countUtf16(string_view text)
+{
+	auto units = 0u;
+
+	for (auto c : text) {
+		auto byte = static_cast<unsigned char>(c);
+		units += (byte & 0xC0) != 0x80;
+		units += byte >= 0xF0;
+	}
+	return units;
+}
+
+/// Get the offset of a column counted in UTF-16 code units in a line, or the end of the line if it's shorter.
+auto getColumnOffset(string_view line, uint character)
+{
+	auto units = 0u;
+	auto offset = 0_uz;
+
+	while (offset < line.size() && units < character) {
+		auto byte = static_cast<unsigned char>(line[offset]);
+		auto length = byte < 0x80 ? 1_uz : byte < 0xE0 ? 2_uz : byte < 0xF0 ? 3_uz : 4_uz;
+		units += length == 4 ? 2 : 1;
+		offset += length;
+	}
+	return std::min(offset, line.size());
+}
+
+/// Get the offset of a position in text which hasn't been indexed, by finding the line breaks before it.
+auto findOffset(string_view text, const Document::Position& position)
+{
+	auto start = 0_uz;
+
+	for (auto line = 0u; line < position.line; ++line) {
+		auto next = text.find('\n', start);
+		if (next == string_view::npos) return text.size();
+		start = next + 1;
+	}
+
+	auto end = std::min(text.find('\n', start), text.size());
+	return start + getColumnOffset(text.substr(start, end - start), position.character);
+}
+
+}
+
+Document::Document(string name, string text, Parser::Options options) :
+	m_name(move(name)),
+	m_options(move(options)),
+	m_source(make_shared<const Source>(m_name, move(text)))
+{
+	Parser::tokenize(m_options, m_source, m_result);
+}
+
+auto Document::getSource() const->const shared_ptr<const Source>&
+{
+	return m_source;
+}
+
+auto Document::getResult() const->const Parser::Result&
+{
+	return m_result;
+}
+
+auto Document::getText() const->string_view
+{
+	return m_edited ? string_view{m_text} : m_source->getCode();
+}
+
+auto Document::isEdited() const->bool
+{
+	return m_edited;
+}
+
+auto Document::edit(const Range& range, string_view text)->void
+{
+	// until the first edit the text is the source, which has its lines indexed already
+	auto start = m_edited ? findOffset(m_text, range.start) : getOffset(range.start);
+	auto end = std::max(start, m_edited ? findOffset(m_text, range.end) : getOffset(range.end));
+
+	if (!m_edited) {
+		m_text = string{m_source->getCode()};
+		m_edited = true;
+	}
+
+	m_text.replace(start, end - start, text);
+}
+
+auto Document::setText(string text)->void
+{
+	m_text = move(text);
+	m_edited = true;
+}
+
+auto Document::update()->bool
+{
+	if (!m_edited) return true;
+
+	// the bytes left alone by every edit are the same at both ends of the text
+	auto code = m_source->getCode();
+	auto text = string_view{m_text};
+	auto prefix = static_cast<size_t>(std::mismatch(code.begin(), code.end(), text.begin(), text.end()).first - code.begin());
+	auto maxSuffix = std::min(code.size(), text.size()) - prefix;
+	auto suffix = static_cast<size_t>(std::mismatch(code.rbegin(), code.rbegin() + maxSuffix, text.rbegin()).first - code.rbegin());
+	auto edit = Parser::Edit{prefix, code.size() - prefix - suffix, text.size() - prefix - suffix};
+
+	// the text is copied rather than moved, so the edits are kept if it isn't valid UTF-8
+	auto source = make_shared<const Source>(m_name, m_text);
+	m_edited = false;
+	m_text.clear();
+
+	auto incremental = Parser::retokenize(m_options, source, edit, m_result);
+	m_source = move(source);
+	m_references.clear();
+	m_indexed = false;
+	return incremental;
+}
+
+auto Document::getOffset(const Position& position) const->size_t
+{
+	auto code = m_source->getCode();
+	auto numLines = m_source->getNumLines();
+	if (position.line >= numLines) return code.size();
+
+	auto start = m_source->getLineOffset(position.line);
+	auto end = position.line + 1 < numLines ? m_source->getLineOffset(position.line + 1) - 1 : code.size();
+	return start + getColumnOffset(code.substr(start, end - start), position.character);
+}
+
+auto Document::getPosition(size_t offset) const->Position
+{
+	auto code = m_source->getCode();
+	offset = std::min(offset, code.size());
+
+	auto line = m_source->getLineIndexByOffset(static_cast<uint>(offset));
+	auto start = m_source->getLineOffset(line);
+	return Position{line, countUtf16(code.substr(start, offset - start))};
+}
+
+auto Document::getRange(const Source::Token& token) const->Range
+{
+	return Range{getPosition(token.offset), getPosition(token.offset + token.text.size())};
+}
+
+auto Document::findLabel(size_t offset) const->const Label*
+{
+	for (auto& segment : m_result.info.segments) {
+		if (!segment.tokens) continue;
+
+		// the last token starting at or before the offset, which is only there if the offset is within or just after it
+		auto& tokens = *segment.tokens;
+		auto index = tokens.findOffset(offset + 1);
+		if (!index) continue;
+
+		auto token = tokens.get(index - 1);
+		if (offset > token.offset + token.text.size()) continue;
+
+		if (auto label = getLabel(token.annotation))
+			return label;
+	}
+	return nullptr;
+}
+
+auto Document::getDefinition(const Label& label) const->Token
+{
+	return m_result.info.getToken(label.definition);
+}
+
+auto Document::findReferences(const Label& label, bool includeDefinition) const->vector<Token>
+{
+	auto& index = getReferenceIndex();
+	auto tokens = vector<Token>{};
+	auto it = index.find(&label);
+	if (it == index.end()) return tokens;
+
+	tokens.reserve(it->second.size());
+
+	for (auto& reference : it->second) {
+		if (includeDefinition || !reference.definition)
+			tokens.push_back(m_result.info.getToken(reference.handle));
+	}
+	return tokens;
+}
+
+auto Document::getReferenceIndex() const->const ReferenceIndex&
+{
+	if (m_indexed) return m_references;
+
+	for (auto& segment : m_result.info.segments) {
+		if (!segment.tokens) continue;
+
+		auto& tokens = *segment.tokens;
+
+		for (auto i = 0_uz; i < tokens.size(); ++i) {
+			auto type = tokens.getType(i);
+			if (type != TokenType::Label && type != TokenType::LabelRef) continue;
+
+			auto token = tokens.get(i);
+			auto label = getLabel(token.annotation);
+			if (!label) continue;
+
+			auto handle = TokenHandle{segment.type, static_cast<uint32>(i)};
+			m_references[label].push_back(Reference{token.offset, handle, type == TokenType::Label});
+		}
+	}
+
+	// each segment is in source order, but a label can be referred to from more than one
+	for (auto& [label, references] : m_references) {
+		std::sort(references.begin(), references.end(), [](const Reference& a, const Reference& b) {
+			return a.offset < b.offset;
+		});
+	}
+
+	m_indexed = true;
+	return m_references;
+}
@@ -0,0 +1,249 @@
+#include <CLARA/pch.h>
+#include <CLARA/Lexer.h>
+#include <CLARA/Common/Scan.h>
+
+using namespace CLARA;
+using namespace CLARA::CLASM;
+
+namespace CLARA::CLASM::Lexer {
+
+enum class CharClass : uint8 {
+	Invalid,
+	Newline,
+	Space,
+	Comment,
+	Separator,
+	Dot,
+	Quote,
+	Sign,
+	Digit,
+	IdentStart,
+};
+
+enum CharFlag : uint8 {
+	IsWord  = 1 << 0,	//< [A-Za-z0-9_]
+	IsDigit = 1 << 1,	//< [0-9]
+	IsHex   = 1 << 2,	//< [0-9A-Fa-f]
+	IsSpace = 1 << 3,	//< isspace() in the "C" locale
+};
+
+struct CharInfo {
+	CharClass cls = CharClass::Invalid;
+	uint8 flags = 0;
+};
+
+constexpr auto makeCharTable()
+{
+	auto table = array<CharInfo, 256>{};
+	auto set = [&](string_view chars, CharClass cls, uint8 flags) {
+		for (auto c : chars) {
+			table[static_cast<uint8>(c)].cls = cls;
+			table[static_cast<uint8>(c)].flags |= flags;
+		}
+	};
+
+	set("0123456789", CharClass::Digit, IsWord | IsDigit | IsHex);
+	set("abcdefghijklmnopqrstuvwxyz", CharClass::IdentStart, IsWord);
+	set("ABCDEFGHIJKLMNOPQRSTUVWXYZ_", CharClass::IdentStart, IsWord);
+	set("abcdefABCDEF", CharClass::IdentStart, IsHex);
+	set("\n", CharClass::Newline, IsSpace);
+	set(" \t\r\v\f", CharClass::Space, IsSpace);
+	set(";", CharClass::Comment, 0);
+	set("=:,", CharClass::Separator, 0);
+	set(".", CharClass::Dot, 0);
+	set("\"", CharClass::Quote, 0);
+	set("+-", CharClass::Sign, 0);
+	return table;
+}
+
+constexpr auto charTable = makeCharTable();
+
+constexpr auto info(char c)->const CharInfo&
+{
+	return charTable[static_cast<uint8>(c)];
+}
+
+constexpr auto has(char c, uint8 flags)
+{
+	return (info(c).flags & flags) != 0;
+}
+
+// regex-style word boundary between `p - 1` and `p`
+constexpr auto isBoundary(const char* begin, const char* p, const char* end)
+{
+	auto before = p != begin && has(p[-1], IsWord);
+	auto after = p != end && has(*p, IsWord);
+	return before != after;
+}
+
+auto scanNewlines(const char* begin, const char* end)
+{
+	return Lexeme{TokenType::EndOfLine, static_cast<size_t>(Scan::skipNewlines(begin, end) - begin)};
+}
+
+auto scanWhitespace(const char* begin, const char* end)
+{
+	return Lexeme{TokenType::WhiteSpace, static_cast<size_t>(Scan::skipSpaces(begin, end) - begin)};
+}
+
+auto scanComment(const char* begin, const char* end)
+{
+	return Lexeme{TokenType::WhiteSpace, static_cast<size_t>(Scan::findNewline(begin + 1, end) - begin)};
+}
+
+auto scanIdentifierLength(const char* begin, const char* end)
+{
+	auto p = begin + 1;
+	while (p != end && has(*p, IsWord)) ++p;
+	return static_cast<size_t>(p - begin);
+}
+
+auto scanIdentifier(const char* begin, const char* end)
+{
+	auto length = scanIdentifierLength(begin, end);
+	auto p = begin + length;
+
+	if (p != end && *p == ':' && (p + 1 == end || has(p[1], IsSpace)))
+		return Lexeme{TokenType::Label, length + 1};
+	return Lexeme{TokenType::Identifier, length};
+}
+
+auto scanSegment(const char* begin, const char* end)
+{
+	if (begin + 1 != end && info(begin[1]).cls == CharClass::IdentStart)
+		return Lexeme{TokenType::Segment, scanIdentifierLength(begin + 1, end) + 1};
+	return Lexeme{};
+}
+
+auto scanString(const char* begin, const char* end)
+{
+	// each escape skips the escaped character, so the body is only ever scanned once
+	for (auto p = Scan::findQuoteOrBackslash(begin + 1, end); p != end; p = Scan::findQuoteOrBackslash(p, end)) {
+		if (*p == '"')
+			return Lexeme{TokenType::String, static_cast<size_t>(p - begin + 1)};
+		p = end - p > 2 ? p + 2 : end;
+	}
+	return Lexeme{};
+}
+
+auto scanHexLiteral(const char* begin, const char* digits, const char* end, bool negative)
+{
+	auto result = Lexeme{TokenType::HexLiteral, 0};
+	auto p = digits;
+
+	result.negative = negative;
+
+	for (; p != end && has(*p, IsHex); ++p) {
+		auto c = static_cast<uint8>(*p);
+		auto digit = has(*p, IsDigit) ? c - '0' : (c | 0x20) - 'a' + 10;
+		if (result.integer > (std::numeric_limits<uint64>::max() >> 4))
+			result.valid = false;
+		result.integer = (result.integer << 4) | static_cast<uint64>(digit);
+	}
+
+	if (p == digits || (p != end && has(*p, IsWord)))
+		return Lexeme{};
+
+	result.length = static_cast<size_t>(p - begin);
+	return result;
+}
+
+auto scanFloatLiteral(const char* begin, const char* dot, const char* end, bool negative)
+{
+	auto fracEnd = dot + 1;
+	while (fracEnd != end && has(*fracEnd, IsDigit)) ++fracEnd;
+
+	auto expEnd = static_cast<const char*>(nullptr);
+
+	if (fracEnd != end && (*fracEnd == 'e' || *fracEnd == 'E')) {
+		auto p = fracEnd + 1;
+		if (p != end && (*p == '+' || *p == '-')) ++p;
+		auto digits = p;
+		while (p != end && has(*p, IsDigit)) ++p;
+		if (p != digits) expEnd = p;
+	}
+
+	// the longest match which is followed by a word boundary wins, mimicking the backtracking of
+	// the pattern [+-]?(0|[1-9]\d*)\.\d*([eE][+-]?\d+)?\b
+	auto litEnd = expEnd && isBoundary(begin, expEnd, end) ? expEnd : static_cast<const char*>(nullptr);
+
+	for (auto p = fracEnd; !litEnd && p > dot; --p) {
+		if (isBoundary(begin, p, end))
+			litEnd = p;
+	}
+
+	if (!litEnd)
+		return Lexeme{};
+
+	auto result = Lexeme{TokenType::FloatLiteral, static_cast<size_t>(litEnd - begin)};
+	auto digits = negative || *begin == '+' ? begin + 1 : begin;
+	auto [ptr, ec] = std::from_chars(digits, litEnd, result.real);
+	result.valid = ec == std::errc{} && ptr == litEnd;
+	result.negative = negative;
+	if (negative) result.real = -result.real;
+	return result;
+}
+
+auto scanNumeric(const char* begin, const char* end)
+{
+	auto p = begin;
+	auto negative = *p == '-';
+
+	if (info(*p).cls == CharClass::Sign) {
+		if (++p == end || !has(*p, IsDigit))
+			return Lexeme{};
+	}
+
+	if (*p == '0' && p + 1 != end && p[1] == 'x')
+		return scanHexLiteral(begin, p + 2, end, negative);
+
+	auto result = Lexeme{TokenType::IntegerLiteral, 0};
+
+	if (*p == '0') {
+		++p;
+	}
+	else {
+		for (; p != end && has(*p, IsDigit); ++p) {
+			auto digit = static_cast<uint64>(*p - '0');
+			if (result.integer > (std::numeric_limits<uint64>::max() - digit) / 10)
+				result.valid = false;
+			result.integer = result.integer * 10 + digit;
+		}
+	}
+
+	if (p != end) {
+		if (*p == '.')
+			return scanFloatLiteral(begin, p, end, negative);
+		if (has(*p, IsWord))
+			return Lexeme{};
+	}
+
+	result.length = static_cast<size_t>(p - begin);
+	result.negative = negative;
+	return result;
+}
+
+auto scan(string_view code, size_t offset)->Lexeme
+{
+	if (offset >= code.size())
+		return Lexeme{};
+
+	auto begin = code.data() + offset;
+	auto end = code.data() + code.size();
+
+	switch (info(*begin).cls) {
+	case CharClass::Newline: return scanNewlines(begin, end);
+	case CharClass::Space: return scanWhitespace(begin, end);
+	case CharClass::Comment: return scanComment(begin, end);
+	case CharClass::Separator: return Lexeme{TokenType::Separator, 1};
+	case CharClass::Dot: return scanSegment(begin, end);
+	case CharClass::Quote: return scanString(begin, end);
+	case CharClass::Sign:
+	case CharClass::Digit: return scanNumeric(begin, end);
+	case CharClass::IdentStart: return scanIdentifier(begin, end);
+	case CharClass::Invalid: break;
+	}
+	return Lexeme{};
+}
+
+}
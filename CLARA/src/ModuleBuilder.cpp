@@ -0,0 +1,206 @@
+#include <CLARA/pch.h>
+#include <CLARA/ModuleBuilder.h>
+
+using namespace CLARA;
+using namespace CLARA::CLASM;
+
+namespace {
+
+/// Check whether an integer fits in `size` bytes, as either a signed or an unsigned value.
+template<typename TInt>
+auto fitsSize(TInt value, size_t size)
+{
+	if (size >= sizeof(uint64)) return true;
+
+	auto bits = size * 8;
+	if constexpr (std::is_signed_v<TInt>)
+		return value >= -(int64{1} << (bits - 1)) && value < (int64{1} << bits);
+	else
+		return value < (uint64{1} << bits);
+}
+
+/// Store an integer in the annotation type of its size, negative values keeping their sign.
+template<typename TInt>
+auto makeIntegerAnnotation(TInt value, size_t size)->TokenAnnotation
+{
+	auto negative = false;
+	if constexpr (std::is_signed_v<TInt>)
+		negative = value < 0;
+
+	switch (size) {
+	case 1: return negative ? TokenAnnotation{static_cast<int8>(value)} : TokenAnnotation{static_cast<uint8>(value)};
+	case 2: return negative ? TokenAnnotation{static_cast<int16>(value)} : TokenAnnotation{static_cast<uint16>(value)};
+	case 4: return negative ? TokenAnnotation{static_cast<int32>(value)} : TokenAnnotation{static_cast<uint32>(value)};
+	}
+	return negative ? TokenAnnotation{static_cast<int64>(value)} : TokenAnnotation{static_cast<uint64>(value)};
+}
+
+}
+
+ModuleBuilder::ModuleBuilder(TokenStorage storage) : m_storage(storage)
+{
+	for (auto& segment : m_info.segments)
+		segment.tokens = make_shared<TokenStream>(nullptr, storage);
+}
+
+auto ModuleBuilder::setSegment(Segment::Type segment)->ModuleBuilder&
+{
+	m_segment = segment;
+	return *this;
+}
+
+auto ModuleBuilder::getSegment() const->Segment::Type
+{
+	return m_segment;
+}
+
+auto ModuleBuilder::makeLabel(string_view name)->const Label*
+{
+	auto symbol = m_info.symbols.intern(name);
+	auto res = m_info.labelMap.emplace(symbol, m_info.labels.size());
+	if (!res.second)
+		throw std::invalid_argument(fmt::format("label '{}' already exists", name));
+
+	// a label's segment stays MAX until it's defined
+	return m_info.labels.emplace_back(m_info.arena->create<Label>(symbol, m_info.symbols.get(symbol), TokenHandle{}, Segment::MAX));
+}
+
+auto ModuleBuilder::label(const Label* label)->ModuleBuilder&
+{
+	auto it = label ? m_info.labelMap.find(label->symbol) : m_info.labelMap.end();
+	if (it == m_info.labelMap.end() || m_info.labels[it->second] != label)
+		throw std::invalid_argument("label isn't one of the module's");
+
+	auto& defined = *m_info.labels[it->second];
+	if (defined.segment != Segment::MAX)
+		throw std::logic_error(fmt::format("label '{}' is already defined", defined.name));
+
+	defined.definition = makeHandle();
+	defined.segment = m_segment;
+	m_info.segments[m_segment].tokens->push(TokenType::Label, TokenAnnotation{label});
+	return *this;
+}
+
+auto ModuleBuilder::label(string_view name)->const Label*
+{
+	auto made = makeLabel(name);
+	label(made);
+	return made;
+}
+
+auto ModuleBuilder::ref(const Label* label)->LabelRef
+{
+	return LabelRef{label};
+}
+
+auto ModuleBuilder::db(uint8 value)->ModuleBuilder&
+{
+	return pushData(DataType::DB, Operand{TokenType::Numeric, value});
+}
+
+auto ModuleBuilder::dw(uint16 value)->ModuleBuilder&
+{
+	return pushData(DataType::DW, Operand{TokenType::Numeric, value});
+}
+
+auto ModuleBuilder::dd(uint32 value)->ModuleBuilder&
+{
+	return pushData(DataType::DD, Operand{TokenType::Numeric, value});
+}
+
+auto ModuleBuilder::dq(uint64 value)->ModuleBuilder&
+{
+	return pushData(DataType::DQ, Operand{TokenType::Numeric, value});
+}
+
+auto ModuleBuilder::ds(string_view value)->ModuleBuilder&
+{
+	if (m_segment != Segment::Data)
+		throw std::logic_error("data can only be declared in the data segment");
+	return pushData(DataType::DS, Operand{TokenType::String, m_info.symbols.intern(value)});
+}
+
+auto ModuleBuilder::getInfo() const->const Parser::ParseInfo&
+{
+	return m_info;
+}
+
+auto ModuleBuilder::finish()->Parser::ParseInfo
+{
+	checkLabels();
+
+	auto info = move(m_info);
+	m_info = Parser::ParseInfo{};
+	for (auto& segment : m_info.segments)
+		segment.tokens = make_shared<TokenStream>(nullptr, m_storage);
+	m_segment = Segment::Code;
+	return info;
+}
+
+auto ModuleBuilder::compile(const Compiler::Options& options, IBinaryOutput& out) const->Compiler::Result
+{
+	checkLabels();
+	return Compiler::compile(options, m_info, out);
+}
+
+auto ModuleBuilder::makeIntegerOperand(OperandSlot slot, int64 value)->Operand
+{
+	auto size = getOperandSize(slot.type);
+	if (!fitsSize(value, size))
+		throw std::out_of_range(fmt::format("{} doesn't fit in an operand of {} bytes", value, size));
+	return Operand{TokenType::Numeric, makeIntegerAnnotation(value, size)};
+}
+
+auto ModuleBuilder::makeIntegerOperand(OperandSlot slot, uint64 value)->Operand
+{
+	auto size = getOperandSize(slot.type);
+	if (!fitsSize(value, size))
+		throw std::out_of_range(fmt::format("{} doesn't fit in an operand of {} bytes", value, size));
+	return Operand{TokenType::Numeric, makeIntegerAnnotation(value, size)};
+}
+
+auto ModuleBuilder::makeRealOperand(OperandSlot slot, double value)->Operand
+{
+	if (getOperandSize(slot.type) == sizeof(float))
+		return Operand{TokenType::Numeric, static_cast<float>(value)};
+	return Operand{TokenType::Numeric, value};
+}
+
+auto ModuleBuilder::pushInstruction(Instruction::Type instruction, const Operand* operands, size_t count)->void
+{
+	if (m_segment == Segment::Data)
+		throw std::logic_error("instructions can't be emitted in the data segment");
+
+	auto& tokens = *m_info.segments[m_segment].tokens;
+	tokens.push(TokenType::Instruction, TokenAnnotation{instruction});
+
+	for (auto i = 0_uz; i < count; ++i)
+		tokens.push(operands[i].type, operands[i].annotation);
+}
+
+auto ModuleBuilder::pushData(DataType::Type type, Operand&& value)->ModuleBuilder&
+{
+	if (m_segment != Segment::Data)
+		throw std::logic_error("data can only be declared in the data segment");
+
+	auto& tokens = *m_info.segments[Segment::Data].tokens;
+	tokens.push(TokenType::DataType, TokenAnnotation{type});
+	tokens.push(value.type, move(value.annotation));
+	return *this;
+}
+
+auto ModuleBuilder::makeHandle() const->TokenHandle
+{
+	auto index = m_info.segments[m_segment].tokens->size();
+	if (index >= std::numeric_limits<uint32>::max())
+		throw std::length_error("too many tokens in segment");
+	return TokenHandle{m_segment, static_cast<uint32>(index)};
+}
+
+auto ModuleBuilder::checkLabels() const->void
+{
+	for (auto label : m_info.labels) {
+		if (label->segment == Segment::MAX)
+			throw std::logic_error(fmt::format("label '{}' is never defined", label->name));
+	}
+}
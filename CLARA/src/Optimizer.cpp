@@ -0,0 +1,467 @@
+#include <CLARA/pch.h>
+#include <CLARA/Decoder.h>
+#include <CLARA/Label.h>
+#include <CLARA/Optimizer.h>
+
+using namespace CLARA;
+using namespace CLARA::CLASM;
+
+namespace CLARA::CLASM::Optimizer {
+
+/// What the automaton sees of a statement: its instruction, or one of the inputs after them.
+using Input = uint16;
+
+constexpr auto labelInput = Input{Instruction::MAX};    //< a label definition
+constexpr auto otherInput = Input{Instruction::MAX + 1};//< any other token
+constexpr auto numInputs = size_t{Instruction::MAX + 2};
+
+/// An instruction with its operands, a label definition or any other token, as it goes through the automaton.
+struct Statement {
+	Input input = otherInput;
+	uint16 state = 0;                                   //< state of the automaton once it's output
+	size_t token = 0;                                   //< index of its first token, or of the first replaced
+	size_t numTokens = 0;                               //< number of tokens it's copied from, 0 if a rewrite made it
+	TokenAnnotation annotation;                         //< the instruction, the label or the token's annotation
+	array<TokenAnnotation, Decoder::maxOperands> operands;
+};
+
+/**
+ * Replace the statements matched by a rule.
+ *
+ * @param  matched     The statements matched, as many as the rule's pattern.
+ * @param  replacement Set to the statements to replace them with, in order.
+ * @return Whether the rule applies, otherwise the replacement is ignored.
+ */
+using RewriteFunc = bool(*)(const Statement* matched, vector<Statement>& replacement);
+
+struct Rule {
+	vector<vector<Input>> pattern;                      //< inputs each statement may be, in order
+	bool Options::* option;                             //< option enabling the rule, nullptr if it's always enabled
+	RewriteFunc rewrite;
+};
+
+auto getInteger(const TokenAnnotation& annotation)->optional<int64>
+{
+	return std::visit([](auto value)->optional<int64> {
+		using T = decltype(value);
+
+		if constexpr (std::is_same_v<T, uint64>) {
+			if (value > static_cast<uint64>(std::numeric_limits<int64>::max())) return nullopt;
+			return static_cast<int64>(value);
+		}
+		else if constexpr (std::is_integral_v<T>)
+			return static_cast<int64>(value);
+		else
+			return nullopt;
+	}, annotation);
+}
+
+auto checkedAdd(int64 a, int64 b)->optional<int64>
+{
+	constexpr auto max = std::numeric_limits<int64>::max();
+	constexpr auto min = std::numeric_limits<int64>::min();
+	if ((b > 0 && a > max - b) || (b < 0 && a < min - b)) return nullopt;
+	return a + b;
+}
+
+auto checkedMultiply(int64 a, int64 b)->optional<int64>
+{
+	constexpr auto max = std::numeric_limits<int64>::max();
+	constexpr auto min = std::numeric_limits<int64>::min();
+
+	if (a > 0) {
+		if (b > 0 ? a > max / b : b < min / a) return nullopt;
+	}
+	else if (a < 0) {
+		if (b > 0 ? a < min / b : b < max / a) return nullopt;
+	}
+	return a * b;
+}
+
+auto makeStatement(Instruction::Type instruction, size_t token)
+{
+	auto statement = Statement{};
+	statement.input = instruction;
+	statement.token = token;
+	statement.annotation = instruction;
+	return statement;
+}
+
+auto makeStatement(Instruction::Type instruction, size_t token, TokenAnnotation operand)
+{
+	auto statement = makeStatement(instruction, token);
+	statement.operands[0] = operand;
+	return statement;
+}
+
+/// Push an integer the way `push` with it as a literal does, in the narrowest instruction holding it.
+auto makePush(int64 value, size_t token)
+{
+	auto fits = [value](auto type) {
+		using T = decltype(type);
+		return value >= std::numeric_limits<T>::min() && value <= static_cast<int64>(std::numeric_limits<T>::max());
+	};
+
+	if (fits(int8{})) return makeStatement(Instruction::PUSHB, token, static_cast<int8>(value));
+	if (fits(uint8{})) return makeStatement(Instruction::PUSHB, token, static_cast<uint8>(value));
+	if (fits(int16{})) return makeStatement(Instruction::PUSHW, token, static_cast<int16>(value));
+	if (fits(uint16{})) return makeStatement(Instruction::PUSHW, token, static_cast<uint16>(value));
+	if (fits(int32{})) return makeStatement(Instruction::PUSHD, token, static_cast<int32>(value));
+	if (fits(uint32{})) return makeStatement(Instruction::PUSHD, token, static_cast<uint32>(value));
+	return makeStatement(Instruction::PUSHQ, token, value);
+}
+
+/// `push x; pop n` pops one fewer without pushing.
+auto discardPushed(const Statement* matched, vector<Statement>& replacement)
+{
+	auto count = getInteger(matched[1].operands[0]);
+	if (!count || *count < 1) return false;
+
+	if (*count > 1)
+		replacement.push_back(makeStatement(Instruction::POP, matched[1].token, static_cast<uint8>(*count - 1)));
+	return true;
+}
+
+/// `push a; push b; add` and `mul` push the result.
+auto foldConstants(const Statement* matched, vector<Statement>& replacement)
+{
+	auto a = getInteger(matched[0].operands[0]);
+	auto b = getInteger(matched[1].operands[0]);
+	if (!a || !b) return false;
+
+	auto result = matched[2].input == Instruction::ADD ? checkedAdd(*a, *b) : checkedMultiply(*a, *b);
+	if (!result) return false;
+
+	replacement.push_back(makePush(*result, matched[0].token));
+	return true;
+}
+
+/// `push 2^k; mul` shifts by k, and multiplying by 1 does nothing.
+auto reduceMultiply(const Statement* matched, vector<Statement>& replacement)
+{
+	auto value = getInteger(matched[0].operands[0]);
+	if (!value || *value < 1 || (*value & (*value - 1))) return false;
+
+	auto shift = int8{0};
+	while ((int64{1} << shift) != *value) ++shift;
+
+	if (shift) {
+		replacement.push_back(makeStatement(Instruction::PUSHB, matched[0].token, shift));
+		replacement.push_back(makeStatement(Instruction::SHL, matched[0].token));
+	}
+	return true;
+}
+
+/// `exf; pushd` and `exf; pushq` are `pushf` and `pushqf` of the same bits.
+auto pushFloat(const Statement* matched, vector<Statement>& replacement)
+{
+	auto& push = matched[1];
+
+	auto bits = std::visit([](auto value)->optional<uint64> {
+		using T = decltype(value);
+
+		if constexpr (std::is_integral_v<T>) {
+			return static_cast<uint64>(value);
+		}
+		else if constexpr (std::is_floating_point_v<T>) {
+			// a literal with a decimal point was already stored as the float it's the bits of
+			auto bits = std::conditional_t<sizeof(T) == sizeof(uint32), uint32, uint64>{};
+			std::memcpy(&bits, &value, sizeof(bits));
+			return bits;
+		}
+		else {
+			return nullopt;
+		}
+	}, push.operands[0]);
+	if (!bits) return false;
+
+	if (push.input == Instruction::PUSHD) {
+		auto value = float{};
+		auto word = static_cast<uint32>(*bits);
+		std::memcpy(&value, &word, sizeof(value));
+		replacement.push_back(makeStatement(Instruction::PUSHF, matched[0].token, value));
+	}
+	else {
+		auto value = double{};
+		std::memcpy(&value, &*bits, sizeof(value));
+		replacement.push_back(makeStatement(Instruction::PUSHQF, matched[0].token, value));
+	}
+	return true;
+}
+
+/// `jmpd label; label:` falls through to the label anyway.
+auto removeJumpToNext(const Statement* matched, vector<Statement>& replacement)
+{
+	auto ref = std::get_if<LabelRef>(&matched[0].operands[0]);
+	auto label = std::get_if<const Label*>(&matched[1].annotation);
+	if (!ref || !label || ref->label != *label) return false;
+
+	replacement.push_back(matched[1]);
+	return true;
+}
+
+auto getRules()->const vector<Rule>&
+{
+	// instructions which only push a value
+	static const auto pushes = vector<Input>{
+		Instruction::PUSHN, Instruction::PUSHB, Instruction::PUSHW, Instruction::PUSHD, Instruction::PUSHQ,
+		Instruction::PUSHF, Instruction::PUSHQF, Instruction::PUSHS, Instruction::DUP,
+	};
+	static const auto integerPushes = vector<Input>{Instruction::PUSHB, Instruction::PUSHW, Instruction::PUSHD, Instruction::PUSHQ};
+
+	static const auto rules = vector<Rule>{
+		Rule{{pushes, {Instruction::POP}}, nullptr, &discardPushed},
+		Rule{{integerPushes, integerPushes, {Instruction::ADD, Instruction::MUL}}, &Options::foldConstants, &foldConstants},
+		Rule{{integerPushes, {Instruction::MUL}}, &Options::reduceStrength, &reduceMultiply},
+		Rule{{{Instruction::EXF}, {Instruction::PUSHD, Instruction::PUSHQ}}, nullptr, &pushFloat},
+		Rule{{{Instruction::JMPD}, {labelInput}}, nullptr, &removeJumpToNext},
+	};
+	return rules;
+}
+
+/**
+ * Matches the patterns of every rule at once, one statement at a time.
+ *
+ * An Aho-Corasick automaton over the inputs: the state after a run of statements stands for the longest end of it
+ * which is the start of a pattern, and lists every rule whose pattern it ends with.
+ */
+class Automaton {
+public:
+	explicit Automaton(const vector<Rule>& rules)
+	{
+		addState();
+
+		for (auto index = 0_uz; index < rules.size(); ++index)
+			addPattern(rules[index].pattern, index);
+
+		link(rules);
+	}
+
+	auto next(uint16 state, Input input) const
+	{
+		return m_transitions[state * numInputs + input];
+	}
+
+	/// Get the rules matching at a state, those with the longest patterns first.
+	auto getMatches(uint16 state) const->const vector<uint16>&
+	{
+		return m_matches[state];
+	}
+
+private:
+	static constexpr auto none = std::numeric_limits<uint16>::max();
+
+	auto addState()->uint16
+	{
+		if (m_matches.size() >= none)
+			throw std::length_error("too many states in optimizer automaton");
+
+		m_transitions.resize(m_transitions.size() + numInputs, none);
+		m_matches.emplace_back();
+		return static_cast<uint16>(m_matches.size() - 1);
+	}
+
+	/// Add every run of inputs a pattern matches to the trie.
+	auto addPattern(const vector<vector<Input>>& pattern, size_t rule, size_t element = 0, uint16 state = 0)->void
+	{
+		if (element == pattern.size()) {
+			m_matches[state].push_back(static_cast<uint16>(rule));
+			return;
+		}
+
+		for (auto input : pattern[element]) {
+			auto next = m_transitions[state * numInputs + input];
+			if (next == none) {
+				next = addState();
+				m_transitions[state * numInputs + input] = next;
+			}
+			addPattern(pattern, rule, element + 1, next);
+		}
+	}
+
+	/// Turn the trie into the automaton, breadth first so every state's fallback is done before it.
+	auto link(const vector<Rule>& rules)->void
+	{
+		auto fallbacks = vector<uint16>(m_matches.size(), 0);
+		auto queue = vector<uint16>{};
+
+		for (auto input = 0_uz; input < numInputs; ++input) {
+			auto& next = m_transitions[input];
+			if (next == none)
+				next = 0;
+			else
+				queue.push_back(next);
+		}
+
+		for (auto head = 0_uz; head < queue.size(); ++head) {
+			auto state = queue[head];
+
+			auto fallback = fallbacks[state];
+			auto& matches = m_matches[state];
+			matches.insert(matches.end(), m_matches[fallback].begin(), m_matches[fallback].end());
+
+			for (auto input = 0_uz; input < numInputs; ++input) {
+				auto& next = m_transitions[state * numInputs + input];
+				if (next == none) {
+					next = m_transitions[fallback * numInputs + input];
+				}
+				else {
+					fallbacks[next] = m_transitions[fallback * numInputs + input];
+					queue.push_back(next);
+				}
+			}
+		}
+
+		for (auto& matches : m_matches) {
+			std::stable_sort(matches.begin(), matches.end(), [&](auto a, auto b) {
+				return rules[a].pattern.size() > rules[b].pattern.size();
+			});
+			matches.erase(std::unique(matches.begin(), matches.end()), matches.end());
+		}
+	}
+
+private:
+	vector<uint16> m_transitions;                       //< next state by state and input
+	vector<vector<uint16>> m_matches;                   //< rules matching at each state
+};
+
+auto getAutomaton()->const Automaton&
+{
+	static const auto automaton = Automaton{getRules()};
+	return automaton;
+}
+
+/// Read the statement starting at a token.
+auto readStatement(const TokenStream& tokens, size_t index)
+{
+	auto statement = Statement{};
+	statement.token = index;
+	statement.numTokens = 1;
+	statement.annotation = tokens.getAnnotation(index);
+
+	switch (tokens.getType(index)) {
+	case TokenType::Instruction: {
+		auto instruction = get<Instruction::Type>(statement.annotation);
+		auto numOperands = std::min<size_t>(Decoder::getOpcodeInfo(instruction).numOperands, tokens.size() - index - 1);
+
+		statement.input = instruction;
+		for (auto i = 0_uz; i < numOperands; ++i)
+			statement.operands[i] = tokens.getAnnotation(index + 1 + i);
+		statement.numTokens += numOperands;
+		break;
+	}
+	case TokenType::Label:
+		statement.input = labelInput;
+		break;
+	default:
+		break;
+	}
+	return statement;
+}
+
+/// Check whether the instruction before a statement of the output is `exf`, which flags the statement.
+auto isFlagged(const vector<Statement>& output, size_t index)
+{
+	// a jump to a label between them doesn't flag it, but falling through does
+	while (index > 0 && output[index - 1].input == labelInput)
+		--index;
+	return index > 0 && output[index - 1].input == Instruction::EXF;
+}
+
+/// Write the output statements to a token stream, moving the labels defined by them to their new indices.
+auto writeStatements(const vector<Statement>& output, const TokenStream& input, vector<Label*>& definitions, TokenStream& tokens)
+{
+	auto nextDefinition = definitions.begin();
+
+	for (auto& statement : output) {
+		if (statement.numTokens) {
+			for (auto index = statement.token; index < statement.token + statement.numTokens; ++index) {
+				while (nextDefinition != definitions.end() && (*nextDefinition)->definition.index < index)
+					++nextDefinition;
+				if (nextDefinition != definitions.end() && (*nextDefinition)->definition.index == index)
+					(*nextDefinition++)->definition.index = static_cast<uint32>(tokens.size());
+
+				tokens.push(input.get(index));
+			}
+			continue;
+		}
+
+		// made by a rewrite, so it's placed where the statements it replaced began
+		auto token = input.get(statement.token);
+		token.type = TokenType::Instruction;
+		token.annotation = statement.annotation;
+		tokens.push(token);
+
+		auto& info = Decoder::getOpcodeInfo(get<Instruction::Type>(statement.annotation));
+		for (auto i = 0_uz; i < info.numOperands; ++i) {
+			token.type = getAnnotationTokenType(statement.operands[i]);
+			token.annotation = statement.operands[i];
+			tokens.push(token);
+		}
+	}
+}
+
+auto optimize(const Options& options, Parser::ParseInfo& parse)->Result
+{
+	auto result = Result{};
+	auto& segment = parse.segments[Segment::Code];
+	if (!segment.tokens || segment.tokens->empty()) return result;
+
+	auto& input = *segment.tokens;
+	auto& rules = getRules();
+	auto& automaton = getAutomaton();
+
+	auto output = vector<Statement>{};
+	auto pending = vector<Statement>{};
+	auto replacement = vector<Statement>{};
+	output.reserve(input.size());
+
+	for (auto index = 0_uz; index < input.size();) {
+		pending.push_back(readStatement(input, index));
+		index += pending.back().numTokens;
+
+		// statements are fed one at a time, replacements before anything after them
+		while (!pending.empty()) {
+			auto statement = move(pending.back());
+			pending.pop_back();
+
+			statement.state = automaton.next(output.empty() ? uint16{0} : output.back().state, statement.input);
+			output.push_back(move(statement));
+
+			for (auto ruleIndex : automaton.getMatches(output.back().state)) {
+				auto& rule = rules[ruleIndex];
+				if (rule.option && !(options.*rule.option)) continue;
+
+				auto begin = output.size() - rule.pattern.size();
+				if (isFlagged(output, begin)) continue;
+
+				replacement.clear();
+				if (!rule.rewrite(output.data() + begin, replacement)) continue;
+
+				output.resize(begin);
+				pending.insert(pending.end(), replacement.rbegin(), replacement.rend());
+				++result.rewrites;
+				break;
+			}
+		}
+	}
+
+	if (!result.rewrites) return result;
+
+	// labels are moved in the order they're defined in, which the statements keep
+	auto definitions = vector<Label*>{};
+	for (auto label : parse.labels) {
+		if (label->definition.segment == Segment::Code)
+			definitions.push_back(label);
+	}
+	std::sort(definitions.begin(), definitions.end(), [](auto a, auto b) { return a->definition.index < b->definition.index; });
+
+	auto tokens = make_shared<TokenStream>(input.getSource(), input.getStorage(), input.size());
+	writeStatements(output, input, definitions, *tokens);
+
+	result.removedTokens = input.size() - tokens->size();
+	segment.tokens = move(tokens);
+	return result;
+}
+
+}
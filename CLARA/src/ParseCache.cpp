@@ -0,0 +1,300 @@
+#include <CLARA/pch.h>
+#include <CLARA/ParseCache.h>
+#include <cstring>
+
+using namespace CLARA;
+using namespace CLARA::CLASM;
+
+namespace {
+
+constexpr auto magic = array<char, 4>{'C', 'L', 'P', 'C'};
+constexpr auto byteOrderMark = uint32{0x01020304};
+
+struct Header {
+	array<char, 4> magic;
+	uint32 version = 0;
+	uint32 byteOrder = 0;                       // byteOrderMark as the writer stored it
+	uint32 numSymbols = 0;
+	uint64 key = 0;
+	uint64 codeSize = 0;
+	uint64 checksum = 0;                        // hash of everything after the header
+	uint32 numLabels = 0;
+	uint32 numSwitches = 0;
+};
+
+struct LabelRecord {
+	uint32 symbol = 0;
+	uint32 index = 0;                           // index of the defining token in its segment
+	uint8 definitionSegment = 0;
+	uint8 segment = 0;
+	uint16 reserved = 0;
+};
+
+struct SwitchRecord {
+	uint64 offset = 0;
+	uint32 segment = 0;
+	uint32 reserved = 0;
+};
+
+constexpr auto prime1 = 0x9E3779B185EBCA87ull;
+constexpr auto prime2 = 0xC2B2AE3D27D4EB4Full;
+constexpr auto prime3 = 0x165667B19E3779F9ull;
+constexpr auto prime4 = 0x85EBCA77C2B2AE63ull;
+constexpr auto prime5 = 0x27D4EB2F165667C5ull;
+
+constexpr auto rotl(uint64 value, int bits)
+{
+	return (value << bits) | (value >> (64 - bits));
+}
+
+constexpr auto round(uint64 acc, uint64 input)
+{
+	return rotl(acc + input * prime2, 31) * prime1;
+}
+
+constexpr auto merge(uint64 acc, uint64 value)
+{
+	return (acc ^ round(0, value)) * prime1 + prime4;
+}
+
+template<typename T>
+auto readBits(const char* data)
+{
+	auto value = T{};
+	std::memcpy(&value, data, sizeof(T));
+	return value;
+}
+
+/// XXH64 of some bytes, which hashes the code of big sources at close to the speed it can be read.
+auto hashBytes(string_view bytes, uint64 seed)
+{
+	auto data = bytes.data();
+	const auto end = data + bytes.size();
+	auto hash = seed + prime5;
+
+	if (bytes.size() >= 32) {
+		auto lanes = array<uint64, 4>{seed + prime1 + prime2, seed + prime2, seed, seed - prime1};
+
+		for (; end - data >= 32; data += 32) {
+			for (auto i = 0; i < 4; ++i)
+				lanes[i] = round(lanes[i], readBits<uint64>(data + i * 8));
+		}
+
+		hash = rotl(lanes[0], 1) + rotl(lanes[1], 7) + rotl(lanes[2], 12) + rotl(lanes[3], 18);
+		for (auto lane : lanes)
+			hash = merge(hash, lane);
+	}
+
+	hash += bytes.size();
+
+	for (; end - data >= 8; data += 8)
+		hash = rotl(hash ^ round(0, readBits<uint64>(data)), 27) * prime1 + prime4;
+	if (end - data >= 4) {
+		hash = rotl(hash ^ (readBits<uint32>(data) * prime1), 23) * prime2 + prime3;
+		data += 4;
+	}
+	for (; data != end; ++data)
+		hash = rotl(hash ^ (static_cast<uint8>(*data) * prime5), 11) * prime1;
+
+	hash ^= hash >> 33;
+	hash *= prime2;
+	hash ^= hash >> 29;
+	hash *= prime3;
+	return hash ^ (hash >> 32);
+}
+
+/// Load a result from a blob, given the key of the source and options, which is the slow part to work out.
+auto loadBlob(const Parser::Options& options, const shared_ptr<const Source>& source, uint64 key, string_view blob, Parser::Result& result)
+{
+	auto reader = BlobReader{blob};
+	auto& info = result.info;
+	auto header = reader.read<Header>();
+
+	if (header.magic != magic || header.version != ParseCache::VERSION || header.byteOrder != byteOrderMark)
+		return false;
+	if (header.key != key || header.codeSize != source->getCode().size())
+		return false;
+	if (header.checksum != hashBytes(reader.getRemaining(), header.key))
+		return false;
+
+	auto lengths = vector<uint32>{};
+	auto text = vector<char>{};
+	reader.readArray(lengths, header.numSymbols);
+	reader.readArray(text, std::accumulate(lengths.begin(), lengths.end(), 0_uz));
+
+	auto offset = 0_uz;
+
+	for (auto length : lengths) {
+		info.symbols.intern(string_view{text.data() + offset, length});
+		offset += length;
+	}
+
+	info.labels.reserve(header.numLabels);
+
+	for (auto i = 0u; i < header.numLabels; ++i) {
+		auto record = reader.read<LabelRecord>();
+		if (record.symbol >= info.symbols.size() || record.segment >= Segment::MAX || record.definitionSegment >= Segment::MAX)
+			return false;
+
+		auto symbol = static_cast<Symbol>(record.symbol);
+		auto definition = TokenHandle{static_cast<Segment::Type>(record.definitionSegment), record.index};
+		info.labels.push_back(info.arena->create<Label>(symbol, info.symbols.get(symbol), definition, static_cast<Segment::Type>(record.segment)));
+		info.labelMap.emplace(symbol, info.labels.size() - 1);
+	}
+
+	info.segmentSwitches.reserve(header.numSwitches);
+
+	for (auto i = 0u; i < header.numSwitches; ++i) {
+		auto record = reader.read<SwitchRecord>();
+		if (record.segment >= Segment::MAX)
+			return false;
+		info.segmentSwitches.push_back(Parser::SegmentSwitch{static_cast<size_t>(record.offset), static_cast<Segment::Type>(record.segment)});
+	}
+
+	for (auto i = 0; i < Segment::MAX; ++i) {
+		auto& segment = info.segments[i];
+		segment.type = static_cast<Segment::Type>(i);
+		segment.size = static_cast<size_t>(reader.read<uint64>());
+
+		if (segment.tokens)
+			segment.tokens->reset(source, options.tokenStorage);
+		else
+			segment.tokens = make_shared<TokenStream>(source, options.tokenStorage);
+
+		segment.tokens->load(reader, info.labels);
+	}
+
+	return reader.atEnd();
+}
+
+/// Write a blob to a file of the cache, by way of a file of its own so nothing ever maps half of one.
+auto writeFile(const std::filesystem::path& path, string_view blob)
+{
+	auto ec = std::error_code{};
+	std::filesystem::create_directories(path.parent_path(), ec);
+
+	auto temp = path;
+	temp += fmt::format(".{:08x}.tmp", std::random_device{}());
+
+	{
+		auto file = std::ofstream{temp, std::ios::binary};
+		file.write(blob.data(), static_cast<std::streamsize>(blob.size()));
+		if (!file) {
+			file.close();
+			std::filesystem::remove(temp, ec);
+			return;
+		}
+	}
+
+	std::filesystem::rename(temp, path, ec);
+	if (ec) std::filesystem::remove(temp, ec);
+}
+
+}
+
+auto ParseCache::getKey(const Parser::Options& options, const Source& source)->uint64
+{
+	// the storage, threads and reporting of the options don't change the tokens or labels parsing gives
+	auto seed = uint64{VERSION} << 1 | (options.testForceTokenization ? 1 : 0);
+	return hashBytes(source.getCode(), seed);
+}
+
+auto ParseCache::save(const Parser::Options& options, const Source& source, const Parser::Result& result)->string
+{
+	if (!result.reports.empty())
+		throw std::invalid_argument("parse results with reports can't be cached");
+
+	auto& info = result.info;
+	auto writer = BlobWriter{};
+	auto header = Header{magic, VERSION, byteOrderMark};
+	header.numSymbols = static_cast<uint32>(info.symbols.size());
+	header.key = getKey(options, source);
+	header.codeSize = source.getCode().size();
+	header.numLabels = static_cast<uint32>(info.labels.size());
+	header.numSwitches = static_cast<uint32>(info.segmentSwitches.size());
+	writer.write(header);
+
+	// symbols are interned again in the same order when loading, so every symbol keeps its number
+	auto lengths = vector<uint32>{};
+	auto text = string{};
+	lengths.reserve(info.symbols.size());
+
+	for (auto i = 0_uz; i < info.symbols.size(); ++i) {
+		auto symbol = info.symbols.get(static_cast<Symbol>(i));
+		lengths.push_back(static_cast<uint32>(symbol.size()));
+		text += symbol;
+	}
+
+	writer.writeArray(lengths);
+	writer.writeArray(text.data(), text.size());
+
+	for (auto label : info.labels) {
+		writer.write(LabelRecord{
+			static_cast<uint32>(label->symbol),
+			label->definition.index,
+			static_cast<uint8>(label->definition.segment),
+			static_cast<uint8>(label->segment)
+		});
+	}
+
+	for (auto& segmentSwitch : info.segmentSwitches)
+		writer.write(SwitchRecord{segmentSwitch.offset, static_cast<uint32>(segmentSwitch.segment)});
+
+	auto getLabelIndex = [&](const Label* label) {
+		return static_cast<uint32>(info.labelMap.at(label->symbol));
+	};
+
+	for (auto& segment : info.segments) {
+		writer.write(static_cast<uint64>(segment.size));
+		if (segment.tokens)
+			segment.tokens->save(writer, getLabelIndex);
+		else
+			TokenStream{}.save(writer, getLabelIndex);
+	}
+
+	auto blob = writer.release();
+	header.checksum = hashBytes(string_view{blob}.substr(sizeof(Header)), header.key);
+	std::memcpy(blob.data(), &header, sizeof(Header));
+	return blob;
+}
+
+auto ParseCache::load(const Parser::Options& options, shared_ptr<const Source> source, string_view blob, Parser::Result& result)->bool
+{
+	result.reset();
+
+	try {
+		if (loadBlob(options, source, getKey(options, *source), blob, result))
+			return true;
+	}
+	catch (const std::out_of_range&) {
+		// the blob ends early, which is as good as not having one
+	}
+
+	result.reset();
+	return false;
+}
+
+auto ParseCache::tokenize(const Parser::Options& options, shared_ptr<const Source> source, const fs::path& directory, Parser::Result& result)->bool
+{
+	const auto key = getKey(options, *source);
+	const auto path = directory / fmt::format("{:016x}.clpc", key);
+	result.reset();
+
+	try {
+		auto file = MappedFile{path};
+		if (loadBlob(options, source, key, file.getData(), result))
+			return true;
+	}
+	catch (const std::system_error&) {
+		// there's no cached result, or it can't be read
+	}
+	catch (const std::out_of_range&) {
+		// the cached result ends early
+	}
+
+	Parser::tokenize(options, source, result);
+
+	if (result.reports.empty())
+		writeFile(path, save(options, *source, result));
+	return false;
+}
@@ -1,154 +1,95 @@
 #include <CLARA/pch.h>
+#include <CLARA/Common/Scan.h>
+#include <CLARA/Common/Workers.h>
+#include <CLARA/Lexer.h>
 #include <CLARA/Parser.h>
+#include <CLARA/ReportWriter.h>
 
 using namespace CLARA::CLASM;
 
 namespace CLARA::CLASM::Parser {
 
-struct LexRule {
-	TokenType type;
-	size_t(*func)(string_view);
-};
-
-struct LexResult {
-	TokenType type;
-	size_t length;
-
-	LexResult(TokenType type, size_t length) : type(type), length(length)
-	{ }
-};
-
-struct Continue {
-	using Tokens = small_vector<Token, 16>;
-	Tokens tokens;
-
-	Continue() = default;
-
-	Continue(Token token) : tokens({token})
-	{ }
-
-	Continue(Token&& token) : tokens({token})
-	{ }
-
-	auto add(const Token& token)
-	{
-		tokens.emplace_back(token);
-	}
-	
-	auto add(const Tokens& newTokens)
-	{
-		tokens.insert(tokens.end(), newTokens.begin(), newTokens.end());
-	}
-};
-
-struct Finish {
-	optional<Token> token;
-	optional<Expected> expected;
-	small_vector<Report> reports;
-
-	Finish() = default;
-
-	Finish(Token&& token) : token(token)
-	{ }
-
-	Finish(const Token& token) : token(token)
-	{ }
-
-	auto& merge(const Finish& other)
-	{
-		if (reports.empty())
-			reports = move(other.reports);
-		return *this;
-	}
-
-	auto& expect(TokenType type)
-	{
-		expected.emplace(type);
-		return *this;
-	}
-
-	auto& expect(TokenType type, string value)
-	{
-		expected.emplace(make_pair(type, value));
-		return *this;
-	}
-
-	auto& expect(AnyOf types)
-	{
-		expected.emplace(types);
-		return *this;
-	}
-
-	template<typename... TArgs>
-	auto& report(TArgs&&... args)
-	{
-		reports.emplace_back(forward<TArgs>(args)...);
-		return *this;
-	}
-
-	template<typename... TArgs>
-	auto& warn(TArgs&&... args)
-	{
-		reports.emplace_back(ReportType::Warning, forward<TArgs>(args)...);
-		return *this;
-	}
-
-	template<typename... TArgs>
-	auto& error(TArgs&&... args)
-	{
-		reports.emplace_back(ReportType::Error, forward<TArgs>(args)...);
-		return *this;
-	}
-};
-
-struct Fatal {
-	Report error;
-
-	Fatal() = default;
-
-	Fatal(Source::Token token) : error(ReportType::Fatal, token, diagnose<DiagCode::Unknown>())
-	{ }
+/*
+ * The parser reads the source a line at a time: tokens which begin a statement (an instruction, keyword or data
+ * declaration) are collected into a buffer until the statement ends, then it is checked in place and its tokens are
+ * moved into the segment token stream. Tokens which make up a line on their own (labels, segments) go straight in.
+ * The buffer and the report lists are kept for the whole parse, so valid lines don't touch the heap.
+ *
+ * A large source may be split into shards at line boundaries which are parsed on worker threads. The only state
+ * carried from one line to the next is the active segment and the labels, so each shard is parsed from a guess of the
+ * segment it begins in, with label definitions it can't know are redefinitions reported provisionally. The shards are
+ * merged in order, one parsed from a wrong guess is parsed again, and the merge settles the labels as one parse would.
+ *
+ * An edit is parsed the same way, the lines around it as a shard between the unchanged lines before and after it. Its
+ * tokens are spliced in if it leaves the segment and the label definitions as they were, which is all the lines after
+ * it depend on.
+ */
 
-	Fatal(Source::Token token, Diagnosis&& info) : error(ReportType::Fatal, token, forward<Diagnosis>(info))
-	{ }
+struct Error {
+	Source::Token token;
+	Diagnosis info;
 };
 
-struct Success {
-	small_vector<Token, 16> tokens;
+using Statement = small_vector<Token, 16>;
 
-	template<typename... TArgs>
-	decltype(auto) addToken(TArgs&&... args)
-	{
-		return tokens.emplace_back(forward<TArgs>(args)...);
-	}
+/// What parsing a single token means for the statement being read.
+enum class TokenAction {
+	Continue,                                   // the token is part of the statement
+	Finish,                                     // the token ends the statement, or is a line on its own
+	End,                                        // the statement ends, the token itself isn't kept
+	Fatal,                                      // parsing can't go on, the report is the last of tokenReports
 };
 
-struct Error {
-	Source::Token token;
-	Diagnosis info;
+// the tokens which may begin a line in each segment, the last for before any segment directive
+constexpr auto lineStartExpectations = array<TokenExpectation, Segment::MAX + 1>{
+	/* Header */ TokenExpectation{{TokenType::EndOfFile, TokenType::EndOfLine, TokenType::Identifier, TokenType::Segment}},
+	/* Data   */ TokenExpectation{{TokenType::EndOfFile, TokenType::EndOfLine, TokenType::Label, TokenType::Segment}},
+	/* Code   */ TokenExpectation{{TokenType::EndOfFile, TokenType::EndOfLine, TokenType::Identifier, TokenType::Label, TokenType::Segment}},
+	/* MAX    */ TokenExpectation{{TokenType::EndOfFile, TokenType::EndOfLine, TokenType::Identifier, TokenType::Segment}},
 };
+constexpr auto endOfLineExpectation = TokenExpectation{{TokenType::EndOfLine}};
 
-using ParseState = variant<Finish, Continue, Fatal>;
-using ParseResult = variant<Success, Error, small_vector<Error>>;
+static_assert(lineStartExpectations[Segment::Data].matches(TokenType::Label, "A:"));
+static_assert(!lineStartExpectations[Segment::Data].matches(TokenType::Identifier, "A"));
 
 struct State {
 	ParseInfo& info;
-	ParseState state;
 	TokenStream* tokens;                        // points to the active segment tokens: &info.segments[segment].tokens
-	small_vector<Token*> unresolvedLabelTokens;
-	std::unordered_multimap<string, size_t> unresolvedLabelTokenNameMap;
+	std::vector<TokenHandle, ArenaAllocator<TokenHandle>> unresolvedLabelTokens;
+	std::unordered_multimap<Symbol, size_t, std::hash<Symbol>, std::equal_to<Symbol>, ArenaAllocator<pair<const Symbol, size_t>>> unresolvedLabelTokenNameMap;
 	Segment::Type segment = Segment::Header;
-	uint64_t offset = 0;
+	bool afterShard = false;                    // labels may also be defined by shards of the source before this one
+
+	Statement statement;                        // the statement being read
+	Segment::Type statementSegment = Segment::Header;
+	bool inStatement = false;
+	TokenExpectation expected = lineStartExpectations[Segment::MAX];
+	small_vector<Report, 4> tokenReports;       // reports from parsing the current token
+	small_vector<Report, 4> lineReports;        // reports from parsing the statement or line it ended
+	string scratch;                             // unescaped string literal text
+
+	State(shared_ptr<const Source> source, TokenStorage storage, ParseInfo& info_) :
+		info(info_),
+		unresolvedLabelTokens(*info_.arena),
+		unresolvedLabelTokenNameMap(0, std::hash<Symbol>{}, std::equal_to<Symbol>{}, *info_.arena)
+	{
+		prepareSegments(info, source, storage);
+		tokens = info.segments[Segment::Header].tokens.get();
+	}
 
-	State(shared_ptr<const Source> source, ParseInfo& info_, ParseState state_) : info(info_), state(state_)
+	/// Give each segment an empty token stream over the source.
+	static auto prepareSegments(ParseInfo& info, const shared_ptr<const Source>& source, TokenStorage storage)->void
 	{
 		auto segType = 0;
 		for (auto& segment : info.segments) {
 			segment.type = static_cast<Segment::Type>(segType++);
-			segment.tokens = make_shared<TokenStream>(source);
-		}
 
-		tokens = info.segments[Segment::Header].tokens.get();
+			// streams left by ParseInfo::reset are only ours, so their memory can be reused
+			if (segment.tokens)
+				segment.tokens->reset(source, storage);
+			else
+				segment.tokens = make_shared<TokenStream>(source, storage);
+		}
 	}
 
 	auto setSegment(Segment::Type seg)
@@ -157,121 +98,141 @@ struct State {
 		tokens = info.segments[seg].tokens.get();
 	}
 
-	auto defineLabel(string name, Token& token, Segment::Type segment)->pair<Label&, bool>
+	auto makeHandle(size_t index) const
+	{
+		if (index > std::numeric_limits<uint32>::max())
+			throw ParseException("too many tokens in segment");
+		return TokenHandle{segment, static_cast<uint32>(index)};
+	}
+
+	/// Define a label for the token at `index` of the active segment.
+	auto defineLabel(Symbol name, size_t index, Segment::Type segment)->pair<Label&, bool>
 	{
 		auto idx = info.labels.size();
 		auto res = info.labelMap.emplace(name, idx);
 		auto label = res.second
-			? info.labels.emplace_back(make_unique<Label>(Label{name, token, segment})).get()
-			: info.labels[res.first->second].get();
+			? info.labels.emplace_back(info.arena->create<Label>(name, info.symbols.get(name), makeHandle(index), segment))
+			: info.labels[res.first->second];
 		auto [begin, end] = unresolvedLabelTokenNameMap.equal_range(name);
 		
 		for (auto it = begin; it != end; ++it) {
-			unresolvedLabelTokens[it->second]->annotation.emplace<LabelRef>(info.labels[it->second].get());
+			auto& handle = unresolvedLabelTokens[it->second];
+			info.segments[handle.segment].tokens->setAnnotation(handle.index, LabelRef(label));
 		}
 
 		if (res.second)
 			label->segment = segment;
 
-		token.annotation.emplace<const Label*>(label);
+		tokens->setAnnotation(index, label);
 		unresolvedLabelTokenNameMap.erase(begin, end);
 		return pair<Label&, bool>(*label, res.second);
 	}
 
-	auto referenceLabel(Token& token)
+	/// Resolve a label reference which is about to be pushed at `index` of the active segment.
+	auto referenceLabel(Token& token, size_t index)
 	{
-		auto it = info.labelMap.find(string(token.text));
+		auto name = get<Symbol>(token.annotation);
+		auto it = info.labelMap.find(name);
 		if (it != info.labelMap.end()) {
-			token.annotation.emplace<LabelRef>(info.labels[it->second].get());
+			token.annotation.emplace<LabelRef>(info.labels[it->second]);
 		}
 		else {
-			unresolvedLabelTokenNameMap.emplace(get<string>(token.annotation), unresolvedLabelTokens.size());
-			unresolvedLabelTokens.push_back(&token);
+			unresolvedLabelTokenNameMap.emplace(name, unresolvedLabelTokens.size());
+			unresolvedLabelTokens.push_back(makeHandle(index));
 		}
 	}
-};
 
-auto parseIdentifier(const State& state, Token&& token)->ParseState
-{
-	auto id = string(token.text);
+	/// Define the label for a label token and push it to the active segment, reporting a redefinition.
+	auto pushLabel(Token&& token, Segment::Type labelSegment)
+	{
+		auto name = info.symbols.intern(token.text.substr(0, token.text.size() - 1));
+		auto index = tokens->size();
+		auto source = Source::Token(token);
+		tokens->push(move(token));
 
-	auto getKeyword = [&]() {
-		if (auto kw = Keyword::fromName(id); kw != Keyword::MAX) {
-			token.type = TokenType::Keyword;
-			token.annotation.emplace<Keyword::Type>(kw);
-			return true;
+		auto&& [label, defined] = defineLabel(name, index, labelSegment);
+
+		if (!defined) {
+			lineReports.emplace_back(ReportType::Error, source, diagnose<DiagCode::LabelRedefinition>(info.getToken(label.definition)));
 		}
-		return false;
-	};
+		else if (afterShard) {
+			// without an original the merge keeps the report only if an earlier shard defined the label
+			lineReports.emplace_back(ReportType::Error, source, diagnose<DiagCode::LabelRedefinition>(Source::Token{}));
+		}
+	}
+
+	/// Get the label references which are still unresolved, in the order they were made.
+	auto getUnresolvedLabelTokens(vector<TokenHandle>& handles) const
+	{
+		if (unresolvedLabelTokenNameMap.empty())
+			return;
 
-	auto getDataType = [&]() {
-		if (auto dt = DataType::fromName(id); dt != DataType::MAX) {
+		auto indices = vector<size_t>{};
+		indices.reserve(unresolvedLabelTokenNameMap.size());
+
+		for (auto& elem : unresolvedLabelTokenNameMap)
+			indices.push_back(elem.second);
+
+		std::sort(indices.begin(), indices.end());
+
+		for (auto index : indices)
+			handles.push_back(unresolvedLabelTokens[index]);
+	}
+};
+
+auto parseIdentifier(State& state, Token& token)->TokenAction
+{
+	// one probe finds every meaning of the word, the checks below only pick which one applies
+	if (auto word = ReservedWord::fromName(token.text)) {
+		if (state.segment == Segment::Data && word->dataType != DataType::MAX) {
 			token.type = TokenType::DataType;
-			token.annotation.emplace<DataType::Type>(dt);
-			return true;
+			token.annotation.emplace<DataType::Type>(word->dataType);
+			return TokenAction::Continue;
 		}
-		return false;
-	};
-
-	auto getMnemonic = [&]() {
-		if (auto mnemonic = Mnemonic::fromName(id); mnemonic != Mnemonic::MAX) {
+		if (word->keyword != Keyword::MAX) {
+			token.type = TokenType::Keyword;
+			token.annotation.emplace<Keyword::Type>(word->keyword);
+			return TokenAction::Continue;
+		}
+		if (word->mnemonic != Mnemonic::MAX) {
 			token.type = TokenType::Mnemonic;
-			token.annotation.emplace<Mnemonic::Type>(mnemonic);
-			return true;
+			token.annotation.emplace<Mnemonic::Type>(word->mnemonic);
+			return TokenAction::Continue;
 		}
-		return false;
-	};
-
-	auto getInstruction = [&]() {
-		if (auto insn = Instruction::fromName(id); insn != Instruction::MAX) {
+		if (word->instruction != Instruction::MAX) {
 			token.type = TokenType::Instruction;
-			token.annotation.emplace<Instruction::Type>(insn);
-			return true;
+			token.annotation.emplace<Instruction::Type>(word->instruction);
+			return TokenAction::Continue;
 		}
-		return false;
-	};
-
-	if (state.segment == Segment::Data) {
-		if (getDataType())
-			return Continue(token);
 	}
-	
-	if (
-		getKeyword() ||
-		getMnemonic() ||
-		getInstruction()
-	)
-		return Continue(token);
-
-	token.annotation.emplace<string>(move(id));
-
-	if (is<Continue>(state.state))
-		return Continue(token);
-	return Finish(token);
+
+	token.annotation.emplace<Symbol>(state.info.symbols.intern(token.text));
+	return state.inStatement ? TokenAction::Continue : TokenAction::Finish;
 }
 
-auto parseSegment(const State& state, Token&& token)->ParseState
+auto parseSegment(State& state, Token& token)->TokenAction
 {
-	auto result = Finish(move(token));
-
-	if (is<Continue>(state.state) && state.segment != Segment::Data)
-		return result.error(token, diagnose<DiagCode::UnexpectedSegmentAfterTokens>());
+	if (state.inStatement && state.segment != Segment::Data) {
+		state.tokenReports.emplace_back(ReportType::Error, token, diagnose<DiagCode::UnexpectedSegmentAfterTokens>());
+		return TokenAction::Finish;
+	}
 
 	auto id = token.text.substr(1);
 
 	if (auto segment = Segment::fromName(id); segment != Segment::MAX) {
-		result.token->annotation = segment;
-		return result;
+		token.annotation = segment;
+		return TokenAction::Finish;
 	}
 
-	return Finish().error(token, diagnose<DiagCode::InvalidSegment>());
+	state.tokenReports.emplace_back(ReportType::Error, token, diagnose<DiagCode::InvalidSegment>());
+	return TokenAction::End;
 }
 
-auto parseString(const State&, Token&& token)->ParseState
+auto parseString(State& state, Token& token)->TokenAction
 {
-	auto result = Finish{};
-	auto str = string{};
-	str.reserve(token.text.size());
+	// unescaped text is built in a buffer kept by the state, so literals don't allocate once it has grown
+	auto& str = state.scratch;
+	str.clear();
 
 	// get just the stuff between the quotes
 	auto text = token.text.substr(1_uz, token.text.size() - 2);
@@ -312,7 +273,8 @@ auto parseString(const State&, Token&& token)->ParseState
 				
 				if (res.ec != std::errc{}) {
 					if (!dist) {
-						result.error(
+						state.tokenReports.emplace_back(
+							ReportType::Error,
 							Source::Token(token.source, token.offset + std::distance(token.text.data(), sv.data()), sv),
 							diagnose<DiagCode::InvalidHexEscapeSequence>(
 								Diagnostic<DiagCode::InvalidHexEscapeSequence>::Problem::NoHexChars
@@ -325,7 +287,8 @@ auto parseString(const State&, Token&& token)->ParseState
 
 						seq = seq.substr(0, dist);
 
-						result.error(
+						state.tokenReports.emplace_back(
+							ReportType::Error,
 							Source::Token(token.source, token.offset + std::distance(token.text.data(), sv.data()) + dist, seq),
 							diagnose<DiagCode::InvalidHexEscapeSequence>(
 								res.ec == std::errc::result_out_of_range
@@ -355,15 +318,13 @@ auto parseString(const State&, Token&& token)->ParseState
 	}
 
 	if (l == 0) {
-		str = text;
+		token.annotation = state.info.symbols.intern(text);
 	}
 	else {
 		str += text.substr(l);
+		token.annotation = state.info.symbols.intern(str);
 	}
-
-	token.annotation = move(str);
-	result.token = move(token);
-	return result;
+	return TokenAction::Finish;
 }
 
 auto resolveIntegerAnnotation(Token& token, uint64_t num, bool negative)->TokenAnnotation
@@ -405,110 +366,86 @@ auto resolveIntegerAnnotation(Token& token, uint64_t num, bool negative)->TokenA
 	return TokenAnnotation{};
 }
 
-auto parseNumeric(const State& state, Token&& token)->ParseState
+auto parseNumeric(State& state, Token& token)->TokenAction
 {
-	auto literal = token.text;
-	auto negative = literal[0] == '-';
-	
-	if (negative || literal[0] == '+')
-		literal = literal.substr(1);
-	
-	if (token.type == TokenType::HexLiteral) {
-		if (auto num = stringToInt<uint64_t>(literal.substr(2), 16)) {
-			token.annotation = resolveIntegerAnnotation(token, *num, negative);
-		}
-	}
-	else if (token.type == TokenType::IntegerLiteral) {
-		if (auto num = stringToInt<uint64_t>(literal, 10)) {
-			token.annotation = resolveIntegerAnnotation(token, *num, negative);
-		}
-	}
-	else if (token.type == TokenType::FloatLiteral) {
-		if (auto num = stringToFloat(token.text)) {
-			token.annotation = *num;
+	// the lexer leaves the magnitude of integer literals in the annotation, resolve it to the smallest fitting type
+	if (token.type == TokenType::HexLiteral || token.type == TokenType::IntegerLiteral) {
+		if (auto num = get_if<uint64>(&token.annotation)) {
+			token.annotation = resolveIntegerAnnotation(token, *num, token.text[0] == '-');
 		}
 	}
-	
-	Finish result;
 
 	token.type = TokenType::Numeric;
 
 	if (is<monostate>(token.annotation)) {
-		result.error(token, diagnose<DiagCode::InvalidNumericLiteral>());
-	}
-	else if (is<Continue>(state.state)) {
-		return Continue(token);
-	}
-
-	result.token = move(token);
-	return result;
-}
-
-auto preParseToken(const State& state, const Token& token)->ParseState
-{
-	if (state.segment == Segment::Data && is<Continue>(state.state)) {
-		switch (token.type) {
-		default: break;
-		case TokenType::Segment: return Finish();
-		}
+		state.tokenReports.emplace_back(ReportType::Error, token, diagnose<DiagCode::InvalidNumericLiteral>());
+		return TokenAction::Finish;
 	}
-	return Continue();
+	return state.inStatement ? TokenAction::Continue : TokenAction::Finish;
 }
 
-auto parseToken(const State& state, Token&& token)->ParseState
+auto parseToken(State& state, Token& token)->TokenAction
 {
 	switch (token.type) {
 	default: break;
 	case TokenType::EndOfLine:
-		if (state.segment == Segment::Data && is<Continue>(state.state)) {
-			return Continue();
-		}
 	case TokenType::EndOfFile:
-		return Finish();
-	case TokenType::Identifier: return parseIdentifier(state, forward<Token>(token));
-	case TokenType::Segment: return parseSegment(state, forward<Token>(token));
-	case TokenType::String: return parseString(state, forward<Token>(token));
+		return TokenAction::End;
+	case TokenType::Identifier: return parseIdentifier(state, token);
+	case TokenType::Segment: return parseSegment(state, token);
+	case TokenType::String: return parseString(state, token);
 	case TokenType::HexLiteral:
 	case TokenType::FloatLiteral:
 	case TokenType::IntegerLiteral:
-		return parseNumeric(state, forward<Token>(token));
+		return parseNumeric(state, token);
 	case TokenType::Label:
 		if (state.segment == Segment::Data) {
-			return Continue(token);
+			return TokenAction::Continue;
 		}
-		if (is<Continue>(state.state)) {
-			return Finish().error(forward<Token>(token), diagnose<DiagCode::UnexpectedLabelAfterTokens>());
+		if (state.inStatement) {
+			state.tokenReports.emplace_back(ReportType::Error, token, diagnose<DiagCode::UnexpectedLabelAfterTokens>());
+			return TokenAction::End;
 		}
-		return Finish(forward<Token>(token));
+		return TokenAction::Finish;
 	case TokenType::Separator:
 		if (token.text == ",") {
-			return Finish();
+			return TokenAction::End;
 		}
-		return Finish().error(forward<Token>(token), diagnose<DiagCode::UnexpectedSeparator>());
+		state.tokenReports.emplace_back(ReportType::Error, token, diagnose<DiagCode::UnexpectedSeparator>());
+		return TokenAction::End;
 	}
-	return Fatal(forward<Token>(token), diagnose<DiagCode::UnexpectedToken>(token.type));
+	state.tokenReports.emplace_back(ReportType::Fatal, token, diagnose<DiagCode::UnexpectedToken>(token.type));
+	return TokenAction::Fatal;
 }
 
-auto checkOperandType(OperandType type, const Token& token)->ParseResult
+/**
+ * Check a token against an operand type.
+ *
+ * @param  type      The operand type.
+ * @param  tokenType The type the token would have as the operand.
+ * @param  token     The token.
+ * @return The problem if the token doesn't fit.
+ */
+auto checkOperandType(OperandType type, TokenType tokenType, const Token& token)->optional<DiagCode>
 {
 	switch (type) {
 	case OperandType::IMM8:
 		if (is<int16_t>(token.annotation) || is<uint16_t>(token.annotation))
-			return Error{token, diagnose<DiagCode::LiteralValueSizeOverflow>(type)};
+			return DiagCode::LiteralValueSizeOverflow;
 	case OperandType::IMM16:
 		if (is<int32_t>(token.annotation) || is<uint32_t>(token.annotation))
-			return Error{token, diagnose<DiagCode::LiteralValueSizeOverflow>(type)};
+			return DiagCode::LiteralValueSizeOverflow;
 	case OperandType::IMM32:
 		if (is<int64_t>(token.annotation) || is<uint64_t>(token.annotation))
-			return Error{token, diagnose<DiagCode::LiteralValueSizeOverflow>(type)};
+			return DiagCode::LiteralValueSizeOverflow;
 	case OperandType::IMM64:
-		if (!token.is(TokenType::Numeric))
-			return Error{token, diagnose<DiagCode::InvalidOperandType>(type)};
+		if (tokenType != TokenType::Numeric)
+			return DiagCode::InvalidOperandType;
 		break;
 
 	case OperandType::REL32:
-		if (token.type != TokenType::LabelRef)
-			return Error{token, diagnose<DiagCode::InvalidOperandType>(type)};
+		if (tokenType != TokenType::LabelRef)
+			return DiagCode::InvalidOperandType;
 		break;
 
 	case OperandType::V16:
@@ -516,742 +453,1365 @@ auto checkOperandType(OperandType type, const Token& token)->ParseResult
 	case OperandType::LV8:
 	case OperandType::LV16:
 	case OperandType::LV32:
-		return Error{};
+		return DiagCode::Unknown;
 
 	case OperandType::S32:
-		if (token.type == TokenType::String)
+		if (tokenType == TokenType::String)
 			break;
-		return Error{token, diagnose<DiagCode::InvalidOperandType>(type)};
+		return DiagCode::InvalidOperandType;
 	}
 
-	return Success{};
+	return nullopt;
 }
 
-auto parseInstructionLine(State& state, const TokenVec& tokens)->ParseResult
+/// Get the type an operand token takes for an operand type, identifiers become label references where one fits.
+auto getOperandTokenType(OperandType type, const Token& token)
 {
-	auto parseOperands = [&](Instruction::Type instruction)->ParseResult {
-		auto success = Success();
-		auto& operands = Instruction::getOperands(instruction);
-		auto begin = std::begin(tokens) + 1;
-		auto end = std::end(tokens);
-		auto it = begin;
-
-		success.tokens.reserve(static_cast<size_t>(std::abs(std::distance(it, end) + 1)));
-
-		auto& insnToken = success.addToken(tokens[0].source, TokenType::Instruction, tokens[0].offset, tokens[0].text.size());
-		insnToken.annotation = instruction;
-
-		auto parseOperand = [&success](OperandType type, Token token)->ParseResult {
-			if (token.type == TokenType::Identifier) {
-				switch (type) {
-				default: break;
-				case OperandType::REL32:
-					token.type = TokenType::LabelRef;
-					break;
-				}
+	if (token.type == TokenType::Identifier && type == OperandType::REL32)
+		return TokenType::LabelRef;
+	return token.type;
+}
+
+/**
+ * Check the operands of a statement against an instruction without changing the tokens.
+ *
+ * @param  tokens      The statement, the instruction or mnemonic first.
+ * @param  instruction The instruction.
+ * @param  error       Set to the first error, if not null.
+ * @return Whether the operands fit.
+ */
+auto checkOperands(const Statement& tokens, Instruction::Type instruction, optional<Error>* error = nullptr)->bool
+{
+	auto& operands = Instruction::getOperands(instruction);
+	auto begin = std::begin(tokens) + 1;
+	auto end = std::end(tokens);
+	auto it = begin;
+
+	auto checkOperand = [&](OperandType type) {
+		if (it == end) {
+			if (error) {
+				auto token = begin != end ? Source::Token(*begin, *std::prev(it)) : Source::Token(tokens.front());
+				error->emplace(Error{token, diagnose<DiagCode::MissingOperand>(type)});
 			}
+			return false;
+		}
 
-			auto res = checkOperandType(type, token);
+		auto& token = *it++;
+		auto problem = checkOperandType(type, getOperandTokenType(type, token), token);
 
-			if (is<Error>(res)) {
-				return get<Error>(res);
+		if (problem && error) {
+			switch (*problem) {
+			default: error->emplace(Error{}); break;
+			case DiagCode::LiteralValueSizeOverflow: error->emplace(Error{token, diagnose<DiagCode::LiteralValueSizeOverflow>(type)}); break;
+			case DiagCode::InvalidOperandType: error->emplace(Error{token, diagnose<DiagCode::InvalidOperandType>(type)}); break;
 			}
+		}
+		return !problem;
+	};
 
-			success.tokens.emplace_back(move(token));
-			return Success{};
-		};
+	for (auto& operand : operands) {
+		// a variadic operand repeats its types until the statement runs out
+		do {
+			for (auto type : operand.types) {
+				if (!checkOperand(type))
+					return false;
+			}
+		}
+		while (operand.variadic && it != end);
+	}
+
+	if (it != end) {
+		if (error) {
+			auto last = end - 1;
+			auto token = it != last ? Source::Token(*it, *last) : Source::Token(*it);
+			auto numExpected = static_cast<uint>(operands.size());
+			auto numProvided = static_cast<uint>(std::distance(begin, end));
+			error->emplace(Error{token, diagnose<DiagCode::UnexpectedOperand>(it->type, numExpected, numProvided)});
+		}
+		return false;
+	}
+	return true;
+}
 
-		for (auto& operand : operands) {
-			if (operand.variadic) {
-				for (auto cur = it; it != end; ++cur) {
-					for (auto type : operand.types) {
-						if (cur == end) {
-							auto last = std::prev(cur);
-							return Error{Source::Token(*begin, *last), diagnose<DiagCode::MissingOperand>(type)};
-						}
+/**
+ * Store a numeric operand at the width of its operand type, so the instruction is emitted at its encoded size.
+ *
+ * Literals are lexed into the narrowest type holding them, which is narrower than the operand unless a mnemonic
+ * picked the instruction by it. Integers keep their signedness, real operands are stored as a float or a double.
+ */
+auto widenOperand(OperandType type, bool real, TokenAnnotation& annotation)
+{
+	auto size = getOperandSize(type);
 
-						auto result = parseOperand(type, *cur++);
+	std::visit([&](auto value) {
+		using T = decltype(value);
 
-						if (is<Error>(result)) {
-							return get<Error>(result);
-						}
-					}
+		if constexpr (std::is_arithmetic_v<T>) {
+			if (real || std::is_floating_point_v<T>) {
+				if (size == sizeof(float)) annotation = static_cast<float>(value);
+				else annotation = static_cast<double>(value);
+			}
+			else if (std::is_signed_v<T>) {
+				switch (size) {
+				case 1: annotation = static_cast<int8>(value); break;
+				case 2: annotation = static_cast<int16>(value); break;
+				case 4: annotation = static_cast<int32>(value); break;
+				default: annotation = static_cast<int64>(value); break;
 				}
 			}
 			else {
-				for (auto type : operand.types) {
-					if (it == end) {
-						auto token = begin != end ? Source::Token(*begin, *std::prev(it)) : Source::Token(tokens.front());
-						return Error{token, diagnose<DiagCode::MissingOperand>(type)};
-					}
-
-					auto result = parseOperand(type, *it++);
-
-					if (is<Error>(result))
-						return get<Error>(result);
+				switch (size) {
+				case 1: annotation = static_cast<uint8>(value); break;
+				case 2: annotation = static_cast<uint16>(value); break;
+				case 4: annotation = static_cast<uint32>(value); break;
+				default: annotation = static_cast<uint64>(value); break;
 				}
 			}
 		}
+	}, annotation);
+}
 
-		if (it != end) {
-			auto last = end - 1;
-			auto token = it != last ? Source::Token(*it, *last) : Source::Token(*it);
-			auto numExpected = static_cast<uint>(operands.size());
-			auto numProvided = static_cast<uint>(std::distance(begin, end));
-			return Error{token, diagnose<DiagCode::UnexpectedOperand>(it->type, numExpected, numProvided)};
+/// Turn a checked statement into the instruction and its operands in place.
+auto applyOperands(Statement& tokens, Instruction::Type instruction)
+{
+	auto& operands = Instruction::getOperands(instruction);
+	auto it = std::begin(tokens) + 1;
+
+	tokens[0].type = TokenType::Instruction;
+	tokens[0].annotation = instruction;
+
+	for (auto& operand : operands) {
+		do {
+			for (auto type : operand.types) {
+				it->type = getOperandTokenType(type, *it);
+				if (it->type == TokenType::Numeric)
+					widenOperand(type, operand.real, it->annotation);
+				++it;
+			}
 		}
+		while (operand.variadic && it != std::end(tokens));
+	}
+}
 
-		return success;
-	};
+/// Classify the operand of a mnemonic statement, which picks the instruction.
+auto getOperandShape(const Statement& tokens)
+{
+	if (tokens.size() == 1)
+		return OperandShape::None;
+	if (tokens.size() > 2)
+		return OperandShape::Other;
+
+	auto& token = tokens[1];
+
+	switch (token.type) {
+	default: break;
+	case TokenType::Identifier:
+	case TokenType::LabelRef:
+		return OperandShape::Label;
+	case TokenType::String:
+		return OperandShape::String;
+	case TokenType::Numeric:
+		return std::visit(visitor{
+			[](uint8) { return OperandShape::Int8; },
+			[](int8) { return OperandShape::Int8; },
+			[](uint16) { return OperandShape::Int16; },
+			[](int16) { return OperandShape::Int16; },
+			[](uint32) { return OperandShape::Int32; },
+			[](int32) { return OperandShape::Int32; },
+			[](uint64) { return OperandShape::Int64; },
+			[](int64) { return OperandShape::Int64; },
+			[](float) { return OperandShape::Real32; },
+			[](double) { return OperandShape::Real64; },
+			[](const auto&) { return OperandShape::Other; },
+		}, token.annotation);
+	}
+	return OperandShape::Other;
+}
+
+auto parseInstructionStatement(State& state)->bool
+{
+	auto& tokens = state.statement;
+	auto instruction = Instruction::MAX;
+	auto error = optional<Error>{};
 
 	if (tokens[0].type == TokenType::Mnemonic) {
 		auto mnemonic = get<Mnemonic::Type>(tokens[0].annotation);
+		instruction = Instruction::fromMnemonic(mnemonic, getOperandShape(tokens));
 
-		for (auto& overload : Mnemonic::getOverloads(mnemonic)) {
-			auto res = parseOperands(overload.insn);
-
-			if (auto success = get_if<Success>(&res)) {
-				return *success;
-			}
-		}
+		if (instruction == Instruction::MAX)
+			error = Error{Source::Token(tokens.front(), tokens.back()), diagnose<DiagCode::InvalidMnemonicOperands>(mnemonic)};
+		else
+			assert(checkOperands(tokens, instruction));
+	}
+	else {
+		instruction = get<Instruction::Type>(tokens[0].annotation);
+		checkOperands(tokens, instruction, &error);
+	}
 
-		return Error{Source::Token(tokens.front(), tokens.back()), diagnose<DiagCode::InvalidMnemonicOperands>(mnemonic)};
+	if (error) {
+		state.lineReports.emplace_back(ReportType::Error, tokens[0], move(error->info));
+		return false;
 	}
-	return parseOperands(get<Instruction::Type>(tokens[0].annotation));
+
+	applyOperands(tokens, instruction);
+	return true;
 }
 
-auto parseGlobalKeywordLine(State&, const TokenVec& tokens)->ParseResult
+auto parseGlobalKeywordStatement(State& state)->bool
 {
 	constexpr auto numParams = 1_uz;
-	auto success = Success();
+	auto& tokens = state.statement;
 	auto numArgs = tokens.size() - 1;
 
-	if (numArgs >= numParams) {
-		success.addToken(move(tokens[0]));
-		
-		auto errors = small_vector<Error, 8, 16>();
-		
-		for (auto it = tokens.cbegin() + 1; it != tokens.cend(); ++it) {
-			if (it->type != TokenType::Identifier) {
-				errors.emplace_back(Error{*it, diagnose<DiagCode::ExpectedToken>(it->type, TokenType::Label)});
-			}
+	if (numArgs < numParams) {
+		state.lineReports.emplace_back(
+			ReportType::Error,
+			tokens[0],
+			diagnose<DiagCode::InvalidKeywordArgCount>(Keyword::Global, numParams, numArgs)
+		);
+		return false;
+	}
 
-			auto& token = success.addToken(move(*it));
-			token.type = TokenType::LabelRef;
-		}
+	auto ok = true;
 
-		if (!errors.empty()) {
-			return errors;
+	for (auto it = tokens.begin() + 1; it != tokens.end(); ++it) {
+		if (it->type != TokenType::Identifier) {
+			state.lineReports.emplace_back(ReportType::Error, *it, diagnose<DiagCode::ExpectedToken>(it->type, TokenExpectation{{TokenType::Label}}));
+			ok = false;
 		}
-		
-		return success;
 	}
 
-	auto token = numArgs > 1 ? Source::Token(tokens[1], tokens.back()) : Source::Token(tokens.front());
-	return Error{token, diagnose<DiagCode::InvalidKeywordArgCount>(Keyword::Global, numParams, numArgs)};
+	if (ok) {
+		for (auto it = tokens.begin() + 1; it != tokens.end(); ++it)
+			it->type = TokenType::LabelRef;
+	}
+	return ok;
 }
 
-auto parseKeywordLine(State& state, const TokenVec& tokens)->ParseResult
+auto parseKeywordStatement(State& state)->bool
 {
-	switch (get<Keyword::Type>(tokens[0].annotation)) {
-	case Keyword::Global: return parseGlobalKeywordLine(state, tokens);
+	switch (get<Keyword::Type>(state.statement[0].annotation)) {
+	case Keyword::Global: return parseGlobalKeywordStatement(state);
 	case Keyword::Extern:
 	case Keyword::Import:
 	case Keyword::Include:
 	case Keyword::MAX:
 		break;
 	}
-	return Error{tokens[0], diagnose<DiagCode::InvalidIdentifier>()};
+	state.lineReports.emplace_back(ReportType::Error, state.statement[0], diagnose<DiagCode::InvalidIdentifier>());
+	return false;
 }
 
-auto parseDataDeclarationLine(State& parser, Continue&& state)->ParseState
+auto parseDataStatement(State& state)
 {
-	if (state.tokens.empty())
-		return Finish();
-
-	auto& tokens = state.tokens;
-	auto res = ParseResult(Success());
+	auto& tokens = state.statement;
+	auto it = tokens.begin();
 
-	if (tokens[0].type == TokenType::Label) {
-		auto name = string(tokens[0].text.substr(0, tokens[0].text.size() - 1));
-		auto token = parser.tokens->push(move(tokens[0]));
-		auto res = parser.defineLabel(name, *token, Segment::Data);
-
-		for (auto it = tokens.begin() + 1; it != tokens.end(); ++it) {
-			parser.tokens->push(move(*it));
-		}
+	switch (it->type) {
+	default: return;
+	case TokenType::Label:
+		state.pushLabel(move(*it++), Segment::Data);
+		break;
+	case TokenType::DataType:
+		break;
+	}
 
-		if (!res.second) {
-			return Finish().error(*token, diagnose<DiagCode::LabelRedefinition>(res.first));
-		}
+	for (; it != tokens.end(); ++it) {
+		state.tokens->push(move(*it));
 	}
-	return Finish().expect(TokenType::EndOfLine);
 }
 
-auto parseLine(State& parser, Finish&& state)->ParseState
+/**
+ * Parse the statement read so far and move its tokens into its segment.
+ *
+ * @return The report if the statement began with a token which can't begin one.
+ */
+auto finishStatement(State& state)->optional<Report>
 {
-	if (!state.token) {
-		return move(state);
-	}
+	auto& tokens = state.statement;
+	auto activeSegment = state.segment;
+	auto fatal = optional<Report>{};
+	state.inStatement = false;
 
-	auto token = &*state.token;
+	// a statement still open at the end of the source is finished in the segment it began in
+	state.setSegment(state.statementSegment);
 
-	switch (state.token->type) {
-	default: break;
+	if (state.segment == Segment::Data) {
+		parseDataStatement(state);
+	}
+	else {
+		auto ok = false;
 
-	case TokenType::Identifier:
-		return Finish().error(*parser.tokens->push(move(*token)), diagnose<DiagCode::InvalidIdentifier>());
+		switch (tokens[0].type) {
+		case TokenType::Mnemonic:
+		case TokenType::Instruction:
+			ok = parseInstructionStatement(state);
+			break;
 
-	case TokenType::Segment:
-		parser.setSegment(get<Segment::Type>(token->annotation));
-		return Finish().expect(TokenType::EndOfLine);
+		case TokenType::Keyword:
+			ok = parseKeywordStatement(state);
+			break;
 
-	case TokenType::Label:
-		{
-			auto name = string(state.token->text.substr(0, state.token->text.size() - 1));
-			token = &*parser.tokens->push(move(*token));
+		case TokenType::Label:
+		case TokenType::Segment:
+			throw ParseException("unexpected token in statement");
 
-			auto&& [label, defined] = parser.defineLabel(name, *token, parser.segment);
+		default:
+			fatal = Report::fatal(tokens[0], diagnose<DiagCode::UnexpectedTokenBeganLine>());
+			break;
+		}
+
+		if (ok) {
+			for (auto& token : tokens) {
+				if (token.type == TokenType::LabelRef) {
+					state.referenceLabel(token, state.tokens->size());
+				}
 
-			if (!defined) {
-				return Finish().error(*token, diagnose<DiagCode::LabelRedefinition>(label));
+				state.tokens->push(move(token));
 			}
 		}
-		return Finish();
-
-	case TokenType::Instruction:
-		parser.tokens->push(move(*token));
-		return Finish().expect({TokenType::EndOfLine, make_pair(TokenType::Separator, ","s)});
 	}
 
-	parser.tokens->push(move(*token));
-	return Finish();
+	state.setSegment(activeSegment);
+	tokens.clear();
+	return fatal;
 }
 
-auto parseLine(State& parser, Continue&& state)->ParseState
+/**
+ * Parse a token which is a line on its own and move it into the active segment.
+ *
+ * @return What the next line is checked against.
+ */
+auto parseLine(State& state, Token&& token)->TokenExpectation
 {
-	if (parser.segment == Segment::Data)
-		return parseDataDeclarationLine(parser, std::move(state));
-
-	if (state.tokens.empty())
-		return Finish();
-
-	auto& tokens = state.tokens;
-
-	auto seperable = false;
-	auto res = ParseResult(Success());
-
-	switch (tokens[0].type) {
-	case TokenType::Mnemonic:
-	case TokenType::Instruction:
-		res = parseInstructionLine(parser, tokens);
-		seperable = true;
-		break;
+	switch (token.type) {
+	default: break;
 
-	case TokenType::Keyword:
-		res = parseKeywordLine(parser, tokens);
+	case TokenType::Identifier:
+		state.lineReports.emplace_back(ReportType::Error, token, diagnose<DiagCode::InvalidIdentifier>());
 		break;
 
-	case TokenType::Label:
 	case TokenType::Segment:
-		throw ParseException("unexpected token in continue state");
-
-	default:
-		return Fatal(tokens[0], diagnose<DiagCode::UnexpectedTokenBeganLine>());
-	}
+		state.setSegment(get<Segment::Type>(token.annotation));
+		state.info.segmentSwitches.push_back(SegmentSwitch{token.offset, state.segment});
+		return endOfLineExpectation;
 
-	if (is<Error>(res)) {
-		return Finish().error(tokens[0], move(get<Error>(res).info));
+	case TokenType::Label:
+		state.pushLabel(move(token), state.segment);
+		return lineStartExpectations[state.segment];
 	}
 
-	for (auto& token : get<Success>(res).tokens) {
-		auto addedToken = parser.tokens->push(move(token));
+	state.tokens->push(move(token));
+	return lineStartExpectations[state.segment];
+}
 
-		if (addedToken->type == TokenType::LabelRef) {
-			parser.referenceLabel(*addedToken);
-		}
+ParseInfo::ParseInfo() :
+	arena(make_unique<Arena>()),
+	labelMap(0, std::hash<Symbol>{}, std::equal_to<Symbol>{}, *arena)
+{
+	for (auto i = 0; i < Segment::MAX; ++i) {
+		segments[i].type = static_cast<Segment::Type>(i);
 	}
+}
 
-	if (seperable)
-		return Finish().expect({TokenType::EndOfLine, make_pair(TokenType::Separator, ","s)});
-	return Finish().expect(TokenType::EndOfLine);
+ParseInfo::ParseInfo(ParseInfo&& other) :
+	arena(move(other.arena)),
+	symbols(move(other.symbols)),
+	labels(move(other.labels)),
+	labelMap(move(other.labelMap)),
+	segments(move(other.segments)),
+	segmentSwitches(move(other.segmentSwitches))
+{
+	// the other's map went with its arena, so it's given a new one bound to a new arena
+	other.arena = make_unique<Arena>();
+	other.labelMap = LabelMap(0, std::hash<Symbol>{}, std::equal_to<Symbol>{}, *other.arena);
 }
 
-auto parseFinish(State& state)->ParseState
+auto ParseInfo::operator=(ParseInfo&& other)->ParseInfo&
 {
-	auto fin = Finish();
+	// the label map releases its nodes on assignment, so it goes before the arena holding them is replaced
+	labelMap = move(other.labelMap);
+	labels = move(other.labels);
+	symbols = move(other.symbols);
+	segments = move(other.segments);
+	segmentSwitches = move(other.segmentSwitches);
+	arena = move(other.arena);
+
+	other.arena = make_unique<Arena>();
+	other.labelMap = LabelMap(0, std::hash<Symbol>{}, std::equal_to<Symbol>{}, *other.arena);
+	return *this;
+}
 
-	if (!state.unresolvedLabelTokens.empty()) {
-		for (auto i = 0_uz; i < state.unresolvedLabelTokenNameMap.bucket_count(); ++i) {
-			auto it = state.unresolvedLabelTokenNameMap.begin(i);
-			if (it == state.unresolvedLabelTokenNameMap.end(i))
-				continue;
-			auto& elem = *state.unresolvedLabelTokenNameMap.begin(i);
-			auto token = state.unresolvedLabelTokens[elem.second];
-			fin.error(*token, diagnose<DiagCode::UnresolvedLabelReference>());
-		}
+auto ParseInfo::getToken(const TokenHandle& handle) const->Token
+{
+	return segments[handle.segment].tokens->get(handle.index);
+}
+
+auto ParseInfo::reset()->void
+{
+	// the map's buckets live in the arena, so they must be dropped before it is rewound
+	labelMap = LabelMap(0, std::hash<Symbol>{}, std::equal_to<Symbol>{}, *arena);
+	labels.clear();
+	symbols.clear();
+	segmentSwitches.clear();
+
+	for (auto& segment : segments) {
+		if (segment.tokens.use_count() == 1)
+			segment.tokens->reset(nullptr, segment.tokens->getStorage());
+		else
+			segment.tokens.reset();
+		segment.size = 0;
 	}
 
-	return fin;
+	arena->reset();
 }
 
-auto lexComment(string_view sv)
+auto Result::reset()->void
 {
-	if (sv[0] == ';') {
-		auto pos = sv.find('\n', 1);
-		if (pos != sv.npos) return pos;
-	}
-	return 0_uz;
+	info.reset();
+	reports.clear();
+	numWarnings = 0;
+	numErrors = 0;
+	hadFatal = false;
 }
 
-auto lexWhitespace(string_view sv)
+Report::Report(ReportType type, Source::Token token, Diagnosis&& diagnosis) :
+	type(type), token(token), diagnosis(diagnosis)
+{ }
+
+auto Report::info(const Source::Token& token, Diagnosis&& diagnosis)->Report
 {
-	auto it = std::find_if_not(sv.cbegin(), sv.cend(), [](auto c) {
-		return std::isspace(static_cast<unsigned char>(c));
-	});
-	return static_cast<size_t>(std::distance(sv.cbegin(), it));
+	return Report(ReportType::Info, token, forward<Diagnosis>(diagnosis));
 }
 
-auto lexWhitespaceNoNewlines(string_view sv)
+auto Report::warning(const Source::Token& token, Diagnosis&& diagnosis)->Report
 {
-	auto it = std::find_if_not(sv.cbegin(), sv.cend(), [](auto c) {
-		return c != '\n' && std::isspace(static_cast<unsigned char>(c));
-	});
-	return static_cast<size_t>(std::distance(sv.cbegin(), it));
+	return Report(ReportType::Warning, token, forward<Diagnosis>(diagnosis));
 }
 
-auto lexNewline(string_view sv)
+auto Report::error(const Source::Token& token, Diagnosis&& diagnosis)->Report
 {
-	auto it = std::find_if_not(sv.cbegin(), sv.cend(), [](auto c) {
-		return c == '\n';
-	});
-	return static_cast<size_t>(std::distance(sv.cbegin(), it));
+	return Report(ReportType::Error, token, forward<Diagnosis>(diagnosis));
 }
 
-auto lexIdentifier(string_view sv)
+auto Report::fatal(const Source::Token& token, Diagnosis&& diagnosis)->Report
 {
-	if ((std::isalpha(sv[0]) || sv[0] == '_') && sv.size() > 1) {
-		auto it = std::find_if_not(sv.cbegin() + 1, sv.cend(), [](auto c) {
-			return c == '_' || std::isalnum(c);
-		});
-		if (it == sv.cend())
-			return sv.size();
-		return static_cast<size_t>(std::distance(sv.cbegin(), it));
-	}
-	return 0_uz;
+	return Report(ReportType::Fatal, token, forward<Diagnosis>(diagnosis));
 }
 
-auto lexSegment(string_view sv)
+/**
+ * Check a token against what was expected.
+ *
+ * @param  expected The expected tokens.
+ * @param  token    The token.
+ * @return The report if the token wasn't expected.
+ */
+auto getExpectedTokenError(const TokenExpectation& expected, const Token& token)->optional<Report>
 {
-	if (sv[0] == '.') {
-		if (auto res = lexIdentifier(sv.substr(1))) {
-			return static_cast<size_t>(res) + 1;
-		}
-	}
-	return 0_uz;
+	if (expected.matches(token.type, token.text))
+		return nullopt;
+	return Report::error(token, diagnose<DiagCode::ExpectedToken>(token.type, expected));
 }
 
-auto lexLabel(string_view sv)
+auto makeToken(const Source* source, size_t offset, const Lexer::Lexeme& lexeme)->Token
 {
-	if (auto res = lexIdentifier(sv)) {
-		if (res < sv.size() && sv[res] == ':') {
-			++res;
-			if (res == sv.size() || std::isspace(sv[res]))
-				return res;
+	auto token = Token(source, lexeme.type, offset, lexeme.length);
+
+	if (lexeme.valid) {
+		switch (lexeme.type) {
+		default: break;
+		case TokenType::HexLiteral:
+		case TokenType::IntegerLiteral:
+			token.annotation = lexeme.integer;
+			break;
+		case TokenType::FloatLiteral:
+			token.annotation = lexeme.real;
+			break;
 		}
 	}
-	return 0_uz;
+	return token;
 }
 
-auto lexHexLiteral(string_view sv)
+/// Where a shard of the source lies, and what is assumed about the shards before it.
+struct ShardContext {
+	size_t begin = 0;
+	size_t end = 0;
+	Segment::Type segment = Segment::MAX;       // active where the shard begins, MAX at the beginning of the source
+	bool last = true;                           // the shard ends the source
+	bool tokensBefore = false;                  // the shards before it pushed tokens into a segment
+};
+
+/// Add a report to a result, passing it to the reporter first.
+auto addReport(Result& result, const Reporter& reporter, Report&& report)
 {
-	static std::regex hexRegex("^([+\\-]?0x[\\dA-Fa-f]+)\\b");
-	auto s = string(sv);
-	std::smatch sm;
+	if (reporter.hasImpl())
+		reporter.report(report.type, report);
+
+	if (report.type == ReportType::Error || report.type == ReportType::Fatal) {
+		++result.numErrors;
 
-	if (std::regex_search(s, sm, hexRegex)) {
-		return static_cast<size_t>(sm[0].length());
+		if (report.type == ReportType::Fatal)
+			result.hadFatal = true;
 	}
-	return 0_uz;
+
+	result.reports.emplace_back(move(report));
 }
 
-auto lexIntegerLiteral(string_view sv)
+/**
+ * Report the first reference to each label which was never defined.
+ *
+ * @param  unresolved The unresolved references, in the order they were made.
+ */
+auto reportUnresolvedLabels(Result& result, const Reporter& reporter, const vector<TokenHandle>& unresolved)
 {
-	static std::regex integerRegex{"^([+\\-]?(?:0|[1-9]\\d*))(?:\\b[^\\.]|$)"};
-	auto s = string(sv);
-	std::smatch sm;
-	
-	if (std::regex_search(s, sm, integerRegex)) {
-		return static_cast<size_t>(sm[1].length());
+	auto reported = std::unordered_set<Symbol>{};
+
+	for (auto& handle : unresolved) {
+		auto token = result.info.getToken(handle);
+
+		if (reported.insert(get<Symbol>(token.annotation)).second)
+			addReport(result, reporter, Report::error(token, diagnose<DiagCode::UnresolvedLabelReference>()));
 	}
-	return 0_uz;
 }
 
-auto lexFloatLiteral(string_view sv)
+/**
+ * Parse a shard of the source into a result of its own.
+ *
+ * @param  unresolved Receives the label references left unresolved, in the order they were made.
+ * @return The segment active at the end of the shard.
+ */
+auto parseShard(const Options& options, const shared_ptr<const Source>& source, const ShardContext& context, Result& result, vector<TokenHandle>& unresolved)->Segment::Type
 {
-	static std::regex floatRegex{"^[+\\-]?(?:0|[1-9]\\d*)(?:\\.\\d*)(?:[eE][+\\-]?\\d+)?\\b"};
-	auto s = string(sv);
-	std::smatch sm;
-	
-	if (std::regex_search(s, sm, floatRegex)) {
-		return static_cast<size_t>(sm[0].length());
+	const auto code = source->getCode();
+	auto offset = context.begin;
+
+	result.reset();
+	auto state = State{source, options.tokenStorage, result.info};
+
+	result.info.labels.reserve(500);
+	state.unresolvedLabelTokens.reserve(100);
+	state.afterShard = context.begin != 0;
+
+	if (context.segment != Segment::MAX) {
+		state.setSegment(context.segment);
+		state.expected = lineStartExpectations[context.segment];
 	}
-	return 0_uz;
-}
 
-auto lexString(string_view sv)
-{
-	if (sv[0] == '"') {
-		size_t end = 0;
+	const auto& reporter = options.reporter;
 
-		for (auto pos = sv.find('"', 1); pos != sv.npos; pos = sv.find('"', pos + 1)) {
-			auto rpos = pos - 1;
-				
-			if (rpos != 1) {
-				while (sv[rpos] == '\\') {
-					--rpos;
-				}
+	auto emitReports = [&](small_vector<Report, 4>& reports) {
+		for (auto& report : reports)
+			addReport(result, reporter, move(report));
+		reports.clear();
+	};
 
-				if (((pos - rpos - 1) % 2) != 0)
-					continue;
+	auto reportFatal = [&](Report&& fatal) {
+		addReport(result, reporter, move(fatal));
+	};
+
+	auto step = [&](Token&& token) {
+		// a segment directive ends a data declaration before it takes effect
+		if (state.inStatement && state.segment == Segment::Data && token.type == TokenType::Segment) {
+			finishStatement(state);
+			emitReports(state.lineReports);
+			state.expected = lineStartExpectations[state.segment];
+		}
+
+		state.tokenReports.clear();
+		state.lineReports.clear();
+		auto action = parseToken(state, token);
+
+		switch (action) {
+		case TokenAction::Fatal:
+			reportFatal(move(state.tokenReports.back()));
+			return;
+
+		case TokenAction::Continue:
+			if (!state.inStatement) {
+				state.inStatement = true;
+				state.statementSegment = state.segment;
+			}
+			state.statement.emplace_back(move(token));
+			return;
+
+		case TokenAction::Finish:
+		case TokenAction::End:
+			break;
+		}
+
+		if (state.inStatement) {
+			if (action == TokenAction::Finish)
+				state.statement.emplace_back(move(token));
+
+			if (auto fatal = finishStatement(state)) {
+				reportFatal(move(*fatal));
+				return;
 			}
 
-			end = pos + 1;
+			// a problem with the token which ended the statement is reported instead of any with the statement
+			emitReports(state.tokenReports.empty() ? state.lineReports : state.tokenReports);
+			state.expected = lineStartExpectations[state.segment];
+			return;
+		}
+
+		auto unexpected = options.testForceTokenization ? nullopt : getExpectedTokenError(state.expected, token);
+		auto expected = action == TokenAction::Finish ? parseLine(state, move(token)) : lineStartExpectations[state.segment];
+
+		// an unexpected token is still parsed, but only the expectation is reported and it stays for the next token
+		if (unexpected) {
+			state.lineReports.clear();
+			state.lineReports.emplace_back(move(*unexpected));
+			emitReports(state.lineReports);
+			return;
+		}
+
+		emitReports(action == TokenAction::Finish ? state.lineReports : state.tokenReports);
+		state.expected = expected;
+	};
+
+	while (offset < context.end) {
+		const auto lexeme = Lexer::scan(code, offset);
+
+		if (lexeme.type == TokenType::None) {
+			reportFatal(Report::fatal(source->getToken(offset), diagnose<DiagCode::UnexpectedLexeme>()));
 			break;
 		}
 
-		if (end)
-			return end;
+		if (lexeme.type != TokenType::WhiteSpace) {
+			step(makeToken(source.get(), offset, lexeme));
+
+			if (result.hadFatal) break;
+		}
+
+		offset += lexeme.length;
 	}
-	return 0_uz;
+
+	// a shard which isn't last ends with a line ending, so there's nothing left to finish
+	if (!context.last && !result.hadFatal) {
+		state.getUnresolvedLabelTokens(unresolved);
+		return state.segment;
+	}
+
+	if (!result.hadFatal) {
+		auto const activeSegment = state.segment;
+		auto endedLine = false;
+
+		for (auto& segment : result.info.segments) {
+			if (!segment.tokens->empty()) {
+				state.setSegment(segment.type);
+				step(Token(source.get(), TokenType::EndOfLine, offset, 0));
+				endedLine = true;
+			}
+		}
+
+		// the line is ended the same in any segment, it only matters that one of the shards before had tokens
+		if (!endedLine && context.tokensBefore)
+			step(Token(source.get(), TokenType::EndOfLine, offset, 0));
+
+		state.setSegment(activeSegment);
+		step(Token(source.get(), TokenType::EndOfFile, offset, 0));
+	}
+
+	state.tokens->push(source.get(), TokenType::EndOfFile, offset, code.substr(offset, 0));
+	state.getUnresolvedLabelTokens(unresolved);
+	return state.segment;
+}
+
+// shards per thread, enough that merging the first shards overlaps parsing the last
+constexpr auto shardsPerThread = 4_uz;
+
+/**
+ * Get the number of shards to split a source into.
+ *
+ * @param  options Parsing options.
+ * @param  threads The number of threads to parse on.
+ * @param  size    The size of the source.
+ * @return The number of shards, 1 to parse it on the calling thread alone.
+ */
+auto getShardCount(const Options& options, size_t threads, size_t size)->size_t
+{
+	if (threads == 1)
+		return 1;
+	return std::clamp(size / std::max(options.shardSize, 1_uz), 1_uz, threads * shardsPerThread);
 }
 
-auto lexSeparator(string_view sv)
+/**
+ * Guess the active segment at the end of part of a source from the last segment directive beginning a line.
+ *
+ * It's only a guess as the directive may be in a string literal or comment, or not take effect.
+ *
+ * @param  segment The segment active at the beginning.
+ * @return The segment active at the end.
+ */
+auto guessSegment(string_view code, size_t begin, size_t end, Segment::Type segment)
 {
-	switch (sv[0]) {
-	case '=':
-	case ':':
-	case ',':
-		return 1_uz;
+	for (auto dot = code.find('.', begin); dot < end; dot = code.find('.', dot + 1)) {
+		auto lineStart = dot;
+		while (lineStart > 0 && (code[lineStart - 1] == ' ' || code[lineStart - 1] == '\t'))
+			--lineStart;
+
+		if (lineStart > 0 && code[lineStart - 1] != '\n')
+			continue;
+
+		auto nameEnd = dot + 1;
+		while (nameEnd < code.size() && (std::isalnum(static_cast<unsigned char>(code[nameEnd])) || code[nameEnd] == '_'))
+			++nameEnd;
+
+		if (auto directive = Segment::fromName(code.substr(dot + 1, nameEnd - dot - 1)); directive != Segment::MAX)
+			segment = directive;
 	}
-	return 0_uz;
+	return segment;
 }
 
-auto lexOne(string_view sv, LexRule rule)->optional<LexResult>
+/**
+ * Split a source into shards of about the same size, each beginning a line outside of a string literal or comment.
+ *
+ * A shard lexes to the same tokens on its own as it does in the whole source, as the shard before it ends with all of
+ * the newlines which make up its last token. There may be fewer shards than asked for if a string literal is in the way.
+ *
+ * @param  count The number of shards wanted.
+ * @return The shards, in order.
+ */
+auto findShards(string_view code, size_t count)->vector<ShardContext>
 {
-	if (auto len = rule.func(sv))
-		return make_optional<LexResult>(rule.type, len);
-	return nullopt;
+	auto shards = vector<ShardContext>{ShardContext{0, code.size()}};
+	const auto begin = code.data();
+	const auto end = begin + code.size();
+	auto target = begin + code.size() / count;
+	auto p = begin;
+
+	// step over string literals and comments, looking for a line ending past the target in the code between them
+	while (p != end && shards.size() < count) {
+		const auto q = Scan::findQuoteOrSemicolon(p, end);
+
+		while (target < q && shards.size() < count) {
+			auto newline = Scan::findNewline(std::max(p, target), q);
+			if (newline == q) break;
+
+			auto boundary = Scan::skipNewlines(newline, end);
+			if (boundary == end) break;
+
+			shards.back().end = static_cast<size_t>(boundary - begin);
+			shards.push_back(ShardContext{static_cast<size_t>(boundary - begin), code.size()});
+			target = std::max(begin + code.size() / count * shards.size(), boundary);
+		}
+
+		if (q == end) break;
+
+		if (*q == ';') {
+			p = Scan::findNewline(q + 1, end);
+			continue;
+		}
+
+		// each escape skips the escaped character, the same as the lexer
+		auto quote = Scan::findQuoteOrBackslash(q + 1, end);
+		while (quote != end && *quote != '"')
+			quote = Scan::findQuoteOrBackslash(end - quote > 2 ? quote + 2 : end, end);
+
+		// the rest of the source is an unterminated string literal
+		if (quote == end) break;
+		p = quote + 1;
+	}
+
+	for (auto i = 1_uz; i < shards.size(); ++i) {
+		shards[i - 1].last = false;
+		shards[i].segment = guessSegment(code, shards[i - 1].begin, shards[i].begin, i == 1 ? Segment::Header : shards[i - 1].segment);
+		shards[i].tokensBefore = true;
+	}
+	return shards;
 }
 
-auto lexOneOf(string_view sv, initializer_list<LexRule> rules)->optional<LexResult>
+/**
+ * Parse shards of a source on worker threads and merge them into a result.
+ *
+ * The calling thread merges the shards in order as they're parsed, and parses shards itself rather than wait, so the
+ * merge of the first shards overlaps the parse of the last.
+ *
+ * @param  threads    The number of threads to parse on, including the calling thread.
+ * @param  contexts   The shards.
+ * @param  unresolved Receives the label references still unresolved after the merge, in the order they were made.
+ */
+auto parseShards(const Options& options, const shared_ptr<const Source>& source, size_t threads, const vector<ShardContext>& contexts, Result& result, vector<TokenHandle>& unresolved)
 {
-	for (auto& rule : rules) {
-		if (auto res = lexOne(sv, rule)) {
-			return res;
+	struct Shard {
+		ShardContext context;
+		Result result;
+		vector<TokenHandle> unresolved;
+		Segment::Type segment = Segment::MAX;   // active at the end of the shard
+		std::exception_ptr error;
+		bool parsed = false;                    // guarded by the mutex
+	};
+
+	// reports are passed to the reporter in order by the merge
+	auto shardOptions = options;
+	shardOptions.reporter = Reporter{};
+	shardOptions.errorReporting = false;
+
+	auto shards = vector<Shard>(contexts.size());
+	auto mutex = std::mutex{};
+	auto parsed = std::condition_variable{};
+
+	auto parse = [&](Shard& shard) {
+		shard.unresolved.clear();
+		shard.error = nullptr;
+
+		try {
+			shard.segment = parseShard(shardOptions, source, shard.context, shard.result, shard.unresolved);
+		}
+		catch (...) {
+			shard.error = std::current_exception();
 		}
+	};
+
+	auto parseTaken = [&](size_t index) {
+		parse(shards[index]);
+
+		{
+			auto lock = std::lock_guard<std::mutex>{mutex};
+			shards[index].parsed = true;
+		}
+		parsed.notify_all();
+	};
+
+	for (auto i = 0_uz; i < shards.size(); ++i)
+		shards[i].context = contexts[i];
+
+	// shards without a worker to parse them are parsed by the merge
+	auto workers = Workers{threads, shards.size(), parseTaken};
+
+	result.reset();
+	State::prepareSegments(result.info, source, options.tokenStorage);
+
+	auto& info = result.info;
+	auto pending = vector<TokenHandle>{};       // references left unresolved by their shard, resolved once all labels are in
+	auto tokensBefore = false;
+
+	for (auto i = 0_uz; i < shards.size(); ++i) {
+		auto& shard = shards[i];
+
+		{
+			auto lock = std::unique_lock<std::mutex>{mutex};
+			while (!shard.parsed) {
+				lock.unlock();
+				auto index = workers.take();
+				if (index)
+					parseTaken(*index);
+				lock.lock();
+
+				if (!index)
+					parsed.wait(lock, [&] { return shard.parsed; });
+			}
+		}
+
+		// a shard parsed from the wrong guess of how the shards before it ended is parsed again
+		if (i != 0) {
+			auto context = shard.context;
+			context.segment = shards[i - 1].segment;
+			context.tokensBefore = tokensBefore;
+
+			if (context.segment != shard.context.segment || (context.last && context.tokensBefore != shard.context.tokensBefore)) {
+				shard.context = context;
+				parse(shard);
+			}
+		}
+
+		if (shard.error)
+			std::rethrow_exception(shard.error);
+
+		auto& local = shard.result.info;
+		auto symbols = vector<Symbol>{};
+		auto labels = vector<const Label*>(local.symbols.size());    // what each label name of the shard resolves to
+		auto inherited = vector<bool>(local.symbols.size());         // whether an earlier shard defined the label
+		auto offsets = array<size_t, Segment::MAX>{};
+
+		info.symbols.merge(local.symbols, symbols);
+
+		for (auto& segmentInfo : info.segments)
+			offsets[segmentInfo.type] = segmentInfo.tokens->size();
+
+		auto shift = [&](TokenHandle handle) {
+			auto index = offsets[handle.segment] + handle.index;
+			if (index > std::numeric_limits<uint32>::max())
+				throw ParseException("too many tokens in segment");
+			return TokenHandle{handle.segment, static_cast<uint32>(index)};
+		};
+
+		for (auto label : local.labels) {
+			auto name = static_cast<size_t>(label->symbol);
+			auto [it, added] = info.labelMap.emplace(symbols[name], info.labels.size());
+
+			if (added)
+				info.labels.emplace_back(info.arena->create<Label>(symbols[name], info.symbols.get(symbols[name]), shift(label->definition), label->segment));
+
+			labels[name] = info.labels[it->second];
+			inherited[name] = !added;
+		}
+
+		for (auto& segmentInfo : local.segments) {
+			info.segments[segmentInfo.type].tokens->append(*segmentInfo.tokens, symbols, labels);
+			tokensBefore = tokensBefore || !segmentInfo.tokens->empty();
+		}
+
+		for (auto& handle : shard.unresolved)
+			pending.push_back(shift(handle));
+
+		info.segmentSwitches.insert(info.segmentSwitches.end(), local.segmentSwitches.begin(), local.segmentSwitches.end());
+
+		for (auto& report : shard.result.reports) {
+			if (report.diagnosis.is(DiagCode::LabelRedefinition)) {
+				auto text = report.token.text;
+				auto name = static_cast<size_t>(*local.symbols.find(text.substr(0, text.size() - 1)));
+
+				// a provisional report is for a label the shard defined first, unless an earlier shard defined it
+				if (!inherited[name] && !report.diagnosis.get<DiagCode::LabelRedefinition>().original.source)
+					continue;
+
+				report.diagnosis = diagnose<DiagCode::LabelRedefinition>(info.getToken(labels[name]->definition));
+			}
+
+			addReport(result, options.reporter, move(report));
+		}
+
+		// nothing after a fatal report is parsed
+		if (shard.result.hadFatal)
+			break;
+	}
+
+	for (auto& handle : pending) {
+		auto& tokens = *info.segments[handle.segment].tokens;
+		auto name = get<Symbol>(tokens.get(handle.index).annotation);
+
+		if (auto it = info.labelMap.find(name); it != info.labelMap.end())
+			tokens.setAnnotation(handle.index, LabelRef(info.labels[it->second]));
+		else
+			unresolved.push_back(handle);
 	}
-	return nullopt;
 }
 
-Report::Report(ReportType type, Source::Token token, Diagnosis&& diagnosis) :
-	type(type), token(token), diagnosis(diagnosis)
-{ }
+/// Without a reporter, write reports out at once, in order.
+template<typename TReports>
+auto writeReports(const Options& options, const TReports& reports)
+{
+	if (options.reporter.hasImpl() || !options.errorReporting)
+		return;
 
-auto Report::info(const Source::Token& token, Diagnosis&& diagnosis)->Report
+	auto writer = ReportWriter{ReportWriter::Options{options.reportFormat}};
+
+	for (auto& report : reports)
+		writer.add(report);
+
+	writer.flush(stderr);
+}
+
+auto tokenize(const Options& options, shared_ptr<const Source> source)->Result
 {
-	return Report(ReportType::Info, token, forward<Diagnosis>(diagnosis));
+	auto result = Result{};
+	tokenize(options, move(source), result);
+	return result;
 }
 
-auto Report::warning(const Source::Token& token, Diagnosis&& diagnosis)->Report
+auto tokenize(const Options& options, shared_ptr<const Source> source, Result& result)->void
 {
-	return Report(ReportType::Warning, token, forward<Diagnosis>(diagnosis));
+	const auto code = source->getCode();
+	const auto threads = getThreadCount(options.threads);
+	auto unresolved = vector<TokenHandle>{};
+
+	if (auto count = getShardCount(options, threads, code.size()); count > 1)
+		parseShards(options, source, threads, findShards(code, count), result, unresolved);
+	else
+		parseShard(options, source, ShardContext{0, code.size()}, result, unresolved);
+
+	reportUnresolvedLabels(result, options.reporter, unresolved);
+	writeReports(options, result.reports);
 }
 
-auto Report::error(const Source::Token& token, Diagnosis&& diagnosis)->Report
+/**
+ * Find the lexeme which spans an offset, lexing from a lexeme boundary before it.
+ *
+ * @param  from The lexeme boundary to lex from.
+ * @param  to   The offset.
+ * @return The offset of the lexeme, or `to` if lexing reaches it at a boundary.
+ */
+auto findLexemeAcross(string_view code, size_t from, size_t to)->size_t
 {
-	return Report(ReportType::Error, token, forward<Diagnosis>(diagnosis));
+	while (from < to) {
+		auto length = std::max(Lexer::scan(code, from).length, 1_uz);
+		if (from + length > to)
+			return from;
+		from += length;
+	}
+	return to;
 }
 
-auto Report::fatal(const Source::Token& token, Diagnosis&& diagnosis)->Report
+/// Get the segment active at an offset of the source a result was parsed from, MAX at its beginning.
+auto getSegmentAt(const ParseInfo& info, size_t offset)
 {
-	return Report(ReportType::Fatal, token, forward<Diagnosis>(diagnosis));
+	auto& switches = info.segmentSwitches;
+	auto it = std::lower_bound(switches.begin(), switches.end(), offset, [](const SegmentSwitch& segmentSwitch, size_t offset) {
+		return segmentSwitch.offset < offset;
+	});
+
+	if (it != switches.begin())
+		return std::prev(it)->segment;
+	return offset ? Segment::Header : Segment::MAX;
 }
 
-const auto lexRules = initializer_list<LexRule>{
-	{TokenType::EndOfLine, lexNewline},
-	{TokenType::WhiteSpace, lexComment},
-	{TokenType::WhiteSpace, lexWhitespaceNoNewlines},
-	{TokenType::Separator, lexSeparator},
-	{TokenType::Segment, lexSegment},
-	{TokenType::String, lexString},
-	{TokenType::HexLiteral, lexHexLiteral},
-	{TokenType::IntegerLiteral, lexIntegerLiteral},
-	{TokenType::FloatLiteral, lexFloatLiteral},
-	{TokenType::Label, lexLabel},
-	{TokenType::Identifier, lexIdentifier},
+/// A label definition made by a token.
+struct LabelDefinition {
+	size_t offset;
+	string_view name;
+	Segment::Type segment;
 };
 
-auto getExpectedTokenError(const Expected& expect, const Token& token)->optional<Report>
+/// Get the label definitions made by runs of the segment token streams, in source order.
+auto getLabelDefinitions(const ParseInfo& info, const array<size_t, Segment::MAX>& begins, const array<size_t, Segment::MAX>& ends)
 {
-	return std::visit(visitor{
-		[&](TokenType type)->optional<Report> {
-			if (token.type != type) {
-				return Report::error(token, diagnose<DiagCode::ExpectedToken>(token.type, type));
-			}
-			return nullopt;
-		},
-		[&](const TokenAndString& typeAndValue)->optional<Report> {
-			if (token.type != typeAndValue.first || token.text != typeAndValue.second) {
-				return Report::error(token, diagnose<DiagCode::ExpectedToken>(token.type, typeAndValue));
-			}
-			return nullopt;
-		},
-		[&](const AnyOf& types)->optional<Report> {
-			if (!std::any_of(types.begin(), types.end(), [token](const AnyOfExpect& expected) {
-				return std::visit(visitor{
-					[&](TokenType type) { return token.type == type; },
-					[&](const pair<TokenType, string>& typeAndStr) {
-						return token.type == typeAndStr.first && token.getText() == typeAndStr.second;
-					},
-				}, expected);
-			})) {
-				auto ss = stringstream{};
-				return Report::error(token, diagnose<DiagCode::ExpectedToken>(token.type, types));
-			}
-			return nullopt;
-		}
-	}, expect);
-}
+	auto definitions = vector<LabelDefinition>{};
 
-auto addExpectationsForSegment(Segment::Type segment, Finish& state)->Finish&
-{
-	switch (segment) {
-	case Segment::MAX:
-	case Segment::Header: return state.expect({TokenType::EndOfFile, TokenType::EndOfLine, TokenType::Identifier, TokenType::Segment});
-	case Segment::Code: return state.expect({TokenType::EndOfFile, TokenType::EndOfLine, TokenType::Identifier, TokenType::Label, TokenType::Segment});
-	case Segment::Data: return state.expect({TokenType::EndOfFile, TokenType::EndOfLine, TokenType::Label, TokenType::Segment});
+	for (auto& segmentInfo : info.segments) {
+		auto& tokens = *segmentInfo.tokens;
+
+		for (auto i = begins[segmentInfo.type]; i < ends[segmentInfo.type]; ++i) {
+			if (tokens.getType(i) != TokenType::Label)
+				continue;
+
+			// label tokens without a label are the operands of data declarations
+			auto token = tokens.get(i);
+			if (auto label = get_if<const Label*>(&token.annotation); label && *label)
+				definitions.push_back(LabelDefinition{token.offset, (*label)->name, segmentInfo.type});
+		}
 	}
-	return state;
-}
 
-auto addExpectationsForSegment(Segment::Type segment)->Finish
-{
-	auto state = Finish{};
-	addExpectationsForSegment(segment, state);
-	return state;
+	std::sort(definitions.begin(), definitions.end(), [](const LabelDefinition& a, const LabelDefinition& b) {
+		return a.offset < b.offset;
+	});
+	return definitions;
 }
 
-auto tokenize(const Options& options, shared_ptr<const Source> source)->Result
+auto retokenize(const Options& options, shared_ptr<const Source> source, const Edit& edit, Result& result)->bool
 {
-	const auto code = string_view(source->getCode());
-	auto offset = 0_uz;
-	
-	auto result = Result{};
-	auto parserState = State{
-		source,
-		result.info,
-		addExpectationsForSegment(Segment::MAX)
+	auto& info = result.info;
+	const auto& streams = info.segments[Segment::Header].tokens;
+	const auto previous = streams ? streams->getSource() : nullptr;
+
+	auto reparse = [&] {
+		tokenize(options, source, result);
+		return false;
 	};
-	const auto& tokens = parserState.tokens;       // intentional reference-to-pointer: parserState.tokens will update
-	
-	result.info.labels.reserve(500);
-	parserState.unresolvedLabelTokens.reserve(100);
-
-	const auto reporter = ([&]()->Reporter {
-		if (!options.reporter.hasImpl() && options.errorReporting) {
-			Reporter reporter;
-			reporter.setImpl([source](const ReportData& log)->void {
-				using namespace fmt::literals;
-
-				auto stream = log.type == ReportType::Fatal || log.type == ReportType::Error ? stdout : stdout;
-				auto reportType = string_view{[](ReportType type) {
-					switch (type) {
-					case ReportType::Fatal:
-						return "fatal"sv;
-					case ReportType::Error:
-						return "error"sv;
-					case ReportType::Warning:
-						return "warn"sv;
-					case ReportType::Info:
-						return "info"sv;
-					}
-					return "unknown"sv;
-				}(log.type)};
-
-				auto& report = std::any_cast<const Report&>(log.data);
-				auto& lineInfo = source->getLineInfo(
-					source->getLineIndexByOffset(static_cast<uint>(report.token.offset))
-				);
-				auto lineNum = to_string(lineInfo.number);
-				auto lineEnd = lineInfo.offset + lineInfo.length;
-				auto tokenEnd = report.token.offset + report.token.text.size();
-
-				fmt::print(stream, fmt::emphasis::bold | fg(fmt::color::red), "{}[E{:04}]", reportType, report.diagnosis.getCodeInt());
-				fmt::print(stream, fmt::text_style{fmt::emphasis::bold}, ": {}\n", report.diagnosis.getName());
-				fmt::print(stream, fg(fmt::color::blue), "{:>{}}", "--> ", lineNum.size() + 4);
-				fmt::print(
-					stream,
-					"{file}:{line}:{column}\n",
-					"file"_a = source->getName(),
-					"line"_a = lineNum,
-					"column"_a = source->getColumnByOffset(static_cast<uint>(report.token.offset))
-				);
-				fmt::print(stream, fg(fmt::color::blue), "{} |  ", lineNum);
-
-				if (report.token.offset > 0) {
-					fmt::print(stream, "{}", source->getText(lineInfo.offset, report.token.offset - lineInfo.offset));
-				}
 
-				if (tokenEnd < lineEnd) {
-					fmt::print(stream, fg(fmt::color::red), "{}", report.token.text);
-					fmt::print(stream, "{}\n", source->getText(tokenEnd, lineEnd - tokenEnd));
-				}
-				else {
-					fmt::print(stream, fg(fmt::color::red), "{}\n", report.token.text);
-				}
+	if (!previous || result.hadFatal)
+		return reparse();
 
-				fmt::print(
-					stream,
-					fg(fmt::color::red),
-					"{:>{}}{:^>{}} {}\n\n",
-					"",
-					report.token.offset + lineNum.size() + 4,
-					"^",
-					report.token.text.size(),
-					report.diagnosis.getMessage()
-				);
-			});
-			return reporter;
-		}
-		return options.reporter;
-	})();
-	
-	auto reportState = [&](ParseState&& state)->ParseState&& {
-		if (auto fatal = get_if<Fatal>(&state)) {
-			++result.numErrors;
-			result.reports.emplace_back(move(fatal->error));
-			result.hadFatal = true;
-			reporter.fatal(fatal->error);
-			return move(state);
+	const auto code = source->getCode();
+	const auto old = previous->getCode();
+
+	if (edit.offset + edit.removed > old.size() || old.size() - edit.removed + edit.inserted != code.size())
+		throw std::out_of_range("edit doesn't fit the source");
+
+	const auto shift = static_cast<ptrdiff_t>(edit.inserted) - static_cast<ptrdiff_t>(edit.removed);
+
+	auto isNewline = [](string_view text, size_t offset) {
+		return offset < text.size() && text[offset] == '\n';
+	};
+	auto getLineStart = [&](size_t offset)->size_t {
+		return source->getLineOffset(source->getLineIndexByOffset(static_cast<uint>(offset)));
+	};
+	auto getNextLineStart = [&](size_t offset)->size_t {
+		auto line = source->getLineIndexByOffset(static_cast<uint>(offset)) + 1;
+		return line < source->getNumLines() ? source->getLineOffset(line) : code.size();
+	};
+	auto toOld = [&](size_t offset) {
+		return static_cast<size_t>(static_cast<ptrdiff_t>(offset) - shift);
+	};
+
+	// the lines parsed again begin after a run of line endings, where the parse before the edit lexed a boundary,
+	// which is found by lexing on from the last token before them
+	auto begin = getLineStart(edit.offset);
+
+	for (;;) {
+		while (begin && (isNewline(code, begin) || isNewline(old, begin)))
+			begin = getLineStart(begin - 1);
+
+		auto from = 0_uz;
+
+		for (auto& segmentInfo : info.segments) {
+			if (auto index = segmentInfo.tokens->findOffset(begin))
+				from = std::max(from, segmentInfo.tokens->getOffset(index - 1));
 		}
 
-		if (auto finish = get_if<Finish>(&state)) {
-			if (!finish->reports.empty()) {
-				for (auto& report : finish->reports) {
-					reporter.report(report.type, report);
+		auto across = findLexemeAcross(old, from, begin);
+		if (across == begin) break;
+		begin = getLineStart(across);
+	}
 
-					if (report.type == ReportType::Error || report.type == ReportType::Fatal) {
-						++result.numErrors;
+	// they end after a run of line endings too, where both the code before and after the edit lex a boundary
+	auto end = getNextLineStart(edit.offset + edit.inserted);
 
-						if (report.type == ReportType::Fatal)
-							result.hadFatal = true;
-					}
-				}
+	for (;;) {
+		while (isNewline(code, end))
+			end = getNextLineStart(end);
 
-				result.reports.insert(result.reports.end(), make_move_iterator(finish->reports.begin()), make_move_iterator(finish->reports.end()));
-				finish->reports.clear();
-			}
+		if (auto across = findLexemeAcross(code, begin, end); across != end) {
+			end = getNextLineStart(across + Lexer::scan(code, across).length - 1);
+		}
+		else if (across = findLexemeAcross(old, begin, toOld(end)); across != toOld(end)) {
+			end = getNextLineStart(static_cast<size_t>(static_cast<ptrdiff_t>(across + Lexer::scan(old, across).length - 1) + shift));
+		}
+		else {
+			break;
 		}
-		return move(state);
+	}
+
+	if (begin == 0 && end == code.size())
+		return reparse();
+
+	const auto last = end == code.size();
+	const auto oldEnd = toOld(end);
+	auto begins = array<size_t, Segment::MAX>{};
+	auto ends = array<size_t, Segment::MAX>{};
+	auto tokensBefore = false;
+
+	for (auto& segmentInfo : info.segments) {
+		begins[segmentInfo.type] = segmentInfo.tokens->findOffset(begin);
+		ends[segmentInfo.type] = last ? segmentInfo.tokens->size() : segmentInfo.tokens->findOffset(oldEnd);
+		tokensBefore = tokensBefore || begins[segmentInfo.type] != 0;
+	}
+
+	// reports of the lines are passed to the reporter once they're known to stand
+	auto shardOptions = options;
+	shardOptions.reporter = Reporter{};
+	shardOptions.errorReporting = false;
+
+	auto lines = Result{};
+	auto linesUnresolved = vector<TokenHandle>{};
+	const auto context = ShardContext{begin, end, getSegmentAt(info, begin), last, tokensBefore};
+	const auto segment = parseShard(shardOptions, source, context, lines, linesUnresolved);
+	auto& local = lines.info;
+
+	if (lines.hadFatal || (!last && segment != getSegmentAt(info, oldEnd)))
+		return reparse();
+
+	auto localSizes = array<size_t, Segment::MAX>{};
+
+	for (auto& segmentInfo : local.segments) {
+		auto type = segmentInfo.type;
+		auto size = info.segments[type].tokens->size();
+		localSizes[type] = segmentInfo.tokens->size();
+
+		// the end of the source is parsed in each segment with tokens, so the segments with tokens must stay the same
+		if ((size != 0) != (size - (ends[type] - begins[type]) + localSizes[type] != 0))
+			return reparse();
+	}
+
+	auto definitions = getLabelDefinitions(info, begins, ends);
+	auto localDefinitions = getLabelDefinitions(local, array<size_t, Segment::MAX>{}, localSizes);
+
+	auto sameDefinition = [](const LabelDefinition& a, const LabelDefinition& b) {
+		return a.name == b.name && a.segment == b.segment;
 	};
 
-	auto step = [&](size_t offset, optional<LexResult> res)->ParseState {
-		if (!res) {
-			auto delimitedToken = source->getToken(offset);
-			return reportState(
-				Fatal{move(delimitedToken), diagnose<DiagCode::UnexpectedLexeme>()}
-			);
-		}
+	if (!std::equal(definitions.begin(), definitions.end(), localDefinitions.begin(), localDefinitions.end(), sameDefinition))
+		return reparse();
 
-		auto token = Token(source.get(), res->type, offset, res->length);
-
-		if (res->type != TokenType::WhiteSpace) {
-			if (tokens->empty() || res->type != TokenType::EndOfLine || !tokens->back().is(TokenType::EndOfLine)) {
-				auto postParseVisitor = visitor{
-					[&](Continue&& newState)->ParseState {
-						if (auto cont = get_if<Continue>(&parserState.state)) {
-							cont->add(newState.tokens);
-							return parserState.state;
-						}
-						return move(newState);
-					},
-					[&](Finish&& newState)->ParseState {
-						auto nextState = ([&]()->ParseState {
-							if (auto cont = get_if<Continue>(&parserState.state)) {
-								if (newState.token) cont->add(*newState.token);
-
-								auto parseLineState = parseLine(parserState, move(*cont));
-
-								if (auto parseLineFinished = get_if<Finish>(&parseLineState)) {
-									return newState.merge(*parseLineFinished);
-								}
-								return parseLineState;
-							}
-							return parseLine(parserState, move(newState));
-						})();
-
-						if (auto finish = get_if<Finish>(&nextState)) {
-							if (!finish->expected)
-								addExpectationsForSegment(parserState.segment, *finish);
-						}
-
-						if (auto finish = get_if<Finish>(&parserState.state)) {
-							if (finish->expected && !options.testForceTokenization) {
-								if (auto error = getExpectedTokenError(*finish->expected, token))
-									return finish->report(*error);
-							}
-						}
-
-						return nextState;
-					},
-					[](Fatal&& newState)->ParseState {
-						return move(newState);
-					}
-				};
-				if (is<Continue>(parserState.state)) {
-					parserState.state = reportState(
-						std::visit(postParseVisitor, preParseToken(parserState, token))
-					);
-				}
-				return reportState(
-					std::visit(postParseVisitor, parseToken(parserState, move(token)))
-				);
-			}
-		}
+	auto isLabel = [&](string_view name) {
+		auto symbol = info.symbols.find(name);
+		return symbol && info.labelMap.find(*symbol) != info.labelMap.end();
+	};
+
+	// the first reference the lines make to each label which is still undefined
+	auto firstReferences = vector<pair<string_view, TokenHandle>>{};
+	auto referenced = std::unordered_set<string_view>{};
 
-		return reportState(move(parserState.state));
+	for (auto& handle : linesUnresolved) {
+		auto name = local.symbols.get(get<Symbol>(local.getToken(handle).annotation));
+
+		if (!isLabel(name) && referenced.insert(name).second)
+			firstReferences.emplace_back(name, handle);
+	}
+
+	auto firstUnresolved = std::find_if(result.reports.begin(), result.reports.end(), [](const Report& report) {
+		return report.diagnosis.is(DiagCode::UnresolvedLabelReference);
+	});
+
+	auto inLines = [&](size_t offset) {
+		return offset >= begin && (last || offset < oldEnd);
 	};
 
-	while (offset < code.size()) {
-		const auto res = lexOneOf(code.substr(offset), lexRules);
-		parserState.state = step(offset, res);
+	// a label whose first reference is removed with no new one in the lines may be first referenced anywhere after
+	for (auto it = firstUnresolved; it != result.reports.end(); ++it) {
+		if (inLines(it->token.offset) && !referenced.count(it->token.text))
+			return reparse();
+	}
+
+	// from here on the result is updated in place
+	auto symbols = vector<Symbol>{};
+	auto labels = vector<const Label*>(local.symbols.size());
+	auto inherited = vector<bool>(local.symbols.size());
+
+	info.symbols.merge(local.symbols, symbols);
 
-		if (result.hadFatal) break;
+	auto moveIndex = [&](TokenHandle& handle, ptrdiff_t distance) {
+		auto index = static_cast<ptrdiff_t>(handle.index) + distance;
+		if (index > static_cast<ptrdiff_t>(std::numeric_limits<uint32>::max()))
+			throw ParseException("too many tokens in segment");
+		handle.index = static_cast<uint32>(index);
+	};
+
+	for (auto label : local.labels) {
+		auto name = static_cast<size_t>(label->symbol);
+		auto global = info.labels[info.labelMap.find(symbols[name])->second];
+		auto& definition = global->definition;
 
-		offset += res->length;
+		labels[name] = global;
+		inherited[name] = definition.index < begins[definition.segment] || definition.index >= ends[definition.segment];
 	}
 
-	if (!result.hadFatal) {
-		auto const activeSegment = parserState.segment;
+	for (auto label : info.labels) {
+		auto& definition = label->definition;
+		if (definition.index >= ends[definition.segment])
+			moveIndex(definition, static_cast<ptrdiff_t>(localSizes[definition.segment]) - static_cast<ptrdiff_t>(ends[definition.segment] - begins[definition.segment]));
+	}
 
-		for (auto& segment : result.info.segments) {
-			if (!segment.tokens->empty() && segment.tokens->back().type != TokenType::EndOfLine) {
-				parserState.setSegment(segment.type);
-				parserState.state = reportState(step(offset, LexResult{TokenType::EndOfLine, 0}));
-			}
+	for (auto label : local.labels) {
+		auto name = static_cast<size_t>(label->symbol);
+		if (inherited[name]) continue;
+
+		auto& definition = info.labels[info.labelMap.find(symbols[name])->second]->definition;
+		definition = label->definition;
+		moveIndex(definition, static_cast<ptrdiff_t>(begins[definition.segment]));
+	}
+
+	for (auto& segmentInfo : info.segments) {
+		// a stream shared with something else is left as it is
+		if (segmentInfo.tokens.use_count() > 1)
+			segmentInfo.tokens = make_shared<TokenStream>(*segmentInfo.tokens);
+
+		auto type = segmentInfo.type;
+		segmentInfo.tokens->splice(begins[type], ends[type], *local.segments[type].tokens, symbols, labels, shift);
+	}
+
+	for (auto handle : linesUnresolved) {
+		moveIndex(handle, static_cast<ptrdiff_t>(begins[handle.segment]));
+
+		auto& tokens = *info.segments[handle.segment].tokens;
+		auto name = get<Symbol>(tokens.get(handle.index).annotation);
+
+		if (auto it = info.labelMap.find(name); it != info.labelMap.end())
+			tokens.setAnnotation(handle.index, LabelRef(info.labels[it->second]));
+	}
+
+	auto& switches = info.segmentSwitches;
+	auto switchesBegin = std::find_if(switches.begin(), switches.end(), [&](const SegmentSwitch& segmentSwitch) {
+		return segmentSwitch.offset >= begin;
+	});
+	auto switchesEnd = std::find_if(switchesBegin, switches.end(), [&](const SegmentSwitch& segmentSwitch) {
+		return !inLines(segmentSwitch.offset);
+	});
+
+	for (auto it = switchesEnd; it != switches.end(); ++it)
+		it->offset = static_cast<size_t>(static_cast<ptrdiff_t>(it->offset) + shift);
+
+	switchesBegin = switches.erase(switchesBegin, switchesEnd);
+	switches.insert(switchesBegin, local.segmentSwitches.begin(), local.segmentSwitches.end());
+
+	// the reports are put back in the order a parse of the edited source would make them, the lines' in place of the
+	// ones from before the edit, then the references to labels which are still undefined
+	auto reports = move(result.reports);
+	auto written = vector<Report>{};
+	const auto silent = Reporter{};
+
+	result.reports.clear();
+	result.numWarnings = 0;
+	result.numErrors = 0;
+	result.hadFatal = false;
+
+	auto getLabel = [&](const Report& report) {
+		auto text = report.token.text;
+		return info.labels[info.labelMap.find(*info.symbols.find(text.substr(0, text.size() - 1)))->second];
+	};
+
+	auto add = [&](Report&& report, size_t offset, bool added) {
+		report.token = Source::Token{source.get(), offset, report.token.text.size()};
+
+		if (report.diagnosis.is(DiagCode::LabelRedefinition))
+			report.diagnosis = diagnose<DiagCode::LabelRedefinition>(info.getToken(getLabel(report)->definition));
+
+		if (added)
+			written.push_back(report);
+
+		addReport(result, added ? options.reporter : silent, move(report));
+	};
+
+	auto moveOffset = [&](size_t offset) {
+		return static_cast<size_t>(static_cast<ptrdiff_t>(offset) + shift);
+	};
+
+	auto firstLinesReport = std::find_if(reports.begin(), firstUnresolved, [&](const Report& report) {
+		return report.token.offset >= begin;
+	});
+
+	for (auto it = reports.begin(); it != firstLinesReport; ++it)
+		add(move(*it), it->token.offset, false);
+
+	for (auto& report : lines.reports) {
+		// a provisional report is for a label the lines defined first, unless the lines before them defined it
+		if (report.diagnosis.is(DiagCode::LabelRedefinition)) {
+			auto text = report.token.text;
+			auto name = static_cast<size_t>(*local.symbols.find(text.substr(0, text.size() - 1)));
+
+			if (!inherited[name] && !report.diagnosis.get<DiagCode::LabelRedefinition>().original.source)
+				continue;
 		}
 
-		parserState.setSegment(activeSegment);
-		parserState.state = reportState(step(offset, LexResult{TokenType::EndOfFile, 0}));
+		add(move(report), report.token.offset, true);
+	}
 
+	for (auto it = firstLinesReport; it != firstUnresolved; ++it) {
+		if (!inLines(it->token.offset))
+			add(move(*it), moveOffset(it->token.offset), false);
 	}
 
-	tokens->push(source.get(), TokenType::EndOfFile, offset, code.substr(offset, 0));
+	/// A report of an undefined label, where it goes in the edited source and whether it's new.
+	struct Unresolved {
+		Report report;
+		size_t offset;
+		bool added;
+	};
+
+	auto unresolvedReports = vector<Unresolved>{};
 
-	parserState.state = reportState(parseFinish(parserState));
+	for (auto it = firstUnresolved; it != reports.end(); ++it) {
+		// a label first referenced before the lines keeps its report, one first referenced after them may now be
+		// first referenced in them
+		const auto offset = it->token.offset;
 
-	return result;
+		if (offset < begin) {
+			referenced.erase(it->token.text);
+			unresolvedReports.push_back(Unresolved{move(*it), offset, false});
+		}
+		else if (!referenced.count(it->token.text)) {
+			unresolvedReports.push_back(Unresolved{move(*it), moveOffset(offset), false});
+		}
+	}
+
+	for (auto& [name, handle] : firstReferences) {
+		if (referenced.count(name)) {
+			moveIndex(handle, static_cast<ptrdiff_t>(begins[handle.segment]));
+
+			auto token = info.getToken(handle);
+			unresolvedReports.push_back(Unresolved{Report::error(token, diagnose<DiagCode::UnresolvedLabelReference>()), token.offset, true});
+		}
+	}
+
+	std::stable_sort(unresolvedReports.begin(), unresolvedReports.end(), [](const Unresolved& a, const Unresolved& b) {
+		return a.offset < b.offset;
+	});
+
+	for (auto& unresolved : unresolvedReports)
+		add(move(unresolved.report), unresolved.offset, unresolved.added);
+
+	writeReports(options, written);
+	return true;
 }
 
-}
\ No newline at end of file
+}
@@ -0,0 +1,281 @@
+#include <CLARA/pch.h>
+#include <CLARA/ReportWriter.h>
+
+using namespace CLARA;
+using namespace CLARA::CLASM;
+using Parser::Report;
+
+namespace {
+
+/// Where a report points in its source, worked out once per report.
+struct Position {
+	string_view file;
+	uint line = 0;                                      //< 1-based line number, 0 without a source
+	uint column = 1;                                    //< 1-based column in characters
+	uint width = 1;                                     //< width of the token in characters
+	string_view before;                                 //< text of the line before the token
+	string_view after;                                  //< text of the line after the token
+};
+
+auto countChars(string_view text)
+{
+	return static_cast<uint>(std::count_if(text.begin(), text.end(), [](char c) {
+		return (c & 0xC0) != 0x80;
+	}));
+}
+
+auto getPosition(const Report& report)->Position
+{
+	auto position = Position{};
+	auto source = report.token.source;
+	if (!source) return position;
+
+	auto code = source->getCode();
+	auto offset = std::min(report.token.offset, code.size());
+	auto& lineInfo = source->getLineInfo(source->getLineIndexByOffset(static_cast<uint>(offset)));
+	auto lineStart = std::min<size_t>(lineInfo.offset, offset);
+	auto lineEnd = std::min<size_t>(lineInfo.offset + lineInfo.length, code.size());
+	auto tokenEnd = std::min(offset + report.token.text.size(), code.size());
+
+	position.file = source->getName();
+	position.line = lineInfo.number;
+	position.before = code.substr(lineStart, offset - lineStart);
+	position.after = tokenEnd < lineEnd ? code.substr(tokenEnd, lineEnd - tokenEnd) : string_view{};
+	position.column = source->getColumnByOffset(static_cast<uint>(offset));
+	position.width = std::max(countChars(report.token.text), 1u);
+	return position;
+}
+
+auto getSeverityName(ReportType type)
+{
+	switch (type) {
+	case ReportType::Fatal:
+		return "fatal"sv;
+	case ReportType::Error:
+		return "error"sv;
+	case ReportType::Warning:
+		return "warning"sv;
+	case ReportType::Info:
+		return "info"sv;
+	}
+	return "unknown"sv;
+}
+
+auto getSarifLevel(ReportType type)
+{
+	switch (type) {
+	case ReportType::Fatal:
+	case ReportType::Error:
+		return "error"sv;
+	case ReportType::Warning:
+		return "warning"sv;
+	case ReportType::Info:
+		break;
+	}
+	return "note"sv;
+}
+
+auto getMessage(const Diagnosis& diagnosis)
+{
+	auto message = diagnosis.getMessage();
+	return message.empty() ? string{diagnosis.getName()} : message;
+}
+
+auto append(fmt::memory_buffer& buffer, string_view text)
+{
+	buffer.append(text.data(), text.data() + text.size());
+}
+
+template<typename... TArgs>
+auto append(fmt::memory_buffer& buffer, fmt::format_string<TArgs...> format, TArgs&&... args)
+{
+	fmt::format_to(std::back_inserter(buffer), format, std::forward<TArgs>(args)...);
+}
+
+template<typename... TArgs>
+auto append(fmt::memory_buffer& buffer, bool colour, fmt::text_style style, fmt::format_string<TArgs...> format, TArgs&&... args)
+{
+	if (colour)
+		fmt::format_to(std::back_inserter(buffer), style, static_cast<fmt::string_view>(format), std::forward<TArgs>(args)...);
+	else
+		fmt::format_to(std::back_inserter(buffer), format, std::forward<TArgs>(args)...);
+}
+
+auto appendJson(fmt::memory_buffer& buffer, string_view text)
+{
+	buffer.push_back('"');
+
+	for (auto c : text) {
+		switch (c) {
+		case '"': append(buffer, "\\\""sv); break;
+		case '\\': append(buffer, "\\\\"sv); break;
+		case '\n': append(buffer, "\\n"sv); break;
+		case '\r': append(buffer, "\\r"sv); break;
+		case '\t': append(buffer, "\\t"sv); break;
+		default:
+			if (static_cast<unsigned char>(c) < 0x20)
+				append(buffer, "\\u{:04x}", static_cast<uint>(c));
+			else
+				buffer.push_back(c);
+		}
+	}
+
+	buffer.push_back('"');
+}
+
+auto renderText(fmt::memory_buffer& buffer, bool colour, const Report& report)
+{
+	auto position = getPosition(report);
+	auto lineNum = to_string(position.line);
+	auto gutter = lineNum.size() + 4;
+	auto severity = report.type == ReportType::Warning ? "warn"sv : getSeverityName(report.type);
+
+	append(buffer, colour, fmt::emphasis::bold | fg(fmt::color::red), "{}[E{:04}]", severity, report.diagnosis.getCodeInt());
+	append(buffer, colour, fmt::text_style{fmt::emphasis::bold}, ": {}\n", report.diagnosis.getName());
+	append(buffer, colour, fg(fmt::color::blue), "{:>{}}", "--> ", gutter);
+	append(buffer, "{}:{}:{}\n", position.file, lineNum, position.column);
+	append(buffer, colour, fg(fmt::color::blue), "{} |  ", lineNum);
+	append(buffer, position.before);
+	append(buffer, colour, fg(fmt::color::red), "{}", report.token.text);
+	append(buffer, position.after);
+	buffer.push_back('\n');
+	append(buffer, colour, fg(fmt::color::red), "{:>{}}{:^>{}} {}\n\n", "", gutter + position.column - 1, "^", position.width, report.diagnosis.getMessage());
+}
+
+auto renderJsonLine(fmt::memory_buffer& buffer, const Report& report)
+{
+	auto position = getPosition(report);
+
+	append(buffer, "{\"file\":"sv);
+	appendJson(buffer, position.file);
+	append(buffer, ",\"line\":{},\"column\":{},\"endColumn\":{},\"severity\":\"{}\",\"code\":\"E{:04}\",\"name\":",
+		position.line, position.column, position.column + position.width, getSeverityName(report.type), report.diagnosis.getCodeInt());
+	appendJson(buffer, report.diagnosis.getName());
+	append(buffer, ",\"message\":"sv);
+	appendJson(buffer, getMessage(report.diagnosis));
+	append(buffer, "}\n"sv);
+}
+
+auto renderSarif(fmt::memory_buffer& buffer, const vector<Report>& reports)
+{
+	auto codes = vector<DiagCode>{};
+	codes.reserve(reports.size());
+
+	for (auto& report : reports)
+		codes.push_back(report.diagnosis.getCode());
+
+	std::sort(codes.begin(), codes.end());
+	codes.erase(std::unique(codes.begin(), codes.end()), codes.end());
+
+	append(buffer, R"({"version":"2.1.0","$schema":"https://json.schemastore.org/sarif-2.1.0.json","runs":[{"tool":{"driver":{"name":"CLARA","rules":[)"sv);
+
+	for (auto it = codes.begin(); it != codes.end(); ++it) {
+		auto name = visitDiagCode(*it, [](auto tag) { return Diagnostic<decltype(tag)::code>::name; });
+
+		if (it != codes.begin()) buffer.push_back(',');
+		append(buffer, "{{\"id\":\"E{:04}\",\"shortDescription\":{{\"text\":", static_cast<std::underlying_type_t<DiagCode>>(*it));
+		appendJson(buffer, name);
+		append(buffer, "}}"sv);
+	}
+
+	append(buffer, "]}},\"results\":["sv);
+
+	for (auto it = reports.begin(); it != reports.end(); ++it) {
+		auto position = getPosition(*it);
+
+		if (it != reports.begin()) buffer.push_back(',');
+		append(buffer, "{{\"ruleId\":\"E{:04}\",\"level\":\"{}\",\"message\":{{\"text\":", it->diagnosis.getCodeInt(), getSarifLevel(it->type));
+		appendJson(buffer, getMessage(it->diagnosis));
+		buffer.push_back('}');
+
+		if (position.line) {
+			append(buffer, ",\"locations\":[{\"physicalLocation\":{\"artifactLocation\":{\"uri\":"sv);
+			appendJson(buffer, position.file);
+			append(buffer, "}},\"region\":{{\"startLine\":{},\"startColumn\":{},\"endColumn\":{}}}}}}}]",
+				position.line, position.column, position.column + position.width);
+		}
+
+		buffer.push_back('}');
+	}
+
+	append(buffer, "]}]}\n"sv);
+}
+
+auto getSortKey(const Report& report)
+{
+	return std::make_tuple(
+		report.token.source ? string_view{report.token.source->getName()} : string_view{},
+		report.token.offset,
+		report.token.text.size(),
+		report.diagnosis.getCode(),
+		report.type
+	);
+}
+
+}
+
+ReportWriter::ReportWriter(Options options) : m_options(options)
+{ }
+
+auto ReportWriter::getReporter()->Reporter
+{
+	return Reporter{[this](const ReportData& data) {
+		add(std::any_cast<const Report&>(data.data));
+	}};
+}
+
+auto ReportWriter::add(const Report& report)->void
+{
+	m_reports.push_back(report);
+}
+
+auto ReportWriter::size() const->size_t
+{
+	return m_reports.size();
+}
+
+auto ReportWriter::render()->string
+{
+	renderBuffer();
+	return fmt::to_string(m_buffer);
+}
+
+auto ReportWriter::flush(std::FILE* stream)->void
+{
+	renderBuffer();
+
+	if (m_buffer.size()) {
+		std::fwrite(m_buffer.data(), 1, m_buffer.size(), stream);
+		std::fflush(stream);
+	}
+}
+
+auto ReportWriter::renderBuffer()->void
+{
+	m_buffer.clear();
+
+	std::stable_sort(m_reports.begin(), m_reports.end(), [](const Report& a, const Report& b) {
+		return getSortKey(a) < getSortKey(b);
+	});
+	m_reports.erase(std::unique(m_reports.begin(), m_reports.end(), [](const Report& a, const Report& b) {
+		return getSortKey(a) == getSortKey(b);
+	}), m_reports.end());
+
+	switch (m_options.format) {
+	case ReportFormat::Text:
+		for (auto& report : m_reports)
+			renderText(m_buffer, m_options.colour, report);
+		break;
+
+	case ReportFormat::JsonLines:
+		for (auto& report : m_reports)
+			renderJsonLine(m_buffer, report);
+		break;
+
+	case ReportFormat::Sarif:
+		renderSarif(m_buffer, m_reports);
+		break;
+	}
+
+	m_reports.clear();
+}
@@ -1,9 +1,22 @@
 #include <CLARA/pch.h>
 #include <CLARA/Source.h>
+#include <CLARA/Common/File.h>
+#include <CLARA/Common/Scan.h>
 
 using namespace CLARA;
 using namespace CLARA::CLASM;
 
+namespace {
+
+auto countChars(string_view text)
+{
+	return static_cast<uint>(std::count_if(text.begin(), text.end(), [](char c) {
+		return (c & 0xC0) != 0x80;
+	}));
+}
+
+}
+
 Source::Token::Token(const Token& first, const Token& last) :
 	offset(first.offset),
 	text(string_view{first.text.data(), last.offset - first.offset + last.text.size()}),
@@ -25,45 +38,41 @@ Source::Token::Token(const Source* source, size_t offset, size_t length) :
 	assert(source != nullptr);
 }
 
-Source::Source(string name, string code) : m_name(name), m_code(code)
+Source::Source(string name, string code) : m_name(move(name)), m_storage(move(code)), m_code(m_storage)
 {
-	LineInfo line;
-	
-	m_lineInfos.reserve(2000);
-
-	for (auto i = 0u, chars = 0u; static_cast<size_t>(i) < code.size(); ++i, ++chars) {
-		if (code[i] == '\n') {
-			m_offsetLines.emplace(static_cast<uint>(line.offset), static_cast<uint>(m_lineInfos.size()));
-			m_lineInfos.emplace_back(line);
-			line = LineInfo{line.number + 1, i + 1, 0, chars};
-			continue;
-		}
+	indexLines();
+}
 
-		++line.length;
-		++line.charLength;
+Source::Source(string name, string_view code, shared_ptr<const void> owner) :
+	m_name(move(name)), m_owner(move(owner)), m_code(code)
+{
+	indexLines();
+}
 
-		if ((code[i] & 0xF0) == 0xF0) {
-			i += 3;
-			line.length += 3;
-		}
-		else if ((code[i] & 0xE0) == 0xE0) {
-			i += 2;
-			line.length += 2;
-		}
-		else if ((code[i] & 0xC0) == 0xC0) {
-			i += 1;
-			line.length += 1;
-		}
-		else continue;
+auto Source::fromFile(const fs::path& path)->shared_ptr<Source>
+{
+	auto file = make_shared<const MappedFile>(path);
+	auto code = file->getData();
+	return shared_ptr<Source>{new Source{path.string(), code, move(file)}};
+}
 
-		if (i >= code.size()) {
-			throw std::runtime_error{"Invalid UTF-8 string in code"};
-		}
+auto Source::fromBuffer(string name, string_view code)->shared_ptr<Source>
+{
+	return shared_ptr<Source>{new Source{move(name), code, nullptr}};
+}
+
+auto Source::indexLines()->void
+{
+	auto end = m_code.data() + m_code.size();
+
+	m_lineStarts.reserve(m_code.size() / 32 + 1);
+	m_lineStarts.push_back(0);
+
+	if (Scan::indexLines(m_code.data(), end, m_lineStarts) != end) {
+		throw std::runtime_error{"Invalid UTF-8 string in code"};
 	}
 
-	m_offsetLines.emplace(static_cast<uint>(line.offset), static_cast<uint>(m_lineInfos.size()));
-	m_lineInfos.push_back(line);
-	m_lineInfos.shrink_to_fit();
+	m_lineStarts.shrink_to_fit();
 }
 
 auto Source::getName() const->const string&
@@ -71,31 +80,56 @@ auto Source::getName() const->const string&
 	return m_name;
 }
 
-auto Source::getCode() const->const string&
+auto Source::getCode() const->string_view
 {
 	return m_code;
 }
 
 auto Source::getNumLines() const->uint
 {
-	return static_cast<uint>(m_lineInfos.size());
+	return static_cast<uint>(m_lineStarts.size());
 }
 
 auto Source::getLineInfos() const->const vector<LineInfo>&
 {
+	std::call_once(m_lineInfosBuilt, [this] {
+		auto charOffset = 0u;
+		m_lineInfos.reserve(m_lineStarts.size());
+
+		for (auto i = 0_uz; i < m_lineStarts.size(); ++i) {
+			auto offset = m_lineStarts[i];
+			auto end = i + 1 < m_lineStarts.size() ? m_lineStarts[i + 1] - 1 : static_cast<uint>(m_code.size());
+			auto chars = countChars(m_code.substr(offset, end - offset));
+
+			m_lineInfos.push_back(LineInfo{static_cast<uint>(i + 1), offset, end - offset, charOffset, chars});
+			charOffset += chars + 1;
+		}
+	});
 	return m_lineInfos;
 }
 
 auto Source::getLineInfo(uint index) const->const LineInfo&
 {
-	return m_lineInfos[index];
-} 
+	return getLineInfos()[index];
+}
+
+auto Source::getLineOffset(uint index) const->uint
+{
+	return m_lineStarts[index];
+}
 
 auto Source::getLineIndexByOffset(uint offset) const->uint
 {
-	auto it = m_offsetLines.upper_bound(offset);
-	if (it != m_offsetLines.begin()) --it;
-	return it != m_offsetLines.end() ? it->second : 0;
+	// the first line starts at 0, so this finds the last line starting at or before the offset
+	auto base = m_lineStarts.data();
+	auto count = m_lineStarts.size();
+
+	while (count > 1) {
+		auto half = count / 2;
+		base += base[half] <= offset ? half : 0;
+		count -= half;
+	}
+	return static_cast<uint>(base - m_lineStarts.data());
 }
 
 auto Source::getColumnByOffset(uint offset) const->uint
@@ -107,10 +141,11 @@ auto Source::getColumnByOffset(uint offset) const->uint
 		return line.charLength;
 	}
 
-	auto token = this->getText(line.offset, numBytes);
-	return std::accumulate(token.begin(), token.end(), 1, [](int n, char c) {
-		return n + int{(c & 0xC0) != 0x80 ? 1 : 0};
-	});
+	if (line.charLength == line.length) {
+		return numBytes + 1;
+	}
+
+	return countChars(getText(line.offset, numBytes)) + 1;
 }
 
 auto Source::getText(size_t from, size_t size) const->string_view
@@ -118,7 +153,7 @@ auto Source::getText(size_t from, size_t size) const->string_view
 	if ((from + size) > m_code.size()) {
 		throw std::range_error{"Invalid source code range requested"};
 	}
-	return string_view{m_code.c_str() + from, size};
+	return m_code.substr(from, size);
 }
 
 auto Source::getToken(size_t from) const->Token
@@ -127,11 +162,11 @@ auto Source::getToken(size_t from) const->Token
 		throw std::out_of_range("offset not in range of source");
 	}
 
-	auto end = m_code.c_str() + m_code.size();
-	auto begin = std::find_if(m_code.c_str() + from, end, std::not_fn(::isspace));
+	auto end = m_code.data() + m_code.size();
+	auto begin = std::find_if(m_code.data() + from, end, std::not_fn(::isspace));
 	auto it = std::find_if(begin, end, ::isspace);
 
-	return Token{this, static_cast<size_t>(begin - m_code.c_str()), static_cast<size_t>(it - begin)};
+	return Token{this, static_cast<size_t>(begin - m_code.data()), static_cast<size_t>(it - begin)};
 }
 
 auto Source::getToken(size_t from, size_t size) const->Token
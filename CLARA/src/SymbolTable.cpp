@@ -0,0 +1,123 @@
+#include <CLARA/pch.h>
+#include <CLARA/SymbolTable.h>
+
+using namespace CLARA;
+using namespace CLARA::CLASM;
+
+namespace {
+
+constexpr auto minSlots = 256_uz;
+
+// FNV-1a, identifiers are short so this beats the setup cost of anything wider
+auto hashString(string_view str)
+{
+	auto hash = uint32{2166136261u};
+	for (auto ch : str) {
+		hash ^= static_cast<uint8>(ch);
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+}
+
+auto SymbolTable::intern(string_view str)->Symbol
+{
+	return insert(str, hashString(str));
+}
+
+auto SymbolTable::merge(const SymbolTable& other, vector<Symbol>& symbols)->void
+{
+	symbols.resize(other.size());
+
+	// grow the index once for the lot, and the other table has the hashes already
+	auto slotCount = std::max(minSlots, slots.size());
+	while ((strings.size() + other.size()) * 2 > slotCount)
+		slotCount *= 2;
+	if (slotCount != slots.size())
+		rehash(slotCount);
+
+	for (auto i = 0_uz; i < other.size(); ++i)
+		symbols[i] = insert(other.strings[i], other.hashes[i]);
+}
+
+auto SymbolTable::insert(string_view str, uint32 hash)->Symbol
+{
+	if (!slots.empty()) {
+		if (auto slot = probe(str, hash); slots[slot])
+			return static_cast<Symbol>(slots[slot] - 1);
+	}
+
+	// keep the index at most half full so probe sequences stay short
+	if ((strings.size() + 1) * 2 > slots.size())
+		rehash(std::max(minSlots, slots.size() * 2));
+
+	if (strings.size() >= std::numeric_limits<uint32>::max())
+		throw std::length_error("too many symbols");
+
+	const auto symbol = static_cast<uint32>(strings.size());
+	strings.push_back(store(str));
+	hashes.push_back(hash);
+	slots[probe(str, hash)] = symbol + 1;
+	return static_cast<Symbol>(symbol);
+}
+
+auto SymbolTable::find(string_view str) const->optional<Symbol>
+{
+	if (slots.empty())
+		return nullopt;
+	if (auto slot = slots[probe(str, hashString(str))])
+		return static_cast<Symbol>(slot - 1);
+	return nullopt;
+}
+
+auto SymbolTable::clear()->void
+{
+	strings.clear();
+	hashes.clear();
+	std::fill(slots.begin(), slots.end(), 0u);
+	storage.reset();
+}
+
+auto SymbolTable::getMemoryUsage() const->size_t
+{
+	auto bytes = storage.getCapacity();
+	bytes += strings.capacity() * sizeof(string_view);
+	bytes += hashes.capacity() * sizeof(uint32);
+	return bytes + slots.capacity() * sizeof(uint32);
+}
+
+auto SymbolTable::probe(string_view str, uint32 hash) const->size_t
+{
+	const auto mask = slots.size() - 1;
+
+	for (auto slot = hash & mask;; slot = (slot + 1) & mask) {
+		auto entry = slots[slot];
+		if (!entry)
+			return slot;
+		if (hashes[entry - 1] == hash && strings[entry - 1] == str)
+			return slot;
+	}
+}
+
+auto SymbolTable::store(string_view str)->string_view
+{
+	if (str.empty())
+		return string_view{};
+
+	auto data = static_cast<char*>(storage.allocate(str.size(), 1));
+	std::memcpy(data, str.data(), str.size());
+	return string_view{data, str.size()};
+}
+
+auto SymbolTable::rehash(size_t capacity)->void
+{
+	slots.assign(capacity, 0);
+
+	for (auto symbol = 0_uz; symbol < strings.size(); ++symbol) {
+		auto slot = hashes[symbol] & (capacity - 1);
+		while (slots[slot])
+			slot = (slot + 1) & (capacity - 1);
+		slots[slot] = static_cast<uint32>(symbol + 1);
+	}
+}
@@ -5,13 +5,14 @@ using namespace CLARA;
 
 namespace CLARA::CLASM {
 
-auto getAnnotationSize(const TokenAnnotation& annotation) {
+auto getAnnotationSize(const TokenAnnotation& annotation)->size_t {
 	if (is<monostate>(annotation)) return 0;
 	if (is<int8_t>(annotation) || is<uint8_t>(annotation)) return 1;
 	if (is<int16_t>(annotation) || is<uint16_t>(annotation)) return 2;
 	if (is<int32_t>(annotation) || is<uint32_t>(annotation) || is<float>(annotation)) return 4;
 	if (is<int64_t>(annotation) || is<uint64_t>(annotation) || is<double>(annotation)) return 8;
 	if (is<Instruction::Type>(annotation)) return 1;
+	if (is<LabelRef>(annotation)) return 4;
 	return 0;
 }
 
@@ -20,7 +21,7 @@ auto getAnnotationTokenType(const TokenAnnotation& annotation)->TokenType {
 		using T = std::decay_t<decltype(arg)>;
 		if constexpr (std::is_arithmetic_v<T>)
 			return TokenType::Numeric;
-		else if constexpr (std::is_same_v<T, string>)
+		else if constexpr (std::is_same_v<T, Symbol>)
 			return TokenType::String;
 		else if constexpr (std::is_same_v<T, const Label*>)
 			return TokenType::Label;
@@ -0,0 +1,516 @@
+#include <CLARA/pch.h>
+#include <CLARA/Label.h>
+#include <CLARA/TokenStream.h>
+#include <cstring>
+
+using namespace CLARA;
+using namespace CLARA::CLASM;
+
+namespace {
+
+constexpr auto kindShift = 27u;
+constexpr auto payloadMask = (1u << kindShift) - 1;
+
+static_assert(std::variant_size_v<TokenAnnotation> <= (1u << (32u - kindShift)), "annotation kind doesn't fit");
+static_assert(static_cast<size_t>(TokenType::FloatLiteral) <= std::numeric_limits<uint8>::max(), "token type doesn't fit");
+
+template<typename T>
+constexpr auto isInline = (std::is_integral_v<T> && sizeof(T) <= 2) || std::is_enum_v<T>;
+
+template<typename T>
+auto toBits(T value)
+{
+	auto bits = uint64{0};
+	std::memcpy(&bits, &value, sizeof(T));
+	return bits;
+}
+
+template<typename T>
+auto fromBits(uint64 bits)
+{
+	auto value = T{};
+	std::memcpy(&value, &bits, sizeof(T));
+	return value;
+}
+
+auto checkIndex(size_t index)
+{
+	if (index > payloadMask)
+		throw std::length_error("too many annotations for a compact token stream");
+	return static_cast<uint32>(index);
+}
+
+/// Where a compact annotation of each kind keeps its value.
+enum class Payload {
+	Value,		//< in the payload
+	Symbol,		//< in the payload, as a symbol
+	Number,		//< in the numbers side table
+	Label,		//< in the labels side table
+};
+
+template<typename T>
+constexpr auto getPayload()
+{
+	if constexpr (std::is_same_v<T, Symbol>)
+		return Payload::Symbol;
+	else if constexpr (std::is_same_v<T, const Label*> || std::is_same_v<T, LabelRef>)
+		return Payload::Label;
+	else if constexpr (std::is_arithmetic_v<T> && !isInline<T>)
+		return Payload::Number;
+	else
+		return Payload::Value;
+}
+
+template<size_t... Kinds>
+constexpr auto makePayloads(std::index_sequence<Kinds...>)
+{
+	return array<Payload, sizeof...(Kinds)>{getPayload<std::variant_alternative_t<Kinds, TokenAnnotation>>()...};
+}
+
+constexpr auto payloads = makePayloads(std::make_index_sequence<std::variant_size_v<TokenAnnotation>>{});
+
+// side tables are compacted once at least this many entries and half of them are dead, so it's amortised over the edits
+constexpr auto minDeadEntries = 1024_uz;
+
+// sources spliced over which are kept alive for the tokens before the edits, before those are pointed at the edited code
+constexpr auto maxRetiredSources = 8_uz;
+
+}
+
+TokenStream::TokenStream(shared_ptr<const Source> source, TokenStorage storage, size_t reserve) :
+	source(source), storage(storage)
+{
+	if (isCompact()) {
+		compact.types.reserve(reserve);
+		compact.offsets.reserve(reserve);
+		compact.lengths.reserve(reserve);
+		compact.annotations.reserve(reserve);
+	}
+	else {
+		tokens.reserve(reserve);
+	}
+}
+
+auto TokenStream::get(size_t index) const->Token
+{
+	if (!isCompact())
+		return tokens[index];
+
+	const auto type = static_cast<TokenType>(compact.types[index]);
+
+	// streams built from token initializers have no source to take the text from
+	if (!source)
+		return Token{type, decodeAnnotation(compact.annotations[index])};
+
+	auto token = Token{source.get(), type, compact.offsets[index], static_cast<size_t>(compact.lengths[index])};
+	token.annotation = decodeAnnotation(compact.annotations[index]);
+	return token;
+}
+
+auto TokenStream::getType(size_t index) const->TokenType
+{
+	return isCompact() ? static_cast<TokenType>(compact.types[index]) : tokens[index].type;
+}
+
+auto TokenStream::getAnnotation(size_t index) const->TokenAnnotation
+{
+	return isCompact() ? decodeAnnotation(compact.annotations[index]) : tokens[index].annotation;
+}
+
+auto TokenStream::getOffset(size_t index) const->size_t
+{
+	return isCompact() ? compact.offsets[index] : tokens[index].offset;
+}
+
+auto TokenStream::findOffset(size_t offset) const->size_t
+{
+	if (isCompact())
+		return static_cast<size_t>(std::lower_bound(compact.offsets.begin(), compact.offsets.end(), offset) - compact.offsets.begin());
+
+	return static_cast<size_t>(std::lower_bound(tokens.begin(), tokens.end(), offset, [](const Token& token, size_t offset) {
+		return token.offset < offset;
+	}) - tokens.begin());
+}
+
+auto TokenStream::setAnnotation(size_t index, TokenAnnotation annotation)->void
+{
+	if (!isCompact()) {
+		tokens[index].annotation = move(annotation);
+		return;
+	}
+
+	releaseAnnotation(compact.annotations[index]);
+	compact.annotations[index] = encodeAnnotation(annotation);
+}
+
+auto TokenStream::reserve(size_t count)->void
+{
+	if (isCompact()) {
+		compact.types.reserve(count);
+		compact.offsets.reserve(count);
+		compact.lengths.reserve(count);
+		compact.annotations.reserve(count);
+	}
+	else {
+		tokens.reserve(count);
+	}
+}
+
+auto TokenStream::append(const TokenStream& other, const vector<Symbol>& symbols, const vector<const Label*>& labels)->void
+{
+	auto translateLabel = [&](const Label* label) {
+		return label ? labels[static_cast<size_t>(label->symbol)] : nullptr;
+	};
+
+	auto translate = [&](TokenAnnotation& annotation) {
+		if (auto symbol = get_if<Symbol>(&annotation))
+			*symbol = symbols[static_cast<size_t>(*symbol)];
+		else if (auto label = get_if<const Label*>(&annotation))
+			*label = translateLabel(*label);
+		else if (auto ref = get_if<LabelRef>(&annotation))
+			ref->label = translateLabel(ref->label);
+	};
+
+	// streams stored differently are only ever appended in tests, so they take the slow way
+	if (isCompact() != other.isCompact()) {
+		for (auto i = 0_uz; i < other.size(); ++i) {
+			auto token = other.get(i);
+			translate(token.annotation);
+			push(move(token));
+		}
+		return;
+	}
+
+	if (!isCompact()) {
+		const auto first = tokens.size();
+		tokens.insert(tokens.end(), other.tokens.begin(), other.tokens.end());
+
+		for (auto it = tokens.begin() + static_cast<ptrdiff_t>(first); it != tokens.end(); ++it)
+			translate(it->annotation);
+		return;
+	}
+
+	// the side tables are appended whole, so their indices only move past the entries already here
+	const auto numberBase = compact.numbers.size();
+	const auto labelBase = compact.labels.size();
+
+	compact.types.insert(compact.types.end(), other.compact.types.begin(), other.compact.types.end());
+	compact.offsets.insert(compact.offsets.end(), other.compact.offsets.begin(), other.compact.offsets.end());
+	compact.lengths.insert(compact.lengths.end(), other.compact.lengths.begin(), other.compact.lengths.end());
+	compact.numbers.insert(compact.numbers.end(), other.compact.numbers.begin(), other.compact.numbers.end());
+	compact.labels.reserve(labelBase + other.compact.labels.size());
+	compact.annotations.reserve(compact.annotations.size() + other.compact.annotations.size());
+
+	for (auto label : other.compact.labels)
+		compact.labels.push_back(translateLabel(label));
+
+	for (auto annotation : other.compact.annotations) {
+		const auto kind = annotation & ~payloadMask;
+		const auto payload = annotation & payloadMask;
+
+		switch (payloads[annotation >> kindShift]) {
+		case Payload::Value:
+			compact.annotations.push_back(annotation);
+			break;
+		case Payload::Symbol:
+			compact.annotations.push_back(kind | checkIndex(static_cast<size_t>(symbols[payload])));
+			break;
+		case Payload::Number:
+			compact.annotations.push_back(kind | checkIndex(numberBase + payload));
+			break;
+		case Payload::Label:
+			compact.annotations.push_back(kind | checkIndex(labelBase + payload));
+			break;
+		}
+	}
+}
+
+auto TokenStream::splice(size_t begin, size_t end, const TokenStream& other, const vector<Symbol>& symbols, const vector<const Label*>& labels, ptrdiff_t shift)->void
+{
+	assert(begin <= end && end <= size());
+
+	// the other stream is translated onto the end, then moved over the run, so the tail only moves if the sizes differ
+	const auto count = size();
+	const auto moved = begin + other.size();
+
+	auto replace = [&](auto& values) {
+		auto run = std::decay_t<decltype(values)>(std::make_move_iterator(values.begin() + static_cast<ptrdiff_t>(count)), std::make_move_iterator(values.end()));
+		auto common = std::min(end - begin, run.size());
+
+		values.resize(count);
+		std::move(run.begin(), run.begin() + static_cast<ptrdiff_t>(common), values.begin() + static_cast<ptrdiff_t>(begin));
+
+		if (run.size() > common)
+			values.insert(values.begin() + static_cast<ptrdiff_t>(end), std::make_move_iterator(run.begin() + static_cast<ptrdiff_t>(common)), std::make_move_iterator(run.end()));
+		else
+			values.erase(values.begin() + static_cast<ptrdiff_t>(begin + common), values.begin() + static_cast<ptrdiff_t>(end));
+	};
+
+	if (isCompact()) {
+		for (auto i = begin; i < end; ++i)
+			releaseAnnotation(compact.annotations[i]);
+
+		source = other.source;
+		append(other, symbols, labels);
+		replace(compact.types);
+		replace(compact.offsets);
+		replace(compact.lengths);
+		replace(compact.annotations);
+
+		if (shift) {
+			for (auto i = moved; i < compact.offsets.size(); ++i)
+				compact.offsets[i] = static_cast<uint32>(static_cast<ptrdiff_t>(compact.offsets[i]) + shift);
+		}
+
+		if (compact.deadEntries >= minDeadEntries && compact.deadEntries * 2 >= compact.numbers.size() + compact.labels.size())
+			compactSideTables();
+		return;
+	}
+
+	// the code before the edit is the same in both sources, so the tokens before the run can go on viewing it
+	if (source && source != other.source && begin) {
+		retired.push_back(move(source));
+	}
+	else if (!begin) {
+		retired.clear();
+	}
+
+	source = other.source;
+	append(other, symbols, labels);
+	replace(tokens);
+
+	auto repoint = [&](size_t first, size_t last, ptrdiff_t distance) {
+		const auto code = source ? source->getCode() : string_view{};
+
+		for (auto i = first; i < last; ++i) {
+			auto& token = tokens[i];
+			token.offset = static_cast<size_t>(static_cast<ptrdiff_t>(token.offset) + distance);
+			if (!token.source || !source) continue;
+			token.source = source.get();
+			token.text = code.substr(token.offset, token.text.size());
+		}
+	};
+
+	repoint(moved, tokens.size(), shift);
+
+	if (retired.size() > maxRetiredSources) {
+		repoint(0, begin, 0);
+		retired.clear();
+	}
+}
+
+auto TokenStream::save(BlobWriter& writer, const function<uint32(const Label*)>& getLabelIndex) const->void
+{
+	if (!isCompact()) {
+		auto packed = TokenStream{source, TokenStorage::Compact, tokens.size()};
+		for (auto& token : tokens)
+			packed.push(token);
+		packed.save(writer, getLabelIndex);
+		return;
+	}
+
+	// labels are written as their index + 1, leaving 0 for annotations of no label
+	auto labels = vector<uint32>{};
+	labels.reserve(compact.labels.size());
+	for (auto label : compact.labels)
+		labels.push_back(label ? getLabelIndex(label) + 1 : 0);
+
+	writer.write(static_cast<uint32>(compact.types.size()));
+	writer.write(static_cast<uint32>(compact.numbers.size()));
+	writer.write(static_cast<uint32>(labels.size()));
+	writer.writeArray(compact.types);
+	writer.writeArray(compact.offsets);
+	writer.writeArray(compact.lengths);
+	writer.writeArray(compact.annotations);
+	writer.writeArray(compact.numbers);
+	writer.writeArray(labels);
+}
+
+auto TokenStream::load(BlobReader& reader, const vector<Label*>& labels)->void
+{
+	const auto count = reader.read<uint32>();
+	const auto numNumbers = reader.read<uint32>();
+	const auto numLabels = reader.read<uint32>();
+	auto indices = vector<uint32>{};
+
+	reader.readArray(compact.types, count);
+	reader.readArray(compact.offsets, count);
+	reader.readArray(compact.lengths, count);
+	reader.readArray(compact.annotations, count);
+	reader.readArray(compact.numbers, numNumbers);
+	reader.readArray(indices, numLabels);
+
+	compact.labels.clear();
+	compact.labels.reserve(numLabels);
+	compact.deadEntries = 0;
+
+	for (auto index : indices) {
+		if (index > labels.size())
+			throw std::out_of_range("blob refers to a label which isn't there");
+		compact.labels.push_back(index ? labels[index - 1] : nullptr);
+	}
+
+	if (isCompact()) {
+		tokens.clear();
+		return;
+	}
+
+	// tokens stored in place are unpacked from the compact form they were written in
+	storage = TokenStorage::Compact;
+	tokens.clear();
+	tokens.reserve(count);
+	for (auto i = 0_uz; i < count; ++i)
+		tokens.push_back(get(i));
+
+	storage = TokenStorage::Tokens;
+	compact = Compact{};
+}
+
+auto TokenStream::reset(shared_ptr<const Source> source_, TokenStorage storage_)->void
+{
+	source = move(source_);
+	storage = storage_;
+	retired.clear();
+	tokens.clear();
+	compact.types.clear();
+	compact.offsets.clear();
+	compact.lengths.clear();
+	compact.annotations.clear();
+	compact.numbers.clear();
+	compact.labels.clear();
+	compact.deadEntries = 0;
+}
+
+auto TokenStream::getMemoryUsage() const->size_t
+{
+	auto bytes = tokens.capacity() * sizeof(Token);
+	bytes += compact.types.capacity() * sizeof(uint8);
+	bytes += compact.offsets.capacity() * sizeof(uint32);
+	bytes += compact.lengths.capacity() * sizeof(uint32);
+	bytes += compact.annotations.capacity() * sizeof(uint32);
+	bytes += compact.numbers.capacity() * sizeof(uint64);
+	return bytes + compact.labels.capacity() * sizeof(const Label*);
+}
+
+auto TokenStream::releaseAnnotation(uint32 annotation)->void
+{
+	switch (payloads[annotation >> kindShift]) {
+	case Payload::Number:
+	case Payload::Label:
+		++compact.deadEntries;
+		break;
+	default:
+		break;
+	}
+}
+
+auto TokenStream::compactSideTables()->void
+{
+	// every entry is referred to by one annotation, so the live ones are moved down in the order they're referred to
+	auto numbers = vector<uint64>{};
+	auto labels = vector<const Label*>{};
+	numbers.reserve(compact.numbers.size());
+	labels.reserve(compact.labels.size());
+
+	for (auto& annotation : compact.annotations) {
+		const auto kind = annotation & ~payloadMask;
+		const auto payload = annotation & payloadMask;
+
+		switch (payloads[annotation >> kindShift]) {
+		case Payload::Number:
+			annotation = kind | checkIndex(numbers.size());
+			numbers.push_back(compact.numbers[payload]);
+			break;
+		case Payload::Label:
+			annotation = kind | checkIndex(labels.size());
+			labels.push_back(compact.labels[payload]);
+			break;
+		default:
+			break;
+		}
+	}
+
+	compact.numbers = move(numbers);
+	compact.labels = move(labels);
+	compact.deadEntries = 0;
+}
+
+auto TokenStream::pushCompact(Token&& token)->void
+{
+	assert(!token.source || token.source == source.get());
+
+	compact.types.push_back(static_cast<uint8>(token.type));
+	compact.offsets.push_back(static_cast<uint32>(token.offset));
+	compact.lengths.push_back(static_cast<uint32>(token.text.size()));
+	compact.annotations.push_back(encodeAnnotation(token.annotation));
+}
+
+auto TokenStream::encodeAnnotation(const TokenAnnotation& annotation)->uint32
+{
+	const auto kind = static_cast<uint32>(annotation.index()) << kindShift;
+
+	return std::visit([&](auto&& arg)->uint32 {
+		using T = std::decay_t<decltype(arg)>;
+
+		if constexpr (std::is_same_v<T, monostate>) {
+			return kind;
+		}
+		else if constexpr (std::is_same_v<T, Symbol>) {
+			return kind | checkIndex(static_cast<size_t>(arg));
+		}
+		else if constexpr (std::is_enum_v<T>) {
+			return kind | static_cast<uint32>(arg);
+		}
+		else if constexpr (isInline<T>) {
+			return kind | static_cast<uint16>(arg);
+		}
+		else if constexpr (std::is_arithmetic_v<T>) {
+			compact.numbers.push_back(toBits(arg));
+			return kind | checkIndex(compact.numbers.size() - 1);
+		}
+		else if constexpr (std::is_same_v<T, const Label*>) {
+			compact.labels.push_back(arg);
+			return kind | checkIndex(compact.labels.size() - 1);
+		}
+		else if constexpr (std::is_same_v<T, LabelRef>) {
+			compact.labels.push_back(arg.label);
+			return kind | checkIndex(compact.labels.size() - 1);
+		}
+		else {
+			static_assert(always_false<T>::value, "non-exhaustive visitor!");
+		}
+	}, annotation);
+}
+
+template<size_t Kind>
+auto TokenStream::decodeAs(const Compact& compact, uint32 payload)->TokenAnnotation
+{
+	using T = std::variant_alternative_t<Kind, TokenAnnotation>;
+
+	if constexpr (std::is_same_v<T, monostate>)
+		return T{};
+	else if constexpr (std::is_enum_v<T>)
+		return static_cast<T>(payload);
+	else if constexpr (isInline<T>)
+		return static_cast<T>(static_cast<uint16>(payload));
+	else if constexpr (std::is_arithmetic_v<T>)
+		return fromBits<T>(compact.numbers[payload]);
+	else if constexpr (std::is_same_v<T, const Label*>)
+		return compact.labels[payload];
+	else if constexpr (std::is_same_v<T, LabelRef>)
+		return LabelRef{compact.labels[payload]};
+	else
+		static_assert(always_false<T>::value, "non-exhaustive visitor!");
+}
+
+template<size_t... Kinds>
+constexpr auto TokenStream::makeDecoders(std::index_sequence<Kinds...>)->array<Decoder, sizeof...(Kinds)>
+{
+	return {&TokenStream::decodeAs<Kinds>...};
+}
+
+auto TokenStream::decodeAnnotation(uint32 annotation) const->TokenAnnotation
+{
+	static constexpr auto decoders = makeDecoders(std::make_index_sequence<std::variant_size_v<TokenAnnotation>>{});
+	return decoders[annotation >> kindShift](compact, annotation & payloadMask);
+}
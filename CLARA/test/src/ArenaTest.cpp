@@ -0,0 +1,143 @@
+#include <catch.hpp>
+#include <CLARA/Common/Arena.h>
+#include <CLARA/Parser.h>
+
+using namespace CLARA;
+using namespace CLARA::CLASM;
+
+namespace {
+
+struct Counted {
+	int& live;
+
+	Counted(int& live) : live(live)
+	{
+		++live;
+	}
+
+	~Counted()
+	{
+		--live;
+	}
+};
+
+auto makeSource(int labels)
+{
+	auto code = string{".data\nSTR: DS \"text\"\n.code\n"};
+	for (auto i = 0; i < labels; ++i)
+		code += "label_" + to_string(i) + ": push " + to_string(i) + ", jmpd label_0\n";
+	return make_shared<Source>("test", code);
+}
+
+}
+
+TEST_CASE("Arena allocates aligned memory from blocks", "[Arena]") {
+	auto arena = Arena{1024};
+
+	for (auto align : {1_uz, 2_uz, 4_uz, 8_uz, 16_uz, 64_uz}) {
+		auto ptr = arena.allocate(3, align);
+		CHECK(reinterpret_cast<uintptr_t>(ptr) % align == 0);
+	}
+	CHECK(arena.getBlockCount() == 1_uz);
+
+	SECTION("large allocations get a block of their own") {
+		auto ptr = static_cast<char*>(arena.allocate(4096, 1));
+		std::fill(ptr, ptr + 4096, 'x');
+		CHECK(arena.getBlockCount() == 2_uz);
+		CHECK(arena.getCapacity() >= 1024_uz + 4096);
+	}
+
+	SECTION("moving keeps allocations valid") {
+		auto value = arena.create<int>(42);
+		auto moved = std::move(arena);
+		CHECK(*value == 42);
+		CHECK(moved.getBlockCount() == 1_uz);
+		CHECK(arena.getBlockCount() == 0_uz);
+	}
+}
+
+TEST_CASE("Arena reset destroys objects and reuses blocks", "[Arena]") {
+	auto live = 0;
+	auto arena = Arena{256};
+
+	for (auto i = 0; i < 100; ++i)
+		arena.create<Counted>(live);
+
+	CHECK(live == 100);
+	const auto blocks = arena.getBlockCount();
+	const auto capacity = arena.getCapacity();
+	REQUIRE(blocks > 1_uz);
+
+	arena.reset();
+	CHECK(live == 0);
+	CHECK(arena.getUsed() == 0_uz);
+
+	for (auto i = 0; i < 100; ++i)
+		arena.create<Counted>(live);
+
+	CHECK(live == 100);
+	CHECK(arena.getBlockCount() == blocks);
+	CHECK(arena.getCapacity() == capacity);
+
+	SECTION("destruction runs the remaining destructors") {
+		{
+			auto other = std::move(arena);
+		}
+		CHECK(live == 0);
+	}
+}
+
+TEST_CASE("Parser result can be reset and reused", "[Arena]") {
+	auto options = Parser::Options{};
+	options.errorReporting = false;
+	auto result = Parser::Result{};
+
+	Parser::tokenize(options, makeSource(1000), result);
+	REQUIRE(result.ok());
+	REQUIRE(result.info.labels.size() == 1001_uz);
+
+	const auto labelCapacity = result.info.arena->getCapacity();
+	const auto symbolMemory = result.info.symbols.getMemoryUsage();
+	const auto tokens = result.info.segments[Segment::Code].tokens.get();
+
+	for (auto i = 0; i < 3; ++i) {
+		Parser::tokenize(options, makeSource(1000), result);
+		REQUIRE(result.ok());
+		CHECK(result.info.labels.size() == 1001_uz);
+		CHECK(result.info.symbols.size() == 1002_uz);
+		CHECK(result.info.arena->getCapacity() == labelCapacity);
+		CHECK(result.info.symbols.getMemoryUsage() == symbolMemory);
+		CHECK(result.info.segments[Segment::Code].tokens.get() == tokens);
+	}
+
+	SECTION("a smaller parse leaves nothing behind") {
+		Parser::tokenize(options, makeSource(1), result);
+		REQUIRE(result.ok());
+		CHECK(result.info.labels.size() == 2_uz);
+		CHECK(result.info.labelMap.size() == 2_uz);
+		CHECK(result.info.segments[Segment::Code].tokens->size() < 10_uz);
+	}
+
+	SECTION("streams still in use are not reused") {
+		auto kept = result.info.segments[Segment::Code].tokens;
+		auto keptSize = kept->size();
+		Parser::tokenize(options, makeSource(1), result);
+		CHECK(kept->size() == keptSize);
+		CHECK(result.info.segments[Segment::Code].tokens != kept);
+	}
+
+	SECTION("a result moved from can be parsed into") {
+		auto constructed = Parser::Result{move(result)};
+		CHECK(constructed.info.labels.size() == 1001_uz);
+		Parser::tokenize(options, makeSource(1), result);
+		REQUIRE(result.ok());
+		CHECK(result.info.labels.size() == 2_uz);
+
+		auto assigned = Parser::Result{};
+		assigned = move(result);
+		Parser::tokenize(options, makeSource(1), result);
+		REQUIRE(result.ok());
+		CHECK(result.info.labelMap.size() == 2_uz);
+		CHECK(constructed.info.labels.size() == 1001_uz);
+	}
+}
@@ -35,4 +35,100 @@ TEST_CASE("Get instruction overloads", "[Assembly]") {
 	REQUIRE(res[0].insn == Instruction::CALL);
 	REQUIRE(res[1].insn== Instruction::CALLD);
 	REQUIRE(res[1].params[0] == OperandType::REL32);
+}
+
+TEST_CASE("Get reserved word by name", "[Assembly]") {
+	SECTION("words with several meanings are found in one lookup") {
+		auto word = ReservedWord::fromName("pop");
+		REQUIRE(word);
+		CHECK(word->mnemonic == Mnemonic::POP);
+		CHECK(word->instruction == Instruction::POP);
+		CHECK(word->keyword == Keyword::MAX);
+
+		word = ReservedWord::fromName("global");
+		REQUIRE(word);
+		CHECK(word->keyword == Keyword::Global);
+		CHECK(word->instruction == Instruction::GLOBAL);
+	}
+
+	SECTION("data types and segments") {
+		CHECK(DataType::fromName("DS") == DataType::DS);
+		CHECK(DataType::fromName("ds") == DataType::MAX);
+		CHECK(Segment::fromName("code") == Segment::Code);
+		CHECK(Segment::fromName("data") == Segment::Data);
+		CHECK(Segment::fromName("header") == Segment::MAX);
+	}
+
+	SECTION("identifiers which are not reserved") {
+		CHECK_FALSE(ReservedWord::fromName(""));
+		CHECK_FALSE(ReservedWord::fromName("pus"));
+		CHECK_FALSE(ReservedWord::fromName("pushh"));
+		CHECK_FALSE(ReservedWord::fromName("func_0"));
+		CHECK_FALSE(ReservedWord::fromName("a_much_longer_identifier_than_any_reserved_word"));
+	}
+
+	SECTION("lookups take views into the source") {
+		auto code = string_view{"add, sub"};
+		CHECK(Instruction::fromName(code.substr(0, 3)) == Instruction::ADD);
+		CHECK(Instruction::fromName(code.substr(5, 3)) == Instruction::SUB);
+	}
+}
+
+TEST_CASE("Instruction set tables", "[Assembly]") {
+	static_assert(Instruction::getSize(Instruction::NOP) == 1);
+	static_assert(Instruction::getSize(Instruction::PUSHD) == 5);
+	static_assert(Instruction::getSize(Instruction::PUSHQ) == 9);
+	static_assert(Instruction::getName(Instruction::JMPD) == "jmpd");
+
+	SECTION("every instruction can be looked up by name") {
+		for (auto i = 0u; i < Instruction::MAX; ++i) {
+			auto type = static_cast<Instruction::Type>(i);
+			INFO(Instruction::getName(type));
+			CHECK(Instruction::getInfo(type).type == type);
+			CHECK(Instruction::fromName(Instruction::getName(type)) == type);
+		}
+	}
+
+	SECTION("encoded size includes operands") {
+		CHECK(Instruction::getSize(Instruction::PUSHQF) == 9);
+		CHECK(Instruction::getSize(Instruction::POPL) == 3);
+		CHECK(Instruction::getSize(Instruction::CALLD) == 5);
+	}
+
+	SECTION("operands") {
+		auto& operands = Instruction::getOperands(Instruction::PUSHF);
+		REQUIRE(operands.size() == 1);
+		REQUIRE(operands[0].types.size() == 1);
+		CHECK(operands[0].types[0] == OperandType::IMM32);
+		CHECK(Instruction::getOperands(Instruction::PUSHAQ).empty());
+		CHECK(Instruction::getOperands(Instruction::POPV)[0].types[0] == OperandType::V16);
+	}
+
+	SECTION("mnemonic overloads are in opcode order") {
+		auto& overloads = Mnemonic::getOverloads(Mnemonic::PUSH);
+		REQUIRE(overloads.size() == 7);
+		CHECK(overloads.front().insn == Instruction::PUSHN);
+		CHECK(overloads.front().params.empty());
+		CHECK(overloads.back().insn == Instruction::PUSHQF);
+		CHECK(overloads.back().params[0] == OperandType::IMM64);
+		CHECK(Mnemonic::getOverloads(Mnemonic::PUSHA).back().insn == Instruction::PUSHAQF);
+	}
+
+	SECTION("mnemonics resolve to the smallest fitting encoding") {
+		static_assert(Instruction::fromMnemonic(Mnemonic::PUSH, OperandShape::Int8) == Instruction::PUSHB);
+		CHECK(Instruction::fromMnemonic(Mnemonic::PUSH, OperandShape::None) == Instruction::PUSHN);
+		CHECK(Instruction::fromMnemonic(Mnemonic::PUSH, OperandShape::Int16) == Instruction::PUSHW);
+		CHECK(Instruction::fromMnemonic(Mnemonic::PUSH, OperandShape::Int32) == Instruction::PUSHD);
+		CHECK(Instruction::fromMnemonic(Mnemonic::PUSH, OperandShape::Int64) == Instruction::PUSHQ);
+		CHECK(Instruction::fromMnemonic(Mnemonic::PUSH, OperandShape::Real32) == Instruction::PUSHF);
+		CHECK(Instruction::fromMnemonic(Mnemonic::PUSH, OperandShape::Real64) == Instruction::PUSHQF);
+		CHECK(Instruction::fromMnemonic(Mnemonic::PUSH, OperandShape::String) == Instruction::MAX);
+		CHECK(Instruction::fromMnemonic(Mnemonic::POP, OperandShape::Int8) == Instruction::POP);
+		CHECK(Instruction::fromMnemonic(Mnemonic::POP, OperandShape::Real32) == Instruction::MAX);
+		CHECK(Instruction::fromMnemonic(Mnemonic::DUP, OperandShape::None) == Instruction::DUP);
+		CHECK(Instruction::fromMnemonic(Mnemonic::JMP, OperandShape::Label) == Instruction::JMPD);
+		CHECK(Instruction::fromMnemonic(Mnemonic::CALL, OperandShape::Other) == Instruction::MAX);
+		CHECK(Instruction::getOperands(Instruction::PUSHF)[0].real);
+		CHECK_FALSE(Instruction::getOperands(Instruction::PUSHD)[0].real);
+	}
 }
\ No newline at end of file
@@ -11,6 +11,7 @@ using namespace CLARA::CLASM;
 
 struct MockOutputHandler : public IBinaryOutput {
 	vector<uint8_t> output;
+	vector<Segment::Type> segments;                     //< every segment written, in order
 
 	virtual ~MockOutputHandler() = default;
 
@@ -42,6 +43,12 @@ struct MockOutputHandler : public IBinaryOutput {
 	{
 		output.insert(output.end(), begin, end);
 	}
+
+	virtual auto writeSegment(Segment::Type segment, const uint8_t* begin, const uint8_t* end)->void override
+	{
+		segments.push_back(segment);
+		write(begin, end);
+	}
 };
 
 inline auto makeParseInfo(const vector<pair<TokenType, TokenAnnotation>>& tokenStreamInit)
@@ -55,4 +55,83 @@ TEST_CASE("compiles pushd instruction", "[Compile]")
 		{Segment::Code, Instruction::PUSHD, 0x80818283_u32},
 		{Instruction::PUSHD, 0x83_u8, 0x82_u8, 0x81_u8, 0x80_u8}
 	));
-}
\ No newline at end of file
+}
+
+TEST_CASE("compiles label references to segment-relative offsets", "[Compile]")
+{
+	auto start = Label{Symbol{}, "start", TokenHandle{Segment::Code, 0}, Segment::Code};
+	auto later = Label{Symbol{}, "later", TokenHandle{Segment::Code, 4}, Segment::Code};
+	auto value = Label{Symbol{}, "value", TokenHandle{Segment::Data, 1}, Segment::Data};
+
+	SECTION("forward and backward references") {
+		REQUIRE(compileCheck(
+			{Segment::Code, &start, Instruction::JMPD, LabelRef{&later}, Instruction::NOP, &later, Instruction::JMPD, LabelRef{&start}},
+			{Instruction::JMPD, 0x06_u8, 0_u8, 0_u8, 0_u8, Instruction::NOP, Instruction::JMPD, 0_u8, 0_u8, 0_u8, 0_u8}
+		));
+	}
+
+	SECTION("references into another segment") {
+		REQUIRE(compileCheck(
+			{Segment::Code, Instruction::NOP, Instruction::PUSHD, LabelRef{&value}, Segment::Data, 0x11_u16, &value, 0x22_u8},
+			{0x11_u8, 0_u8, 0x22_u8, Instruction::NOP, Instruction::PUSHD, 0x02_u8, 0_u8, 0_u8, 0_u8}
+		));
+	}
+}
+
+TEST_CASE("lays out segments before compiling them in segment order", "[Compile]")
+{
+	auto options = Parser::Options{};
+	options.errorReporting = false;
+	auto res = Parser::tokenize(options, make_shared<Source>("layout", ".code\nstart:\njmp later\nnop\n.data\nDS \"abc\"\nlater: DB 1\n.code\njmp start\n"));
+	REQUIRE(res.numErrors == 0);
+
+	Compiler::layout(res.info);
+	CHECK(res.info.segments[Segment::Header].size == 0);
+	CHECK(res.info.segments[Segment::Code].size == 11);
+	CHECK(res.info.segments[Segment::Data].size == 4);
+	CHECK(res.info.labels[0]->offset == 0);
+	CHECK(res.info.labels[1]->offset == 3);
+
+	auto out = MockOutputHandler{};
+	Compiler::compile(Compiler::Options{}, res.info, out);
+	CHECK(out.check(vector<uint8_t>{'a', 'b', 'c', 1, Instruction::JMPD, 3, 0, 0, 0, Instruction::NOP, Instruction::JMPD, 0, 0, 0, 0}));
+}
+
+TEST_CASE("hands each segment to the output in one call", "[Compile]")
+{
+	auto out = compile({Segment::Data, 0x11223344_u32, 0x55_u8, Segment::Code, Instruction::PUSHW, 0x0102_u16, Instruction::NOP});
+	CHECK(out.segments == vector<Segment::Type>{Segment::Data, Segment::Code});
+	CHECK(out.check(vector<uint8_t>{0x44, 0x33, 0x22, 0x11, 0x55, Instruction::PUSHW, 0x02, 0x01, Instruction::NOP}));
+}
+
+TEST_CASE("compiles the same on any number of threads", "[Compile]")
+{
+	auto code = ".data\n"s;
+	for (auto i = 0; i < 200; ++i)
+		code += fmt::format("str_{}: DS \"string {}\"\nDB {}\n", i, i, i % 256);
+	code += ".code\n";
+	for (auto i = 0; i < 500; ++i)
+		code += fmt::format("label_{}:\npushd {}\njmp label_{}\njmp label_{}\npushw 0x1234, nop\n", i, i * 7919, (i * 37) % 500, i % 200);
+
+	auto storage = GENERATE(TokenStorage::Tokens, TokenStorage::Compact);
+	auto parseOptions = Parser::Options{};
+	parseOptions.errorReporting = false;
+	parseOptions.tokenStorage = storage;
+	auto res = Parser::tokenize(parseOptions, make_shared<Source>("threads", code));
+	REQUIRE(res.numErrors == 0);
+
+	auto serial = MockOutputHandler{};
+	Compiler::compile(Compiler::Options{}, res.info, serial);
+	REQUIRE(serial.output.size() > 1000);
+
+	for (auto chunkSize : {1_uz, 7_uz, 1000_uz}) {
+		auto options = Compiler::Options{};
+		options.threads = 4;
+		options.chunkSize = chunkSize;
+
+		auto parallel = MockOutputHandler{};
+		Compiler::compile(options, res.info, parallel);
+		CHECK(parallel.segments == serial.segments);
+		CHECK(parallel.check(serial.output));
+	}
+}
@@ -0,0 +1,122 @@
+#include "catch.hpp"
+#include <CLARA/Decoder.h>
+#include <CLARA/ModuleBuilder.h>
+#include "CompilerHelper.h"
+
+using namespace CLARA;
+using namespace CLARA::CLASM;
+
+namespace {
+
+template<typename TInt, typename T>
+auto getBits(T value)
+{
+	static_assert(sizeof(TInt) == sizeof(T));
+	auto bits = TInt{};
+	std::memcpy(&bits, &value, sizeof(bits));
+	return bits;
+}
+
+}
+
+TEST_CASE("Opcode table matches the instruction set", "[Decoder]")
+{
+	for (auto opcode = 0u; opcode < Decoder::opcodes.size(); ++opcode) {
+		auto& info = Decoder::getOpcodeInfo(static_cast<uint8>(opcode));
+
+		if (opcode >= Instruction::MAX) {
+			CHECK(info.instruction == Instruction::MAX);
+			continue;
+		}
+
+		auto instruction = static_cast<Instruction::Type>(opcode);
+		CHECK(info.instruction == instruction);
+		CHECK(info.size == Instruction::getSize(instruction));
+
+		// operands follow the opcode back to back
+		auto end = 1_uz;
+		for (auto i = 0_uz; i < info.numOperands; ++i) {
+			CHECK(info.offsets[i] == end);
+			end += getOperandSize(info.operands[i]);
+		}
+		CHECK(end == info.size);
+	}
+
+	static_assert(Decoder::getOpcodeInfo(Instruction::PUSHF).real[0]);
+	static_assert(Decoder::getOpcodeInfo(Instruction::JMPD).operands[0] == OperandType::REL32);
+	static_assert(sizeof(Decoder::DecodedInstruction) == 8);
+}
+
+TEST_CASE("Decoder gives back the instructions compiled", "[Decoder]")
+{
+	auto builder = ModuleBuilder{};
+	auto loop = builder.label("loop");
+	builder.emit<Instruction::PUSHB>(0xFE)
+		.emit<Instruction::PUSHW>(0x1234)
+		.emit<Instruction::PUSHQ>(0x0102030405060708ull)
+		.emit<Instruction::PUSHF>(1.5)
+		.emit<Instruction::PUSHQF>(-2.25)
+		.emit<Instruction::ADD>()
+		.emit<Instruction::POPVE>(70000u)
+		.emit<Instruction::JT>(builder.ref(loop))
+		.emit<Instruction::RET>();
+
+	auto out = MockOutputHandler{};
+	builder.compile(Compiler::Options{}, out);
+
+	const auto instructions = Decoder::decode(out.output.data(), out.output.size());
+	const auto expected = vector<Instruction::Type>{
+		Instruction::PUSHB, Instruction::PUSHW, Instruction::PUSHQ, Instruction::PUSHF, Instruction::PUSHQF,
+		Instruction::ADD, Instruction::POPVE, Instruction::JT, Instruction::RET,
+	};
+	REQUIRE(instructions.size() == expected.size());
+
+	auto offset = 0_uz;
+	for (auto i = 0_uz; i < instructions.size(); ++i) {
+		CHECK(instructions[i].instruction == expected[i]);
+		CHECK(instructions[i].offset == offset);
+		CHECK(instructions[i].size == Instruction::getSize(expected[i]));
+		offset += instructions[i].size;
+	}
+	CHECK(offset == out.output.size());
+
+	auto code = out.output.data();
+	CHECK(Decoder::readOperand(code, instructions[0], 0) == 0xFE);
+	CHECK(Decoder::readOperand(code, instructions[1], 0) == 0x1234);
+	CHECK(Decoder::readOperand(code, instructions[2], 0) == 0x0102030405060708ull);
+	CHECK(Decoder::readOperand(code, instructions[3], 0) == getBits<uint32>(1.5f));
+	CHECK(Decoder::readOperand(code, instructions[4], 0) == getBits<uint64>(-2.25));
+	CHECK(Decoder::readOperand(code, instructions[6], 0) == 70000);
+	CHECK(Decoder::readOperand(code, instructions[7], 0) == loop->offset);
+}
+
+TEST_CASE("Decoder rejects bytes which aren't instructions", "[Decoder]")
+{
+	SECTION("empty segment") {
+		CHECK(Decoder::decode(nullptr, 0).empty());
+	}
+
+	SECTION("invalid opcode") {
+		const auto code = vector<uint8>{Instruction::NOP, Instruction::ADD, 0xFF, Instruction::NOP};
+
+		try {
+			Decoder::decode(code.data(), code.size());
+			FAIL("decoded an invalid opcode");
+		}
+		catch (const Decoder::DecodeException& ex) {
+			CHECK(ex.offset == 2);
+		}
+	}
+
+	SECTION("instruction cut short") {
+		const auto code = vector<uint8>{Instruction::NOP, Instruction::PUSHD, 1, 2, 3};
+
+		try {
+			Decoder::decode(code.data(), code.size());
+			FAIL("decoded a cut short instruction");
+		}
+		catch (const Decoder::DecodeException& ex) {
+			CHECK(ex.offset == 1);
+		}
+	}
+}
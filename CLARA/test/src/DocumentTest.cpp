@@ -0,0 +1,134 @@
+#include <catch.hpp>
+#include <CLARA/Document.h>
+#include "ParserHelper.h"
+
+using namespace CLARA;
+using namespace CLARA::CLASM;
+
+namespace {
+
+auto getTexts(const vector<Token>& tokens)
+{
+	auto texts = vector<string>{};
+	for (auto& token : tokens)
+		texts.push_back(to_string(token.offset) + ":" + string{token.text});
+	return texts;
+}
+
+}
+
+TEST_CASE("Document converts positions counted in UTF-16", "[Document]") {
+	// the comment has a two byte character, then one which takes two UTF-16 code units
+	auto document = Document{"test", ".code\n; \xC3\xA9 \xF0\x9F\x98\x80 x\nnop\n", getParseOpts()};
+
+	CHECK(document.getOffset({0, 0}) == 0_uz);
+	CHECK(document.getOffset({1, 2}) == 8_uz);
+	CHECK(document.getOffset({1, 4}) == 11_uz);
+	CHECK(document.getOffset({1, 6}) == 15_uz);
+	CHECK(document.getOffset({1, 99}) == 17_uz);
+	CHECK(document.getOffset({2, 1}) == 19_uz);
+	CHECK(document.getOffset({9, 0}) == 22_uz);
+
+	auto position = document.getPosition(15);
+	CHECK(position.line == 1u);
+	CHECK(position.character == 6u);
+
+	auto range = document.getRange(document.getSource()->getToken(18, 3));
+	CHECK(range.start.line == 2u);
+	CHECK(range.start.character == 0u);
+	CHECK(range.end.line == 2u);
+	CHECK(range.end.character == 3u);
+}
+
+TEST_CASE("Document parses edits in one update", "[Document]") {
+	auto document = Document{"test", ".code\nstart:\nnop\njmp start\n", getParseOpts()};
+	REQUIRE(document.getResult().ok());
+
+	document.edit({{2, 0}, {2, 3}}, "push 1");
+	document.edit({{3, 0}, {3, 0}}, "dup\n");
+	CHECK(document.isEdited());
+	CHECK(document.getText() == ".code\nstart:\npush 1\ndup\njmp start\n");
+	CHECK(document.getSource()->getCode() == ".code\nstart:\nnop\njmp start\n");
+
+	CHECK(document.update());
+	CHECK_FALSE(document.isEdited());
+	CHECK(document.getSource()->getCode() == ".code\nstart:\npush 1\ndup\njmp start\n");
+
+	auto expected = Parser::tokenize(getParseOpts(), make_shared<Source>("test", ".code\nstart:\npush 1\ndup\njmp start\n"));
+	auto& tokens = *document.getResult().info.segments[Segment::Code].tokens;
+	auto& expectedTokens = *expected.info.segments[Segment::Code].tokens;
+	REQUIRE(tokens.size() == expectedTokens.size());
+	for (auto i = 0_uz; i < tokens.size(); ++i) {
+		CHECK(tokens[i].type == expectedTokens[i].type);
+		CHECK(tokens[i].offset == expectedTokens[i].offset);
+	}
+
+	SECTION("with errors") {
+		document.edit({{2, 6}, {2, 6}}, " :");
+		CHECK(document.update());
+		REQUIRE(document.getResult().reports.size() == 1_uz);
+		CHECK(document.getResult().reports[0].token.offset == 20_uz);
+	}
+
+	SECTION("text which isn't valid UTF-8") {
+		document.edit({{1, 0}, {1, 0}}, "; \xFF\n");
+		CHECK_THROWS_AS(document.update(), std::runtime_error);
+		CHECK(document.isEdited());
+		CHECK(document.getText() == ".code\n; \xFF\nstart:\npush 1\ndup\njmp start\n");
+		CHECK(document.getResult().ok());
+
+		document.edit({{1, 0}, {1, 4}}, "nop");
+		CHECK(document.update());
+		CHECK(document.getSource()->getCode() == ".code\nnop\nstart:\npush 1\ndup\njmp start\n");
+	}
+
+	SECTION("replacing the whole text") {
+		document.setText(".code\nbegin:\njmp begin\n");
+		CHECK_FALSE(document.update());
+		CHECK(document.getResult().ok());
+		CHECK(document.getResult().info.labels.size() == 1_uz);
+		CHECK(document.getResult().info.labels[0]->name == "begin");
+	}
+}
+
+TEST_CASE("Document finds labels and references", "[Document]") {
+	auto options = getParseOpts();
+	options.tokenStorage = GENERATE(TokenStorage::Tokens, TokenStorage::Compact);
+
+	const auto code = ".code\nstart:\njmp later\njmp start\n.data\nlater: DB 1\n.code\njmp later\njmp missing\n"s;
+	auto document = Document{"test", code, options};
+	auto later = document.findLabel(code.find("later"));
+	REQUIRE(later);
+	CHECK(later->name == "later");
+
+	CHECK(document.findLabel(code.find("later:")) == later);
+	CHECK(document.findLabel(code.find("later:") + 5) == later);
+	CHECK(document.findLabel(code.rfind("later") + 2) == later);
+	CHECK_FALSE(document.findLabel(code.find("missing")));
+	CHECK_FALSE(document.findLabel(code.find("jmp")));
+
+	auto definition = document.getDefinition(*later);
+	CHECK(definition.offset == code.find("later:"));
+
+	auto laterOffset = code.find("later");
+	auto lastOffset = code.rfind("later");
+	auto definitionOffset = code.find("later:");
+	CHECK(getTexts(document.findReferences(*later, false)) == vector<string>{
+		to_string(laterOffset) + ":later", to_string(lastOffset) + ":later"
+	});
+	CHECK(document.findReferences(*later, true).size() == 3_uz);
+	CHECK(document.findReferences(*later, true)[1].offset == definitionOffset);
+
+	SECTION("after an edit") {
+		document.edit(document.getRange(document.getSource()->getToken(code.find("jmp start"), 9)), "jmp later");
+		CHECK(document.update());
+
+		auto start = document.findLabel(code.find("start"));
+		REQUIRE(start);
+		CHECK(document.findReferences(*start, false).empty());
+
+		auto label = document.findLabel(code.find("later"));
+		REQUIRE(label);
+		CHECK(document.findReferences(*label, false).size() == 3_uz);
+	}
+}
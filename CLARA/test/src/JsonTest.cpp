@@ -0,0 +1,81 @@
+#include <catch.hpp>
+#include "Json.h"
+
+using namespace CLARA;
+using namespace CLARA::LSP;
+
+TEST_CASE("Json parses values", "[Json]") {
+	auto json = Json::parse(R"( {"null": null, "yes": true, "no": false, "list": [1, "two", [], {}], "nested": {"a": {"b": 3}}} )");
+
+	CHECK(json["null"].isNull());
+	CHECK(json["yes"].getBool());
+	CHECK_FALSE(json["no"].getBool());
+	CHECK(json["no"].isBool());
+	REQUIRE(json["list"].getArray().size() == 4_uz);
+	CHECK(json["list"].getArray()[0].getInt() == 1);
+	CHECK(json["list"].getArray()[1].getString() == "two");
+	CHECK(json["list"].getArray()[2].isArray());
+	CHECK(json["list"].getArray()[3].isObject());
+	CHECK(json["nested"]["a"]["b"].getInt() == 3);
+	CHECK(json["missing"]["deeper"].isNull());
+	CHECK(json["list"]["key"].isNull());
+}
+
+TEST_CASE("Json parses string escapes", "[Json]") {
+	CHECK(Json::parse(R"("a\"b\\c\/d")").getString() == "a\"b\\c/d");
+	CHECK(Json::parse(R"("\b\f\n\r\t")").getString() == "\b\f\n\r\t");
+	CHECK(Json::parse(R"("\u0041\u00e9\u20AC")").getString() == "A\xC3\xA9\xE2\x82\xAC");
+
+	SECTION("surrogate pairs") {
+		CHECK(Json::parse(R"("\ud83d\ude00")").getString() == "\xF0\x9F\x98\x80");
+		CHECK(Json::parse(R"("x\uD800\uDC00y")").getString() == "x\xF0\x90\x80\x80y");
+		CHECK_THROWS_AS(Json::parse(R"("\ud83d")"), JsonException);
+		CHECK_THROWS_AS(Json::parse(R"("\ud83dx")"), JsonException);
+		CHECK_THROWS_AS(Json::parse(R"("\ude00")"), JsonException);
+		CHECK_THROWS_AS(Json::parse(R"("\ud83d\u0041")"), JsonException);
+	}
+
+	SECTION("written back") {
+		auto text = string{"quote \" backslash \\ line\nbell\x07"};
+		CHECK(Json{text}.dump() == R"("quote \" backslash \\ line\nbell\u0007")");
+		CHECK(Json::parse(Json{text}.dump()).getString() == text);
+	}
+}
+
+TEST_CASE("Json parses numbers", "[Json]") {
+	CHECK(Json::parse("0").getInt() == 0);
+	CHECK(Json::parse("-12").getInt() == -12);
+	CHECK(Json::parse("9223372036854775807").getInt() == std::numeric_limits<int64>::max());
+	CHECK(Json::parse("1.5").getInt() == 1);
+	CHECK(Json::parse("2e3").getInt() == 2000);
+	CHECK(Json::parse("-2.5E-1").isNumber());
+	CHECK(Json::parse("9223372036854775808").isNumber());
+	CHECK(Json::parse("[0,1]").getArray().size() == 2_uz);
+
+	for (auto number : {"", "-", "+1", ".5", "01", "1.", "1e", "1e+", "-x", "0x10", "1e999"}) {
+		INFO(number);
+		CHECK_THROWS_AS(Json::parse(number), JsonException);
+	}
+}
+
+TEST_CASE("Json rejects malformed input", "[Json]") {
+	for (auto text : {"", " ", "nul", "tru", "[", "[1,]", "[1 2]", "{", "{\"a\"}", "{\"a\" 1}", "{\"a\":1,}", "{1:2}",
+		"\"unterminated", "\"bad \\q escape\"", "\"\\u12\"", "1 2", "[]]"}) {
+		INFO(text);
+		CHECK_THROWS_AS(Json::parse(text), JsonException);
+	}
+
+	SECTION("nested too deeply") {
+		auto text = string(100000, '[') + string(100000, ']');
+		CHECK_THROWS_AS(Json::parse(text), JsonException);
+
+		auto shallow = string(200, '[') + string(200, ']');
+		CHECK(Json::parse(shallow).isArray());
+	}
+}
+
+TEST_CASE("Json writes objects in the order members were added", "[Json]") {
+	auto json = Json{}.set("b", 1).set("a", Json::Array{Json{}, true, 2.5, "x"}).set("c", Json{}.set("d", false));
+	CHECK(json.dump() == R"({"b":1,"a":[null,true,2.5,"x"],"c":{"d":false}})");
+	CHECK(Json::parse(json.dump()).dump() == json.dump());
+}
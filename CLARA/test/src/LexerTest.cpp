@@ -0,0 +1,129 @@
+#include <catch.hpp>
+#include <CLARA/Lexer.h>
+
+using namespace CLARA;
+using namespace CLARA::CLASM;
+
+auto scanOne(string_view code) {
+	return Lexer::scan(code, 0);
+}
+
+auto scanTypes(string_view code) {
+	auto types = vector<TokenType>{};
+	for (auto offset = 0_uz; offset < code.size();) {
+		auto lexeme = Lexer::scan(code, offset);
+		types.push_back(lexeme.type);
+		if (lexeme.type == TokenType::None) break;
+		offset += lexeme.length;
+	}
+	return types;
+}
+
+TEST_CASE("Scanner recognises whitespace and comments", "[Lexer]") {
+	CHECK(scanOne("\n\n\nnop").type == TokenType::EndOfLine);
+	CHECK(scanOne("\n\n\nnop").length == 3);
+	CHECK(scanOne(" \t\r\nnop").type == TokenType::WhiteSpace);
+	CHECK(scanOne(" \t\r\nnop").length == 3);
+	CHECK(scanOne("; comment\nnop").type == TokenType::WhiteSpace);
+	CHECK(scanOne("; comment\nnop").length == 9);
+
+	SECTION("comment may end the file") {
+		auto lexeme = scanOne("; comment");
+		CHECK(lexeme.type == TokenType::WhiteSpace);
+		CHECK(lexeme.length == 9);
+	}
+}
+
+TEST_CASE("Scanner recognises identifiers, labels and segments", "[Lexer]") {
+	CHECK(scanOne("push 1").type == TokenType::Identifier);
+	CHECK(scanOne("push 1").length == 4);
+	CHECK(scanOne("x").type == TokenType::Identifier);
+	CHECK(scanOne("x").length == 1);
+	CHECK(scanOne("label: nop").type == TokenType::Label);
+	CHECK(scanOne("label: nop").length == 6);
+	CHECK(scanOne("label:").type == TokenType::Label);
+	CHECK(scanOne("label:nop").type == TokenType::Identifier);
+	CHECK(scanOne("label:nop").length == 5);
+	CHECK(scanOne(".code\n").type == TokenType::Segment);
+	CHECK(scanOne(".code\n").length == 5);
+	CHECK(scanOne(". code").type == TokenType::None);
+}
+
+TEST_CASE("Scanner recognises strings", "[Lexer]") {
+	CHECK(scanOne("\"hello world\" x").length == 13);
+	CHECK(scanOne("\"a\\\"b\" x").length == 6);
+	CHECK(scanOne("\"a\\\\\" x").length == 5);
+	CHECK(scanOne("\"\\\"\" x").length == 4);
+	CHECK(scanOne("\"unterminated").type == TokenType::None);
+	CHECK(scanOne("\"unterminated\\\"").type == TokenType::None);
+}
+
+TEST_CASE("Scanner recognises numeric literals", "[Lexer]") {
+	SECTION("integers") {
+		auto lexeme = scanOne("123 ");
+		CHECK(lexeme.type == TokenType::IntegerLiteral);
+		CHECK(lexeme.length == 3);
+		CHECK(lexeme.integer == 123);
+
+		lexeme = scanOne("-12,");
+		CHECK(lexeme.type == TokenType::IntegerLiteral);
+		CHECK(lexeme.length == 3);
+		CHECK(lexeme.integer == 12);
+		CHECK(lexeme.negative);
+
+		CHECK(scanOne("0").length == 1);
+		CHECK(scanOne("0123").type == TokenType::None);
+		CHECK(scanOne("12a").type == TokenType::None);
+		CHECK(scanOne("- 1").type == TokenType::None);
+		CHECK_FALSE(scanOne("18446744073709551616").valid);
+		CHECK(scanOne("18446744073709551615").integer == 18446744073709551615u);
+	}
+
+	SECTION("hexadecimals") {
+		auto lexeme = scanOne("0xFF\n");
+		CHECK(lexeme.type == TokenType::HexLiteral);
+		CHECK(lexeme.length == 4);
+		CHECK(lexeme.integer == 0xFF);
+
+		lexeme = scanOne("-0x8000");
+		CHECK(lexeme.type == TokenType::HexLiteral);
+		CHECK(lexeme.integer == 0x8000);
+		CHECK(lexeme.negative);
+
+		CHECK(scanOne("0x").type == TokenType::None);
+		CHECK(scanOne("0x1g").type == TokenType::None);
+		CHECK(scanOne("0xFFFFFFFFFFFFFFFF").valid);
+		CHECK_FALSE(scanOne("0xFFFFFFFFFFFFFFFF1").valid);
+	}
+
+	SECTION("floats") {
+		auto lexeme = scanOne("3.14 ");
+		CHECK(lexeme.type == TokenType::FloatLiteral);
+		CHECK(lexeme.length == 4);
+		CHECK(lexeme.real == Approx(3.14f));
+
+		lexeme = scanOne("-1.e-4");
+		CHECK(lexeme.type == TokenType::FloatLiteral);
+		CHECK(lexeme.length == 6);
+		CHECK(lexeme.real == Approx(-1.e-4f));
+
+		lexeme = scanOne("+2.5");
+		CHECK(lexeme.valid);
+		CHECK(lexeme.real == Approx(2.5f));
+
+		// a float must end on a word boundary, so trailing garbage is left for the next lexeme
+		CHECK(scanOne("1.e").length == 2);
+		CHECK(scanOne("3. ").type == TokenType::None);
+	}
+}
+
+TEST_CASE("Scanner tokenizes a line in one pass", "[Lexer]") {
+	auto types = scanTypes("label: push 0x10, pushd -5 ; comment\n");
+	CHECK(types == vector<TokenType>{
+		TokenType::Label, TokenType::WhiteSpace, TokenType::Identifier, TokenType::WhiteSpace,
+		TokenType::HexLiteral, TokenType::Separator, TokenType::WhiteSpace, TokenType::Identifier,
+		TokenType::WhiteSpace, TokenType::IntegerLiteral, TokenType::WhiteSpace, TokenType::WhiteSpace,
+		TokenType::EndOfLine
+	});
+	CHECK(scanTypes("`123").front() == TokenType::None);
+}
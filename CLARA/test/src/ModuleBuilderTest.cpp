@@ -0,0 +1,127 @@
+#include "catch.hpp"
+#include <CLARA/ModuleBuilder.h>
+#include "CompilerHelper.h"
+
+using namespace CLARA;
+using namespace CLARA::CLASM;
+
+TEST_CASE("Module builder gives the parse of the same assembly", "[ModuleBuilder]")
+{
+	const auto code = ".code\nstart:\npushd 0x80818283\njmp later\nnop\nlater:\njmp start\npushs \"text\"\n.data\nvalue: DS \"abc\"\nDB 0xFF\n"s;
+	auto options = Parser::Options{};
+	options.errorReporting = false;
+	auto parsed = Parser::tokenize(options, make_shared<Source>("builder", code));
+	REQUIRE(parsed.numErrors == 0);
+
+	auto storage = GENERATE(TokenStorage::Tokens, TokenStorage::Compact);
+	auto builder = ModuleBuilder{storage};
+	auto start = builder.label("start");
+	auto later = builder.makeLabel("later");
+	builder.emit(Instruction::PUSHD, 0x80818283u)
+		.emit<Instruction::JMPD>(builder.ref(later))
+		.emit<Instruction::NOP>()
+		.label(later)
+		.emit(Instruction::JMPD, builder.ref(start))
+		.emit<Instruction::PUSHS>("text");
+	builder.setSegment(Segment::Data);
+	builder.label("value");
+	builder.ds("abc").db(0xFF);
+
+	SECTION("tokens") {
+		auto& info = builder.getInfo();
+
+		for (auto segment : {Segment::Header, Segment::Data, Segment::Code}) {
+			auto& expected = *parsed.info.segments[segment].tokens;
+			auto& tokens = *info.segments[segment].tokens;
+
+			// the parse ends with the end of the source in its last segment
+			auto expectedSize = expected.size();
+			if (expectedSize && expected.getType(expectedSize - 1) == TokenType::EndOfFile)
+				--expectedSize;
+			REQUIRE(tokens.size() == expectedSize);
+
+			for (auto i = 0_uz; i < tokens.size(); ++i) {
+				CHECK(tokens.getType(i) == expected.getType(i));
+				CHECK(tokens.getAnnotation(i).index() == expected.getAnnotation(i).index());
+			}
+		}
+
+		REQUIRE(info.labels.size() == parsed.info.labels.size());
+		for (auto i = 0_uz; i < info.labels.size(); ++i) {
+			CHECK(info.labels[i]->name == parsed.info.labels[i]->name);
+			CHECK(info.labels[i]->segment == parsed.info.labels[i]->segment);
+			CHECK(info.labels[i]->definition.index == parsed.info.labels[i]->definition.index);
+		}
+	}
+
+	SECTION("compiled bytes") {
+		auto expected = MockOutputHandler{};
+		Compiler::compile(Compiler::Options{}, parsed.info, expected);
+
+		auto out = MockOutputHandler{};
+		builder.compile(Compiler::Options{}, out);
+		CHECK(out.segments == expected.segments);
+		CHECK(out.check(expected.output));
+
+		auto finished = MockOutputHandler{};
+		Compiler::compile(Compiler::Options{}, builder.finish(), finished);
+		CHECK(finished.check(expected.output));
+	}
+}
+
+TEST_CASE("Module builder stores operands at the width of their operand type", "[ModuleBuilder]")
+{
+	auto builder = ModuleBuilder{};
+	builder.emit(Instruction::PUSHD, 1)
+		.emit(Instruction::PUSHW, -2)
+		.emit<Instruction::PUSHQ>(uint8{3})
+		.emit<Instruction::PUSHF>(1.5)
+		.emit(Instruction::PUSHQF, 2);
+
+	auto out = MockOutputHandler{};
+	builder.compile(Compiler::Options{}, out);
+
+	auto expected = vector<uint8_t>{Instruction::PUSHD, 1, 0, 0, 0, Instruction::PUSHW, 0xFE, 0xFF, Instruction::PUSHQ, 3, 0, 0, 0, 0, 0, 0, 0, Instruction::PUSHF};
+	auto real32 = encodeBytesLE(1.5f);
+	auto real64 = encodeBytesLE(2.0);
+	expected.insert(expected.end(), real32.begin(), real32.end());
+	expected.push_back(Instruction::PUSHQF);
+	expected.insert(expected.end(), real64.begin(), real64.end());
+	CHECK(out.check(expected));
+
+	auto size = 0_uz;
+	for (auto instruction : {Instruction::PUSHD, Instruction::PUSHW, Instruction::PUSHQ, Instruction::PUSHF, Instruction::PUSHQF})
+		size += Instruction::getSize(instruction);
+	CHECK(out.output.size() == size);
+}
+
+TEST_CASE("Module builder rejects what the assembler would", "[ModuleBuilder]")
+{
+	auto builder = ModuleBuilder{};
+	auto label = builder.makeLabel("label");
+
+	CHECK_THROWS_AS(builder.emit(Instruction::PUSHB, 256), std::out_of_range);
+	CHECK_THROWS_AS(builder.emit(Instruction::PUSHB, -129), std::out_of_range);
+	CHECK_THROWS_AS(builder.emit(Instruction::PUSHD), std::invalid_argument);
+	CHECK_THROWS_AS(builder.emit(Instruction::NOP, 1), std::invalid_argument);
+	CHECK_THROWS_AS(builder.emit(Instruction::JMPD, 1), std::invalid_argument);
+	CHECK_THROWS_AS(builder.emit(Instruction::PUSHD, 1.5), std::invalid_argument);
+	CHECK_THROWS_AS(builder.emit(Instruction::PUSHS, builder.ref(label)), std::invalid_argument);
+	CHECK_THROWS_AS(builder.makeLabel("label"), std::invalid_argument);
+	CHECK_THROWS_AS(builder.db(1), std::logic_error);
+	CHECK(builder.getInfo().segments[Segment::Code].tokens->empty());
+
+	builder.emit(Instruction::JMPD, builder.ref(label));
+	CHECK_THROWS_AS(builder.finish(), std::logic_error);
+
+	builder.label(label);
+	CHECK_THROWS_AS(builder.label(label), std::logic_error);
+	CHECK_THROWS_AS(ModuleBuilder{}.label(label), std::invalid_argument);
+
+	builder.setSegment(Segment::Data);
+	CHECK_THROWS_AS(builder.emit(Instruction::NOP), std::logic_error);
+
+	auto info = builder.finish();
+	CHECK(info.segments[Segment::Code].tokens->size() == 3);
+	CHECK(builder.getInfo().labels.empty());
+}
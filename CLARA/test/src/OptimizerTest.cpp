@@ -0,0 +1,130 @@
+#include "catch.hpp"
+#include <CLARA/Label.h>
+#include <CLARA/Optimizer.h>
+#include "CompilerHelper.h"
+
+using namespace CLARA;
+using namespace CLARA::CLASM;
+
+namespace {
+
+auto parse(const string& code, TokenStorage storage = TokenStorage::Tokens)
+{
+	auto options = Parser::Options{};
+	options.errorReporting = false;
+	options.tokenStorage = storage;
+	auto result = Parser::tokenize(options, make_shared<Source>("optimizer", ".code\n" + code));
+	REQUIRE(result.numErrors == 0);
+	return result;
+}
+
+auto compile(const Parser::ParseInfo& info)
+{
+	auto out = MockOutputHandler{};
+	Compiler::compile(Compiler::Options{}, info, out);
+	return out.output;
+}
+
+/// Check that optimizing some code compiles to the same as other code.
+auto checkOptimizes(const string& code, const string& expected, const Optimizer::Options& options = Optimizer::Options{})
+{
+	INFO(code);
+	auto result = parse(code, GENERATE(TokenStorage::Tokens, TokenStorage::Compact));
+	Optimizer::optimize(options, result.info);
+	CHECK(compile(result.info) == compile(parse(expected).info));
+}
+
+}
+
+TEST_CASE("Optimizer removes redundant sequences", "[Optimizer]")
+{
+	SECTION("pushed then popped") {
+		checkOptimizes("pushd 5\npop 1\nnop", "nop");
+		checkOptimizes("dup\npop 1\nret", "ret");
+		checkOptimizes("pushs \"text\"\npop 1", "");
+		checkOptimizes("pushd 1\npop 3", "pop 2");
+		checkOptimizes("push 1\npushn\npop 2\nret", "ret");
+	}
+
+	SECTION("float flag") {
+		checkOptimizes("exf\npushd 0x3FC00000", "pushf 1.5");
+		checkOptimizes("exf\npushq 0x3FF8000000000000", "pushqf 1.5");
+	}
+
+	SECTION("constant arithmetic") {
+		checkOptimizes("push 2\npush 40\nadd", "push 42");
+		checkOptimizes("push -1000\npush 1000\nmul", "push -1000000");
+		checkOptimizes("push 6\npush 7\nmul\npush 2\nmul", "push 84");
+		checkOptimizes("push 3\npush 4\nadd\npop 1\nret", "ret");
+	}
+
+	SECTION("multiply by a power of two") {
+		checkOptimizes("dup\npush 8\nmul", "dup\npush 3\nshl");
+		checkOptimizes("dup\npush 1\nmul\nret", "dup\nret");
+	}
+
+	SECTION("jump to the next instruction") {
+		checkOptimizes("jmp next\nnext:\nret", "next:\nret");
+		checkOptimizes("start:\njmp next\njmp next\nnext:\njmp start", "start:\nnext:\njmp start");
+	}
+}
+
+TEST_CASE("Optimizer leaves what it can't prove the same", "[Optimizer]")
+{
+	SECTION("jump targets") {
+		checkOptimizes("push 1\nskip:\npop 1\njmp skip", "push 1\nskip:\npop 1\njmp skip");
+		checkOptimizes("jmp other\nnext:\nother:\nret", "jmp other\nnext:\nother:\nret");
+	}
+
+	SECTION("flagged instructions") {
+		checkOptimizes("exf\npush 1\npop 1", "exf\npush 1\npop 1");
+		checkOptimizes("exf\nback:\npush 1\npop 1\njmp back", "exf\nback:\npush 1\npop 1\njmp back");
+		checkOptimizes("exf\npush 2\npush 3\nadd", "exf\npush 2\npush 3\nadd");
+	}
+
+	SECTION("other values") {
+		checkOptimizes("push 3\nmul", "push 3\nmul");
+		checkOptimizes("push 2\npush 3\nsub", "push 2\npush 3\nsub");
+		checkOptimizes("pushq 0x7FFFFFFFFFFFFFFF\npush 2\nmul", "pushq 0x7FFFFFFFFFFFFFFF\npush 1\nshl");
+		checkOptimizes("push 1\npop 0", "push 1\npop 0");
+	}
+
+	SECTION("disabled rules") {
+		auto options = Optimizer::Options{};
+		options.foldConstants = false;
+		checkOptimizes("push 2\npush 4\nmul", "push 2\npush 2\nshl", options);
+
+		options.reduceStrength = false;
+		checkOptimizes("push 2\npush 4\nmul", "push 2\npush 4\nmul", options);
+	}
+}
+
+TEST_CASE("Optimizer moves labels to their new definitions", "[Optimizer]")
+{
+	const auto code = "start:\npush 1\npush 2\nadd\npop 1\nloop:\ndup\npop 1\njmp end\nend:\njt loop\njmp start"s;
+	auto result = parse(code, GENERATE(TokenStorage::Tokens, TokenStorage::Compact));
+	const auto before = result.info.segments[Segment::Code].tokens->size();
+
+	auto optimized = Optimizer::optimize(Optimizer::Options{}, result.info);
+	CHECK(optimized.rewrites == 4);
+	CHECK(optimized.removedTokens == before - result.info.segments[Segment::Code].tokens->size());
+	CHECK(compile(result.info) == compile(parse("start:\nloop:\nend:\njt loop\njmp start").info));
+
+	auto& tokens = *result.info.segments[Segment::Code].tokens;
+	for (auto label : result.info.labels) {
+		REQUIRE(label->definition.index < tokens.size());
+		CHECK(tokens.getType(label->definition.index) == TokenType::Label);
+		CHECK(get<const Label*>(tokens.getAnnotation(label->definition.index)) == label);
+	}
+}
+
+TEST_CASE("Optimizer leaves code without anything to rewrite alone", "[Optimizer]")
+{
+	auto result = parse("start:\npush 1\nadd\njmp start");
+	auto tokens = result.info.segments[Segment::Code].tokens;
+
+	auto optimized = Optimizer::optimize(Optimizer::Options{}, result.info);
+	CHECK(optimized.rewrites == 0);
+	CHECK(optimized.removedTokens == 0);
+	CHECK(result.info.segments[Segment::Code].tokens == tokens);
+}
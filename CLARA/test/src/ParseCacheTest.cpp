@@ -0,0 +1,126 @@
+#include <catch.hpp>
+#include <CLARA/ParseCache.h>
+#include "ParserHelper.h"
+
+using namespace CLARA;
+using namespace CLARA::CLASM;
+
+namespace {
+
+const auto cleanCode = ".code\nstart:\npushd 70000\npushq 0xFFFFFFFFFF\npushf 1.5\njmp later\n; a \"quoted\" comment\n"
+	".data\nlater: DB 1\nDS \"a;b\"\n.code\njmp start\ncall later\n"s;
+
+auto describeTokens(const Parser::Result& res)
+{
+	auto text = string{};
+
+	for (auto& segmentInfo : res.info.segments) {
+		text += "segment "s + to_string(segmentInfo.size) + "\n"s;
+		for (auto i = 0_uz; i < segmentInfo.tokens->size(); ++i)
+			text += string{segmentInfo.tokens->get(i).text} + "\n"s;
+	}
+
+	for (auto& segmentSwitch : res.info.segmentSwitches)
+		text += "switch "s + to_string(segmentSwitch.offset) + " "s + to_string(static_cast<int>(segmentSwitch.segment)) + "\n"s;
+	return text;
+}
+
+}
+
+TEST_CASE("Parse cache loads a result it saved", "[ParseCache]") {
+	auto saveOptions = getParseOpts();
+	auto loadOptions = getParseOpts();
+	saveOptions.tokenStorage = GENERATE(TokenStorage::Tokens, TokenStorage::Compact);
+	loadOptions.tokenStorage = GENERATE(TokenStorage::Tokens, TokenStorage::Compact);
+
+	auto source = make_shared<Source>("test", cleanCode);
+	auto result = Parser::tokenize(saveOptions, source);
+	REQUIRE(checkResult(result));
+	REQUIRE(result.reports.empty());
+
+	auto blob = ParseCache::save(saveOptions, *source, result);
+	auto loaded = Parser::Result{};
+	REQUIRE(ParseCache::load(loadOptions, source, blob, loaded));
+
+	CHECK(describeResult(loaded) == describeResult(result));
+	CHECK(describeTokens(loaded) == describeTokens(result));
+	CHECK(loaded.info.symbols.size() == result.info.symbols.size());
+
+	for (auto& segmentInfo : loaded.info.segments)
+		CHECK(segmentInfo.tokens->getStorage() == loadOptions.tokenStorage);
+
+	// the labels are found by name and refer to their definitions as before
+	auto symbol = loaded.info.symbols.find("later");
+	REQUIRE(symbol);
+	auto it = loaded.info.labelMap.find(*symbol);
+	REQUIRE(it != loaded.info.labelMap.end());
+	auto& label = *loaded.info.labels[it->second];
+	CHECK(label.name == "later");
+	CHECK(label.segment == Segment::Data);
+	CHECK(loaded.info.getToken(label.definition).offset == cleanCode.find("later:"));
+}
+
+TEST_CASE("Parse cache ignores blobs which don't match", "[ParseCache]") {
+	auto options = getParseOpts();
+	auto source = make_shared<Source>("test", cleanCode);
+	auto result = Parser::tokenize(options, source);
+	auto blob = ParseCache::save(options, *source, result);
+	auto loaded = Parser::Result{};
+
+	SECTION("another source") {
+		auto edited = cleanCode;
+		edited[edited.find("70000")] = '8';
+		CHECK_FALSE(ParseCache::load(options, make_shared<Source>("test", edited), blob, loaded));
+	}
+
+	SECTION("other options") {
+		options.testForceTokenization = true;
+		CHECK_FALSE(ParseCache::load(options, source, blob, loaded));
+	}
+
+	SECTION("another version") {
+		blob[4] = static_cast<char>(blob[4] + 1);
+		CHECK_FALSE(ParseCache::load(options, source, blob, loaded));
+	}
+
+	SECTION("a corrupt blob") {
+		blob[blob.size() / 2] = static_cast<char>(~blob[blob.size() / 2]);
+		CHECK_FALSE(ParseCache::load(options, source, blob, loaded));
+	}
+
+	SECTION("a truncated blob") {
+		CHECK_FALSE(ParseCache::load(options, source, string_view{blob}.substr(0, blob.size() - 1), loaded));
+		CHECK_FALSE(ParseCache::load(options, source, string_view{blob}.substr(0, 8), loaded));
+	}
+
+	CHECK(loaded.info.labels.empty());
+	CHECK(loaded.info.segmentSwitches.empty());
+
+	SECTION("a result with reports") {
+		auto failed = Parser::tokenize(options, make_shared<Source>("test", ".code\nnop :\n"));
+		REQUIRE_FALSE(failed.reports.empty());
+		CHECK_THROWS_AS(ParseCache::save(options, *source, failed), std::invalid_argument);
+	}
+}
+
+TEST_CASE("Parse cache keeps results in a directory", "[ParseCache]") {
+	auto directory = std::filesystem::temp_directory_path() / "clara_parse_cache_test";
+	std::filesystem::remove_all(directory);
+
+	auto options = getParseOpts();
+	auto source = make_shared<Source>("test", cleanCode);
+	auto result = Parser::Result{};
+
+	CHECK_FALSE(ParseCache::tokenize(options, source, directory, result));
+	auto expected = describeResult(result);
+
+	CHECK(ParseCache::tokenize(options, source, directory, result));
+	CHECK(describeResult(result) == expected);
+
+	auto failing = make_shared<Source>("test", ".code\nnop :\n");
+	CHECK_FALSE(ParseCache::tokenize(options, failing, directory, result));
+	CHECK(result.numErrors == 1);
+	CHECK_FALSE(ParseCache::tokenize(options, failing, directory, result));
+
+	std::filesystem::remove_all(directory);
+}
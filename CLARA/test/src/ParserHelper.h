@@ -24,6 +24,33 @@ inline auto isOneOf(const T& value, std::initializer_list<T> oneOfThese) {
 	return false;
 }
 
+// everything a parse produced, with annotations resolved to names so results from different symbol tables compare
+inline auto describeResult(const Parser::Result& res)
+{
+	auto text = "errors "s + to_string(res.numErrors) + (res.hadFatal ? " fatal\n"s : "\n"s);
+
+	for (auto& report : res.reports)
+		text += "report "s + to_string(report.diagnosis.getCodeInt()) + " "s + to_string(report.token.offset) + " "s + report.diagnosis.getMessage() + "\n"s;
+
+	for (auto& segmentInfo : res.info.segments) {
+		for (auto i = 0_uz; i < segmentInfo.tokens->size(); ++i) {
+			auto token = segmentInfo.tokens->get(i);
+			text += to_string(static_cast<int>(token.type)) + "@"s + to_string(token.offset) + " "s;
+			std::visit(visitor{
+				[&](const Label* label) { text += label ? string{label->name} : "?"s; },
+				[&](const LabelRef& ref) { text += ref.label ? string{ref.label->name} : "?"s; },
+				[&](Symbol symbol) { text += string{res.info.symbols.get(symbol)}; },
+				[&](const auto&) { text += to_string(token.annotation.index()); },
+			}, token.annotation);
+			text += "\n"s;
+		}
+	}
+
+	for (auto label : res.info.labels)
+		text += "label "s + string{label->name} + " "s + to_string(static_cast<int>(label->definition.segment)) + ":"s + to_string(label->definition.index) + "\n"s;
+	return text;
+}
+
 inline auto checkResult(const Parser::Result& res) {
 	for (auto& report : res.reports) {
 		UNSCOPED_INFO(string{report.diagnosis.getName()} +" ["s + to_string(report.diagnosis.getCodeInt()) + "]: "s + string{report.token.text});
@@ -63,6 +90,10 @@ struct ParsingTestHelper {
 		return *tokensPtr;
 	}
 
+	auto getSymbol(const TokenAnnotation& annotation) const {
+		return result.info.symbols.get(get<Symbol>(annotation));
+	}
+
 	auto& parseExpectCode(string code, initializer_list<TokenType> types) {
 		result = parseCode(std::move(code));
 		auto& tokens = *result.info.segments[Segment::Code].tokens;
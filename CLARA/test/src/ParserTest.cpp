@@ -118,8 +118,8 @@ TEST_CASE("Parser enforces start of line tokens per segment", "[Parser]") {
 		REQUIRE(res.numErrors == 1_uz);
 		REQUIRE(res.reports[0].diagnosis.getCode() == DiagCode::ExpectedToken);
 		CHECK(res.reports[0].diagnosis.get<DiagCode::ExpectedToken>().given == TokenType::String);
-		REQUIRE(is<AnyOf>(res.reports[0].diagnosis.get<DiagCode::ExpectedToken>().expected));
-		auto& expected = get<AnyOf>(res.reports[0].diagnosis.get<DiagCode::ExpectedToken>().expected);
+		REQUIRE(is<AnyOf>(res.reports[0].diagnosis.get<DiagCode::ExpectedToken>().getExpected()));
+		auto expected = get<AnyOf>(res.reports[0].diagnosis.get<DiagCode::ExpectedToken>().getExpected());
 
 		for (auto& expect : expected) {
 			REQUIRE(is<TokenType>(expect));
@@ -133,8 +133,8 @@ TEST_CASE("Parser enforces start of line tokens per segment", "[Parser]") {
 		REQUIRE(res.numErrors == 1_uz);
 		REQUIRE(res.reports[0].diagnosis.getCode() == DiagCode::ExpectedToken);
 		CHECK(res.reports[0].diagnosis.get<DiagCode::ExpectedToken>().given == TokenType::String);
-		REQUIRE(is<AnyOf>(res.reports[0].diagnosis.get<DiagCode::ExpectedToken>().expected));
-		auto& expected = get<AnyOf>(res.reports[0].diagnosis.get<DiagCode::ExpectedToken>().expected);
+		REQUIRE(is<AnyOf>(res.reports[0].diagnosis.get<DiagCode::ExpectedToken>().getExpected()));
+		auto expected = get<AnyOf>(res.reports[0].diagnosis.get<DiagCode::ExpectedToken>().getExpected());
 
 		for (auto& expect : expected) {
 			REQUIRE(is<TokenType>(expect));
@@ -148,8 +148,8 @@ TEST_CASE("Parser enforces start of line tokens per segment", "[Parser]") {
 		REQUIRE(res.numErrors == 1_uz);
 		REQUIRE(res.reports[0].diagnosis.getCode() == DiagCode::ExpectedToken);
 		CHECK(res.reports[0].diagnosis.get<DiagCode::ExpectedToken>().given == TokenType::String);
-		REQUIRE(is<AnyOf>(res.reports[0].diagnosis.get<DiagCode::ExpectedToken>().expected));
-		auto& expected = get<AnyOf>(res.reports[0].diagnosis.get<DiagCode::ExpectedToken>().expected);
+		REQUIRE(is<AnyOf>(res.reports[0].diagnosis.get<DiagCode::ExpectedToken>().getExpected()));
+		auto expected = get<AnyOf>(res.reports[0].diagnosis.get<DiagCode::ExpectedToken>().getExpected());
 
 		for (auto& expect : expected) {
 			REQUIRE(is<TokenType>(expect));
@@ -158,35 +158,76 @@ TEST_CASE("Parser enforces start of line tokens per segment", "[Parser]") {
 	}
 }
 
+TEST_CASE("Token expectations match types and punctuators", "[Parser]") {
+	constexpr auto expectation = TokenExpectation{{TokenType::EndOfLine, TokenType::Label}, {Punctuator::Comma}};
+	static_assert(expectation.matches(TokenType::EndOfLine, ""));
+	static_assert(expectation.matches(TokenType::Separator, ","));
+	static_assert(!expectation.matches(TokenType::Separator, ":"));
+	static_assert(!expectation.matches(TokenType::Identifier, "label"));
+	static_assert(TokenExpectation{}.empty());
+
+	SECTION("a single type is listed as that type")
+	{
+		auto expected = TokenExpectation{{TokenType::EndOfLine}}.toExpected();
+		REQUIRE(is<TokenType>(expected));
+		CHECK(get<TokenType>(expected) == TokenType::EndOfLine);
+	}
+
+	SECTION("a single punctuator is listed with its text")
+	{
+		auto expected = TokenExpectation{{}, {Punctuator::Colon}}.toExpected();
+		REQUIRE(is<TokenAndString>(expected));
+		CHECK(get<TokenAndString>(expected) == make_pair(TokenType::Separator, ":"s));
+	}
+
+	SECTION("several are listed in diagnostic order")
+	{
+		auto expected = expectation.toExpected();
+		REQUIRE(is<AnyOf>(expected));
+		auto& anyOf = get<AnyOf>(expected);
+		REQUIRE(anyOf.size() == 3);
+		CHECK(get<TokenType>(anyOf[0]) == TokenType::EndOfLine);
+		CHECK(get<TokenType>(anyOf[1]) == TokenType::Label);
+		CHECK(get<TokenAndString>(anyOf[2]).second == ",");
+	}
+
+	SECTION("messages list line endings first")
+	{
+		auto res = helper.parse(".code\n\"string\"");
+		REQUIRE(res.numErrors == 1_uz);
+		CHECK(res.reports[0].diagnosis.getMessage() == "string literal encountered when expecting one of: end of file, end of line, identifier, label, segment");
+	}
+}
+
 TEST_CASE("Parser parses strings with hex escape sequences", "[Parser]") {
 	SECTION("parses a single byte hex pair") {
 		auto& tokens = helper.parseExpectCode("\"\\x41\"", {TokenType::String});
-		REQUIRE(get<string>(tokens[0].annotation) == "A");
+		REQUIRE(helper.getSymbol(tokens[0].annotation) == "A");
 	}
 	
 	SECTION("parses a single byte hex digit") {
 		auto& tokens = helper.parseExpectCode("\"\\x9\"", {TokenType::String});
-		REQUIRE(get<string>(tokens[0].annotation) == "\x09");
+		REQUIRE(helper.getSymbol(tokens[0].annotation) == "\x09");
 	}
 	
 	SECTION("parses a two byte hex sequence") {
 		auto& tokens = helper.parseExpectCode("\"\\x4142\"", {TokenType::String});
-		REQUIRE(get<string>(tokens[0].annotation) == "BA");
+		REQUIRE(helper.getSymbol(tokens[0].annotation) == "BA");
 	}
 	
 	SECTION("parses a three byte hex sequence") {
 		auto& tokens = helper.parseExpectCode("\"\\x414243\"", {TokenType::String});
-		REQUIRE(get<string>(tokens[0].annotation) == "CBA");
+		REQUIRE(helper.getSymbol(tokens[0].annotation) == "CBA");
 	}
 	
 	SECTION("parses a four byte hex sequence") {
 		auto& tokens = helper.parseExpectCode("\"\\x41424344\"", {TokenType::String});
-		REQUIRE(get<string>(tokens[0].annotation) == "DCBA");
+		REQUIRE(helper.getSymbol(tokens[0].annotation) == "DCBA");
 	}
 
 	SECTION("parsing stops at backslash to prevent interpreting extra characters as bytes") {
 		auto& tokens = helper.parseExpectCode("\"\\x4142\\CD\"", {TokenType::String});
-		REQUIRE(get<string>(tokens[0].annotation) == "BACD");
+		REQUIRE(helper.getSymbol(tokens[0].annotation) == "BACD");
 	}
 }
 
@@ -299,13 +340,17 @@ TEST_CASE("Parser parses labels", "[Parser]") {
 		auto& labelToken = tokens[0];
 		REQUIRE(labelToken.is(TokenType::Label, "label:"));
 		CHECK(is<const Label*>(labelToken.annotation));
-		auto it = labelMap.find("label");
+		auto symbol = res.info.symbols.find("label");
+		REQUIRE(symbol);
+		auto it = labelMap.find(*symbol);
 		REQUIRE(it != labelMap.end());
 		REQUIRE(it->second < labels.size());
-		auto label = labels[it->second].get();
+		auto label = labels[it->second];
 		CHECK(label == get<const Label*>(labelToken.annotation));
 		CHECK(label->name == "label");
-		CHECK(&label->definition == &labelToken);
+		CHECK(label->definition.segment == Segment::Code);
+		CHECK(label->definition.index == 0);
+		CHECK(res.info.getToken(label->definition).is(TokenType::Label, "label:"));
 	}
 
 	SECTION("Labels can be referenced") {
@@ -315,7 +360,7 @@ TEST_CASE("Parser parses labels", "[Parser]") {
 		REQUIRE(tokens.size() == 4);
 		REQUIRE(is<LabelRef>(tokens[2].annotation));
 		auto ref = get<LabelRef>(tokens[2].annotation);
-		REQUIRE(ref.label == res.info.labels[0].get());
+		REQUIRE(ref.label == res.info.labels[0]);
 		REQUIRE(ref.label == get<const Label*>(tokens[0].annotation));
 	}
 
@@ -331,6 +376,24 @@ TEST_CASE("Parser parses labels", "[Parser]") {
 	}
 }
 
+TEST_CASE("Parser keeps label definitions valid as token storage grows", "[Parser]") {
+	auto code = string{"first:\n"};
+	for (auto i = 0; i < 10000; ++i)
+		code += "push 1, jmpd first\n";
+	code += "last:\n";
+
+	auto res = helper.parseCode(code);
+	REQUIRE(checkResult(res));
+	REQUIRE(res.info.labels.size() == 2);
+
+	auto first = res.info.getToken(res.info.labels[0]->definition);
+	auto last = res.info.getToken(res.info.labels[1]->definition);
+	CHECK(first.is(TokenType::Label, "first:"));
+	CHECK(last.is(TokenType::Label, "last:"));
+	CHECK(get<const Label*>(last.annotation) == res.info.labels[1]);
+	CHECK(res.info.labels[1]->definition.index > 10000);
+}
+
 TEST_CASE("Parser parses keywords", "[Parser]") {
 	SECTION("global keyword") {
 		auto res = helper.parse("global main\n.code\nmain:");
@@ -375,6 +438,51 @@ TEST_CASE("Parser resolves mnemonics", "[Parser]") {
 		REQUIRE(is<Instruction::Type>(annotation));
 		CHECK(get<Instruction::Type>(annotation) == Instruction::PUSHQ);
 	}
+
+	SECTION("pushf") {
+		auto annotation = parseAnnotation("push 1.5", 0);
+		REQUIRE(is<Instruction::Type>(annotation));
+		CHECK(get<Instruction::Type>(annotation) == Instruction::PUSHF);
+	}
+
+	SECTION("no overload") {
+		auto res = helper.parseCode("pop 1.5");
+		REQUIRE(res.numErrors == 1);
+		CHECK(res.reports[0].diagnosis.getCode() == DiagCode::InvalidMnemonicOperands);
+	}
+}
+
+TEST_CASE("Parser parses every named instruction", "[Parser]") {
+	SECTION("pushq") {
+		auto annotation = parseAnnotation("pushq 0xFFFFFFFFFF", 1);
+		REQUIRE(is<int64>(annotation));
+		CHECK(get<int64>(annotation) == 0xFFFFFFFFFF);
+	}
+
+	SECTION("pushf") {
+		auto annotation = parseAnnotation("pushf 1.5", 1);
+		REQUIRE(is<float>(annotation));
+		CHECK(get<float>(annotation) == 1.5f);
+	}
+
+	SECTION("operands widened to the instruction") {
+		auto annotation = parseAnnotation("pushd 1", 1);
+		CHECK(getAnnotationSize(annotation) == 4);
+
+		annotation = parseAnnotation("pushw -2", 1);
+		REQUIRE(is<int16>(annotation));
+		CHECK(get<int16>(annotation) == -2);
+
+		annotation = parseAnnotation("pushqf 1.5", 1);
+		REQUIRE(is<double>(annotation));
+		CHECK(get<double>(annotation) == 1.5);
+	}
+
+	SECTION("pushaqf") {
+		auto annotation = parseAnnotation("pushaqf", 0);
+		REQUIRE(is<Instruction::Type>(annotation));
+		CHECK(get<Instruction::Type>(annotation) == Instruction::PUSHAQF);
+	}
 }
 
 TEST_CASE("Parser parses data segment definitions", "[Parser]") {
@@ -393,6 +501,27 @@ TEST_CASE("Parser parses data segment definitions", "[Parser]") {
 		CHECK(is<uint8>(tokens[2].annotation));
 		CHECK(get<uint8>(tokens[2].annotation) == 0xFF);
 	}
+
+	SECTION("Declarations end at the end of their line") {
+		auto res = helper.parseData("FIRST: DD 1\nSECOND: DD 2\nDB 3\n.code\njmpd SECOND");
+		auto& tokens = *res.info.segments[Segment::Data].tokens;
+		REQUIRE(checkResult(res));
+		REQUIRE(res.info.labels.size() == 2);
+		CHECK(res.info.labels[1]->name == "SECOND");
+		CHECK(res.info.labels[1]->definition.index == 3);
+		REQUIRE(tokens.size() >= 8);
+		CHECK(tokens[3].type == TokenType::Label);
+		CHECK(tokens[6].type == TokenType::DataType);
+		CHECK(tokens[7].type == TokenType::Numeric);
+	}
+
+	SECTION("Declaration at the end of the source after code") {
+		auto res = helper.parse(".code\nnop\n.data\nLAST: DD 1");
+		REQUIRE(checkResult(res));
+		REQUIRE(res.info.labels.size() == 1);
+		CHECK(res.info.labels[0]->segment == Segment::Data);
+		CHECK(res.info.segments[Segment::Data].tokens->size() >= 3);
+	}
 }
 
 TEST_CASE("Error unexpected lexeme", "[Error Handling]") {
@@ -408,7 +537,7 @@ TEST_CASE("Error expected EndOfLine after segment", "[Error Handling]") {
 	REQUIRE(res.reports[0].diagnosis.getCode() == DiagCode::ExpectedToken);
 	CHECK(res.reports[0].diagnosis.get<DiagCode::ExpectedToken>().given == TokenType::Numeric);
 	auto& diagnosis = res.reports[0].diagnosis.get<DiagCode::ExpectedToken>();
-	CHECK(get<TokenType>(diagnosis.expected) == TokenType::EndOfLine);
+	CHECK(get<TokenType>(diagnosis.getExpected()) == TokenType::EndOfLine);
 }
 
 TEST_CASE("Error unexpected separator", "[Error Handling]") {
@@ -430,6 +559,32 @@ TEST_CASE("Error unexpected label after tokens", "[Error Handling]") {
 	REQUIRE(res.reports[0].diagnosis.getCode() == DiagCode::UnexpectedLabelAfterTokens);
 }
 
+TEST_CASE("Error label redefinition", "[Error Handling]") {
+	for (auto storage : {TokenStorage::Tokens, TokenStorage::Compact}) {
+		auto options = getParseOpts();
+		options.tokenStorage = storage;
+		auto res = Parser::tokenize(options, make_shared<Source>("test", ".code\nnop\nlabel:\nnop\nlabel:"));
+		REQUIRE(res.numErrors == 1);
+		REQUIRE(res.reports[0].diagnosis.getCode() == DiagCode::LabelRedefinition);
+		CHECK(res.reports[0].diagnosis.getMessage() == "label already defined on line 3");
+	}
+}
+
+TEST_CASE("Diagnoses are plain data formatted on demand", "[Error Handling]") {
+	static_assert(std::is_trivially_copyable_v<Diagnosis>);
+	static_assert(std::is_trivially_copyable_v<Parser::Report>);
+
+	auto diagnosis = diagnose<DiagCode::InvalidKeywordArgCount>(Keyword::Global, 1_uz, 3_uz);
+	auto copy = diagnosis;
+	CHECK(copy.getCode() == DiagCode::InvalidKeywordArgCount);
+	CHECK(copy.get<DiagCode::InvalidKeywordArgCount>().numGiven == 3_uz);
+	CHECK(copy.getName() == "incorrect number of keyword arguments");
+	CHECK(copy.getMessage() == "expected 1 argument for 'global' keyword, 3 given");
+
+	CHECK(diagnose<DiagCode::UnexpectedSeparator>().getMessage().empty());
+	CHECK(Diagnosis{}.getName() == Diagnostic<DiagCode::Unknown>::name);
+}
+
 TEST_CASE("Error invalid identifier", "[Error Handling]") {
 	auto res = helper.parse("blahdyblahbloo");
 	REQUIRE(res.numErrors == 1);
@@ -455,13 +610,137 @@ TEST_CASE("Error instruction invalid operand type", "[Error Handling]") {
 	REQUIRE(res.reports[0].diagnosis.getCode() == DiagCode::InvalidOperandType);
 }
 
+TEST_CASE("Error global keyword argument", "[Error Handling]") {
+	auto res = helper.parseCode("label:\nglobal label, global 1 2");
+	REQUIRE(res.numErrors == 2);
+	CHECK(res.reports[0].diagnosis.getCode() == DiagCode::ExpectedToken);
+	CHECK(res.reports[0].token.text == "1");
+	CHECK(res.reports[1].token.text == "2");
+	CHECK(res.info.segments[Segment::Code].tokens->size() == 4);
+}
+
 TEST_CASE("Error undefined label", "[Error Handling]") {
 	auto res = helper.parseCode("jmp label");
 	REQUIRE(res.numErrors >= 1);
 	auto& tokens = *res.info.segments[Segment::Code].tokens;
 	REQUIRE(tokens.size() >= 2);
 	REQUIRE(tokens[1].type == TokenType::LabelRef);
-	REQUIRE(is<string>(tokens[1].annotation));
-	CHECK(get<string>(tokens[1].annotation) == "label");
+	REQUIRE(is<Symbol>(tokens[1].annotation));
+	CHECK(res.info.symbols.get(get<Symbol>(tokens[1].annotation)) == "label");
 	REQUIRE(res.reports[0].diagnosis.getCode() == DiagCode::UnresolvedLabelReference);
 }
+
+TEST_CASE("Parser gives the same result parsing shards on threads", "[Parser]") {
+	auto code = GENERATE(
+		".code\nstart:\njmp later\n; a \"quoted\" comment\nnop\n.data\nlater: DB 1\nDS \"a;b\"\n.code\njmp start\n"s,
+		".code\na:\nnop\na:\njmp b\nb:\njmp c\n.data\nb:\n"s,
+		".data\nDS \"spans\n\nlines; \\\" \"\n.code\njmp x\n\n\njmp y\njmp x\n"s,
+		".code\nnop\n.bogus\nnop\njmp a\na:\n"s,
+		".code\nnop\npush \"unterminated\njmp a\na:\n"s
+	);
+	auto storage = GENERATE(TokenStorage::Tokens, TokenStorage::Compact);
+
+	auto options = getParseOpts();
+	options.tokenStorage = storage;
+	auto source = make_shared<Source>("test", code);
+	auto serial = describeResult(Parser::tokenize(options, source));
+
+	for (auto threads = 2_uz; threads <= 8; ++threads) {
+		options.threads = threads;
+		options.shardSize = 1;
+		CHECK(describeResult(Parser::tokenize(options, source)) == serial);
+	}
+}
+
+TEST_CASE("Parser updates a result for an edit", "[Parser]") {
+	const auto code = ".code\nstart:\njmp later\n; a \"quoted\" comment\nnop\njmp missing\n.data\nlater: DB 1\nDS \"a;b\nc\"\n.code\njmp start\njmp missing\n"s;
+
+	struct Case {
+		string find;                        // the text to replace
+		string replacement;
+		bool incremental;                   // whether only the lines around it should be parsed again
+	};
+
+	auto [find, replacement, incremental] = GENERATE(
+		Case{"nop", "push 1", true},
+		Case{"nop", "nop :", true},
+		Case{"jmp later", "jmp start", true},
+		Case{"jmp missing\n.data", "jmp missing\njmp gone\n.data", true},
+		Case{"jmp start\njmp missing", "jmp missing\njmp missing", true},
+		Case{"a;b\nc", "a;b\n;c", true},
+		Case{"; a \"quoted\"", "; a \"", true},
+		Case{"nop\n", "nop\nnop\n\n\n", true},
+		Case{"start:", "begin:", false},
+		Case{".data\n", "", false},
+		Case{"jmp missing\n.data", "jmp gone\n.data", false},
+		Case{"DS \"a", "DS a", false}
+	);
+	auto storage = GENERATE(TokenStorage::Tokens, TokenStorage::Compact);
+
+	auto options = getParseOpts();
+	options.tokenStorage = storage;
+
+	auto result = Parser::tokenize(options, make_shared<Source>("test", code));
+	auto offset = code.find(find);
+	REQUIRE(offset != string::npos);
+
+	auto edited = code;
+	edited.replace(offset, find.size(), replacement);
+	auto source = make_shared<Source>("test", edited);
+
+	INFO(find + " -> " + replacement);
+	CHECK(Parser::retokenize(options, source, Parser::Edit{offset, find.size(), replacement.size()}, result) == incremental);
+	CHECK(describeResult(result) == describeResult(Parser::tokenize(options, source)));
+
+	for (auto& segmentInfo : result.info.segments)
+		CHECK(segmentInfo.tokens->getSource() == source);
+}
+
+TEST_CASE("Parser keeps a result right over many edits", "[Parser]") {
+	constexpr auto lines = 64_uz;
+	constexpr auto edits = 3000_uz;
+
+	auto code = ".code\nstart:\n"s;
+	for (auto i = 0_uz; i < lines; ++i)
+		code += "push 100000\n";
+	code += "jmp start\n";
+
+	auto options = getParseOpts();
+	options.tokenStorage = GENERATE(TokenStorage::Tokens, TokenStorage::Compact);
+
+	auto source = make_shared<Source>("test", code);
+	auto result = Parser::tokenize(options, source);
+	const auto fresh = result.info.segments[Segment::Code].tokens->getMemoryUsage();
+
+	// each edit makes a line's literal a digit longer or shorter, moving the lines after it
+	for (auto i = 0_uz; i < edits; ++i) {
+		auto offset = code.find("push ", code.find("start:") + (i * 37 % lines) * 12);
+		auto shorter = code.compare(offset, 13, "push 1000000\n") == 0;
+		auto edit = Parser::Edit{offset + 5, shorter ? 7_uz : 6_uz, shorter ? 6_uz : 7_uz};
+
+		code.replace(edit.offset, edit.removed, shorter ? "100000" : "1000000");
+		source = make_shared<Source>("test", code);
+		REQUIRE(Parser::retokenize(options, source, edit, result));
+	}
+
+	auto reparsed = Parser::tokenize(options, source);
+	auto& tokens = *result.info.segments[Segment::Code].tokens;
+	auto& expected = *reparsed.info.segments[Segment::Code].tokens;
+	REQUIRE(tokens.size() == expected.size());
+
+	for (auto i = 0_uz; i < tokens.size(); ++i) {
+		auto token = tokens.get(i);
+		auto expectedToken = expected.get(i);
+		CHECK(token.text == expectedToken.text);
+		CHECK(token.text == string_view{code}.substr(token.offset, token.text.size()));
+		REQUIRE(token.annotation.index() == expectedToken.annotation.index());
+
+		std::visit([&](auto value) {
+			if constexpr (std::is_arithmetic_v<decltype(value)>)
+				CHECK(value == get<decltype(value)>(expectedToken.annotation));
+		}, token.annotation);
+	}
+
+	// replaced tokens don't leave their side table entries behind for good
+	CHECK(tokens.getMemoryUsage() <= fresh * 4);
+}
@@ -0,0 +1,87 @@
+#include <catch.hpp>
+#include <CLARA/ReportWriter.h>
+#include "ParserHelper.h"
+
+using namespace CLARA;
+using namespace CLARA::CLASM;
+
+namespace {
+
+auto parseWithWriter(ReportWriter& writer, string code)
+{
+	auto options = getParseOpts();
+	options.reporter = writer.getReporter();
+	return Parser::tokenize(options, make_shared<Source>("test.clasm", code));
+}
+
+}
+
+TEST_CASE("Report writer renders text with the caret under the token", "[ReportWriter]") {
+	auto writer = ReportWriter{ReportWriter::Options{ReportFormat::Text, false}};
+	auto res = parseWithWriter(writer, ".code\nnop\n  nop :\n");
+	REQUIRE(res.numErrors == 1);
+	REQUIRE(writer.size() == 1_uz);
+
+	CHECK(writer.render() ==
+		"error[E2003]: unexpected separator\n"
+		" --> test.clasm:3:7\n"
+		"3 |    nop :\n"
+		"           ^ \n\n"
+	);
+	CHECK(writer.size() == 0_uz);
+}
+
+TEST_CASE("Report writer colours text only for a terminal by default", "[ReportWriter]") {
+	CHECK(ReportWriter::Options{}.colour == isTerminal(stderr));
+
+	auto writer = ReportWriter{ReportWriter::Options{ReportFormat::Text, true}};
+	auto res = parseWithWriter(writer, ".code\nnop :\n");
+	REQUIRE(res.numErrors == 1);
+	CHECK(writer.render().find("\x1b[") != string::npos);
+}
+
+TEST_CASE("Report writer sorts and deduplicates reports", "[ReportWriter]") {
+	auto writer = ReportWriter{ReportWriter::Options{ReportFormat::JsonLines}};
+	auto res = parseWithWriter(writer, ".code\nnop :\nnop\nnop :\n");
+	REQUIRE(res.reports.size() == 2_uz);
+
+	writer.add(res.reports[1]);
+	writer.add(res.reports[0]);
+	writer.add(res.reports[1]);
+	REQUIRE(writer.size() == 5_uz);
+
+	auto output = writer.render();
+	CHECK(output ==
+		R"({"file":"test.clasm","line":2,"column":5,"endColumn":6,"severity":"error","code":"E2003","name":"unexpected separator","message":"unexpected separator"})" "\n"
+		R"({"file":"test.clasm","line":4,"column":5,"endColumn":6,"severity":"error","code":"E2003","name":"unexpected separator","message":"unexpected separator"})" "\n"
+	);
+}
+
+TEST_CASE("Report writer renders a SARIF log", "[ReportWriter]") {
+	auto writer = ReportWriter{ReportWriter::Options{ReportFormat::Sarif}};
+
+	SECTION("with results") {
+		auto res = parseWithWriter(writer, ".code\npush \"\\\"quoted\\\"\"\n");
+		REQUIRE(res.numErrors == 1);
+
+		auto output = writer.render();
+		CHECK(output.find(R"("rules":[{"id":"E2013","shortDescription":{"text":"invalid operands for mnemonic"}}])") != string::npos);
+		CHECK(output.find(R"("ruleId":"E2013","level":"error")") != string::npos);
+		CHECK(output.find(R"("artifactLocation":{"uri":"test.clasm"},"region":{"startLine":2,"startColumn":1,)") != string::npos);
+		CHECK(std::count(output.begin(), output.end(), '{') == std::count(output.begin(), output.end(), '}'));
+	}
+
+	SECTION("without results") {
+		CHECK(writer.render() ==
+			R"({"version":"2.1.0","$schema":"https://json.schemastore.org/sarif-2.1.0.json","runs":[{"tool":{"driver":{"name":"CLARA","rules":[]}},"results":[]}]})" "\n"
+		);
+	}
+}
+
+TEST_CASE("Report writer escapes JSON strings", "[ReportWriter]") {
+	auto writer = ReportWriter{ReportWriter::Options{ReportFormat::JsonLines}};
+	auto source = Source{"dir\\\"name\".clasm", ".code\nnop :\n"};
+	writer.add(Parser::Report::error(Source::Token{&source, 10, 1}, diagnose<DiagCode::UnexpectedSeparator>()));
+
+	CHECK(writer.render().find(R"({"file":"dir\\\"name\".clasm","line":2,)") == 0);
+}
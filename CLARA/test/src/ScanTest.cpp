@@ -0,0 +1,129 @@
+#include <catch.hpp>
+#include <CLARA/Common.h>
+#include <CLARA/Common/Scan.h>
+#include <CLARA/Lexer.h>
+
+using namespace CLARA;
+using namespace CLARA::CLASM;
+
+auto getTestIsas() {
+	auto isas = vector<Scan::Isa>{Scan::Isa::Scalar};
+	if (Scan::getSupportedIsa() != Scan::Isa::Scalar) isas.push_back(Scan::Isa::SSE2);
+	if (Scan::getSupportedIsa() == Scan::Isa::AVX2) isas.push_back(Scan::Isa::AVX2);
+	return isas;
+}
+
+struct ScopedIsa {
+	Scan::Isa previous;
+
+	ScopedIsa(Scan::Isa isa) : previous(Scan::getIsa()) {
+		Scan::setIsa(isa);
+	}
+
+	~ScopedIsa() {
+		Scan::setIsa(previous);
+	}
+};
+
+TEST_CASE("Scan kernels find the stopping character at every position", "[Scan]") {
+	for (auto isa : getTestIsas()) {
+		auto scoped = ScopedIsa(isa);
+		INFO("isa " << static_cast<int>(isa));
+
+		for (auto length = 0_uz; length < 100; ++length) {
+			for (auto stop : {'x', '"', '\\', '\n'}) {
+				auto buffer = string(length, ' ');
+				buffer += stop;
+				buffer += string(40, ' ');
+				auto begin = buffer.data();
+				auto end = buffer.data() + buffer.size();
+
+				CHECK(Scan::skipSpaces(begin, end) == begin + length);
+			}
+
+			auto spaces = string(length, '\t') + "\r\v\f x";
+			CHECK(Scan::skipSpaces(spaces.data(), spaces.data() + spaces.size()) == spaces.data() + length + 4);
+
+			auto newlines = string(length, '\n') + "\r";
+			CHECK(Scan::skipNewlines(newlines.data(), newlines.data() + newlines.size()) == newlines.data() + length);
+
+			auto comment = string(length, ';') + "\n;;";
+			CHECK(Scan::findNewline(comment.data(), comment.data() + comment.size()) == comment.data() + length);
+
+			auto body = string(length, 'a');
+			auto quoted = body + "\"" + string(33, 'b');
+			auto escaped = body + "\\" + string(33, 'b');
+			CHECK(Scan::findQuoteOrBackslash(quoted.data(), quoted.data() + quoted.size()) == quoted.data() + length);
+			CHECK(Scan::findQuoteOrBackslash(escaped.data(), escaped.data() + escaped.size()) == escaped.data() + length);
+			CHECK(Scan::findQuoteOrBackslash(body.data(), body.data() + body.size()) == body.data() + length);
+
+			auto commented = body + ";\"" + string(33, 'b');
+			CHECK(Scan::findQuoteOrSemicolon(quoted.data(), quoted.data() + quoted.size()) == quoted.data() + length);
+			CHECK(Scan::findQuoteOrSemicolon(commented.data(), commented.data() + commented.size()) == commented.data() + length);
+			CHECK(Scan::findQuoteOrSemicolon(escaped.data(), escaped.data() + escaped.size()) == escaped.data() + escaped.size());
+		}
+	}
+}
+
+TEST_CASE("Scan kernels never read past the end", "[Scan]") {
+	for (auto isa : getTestIsas()) {
+		auto scoped = ScopedIsa(isa);
+		auto buffer = string(64, ' ') + "x";
+
+		for (auto length = 0_uz; length < 64; ++length) {
+			CHECK(Scan::skipSpaces(buffer.data(), buffer.data() + length) == buffer.data() + length);
+		}
+	}
+}
+
+TEST_CASE("Scanner lexes escape-heavy strings", "[Scan]") {
+	for (auto isa : getTestIsas()) {
+		auto scoped = ScopedIsa(isa);
+
+		auto code = "\"" + string(10000, '\\') + "\" nop";
+		auto lexeme = Lexer::scan(code, 0);
+		CHECK(lexeme.type == TokenType::String);
+		CHECK(lexeme.length == 10002);
+
+		auto unterminated = string("\"");
+		for (auto i = 0; i < 5000; ++i) unterminated += "\\\"";
+		CHECK(Lexer::scan(unterminated, 0).type == TokenType::None);
+		CHECK(Lexer::scan(unterminated + "\"", 0).length == unterminated.size() + 1);
+	}
+}
+
+TEST_CASE("Scan kernels index lines and validate UTF-8", "[Scan]") {
+	auto naive = [](const string& text) {
+		auto starts = vector<uint32>{};
+		for (auto i = 0_uz; i < text.size(); ++i) {
+			if (text[i] == '\n') starts.push_back(static_cast<uint32>(i + 1));
+		}
+		return starts;
+	};
+
+	for (auto isa : getTestIsas()) {
+		auto scoped = ScopedIsa(isa);
+		INFO("isa " << static_cast<int>(isa));
+
+		for (auto length = 0_uz; length < 80; ++length) {
+			for (auto insert : {"\n"s, "\xC2\xA7"s, "\xE1\xBA\xBD\n"s, "\xF0\x9F\x98\x80"s}) {
+				auto text = string(length, 'a') + insert + string(length % 7, '\n') + string(40, 'b') + "\n";
+				auto starts = vector<uint32>{};
+				CHECK(Scan::indexLines(text.data(), text.data() + text.size(), starts) == text.data() + text.size());
+				CHECK(starts == naive(text));
+			}
+
+			// truncated, overlong, surrogate and out of range sequences, and stray continuation bytes
+			for (auto invalid : {"\xC2"s, "\xC0\x80"s, "\xED\xA0\x80"s, "\xF4\x90\x80\x80"s, "\x80"s, "\xFF"s, "\xE1\xBA"s}) {
+				auto text = string(length, '\n') + invalid;
+				auto starts = vector<uint32>{};
+				CHECK(Scan::indexLines(text.data(), text.data() + text.size(), starts) == text.data() + length);
+				CHECK(starts.size() == length);
+
+				text += string(40, 'c');
+				starts.clear();
+				CHECK(Scan::indexLines(text.data(), text.data() + text.size(), starts) == text.data() + length);
+			}
+		}
+	}
+}
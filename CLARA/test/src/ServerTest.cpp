@@ -0,0 +1,257 @@
+#include <catch.hpp>
+#include "Server.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+#if defined(CLASM_SYSTEM_WINDOWS)
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+using namespace CLARA;
+using namespace CLARA::LSP;
+
+namespace {
+
+auto frame(const Json& message)
+{
+	auto body = message.dump();
+	return fmt::format("Content-Length: {}\r\n\r\n{}", body.size(), body);
+}
+
+auto request(int id, string method, Json params = Json{})
+{
+	return frame(Json{}.set("jsonrpc", "2.0").set("id", id).set("method", move(method)).set("params", move(params)));
+}
+
+auto notify(string method, Json params = Json{})
+{
+	return frame(Json{}.set("jsonrpc", "2.0").set("method", move(method)).set("params", move(params)));
+}
+
+auto openDocument(string_view text)
+{
+	auto item = Json{}.set("uri", "file:///test.clasm").set("languageId", "clasm").set("version", 1).set("text", text);
+	return notify("textDocument/didOpen", Json{}.set("textDocument", move(item)));
+}
+
+auto changeDocument(int version, Json change)
+{
+	auto document = Json{}.set("uri", "file:///test.clasm").set("version", version);
+	return notify("textDocument/didChange", Json{}.set("textDocument", move(document)).set("contentChanges", Json::Array{move(change)}));
+}
+
+auto makeRange(int startLine, int startCharacter, int endLine, int endCharacter)
+{
+	return Json{}
+		.set("start", Json{}.set("line", startLine).set("character", startCharacter))
+		.set("end", Json{}.set("line", endLine).set("character", endCharacter));
+}
+
+auto findDefinition(int id, int line, int character)
+{
+	auto position = Json{}.set("line", line).set("character", character);
+	return request(id, "textDocument/definition", Json{}.set("textDocument", Json{}.set("uri", "file:///test.clasm")).set("position", move(position)));
+}
+
+const auto initialize = request(1, "initialize", Json{}.set("capabilities", Json{}));
+const auto shutdown = request(99, "shutdown");
+const auto exitServer = notify("exit");
+
+/// Split what a server wrote into the messages it framed.
+auto readMessages(std::FILE* stream)
+{
+	auto text = string{};
+	char buffer[4096];
+	for (auto size = 0_uz; (size = std::fread(buffer, 1, sizeof(buffer), stream)) != 0;)
+		text.append(buffer, size);
+
+	auto messages = vector<Json>{};
+	for (auto offset = 0_uz; offset < text.size();) {
+		auto header = text.find("\r\n\r\n", offset);
+		REQUIRE(text.compare(offset, 16, "Content-Length: ") == 0);
+		REQUIRE(header != string::npos);
+
+		auto length = std::stoul(text.substr(offset + 16, header - offset - 16));
+		messages.push_back(Json::parse(string_view{text}.substr(header + 4, length)));
+		offset = header + 4 + length;
+	}
+	return messages;
+}
+
+/// Run a server reading every message from the start.
+auto runServer(const string& input, int& exitCode)
+{
+	auto in = std::tmpfile();
+	auto out = std::tmpfile();
+	REQUIRE(in);
+	REQUIRE(out);
+	std::fwrite(input.data(), 1, input.size(), in);
+	std::rewind(in);
+
+	exitCode = Server{in, out}.run();
+
+	std::rewind(out);
+	auto messages = readMessages(out);
+	std::fclose(in);
+	std::fclose(out);
+	return messages;
+}
+
+auto findResponse(const vector<Json>& messages, int id)->const Json&
+{
+	for (auto& message : messages) {
+		if (!message["id"].isNull() && message["id"].getInt() == id)
+			return message;
+	}
+	FAIL("no response to request " << id);
+	return messages.front();
+}
+
+auto findDiagnostics(const vector<Json>& messages)
+{
+	auto found = vector<Json>{};
+	for (auto& message : messages) {
+		if (message["method"].getString() == "textDocument/publishDiagnostics")
+			found.push_back(message["params"]);
+	}
+	return found;
+}
+
+}
+
+TEST_CASE("Server reads messages framed by headers", "[Server]") {
+	auto malformed = "{\"id\": 5,"s;
+	auto input = "Content-Type: application/vscode-jsonrpc; charset=utf-8\r\n" + initialize
+		+ "Content-Length:    \r\n\r\n"
+		+ fmt::format("Content-Length: {}\r\n\r\n{}", malformed.size(), malformed)
+		+ "Content-Length:  " + shutdown.substr(16)
+		+ exitServer;
+
+	auto exitCode = 1;
+	auto messages = runServer(input, exitCode);
+	CHECK(exitCode == 0);
+	REQUIRE(messages.size() == 3_uz);
+
+	auto& initialized = findResponse(messages, 1);
+	CHECK(initialized["result"]["capabilities"]["definitionProvider"].getBool());
+	CHECK(initialized["result"]["serverInfo"]["version"].getString() == fmt::format("{}.{}.{}", CLASM::VERSION_MAJOR, CLASM::VERSION_MINOR, CLASM::VERSION_PATCH));
+	CHECK(initialized["result"]["serverInfo"]["version"].getString() != "0.0.0");
+
+	// the message which isn't JSON is answered as soon as it's read, without an id as there's no telling what it was
+	auto parseError = std::find_if(messages.begin(), messages.end(), [](const Json& message) { return message["id"].isNull(); });
+	REQUIRE(parseError != messages.end());
+	CHECK((*parseError)["error"]["code"].getInt() == static_cast<int>(ErrorCode::ParseError));
+
+	CHECK(findResponse(messages, 99)["result"].isNull());
+}
+
+TEST_CASE("Server shuts down before it exits", "[Server]") {
+	auto exitCode = -1;
+
+	SECTION("shutdown then exit") {
+		auto messages = runServer(initialize + shutdown + findDefinition(2, 0, 0) + exitServer, exitCode);
+		CHECK(exitCode == 0);
+		CHECK(findResponse(messages, 2)["error"]["code"].getInt() == static_cast<int>(ErrorCode::InvalidRequest));
+	}
+
+	SECTION("exit without shutdown") {
+		runServer(initialize + exitServer, exitCode);
+		CHECK(exitCode == 1);
+	}
+
+	SECTION("input closed without exit") {
+		runServer(initialize + shutdown, exitCode);
+		CHECK(exitCode == 1);
+	}
+
+	SECTION("requests before initialize") {
+		auto messages = runServer(findDefinition(2, 0, 0) + initialize + request(3, "unknown") + shutdown + exitServer, exitCode);
+		CHECK(exitCode == 0);
+		CHECK(findResponse(messages, 2)["error"]["code"].getInt() == static_cast<int>(ErrorCode::ServerNotInitialized));
+		CHECK(findResponse(messages, 3)["error"]["code"].getInt() == static_cast<int>(ErrorCode::MethodNotFound));
+	}
+}
+
+TEST_CASE("Server drops requests which have gone stale", "[Server]") {
+	// the diagnostics of the opened document fill the output pipe, so the server is held up writing them while the
+	// rest of the messages are read and queued behind it
+	auto text = ".code\nstart:\n"s;
+	for (auto i = 0; i < 2000; ++i)
+		text += "nop :\n";
+
+	auto cancel = notify("$/cancelRequest", Json{}.set("id", 3));
+	auto change = Json{}.set("text", ".code\nstart:\njmp start\n");
+	auto input = initialize + openDocument(text) + findDefinition(2, 1, 0) + changeDocument(2, change)
+		+ findDefinition(3, 2, 5) + cancel + findDefinition(4, 2, 5) + shutdown + exitServer;
+
+	int fds[2];
+#if defined(CLASM_SYSTEM_WINDOWS)
+	REQUIRE(_pipe(fds, 4096, _O_BINARY) == 0);
+	auto output = _fdopen(fds[1], "wb");
+	auto written = _fdopen(fds[0], "rb");
+#else
+	REQUIRE(::pipe(fds) == 0);
+	auto output = ::fdopen(fds[1], "wb");
+	auto written = ::fdopen(fds[0], "rb");
+#endif
+	auto in = std::tmpfile();
+	REQUIRE(in);
+	std::fwrite(input.data(), 1, input.size(), in);
+	std::rewind(in);
+
+	auto exitCode = -1;
+	auto server = std::thread{[&] {
+		exitCode = Server{in, output}.run();
+		std::fclose(output);
+	}};
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(200));
+	auto messages = readMessages(written);
+	server.join();
+	std::fclose(written);
+	std::fclose(in);
+
+	CHECK(exitCode == 0);
+	CHECK(findResponse(messages, 2)["error"]["code"].getInt() == static_cast<int>(ErrorCode::ContentModified));
+	CHECK(findResponse(messages, 3)["error"]["code"].getInt() == static_cast<int>(ErrorCode::RequestCancelled));
+
+	auto& definition = findResponse(messages, 4)["result"];
+	CHECK(definition["uri"].getString() == "file:///test.clasm");
+	CHECK(definition["range"]["start"]["line"].getInt() == 1);
+
+	auto diagnostics = findDiagnostics(messages);
+	REQUIRE(diagnostics.size() == 2_uz);
+	CHECK(diagnostics[0]["diagnostics"].getArray().size() == 2000_uz);
+	CHECK(diagnostics[1]["version"].getInt() == 2);
+	CHECK(diagnostics[1]["diagnostics"].getArray().empty());
+}
+
+TEST_CASE("Server keeps edits it can't parse", "[Server]") {
+	auto exitCode = -1;
+	auto invalid = changeDocument(2, Json{}.set("range", makeRange(1, 0, 1, 0)).set("text", "; \xFF\n"));
+
+	SECTION("the failure is published") {
+		auto messages = runServer(initialize + openDocument(".code\nstart:\njmp start\n") + invalid + shutdown + exitServer, exitCode);
+		auto diagnostics = findDiagnostics(messages);
+		REQUIRE(diagnostics.size() == 2_uz);
+		CHECK(diagnostics[1]["version"].getInt() == 2);
+		REQUIRE(diagnostics[1]["diagnostics"].getArray().size() == 1_uz);
+		CHECK(diagnostics[1]["diagnostics"].getArray()[0]["message"].getString().find("UTF-8") != string::npos);
+	}
+
+	SECTION("later edits apply to the text with it") {
+		auto fix = changeDocument(3, Json{}.set("range", makeRange(1, 0, 1, 4)).set("text", ""));
+		auto messages = runServer(initialize + openDocument(".code\nstart:\njmp start\n") + invalid + fix + findDefinition(2, 3, 5) + shutdown + exitServer, exitCode);
+
+		auto& definition = findResponse(messages, 2)["result"];
+		CHECK(definition["range"]["start"]["line"].getInt() == 2);
+		CHECK(findDiagnostics(messages).back()["diagnostics"].getArray().empty());
+	}
+
+	CHECK(exitCode == 0);
+}
@@ -1,5 +1,6 @@
 #include "catch.hpp"
 #include <CLARA/Source.h>
+#include <fstream>
 
 using namespace CLARA;
 using namespace CLARA::CLASM;
@@ -93,4 +94,67 @@ TEST_CASE("Get column via offset", "[Source]")
 	REQUIRE(source.getColumnByOffset(33) == 2);
 	REQUIRE(source.getColumnByOffset(34) == 1);
 	REQUIRE(source.getColumnByOffset(38) == 5);
-}
\ No newline at end of file
+}
+
+TEST_CASE("Source rejects invalid UTF-8", "[Source]")
+{
+	REQUIRE_THROWS_AS((Source{"test", "nop\n\xC3"}), std::runtime_error);
+	REQUIRE_THROWS_AS((Source{"test", "nop ; \xC3\x28\n"}), std::runtime_error);
+	REQUIRE_THROWS_AS((Source{"test", "\xED\xA0\x80"}), std::runtime_error);
+	REQUIRE_NOTHROW((Source{"test", "nop ; \xC3\xA9\n"}));
+}
+
+TEST_CASE("Line index agrees with line infos", "[Source]")
+{
+	auto code = string{};
+	for (auto i = 0; i < 500; ++i)
+		code += string(i % 13, i % 3 ? 'x' : ' ') + (i % 5 ? "" : "\xC2\xA7") + "\n";
+
+	Source source{"test", code};
+	auto& lines = source.getLineInfos();
+	REQUIRE(lines.size() == 501_uz);
+
+	for (auto offset = 0u; offset <= code.size(); ++offset) {
+		auto index = source.getLineIndexByOffset(offset);
+		auto& line = lines[index];
+		REQUIRE(line.offset <= offset);
+		REQUIRE(offset <= line.offset + line.length);
+		REQUIRE(source.getLineOffset(index) == line.offset);
+
+		auto prefix = string_view{code}.substr(line.offset, offset - line.offset);
+		auto chars = std::count_if(prefix.begin(), prefix.end(), [](char c) { return (c & 0xC0) != 0x80; });
+		REQUIRE(source.getColumnByOffset(offset) == static_cast<uint>(chars) + 1);
+	}
+}
+
+TEST_CASE("Source views a caller's buffer without copying", "[Source]")
+{
+	auto code = string{"nop\npush 1\n"};
+	auto source = Source::fromBuffer("buffer", code);
+	REQUIRE(source->getName() == "buffer");
+	REQUIRE(source->getCode().data() == code.data());
+	REQUIRE(source->getNumLines() == 3);
+	REQUIRE(source->getToken(4).text.data() == code.data() + 4);
+	REQUIRE_THROWS_AS(Source::fromBuffer("buffer", "\xC3"), std::runtime_error);
+}
+
+TEST_CASE("Source maps files", "[Source]")
+{
+	auto path = std::filesystem::temp_directory_path() / "clara_source_test.clasm";
+	auto code = string{".code\nlabel: push 1\n; cómment\n"};
+	std::ofstream{path, std::ios::binary} << code;
+
+	{
+		auto source = Source::fromFile(path);
+		CHECK(source->getName() == path.string());
+		CHECK(source->getCode() == code);
+		CHECK(source->getNumLines() == 4);
+		CHECK(source->getColumnByOffset(27) == 7);
+	}
+
+	std::ofstream{path, std::ios::binary | std::ios::trunc}.flush();
+	CHECK(Source::fromFile(path)->getCode().empty());
+
+	std::filesystem::remove(path);
+	REQUIRE_THROWS_AS(Source::fromFile(path), std::system_error);
+}
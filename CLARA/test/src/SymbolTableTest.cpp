@@ -0,0 +1,78 @@
+#include <catch.hpp>
+#include <CLARA/Parser.h>
+#include <CLARA/SymbolTable.h>
+
+using namespace CLARA;
+using namespace CLARA::CLASM;
+
+TEST_CASE("Symbol table interns strings once", "[SymbolTable]") {
+	auto symbols = SymbolTable{};
+	auto a = symbols.intern("label");
+	auto b = symbols.intern("other");
+	auto empty = symbols.intern("");
+
+	CHECK(a == static_cast<Symbol>(0));
+	CHECK(b == static_cast<Symbol>(1));
+	CHECK(empty == static_cast<Symbol>(2));
+	CHECK(symbols.intern(string("label")) == a);
+	CHECK(symbols.intern("") == empty);
+	CHECK(symbols.size() == 3_uz);
+
+	CHECK(symbols.get(a) == "label");
+	CHECK(symbols.get(b) == "other");
+	CHECK(symbols.get(empty).empty());
+
+	CHECK(symbols.find("other") == b);
+	CHECK_FALSE(symbols.find("missing"));
+	CHECK(symbols.size() == 3_uz);
+}
+
+TEST_CASE("Symbol table views stay valid as it grows", "[SymbolTable]") {
+	auto symbols = SymbolTable{};
+	auto first = symbols.intern("first");
+	auto firstView = symbols.get(first);
+	auto big = symbols.intern(string(100 * 1024, 'x'));
+
+	for (auto i = 0; i < 20000; ++i) {
+		REQUIRE(symbols.intern("name_" + to_string(i)) == static_cast<Symbol>(i + 2));
+	}
+
+	auto moved = std::move(symbols);
+	CHECK(moved.size() == 20002_uz);
+	CHECK(moved.get(first).data() == firstView.data());
+	CHECK(moved.get(first) == "first");
+	CHECK(moved.get(big).size() == 100_uz * 1024);
+
+	for (auto i = 0; i < 20000; ++i) {
+		auto name = "name_" + to_string(i);
+		REQUIRE(moved.find(name) == static_cast<Symbol>(i + 2));
+		REQUIRE(moved.get(static_cast<Symbol>(i + 2)) == name);
+	}
+}
+
+TEST_CASE("Parser interns label names and strings", "[SymbolTable]") {
+	auto options = Parser::Options{};
+	options.errorReporting = false;
+
+	auto code = string{".data\nSTR: DS \"STR\"\n.code\nlabel:\n"};
+	for (auto i = 0; i < 100; ++i)
+		code += "jmpd label, jmpd later\n";
+	code += "later:\n";
+
+	auto res = Parser::tokenize(options, make_shared<Source>("test", code));
+	REQUIRE(res.ok());
+
+	// the string literal matches the label name, so they share a symbol
+	CHECK(res.info.symbols.size() == 3_uz);
+	REQUIRE(res.info.labels.size() == 3_uz);
+
+	for (auto& label : res.info.labels) {
+		CHECK(res.info.symbols.get(label->symbol) == label->name);
+		CHECK(res.info.labelMap.at(label->symbol) < res.info.labels.size());
+	}
+
+	auto& data = *res.info.segments[Segment::Data].tokens;
+	REQUIRE(data.size() >= 3_uz);
+	REQUIRE(is<Symbol>(data[2].annotation));
+	CHECK(get<Symbol>(data[2].annotation) == res.info.labels[0]->symbol);
+}
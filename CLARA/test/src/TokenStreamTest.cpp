@@ -0,0 +1,159 @@
+#include <catch.hpp>
+#include <CLARA/Compiler.h>
+#include <CLARA/Label.h>
+#include <CLARA/Parser.h>
+#include <CLARA/TokenStream.h>
+#include "CompilerHelper.h"
+
+using namespace CLARA;
+using namespace CLARA::CLASM;
+
+namespace {
+
+auto parseWith(TokenStorage storage, string code)
+{
+	auto options = Parser::Options{};
+	options.errorReporting = false;
+	options.tokenStorage = storage;
+	return Parser::tokenize(options, make_shared<Source>("test", code));
+}
+
+// variant comparison needs every alternative to be comparable, label annotations are compared by name
+auto sameAnnotation(const TokenAnnotation& a, const TokenAnnotation& b)
+{
+	if (a.index() != b.index())
+		return false;
+
+	return std::visit([&](auto&& arg) {
+		using T = std::decay_t<decltype(arg)>;
+
+		if constexpr (std::is_same_v<T, LabelRef>)
+			return arg.label->name == get<LabelRef>(b).label->name;
+		else if constexpr (std::is_same_v<T, const Label*>)
+			return arg->name == get<const Label*>(b)->name;
+		else
+			return arg == get<T>(b);
+	}, a);
+}
+
+const auto sampleCode = string{
+	".data\n"
+	"STR: DS \"hello\\x21\"\n"
+	"NUM: DD 123456\n"
+	".code\n"
+	"start:\n"
+	"\tpush 1, push -2, pushw 0x1234\n"
+	"\tpushd 70000, pushq 0xFFFFFFFFFF\n"
+	"\tpushf 1.5, jmpd end\n"
+	"end:\n"
+	"\tjmpd start\n"
+};
+
+}
+
+TEST_CASE("Compact token stream round-trips every annotation kind", "[TokenStream]") {
+	auto label = Label{Symbol{}, "label", TokenHandle{}, Segment::Code};
+	auto annotations = vector<TokenAnnotation>{
+		monostate{},
+		uint8{0xFF}, int8{-128}, uint16{0xFFFF}, int16{-32768},
+		uint32{0xFFFFFFFF}, int32{-2147483647 - 1}, uint64{0xFFFFFFFFFFFFFFFF}, int64{-1},
+		1.5f, -2.25,
+		static_cast<Symbol>(0x7FFFFFF),
+		static_cast<const Label*>(&label),
+		LabelRef(&label),
+		Keyword::Global,
+		Segment::Data,
+		Mnemonic::PUSH,
+		Instruction::PUSHQ,
+		DataType::DQ,
+	};
+	REQUIRE(annotations.size() == std::variant_size_v<TokenAnnotation>);
+
+	auto tokens = TokenStream{nullptr, TokenStorage::Compact};
+	for (auto& annotation : annotations) {
+		tokens.push(getAnnotationTokenType(annotation), annotation);
+	}
+
+	REQUIRE(tokens.isCompact());
+	REQUIRE(tokens.size() == annotations.size());
+
+	for (auto i = 0_uz; i < annotations.size(); ++i) {
+		auto token = tokens.get(i);
+		CHECK(token.type == getAnnotationTokenType(annotations[i]));
+		CHECK(sameAnnotation(token.annotation, annotations[i]));
+	}
+
+	SECTION("annotations can be replaced") {
+		tokens.setAnnotation(1, static_cast<Symbol>(7));
+		CHECK(get<Symbol>(tokens.get(1).annotation) == static_cast<Symbol>(7));
+		CHECK(tokens.getType(1) == getAnnotationTokenType(annotations[1]));
+	}
+
+	// writes through an iterator would only reach its copy of the token, so they don't compile
+	static_assert(std::is_same_v<decltype(*tokens.begin()), const Token&>);
+	static_assert(std::is_same_v<decltype(tokens.begin().operator->()), const Token*>);
+}
+
+TEST_CASE("Compact token stream parses like the default storage", "[TokenStream]") {
+	auto expected = parseWith(TokenStorage::Tokens, sampleCode);
+	auto compact = parseWith(TokenStorage::Compact, sampleCode);
+	REQUIRE(expected.ok());
+	REQUIRE(compact.ok());
+	REQUIRE(compact.info.labels.size() == expected.info.labels.size());
+
+	for (auto i = 0; i < Segment::MAX; ++i) {
+		auto& expectTokens = *expected.info.segments[i].tokens;
+		auto& tokens = *compact.info.segments[i].tokens;
+		REQUIRE(tokens.isCompact());
+		REQUIRE(tokens.size() == expectTokens.size());
+
+		auto expectIt = expectTokens.begin();
+		for (auto it = tokens.begin(); it != tokens.end(); ++it, ++expectIt) {
+			INFO(expectIt->text);
+			CHECK(it->type == expectIt->type);
+			CHECK(it->offset == expectIt->offset);
+			CHECK(it->text == expectIt->text);
+			CHECK(sameAnnotation(it->annotation, expectIt->annotation));
+		}
+	}
+
+	for (auto& label : compact.info.labels) {
+		auto definition = compact.info.getToken(label->definition);
+		CHECK(definition.type == TokenType::Label);
+		CHECK(get<const Label*>(definition.annotation) == label);
+	}
+}
+
+TEST_CASE("Compact token stream compiles like the default storage", "[TokenStream]") {
+	auto expected = parseWith(TokenStorage::Tokens, sampleCode);
+	auto compact = parseWith(TokenStorage::Compact, sampleCode);
+	REQUIRE(expected.ok());
+	REQUIRE(compact.ok());
+
+	auto expectOut = MockOutputHandler{};
+	auto out = MockOutputHandler{};
+	Compiler::compile(Compiler::Options{}, expected.info, expectOut);
+	Compiler::compile(Compiler::Options{}, compact.info, out);
+	CHECK(out.check(expectOut.output));
+}
+
+TEST_CASE("Compact token stream reports unresolved labels", "[TokenStream]") {
+	auto res = parseWith(TokenStorage::Compact, ".code\njmpd nowhere\n");
+	REQUIRE_FALSE(res.ok());
+	REQUIRE(res.reports.size() == 1_uz);
+	CHECK(res.reports[0].diagnosis.getCode() == DiagCode::UnresolvedLabelReference);
+	CHECK(res.reports[0].token.text == "nowhere");
+}
+
+TEST_CASE("Compact token stream uses less memory", "[TokenStream]") {
+	auto code = string{".code\n"};
+	for (auto i = 0; i < 1000; ++i)
+		code += "\tpush 1, pushd 70000, add\n";
+
+	auto expected = parseWith(TokenStorage::Tokens, code);
+	auto compact = parseWith(TokenStorage::Compact, code);
+	auto& expectTokens = *expected.info.segments[Segment::Code].tokens;
+	auto& tokens = *compact.info.segments[Segment::Code].tokens;
+	REQUIRE(tokens.size() == expectTokens.size());
+	CHECK(tokens.getMemoryUsage() * 3 < expectTokens.getMemoryUsage());
+}